@@ -2,7 +2,9 @@
 MCC DAQ HATs module.
 """
 from daqhats.hats import HatError, hat_list, HatIDs, TriggerModes, \
-    OptionFlags, wait_for_interrupt, interrupt_state, \
-    interrupt_callback_enable, interrupt_callback_disable, HatCallback
+    ScanProfiles, OptionFlags, wait_for_interrupt, wait_for_interrupt_async, \
+    interrupt_state, interrupt_timestamp, interrupt_callback_enable, \
+    interrupt_callback_disable, interrupt_callback_stats, HatCallback, \
+    MinMaxDecimator
 from daqhats.mcc118 import mcc118
 from daqhats.mcc152 import mcc152, DIOConfigItem
@@ -0,0 +1,210 @@
+/*
+*   file _daqhats.c
+*   author Measurement Computing Corp.
+*   brief This file contains a native Python module for the most frequently
+*       called DAQ HAT methods.  The methods in mcc118.py and mcc152.py use it
+*       when it is installed, so a call does not go through ctypes argument
+*       conversion, and fall back to ctypes when it is not.  It links to the
+*       same libdaqhats.so.1 that ctypes loads, so both share the open boards.
+*
+*   date 10/18/2026
+*/
+#include <Python.h>
+#include <stdint.h>
+#include "daqhats.h"
+
+#define MCC118_NUM_CHANNELS     8
+#define MCC152_AOUT_CHANNELS    2
+#define MCC152_DIO_CHANNELS     8
+#define MCC152_MAX_CODE         4095.0
+#define MCC152_MAX_VOLTAGE      (5.0 * MCC152_MAX_CODE / (MCC152_MAX_CODE + 1))
+
+#if PY_MAJOR_VERSION < 3
+// return int rather than long, the same as ctypes
+#define PyLong_FromLong         PyInt_FromLong
+#endif
+
+// This module; hats.py sets its HatError attribute
+static PyObject* native_module = NULL;
+
+/******************************************************************************
+  Raise HatError(address, "Incorrect response.") like the ctypes methods, or
+  RuntimeError if hats.py has not provided the HatError class.
+ *****************************************************************************/
+static PyObject* _raise_hat_error(int address)
+{
+    PyObject* error_type;
+    PyObject* error;
+
+    error_type = PyObject_GetAttrString(native_module, "HatError");
+    if (error_type == NULL)
+    {
+        PyErr_Clear();
+        PyErr_SetString(PyExc_RuntimeError, "Incorrect response.");
+        return NULL;
+    }
+
+    error = PyObject_CallFunction(error_type, "is", address,
+        "Incorrect response.");
+    if (error != NULL)
+    {
+        PyErr_SetObject(error_type, error);
+        Py_DECREF(error);
+    }
+    Py_DECREF(error_type);
+    return NULL;
+}
+
+/******************************************************************************
+  mcc118_a_in_read(address, channel, options) -> float
+ *****************************************************************************/
+static PyObject* _mcc118_a_in_read(PyObject* self, PyObject* args)
+{
+    int address;
+    int channel;
+    unsigned int options;
+    double value;
+    int result;
+
+    (void)self;
+    if (!PyArg_ParseTuple(args, "iiI", &address, &channel, &options))
+    {
+        return NULL;
+    }
+    if ((channel < 0) || (channel >= MCC118_NUM_CHANNELS))
+    {
+        return PyErr_Format(PyExc_ValueError,
+            "Invalid channel %d. Must be 0-%d.", channel,
+            MCC118_NUM_CHANNELS - 1);
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    result = mcc118_a_in_read((uint8_t)address, (uint8_t)channel, options,
+        &value);
+    Py_END_ALLOW_THREADS
+
+    if (result != RESULT_SUCCESS)
+    {
+        return _raise_hat_error(address);
+    }
+    return PyFloat_FromDouble(value);
+}
+
+/******************************************************************************
+  mcc152_a_out_write(address, channel, value, options) -> None
+
+  The value is limited to the range of the DAC, the same as mcc152.a_out_write.
+ *****************************************************************************/
+static PyObject* _mcc152_a_out_write(PyObject* self, PyObject* args)
+{
+    int address;
+    int channel;
+    double value;
+    unsigned int options;
+    double max_value;
+    int result;
+
+    (void)self;
+    if (!PyArg_ParseTuple(args, "iidI", &address, &channel, &value, &options))
+    {
+        return NULL;
+    }
+    if ((channel < 0) || (channel >= MCC152_AOUT_CHANNELS))
+    {
+        return PyErr_Format(PyExc_ValueError,
+            "Invalid channel %d. Must be 0-%d.", channel,
+            MCC152_AOUT_CHANNELS - 1);
+    }
+
+    max_value = (options & OPTS_NOSCALEDATA) ? MCC152_MAX_CODE :
+        MCC152_MAX_VOLTAGE;
+    if (value < 0.0)
+    {
+        value = 0.0;
+    }
+    else if (value > max_value)
+    {
+        value = max_value;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    result = mcc152_a_out_write((uint8_t)address, (uint8_t)channel, options,
+        value);
+    Py_END_ALLOW_THREADS
+
+    if (result != RESULT_SUCCESS)
+    {
+        return _raise_hat_error(address);
+    }
+    Py_RETURN_NONE;
+}
+
+/******************************************************************************
+  mcc152_dio_input_read_bit(address, channel) -> int
+ *****************************************************************************/
+static PyObject* _mcc152_dio_input_read_bit(PyObject* self, PyObject* args)
+{
+    int address;
+    int channel;
+    uint8_t value;
+    int result;
+
+    (void)self;
+    if (!PyArg_ParseTuple(args, "ii", &address, &channel))
+    {
+        return NULL;
+    }
+    if ((channel < 0) || (channel >= MCC152_DIO_CHANNELS))
+    {
+        return PyErr_Format(PyExc_ValueError, "Invalid channel %d.", channel);
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    result = mcc152_dio_input_read_bit((uint8_t)address, (uint8_t)channel,
+        &value);
+    Py_END_ALLOW_THREADS
+
+    if (result != RESULT_SUCCESS)
+    {
+        return _raise_hat_error(address);
+    }
+    return PyLong_FromLong(value);
+}
+
+static PyMethodDef native_methods[] =
+{
+    {"mcc118_a_in_read", _mcc118_a_in_read, METH_VARARGS,
+        "Read an MCC 118 analog input channel."},
+    {"mcc152_a_out_write", _mcc152_a_out_write, METH_VARARGS,
+        "Write an MCC 152 analog output channel."},
+    {"mcc152_dio_input_read_bit", _mcc152_dio_input_read_bit, METH_VARARGS,
+        "Read an MCC 152 digital input channel."},
+    {NULL, NULL, 0, NULL}
+};
+
+#if PY_MAJOR_VERSION >= 3
+static struct PyModuleDef native_module_def =
+{
+    PyModuleDef_HEAD_INIT,
+    "_daqhats",
+    "Native calls for frequently used DAQ HAT methods.",
+    -1,
+    native_methods,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+};
+
+PyMODINIT_FUNC PyInit__daqhats(void)
+{
+    native_module = PyModule_Create(&native_module_def);
+    return native_module;
+}
+#else
+PyMODINIT_FUNC init_daqhats(void)
+{
+    native_module = Py_InitModule3("_daqhats", native_methods,
+        "Native calls for frequently used DAQ HAT methods.");
+}
+#endif
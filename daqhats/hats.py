@@ -1,9 +1,12 @@
 """
 Wraps the global methods from the MCC Hat library for use in Python.
 """
+import os
+from array import array
 from collections import namedtuple
 from ctypes import cdll, Structure, c_ubyte, c_ushort, c_char, c_int, POINTER, \
-    CFUNCTYPE, cast, py_object, c_void_p, pointer
+    CFUNCTYPE, cast, py_object, c_void_p, pointer, c_ulonglong, c_double, \
+    byref, c_uint
 from enum import IntEnum
 
 class HatIDs(IntEnum):
@@ -19,6 +22,12 @@ class TriggerModes(IntEnum):
     ACTIVE_HIGH = 2     #: Start the scan any time TRIG is high.
     ACTIVE_LOW = 3      #: Start the scan any time TRIG is low.
 
+class ScanProfiles(IntEnum):
+    """Scan transfer profiles that trade latency for throughput."""
+    DEFAULT = 0         #: Balanced, read data at least every 100 ms.
+    LOW_LATENCY = 1     #: Small, frequent reads for the lowest delay.
+    THROUGHPUT = 2      #: Large, infrequent reads for the lowest overhead.
+
 class OptionFlags(IntEnum):
     """Scan / read option flags. See individual methods for detailed
     descriptions."""
@@ -28,6 +37,8 @@ class OptionFlags(IntEnum):
     EXTCLOCK = 0x0004        #: Use an external clock source.
     EXTTRIGGER = 0x0008      #: Use an external trigger source.
     CONTINUOUS = 0x0010      #: Run until explicitly stopped.
+    AUTORECOVER = 0x0020     #: Restart a continuous scan after an overrun.
+    RETRIGGER = 0x0040       #: Re-arm a finite triggered scan after each capture.
 
 # exception class
 class HatError(Exception):
@@ -45,6 +56,15 @@ class HatError(Exception):
     def __str__(self):
         return "Addr {}: ".format(self.address) + self.value
 
+# The optional native module implements the most frequently called methods
+# without ctypes.  It is built when the package is installed if the compiler
+# and Python headers are available; otherwise the ctypes calls are used.
+try:
+    from daqhats import _daqhats as _NATIVE
+    _NATIVE.HatError = HatError
+except ImportError:
+    _NATIVE = None
+
 # HAT info structure class
 class _Info(Structure): # pylint: disable=too-few-public-methods
     _fields_ = [("address", c_ubyte),
@@ -100,15 +120,79 @@ class HatCallback(object):
         p_user_data = cast(user_data, POINTER(py_object)).contents.value
         self.function(p_user_data)
 
+class _CallbackStats(Structure): # pylint: disable=too-few-public-methods
+    _fields_ = [("count", c_ulonglong),
+                ("mean_latency", c_double),
+                ("max_latency", c_double)]
+
+# Min/max decimation state structure class
+_DECIMATE_MAX_CHANNELS = 8
+
+class _MinMaxDecimator(Structure): # pylint: disable=too-few-public-methods
+    _fields_ = [("bucket_size", c_uint),
+                ("count", c_uint),
+                ("channel_count", c_ubyte),
+                ("min", c_double * _DECIMATE_MAX_CHANNELS),
+                ("max", c_double * _DECIMATE_MAX_CHANNELS),
+                ("min_index", c_uint * _DECIMATE_MAX_CHANNELS),
+                ("max_index", c_uint * _DECIMATE_MAX_CHANNELS)]
+
+_HatInfo = namedtuple('HatInfo', ['address', 'id', 'version', 'product_name'])
+_HatCallbackStats = namedtuple('HatCallbackStats',
+                               ['count', 'mean_latency', 'max_latency'])
+
+# The library is loaded and its argtypes are set once, then shared by the
+# module functions and all Hat instances.
+_LIB = None
+
 def _load_daqhats_library():
     """
     Load the library
     """
+    global _LIB # pylint: disable=global-statement
+    if _LIB is not None:
+        return _LIB
+
     libname = 'libdaqhats.so.1'
     try:
         lib = cdll.LoadLibrary(libname)
     except: # pylint: disable=bare-except
-        lib = 0
+        return 0
+
+    lib.hat_list.argtypes = [c_ushort, POINTER(_Info)]
+    lib.hat_list.restype = c_int
+
+    lib.hat_interrupt_state.argtypes = []
+    lib.hat_interrupt_state.restype = c_int
+
+    lib.hat_wait_for_interrupt.argtypes = [c_int]
+    lib.hat_wait_for_interrupt.restype = c_int
+
+    lib.hat_interrupt_timestamp.argtypes = [POINTER(c_ulonglong)]
+    lib.hat_interrupt_timestamp.restype = c_int
+
+    lib.hat_interrupt_callback_disable.argtypes = []
+    lib.hat_interrupt_callback_disable.restype = c_int
+
+    lib.hat_interrupt_callback_stats.argtypes = [POINTER(_CallbackStats)]
+    lib.hat_interrupt_callback_stats.restype = c_int
+
+    lib.hat_interrupt_fd_open.argtypes = [POINTER(c_int)]
+    lib.hat_interrupt_fd_open.restype = c_int
+
+    lib.hat_interrupt_fd_close.argtypes = []
+    lib.hat_interrupt_fd_close.restype = c_int
+
+    lib.hat_decimate_init.argtypes = [POINTER(_MinMaxDecimator), c_ubyte,
+                                      c_uint]
+    lib.hat_decimate_init.restype = c_int
+
+    lib.hat_decimate_minmax.argtypes = [POINTER(_MinMaxDecimator), c_void_p,
+                                        c_uint, c_void_p, c_uint,
+                                        POINTER(c_uint)]
+    lib.hat_decimate_minmax.restype = c_int
+
+    _LIB = lib
     return lib
 
 def hat_list(filter_by_id=0):
@@ -140,9 +224,6 @@ def hat_list(filter_by_id=0):
     if _libc == 0:
         return []
 
-    _libc.hat_list.argtypes = [c_ushort, POINTER(_Info)]
-    _libc.hat_list.restype = c_int
-
     # find out how many structs we need
     count = _libc.hat_list(filter_by_id, None)
     if count == 0:
@@ -156,10 +237,8 @@ def hat_list(filter_by_id=0):
 
     # create the list of dictionaries to return
     my_list = []
-    hat_info = namedtuple('HatInfo',
-                          ['address', 'id', 'version', 'product_name'])
     for item in my_info:
-        info = hat_info(
+        info = _HatInfo(
             address=item.address,
             id=item.id,
             version=item.version,
@@ -184,9 +263,6 @@ def interrupt_state():
     if _libc == 0:
         return []
 
-    _libc.hat_interrupt_state.argtypes = []
-    _libc.hat_interrupt_state.restype = c_int
-
     # get the info
     state = _libc.hat_interrupt_state()
 
@@ -208,9 +284,6 @@ def wait_for_interrupt(timeout):
     if _libc == 0:
         return []
 
-    _libc.hat_wait_for_interrupt.argtypes = [c_int]
-    _libc.hat_wait_for_interrupt.restype = c_int
-
     if timeout == -1:
         timeout_ms = -1
     elif timeout == 0:
@@ -221,6 +294,143 @@ def wait_for_interrupt(timeout):
     state = _libc.hat_wait_for_interrupt(timeout_ms)
     return state == 1
 
+def _event_loop():
+    """
+    Return the running asyncio event loop.
+    """
+    import asyncio
+    try:
+        return asyncio.get_running_loop()
+    except AttributeError:
+        return asyncio.get_event_loop()
+
+def _eventfd_clear(fd):
+    """
+    Clear a library event file descriptor without blocking.
+    """
+    try:
+        os.read(fd, 8)
+    except (BlockingIOError, InterruptedError):
+        pass
+
+# futures waiting in wait_for_interrupt_async() and their timeout handles; the
+# waiters share one interrupt file descriptor registered with the event loop
+_INTERRUPT_WAITERS = []
+_INTERRUPT_FD = None
+
+def _interrupt_fd_release():
+    """
+    Release the interrupt file descriptor when there are no more waiters.
+    """
+    global _INTERRUPT_FD # pylint: disable=global-statement
+    if not _INTERRUPT_WAITERS and _INTERRUPT_FD is not None:
+        _event_loop().remove_reader(_INTERRUPT_FD)
+        _INTERRUPT_FD = None
+        _load_daqhats_library().hat_interrupt_fd_close()
+
+def _interrupt_waiter_done(future):
+    """
+    Remove a waiter once it has completed, timed out or been cancelled.
+    """
+    for item in _INTERRUPT_WAITERS:
+        if item[0] is future:
+            _INTERRUPT_WAITERS.remove(item)
+            if item[1] is not None:
+                item[1].cancel()
+            break
+    _interrupt_fd_release()
+
+def _interrupt_ready():
+    """
+    Event loop reader for the interrupt file descriptor.
+    """
+    _eventfd_clear(_INTERRUPT_FD)
+    for future, _ in _INTERRUPT_WAITERS:
+        if not future.done():
+            future.set_result(True)
+
+def _interrupt_timeout(future):
+    """
+    Event loop timer for a waiter's timeout.
+    """
+    if not future.done():
+        future.set_result(False)
+
+def wait_for_interrupt_async(timeout):
+    """
+    Wait for an interrupt from a DAQ HAT to occur in an asyncio event loop.
+
+    This is the asyncio equivalent of :py:func:`wait_for_interrupt`; it must
+    be called from a coroutine and the result awaited, for example: ::
+
+        if await wait_for_interrupt_async(1.0):
+            print("Interrupt")
+
+    The interrupt is watched with a file descriptor registered with the event
+    loop, so no thread is blocked while waiting and several waits may be
+    pending at once. Requires Python 3.
+
+    Args:
+        timeout (float): The timeout in seconds. Pass -1 to wait forever or 0
+            to return immediately.
+
+    Returns:
+        asyncio.Future: A future whose result is True if the interrupt is
+        active, or False if the timeout elapsed first.
+
+    Raises:
+        HatError: The interrupt file descriptor could not be created.
+    """
+    global _INTERRUPT_FD # pylint: disable=global-statement
+    _libc = _load_daqhats_library()
+    if _libc == 0:
+        raise HatError(0, "Library not loaded.")
+
+    loop = _event_loop()
+    if _INTERRUPT_FD is None:
+        fd = c_int(-1)
+        if _libc.hat_interrupt_fd_open(byref(fd)) != 0:
+            raise HatError(0, "Could not open the interrupt file descriptor.")
+        _INTERRUPT_FD = fd.value
+        loop.add_reader(_INTERRUPT_FD, _interrupt_ready)
+
+    # check the state after the descriptor is open so an interrupt cannot be
+    # missed; one that is already active will not signal the descriptor
+    future = loop.create_future()
+    state = _libc.hat_interrupt_state() == 1
+    if state or timeout == 0:
+        future.set_result(state)
+        _interrupt_fd_release()
+        return future
+
+    handle = None
+    if timeout > 0:
+        handle = loop.call_later(timeout, _interrupt_timeout, future)
+    _INTERRUPT_WAITERS.append((future, handle))
+    future.add_done_callback(_interrupt_waiter_done)
+    return future
+
+def interrupt_timestamp():
+    """
+    Read the time of the most recent DAQ HAT interrupt.
+
+    Returns the :py:func:`time.monotonic` time of the last interrupt edge seen
+    by the callback handler or :py:func:`wait_for_interrupt`. When the GPIO
+    character device is available the time is captured by the kernel when the
+    edge occurs, so it is not affected by thread scheduling delays.
+
+    Returns:
+        float: The time in seconds, or None if no interrupt has been seen.
+    """
+    _libc = _load_daqhats_library()
+    if _libc == 0:
+        return None
+
+    timestamp = c_ulonglong(0)
+    if _libc.hat_interrupt_timestamp(byref(timestamp)) != 0:
+        return None
+    return timestamp.value / 1e9
+
 def interrupt_callback_enable(callback, user_data):
     """
     Enable an interrupt callback function.
@@ -304,12 +514,134 @@ def interrupt_callback_disable():
     if _libc == 0:
         return []
 
-    _libc.hat_interrupt_callback_disable.argtypes = []
-    _libc.hat_interrupt_callback_disable.restype = c_int
-
     if _libc.hat_interrupt_callback_disable() != 0:
         raise Exception("Could not disabled callback function.")
 
+def interrupt_callback_stats():
+    """
+    Read the interrupt callback statistics.
+
+    The callback runs on the library interrupt dispatcher thread. The latency
+    is measured from the time of the interrupt edge, so it includes both the
+    dispatch delay and the time spent in the callback. The statistics are reset
+    when the callback is enabled.
+
+    Returns:
+        namedtuple: a namedtuple containing the following field names:
+
+        * **count** (int): The number of times the callback was called.
+        * **mean_latency** (float): The mean time in seconds from the
+          interrupt to the callback returning.
+        * **max_latency** (float): The longest time in seconds from the
+          interrupt to the callback returning.
+
+        None is returned if no callback is enabled.
+    """
+    _libc = _load_daqhats_library()
+    if _libc == 0:
+        return None
+
+    stats = _CallbackStats()
+    if _libc.hat_interrupt_callback_stats(byref(stats)) != 0:
+        return None
+
+    return _HatCallbackStats(count=stats.count,
+                             mean_latency=stats.mean_latency,
+                             max_latency=stats.max_latency)
+
+class MinMaxDecimator(object):
+    """
+    Reduce scan data to a min/max envelope for display.
+
+    Each bucket of *bucket_size* samples per channel is reduced to two samples
+    per channel: the minimum and the maximum of the bucket, in the order they
+    occurred. Plotting the result draws the same envelope as plotting every
+    sample, so narrow peaks are not lost, while the number of points scales with
+    the width of the plot rather than the scan rate.
+
+    Pass each block of data to :py:func:`process` as it is read; a partial
+    bucket at the end of a block is kept and completed by the next block.
+
+    Args:
+        channel_count (int): The number of channels in each sample (1-8).
+        bucket_size (int): The number of samples per channel reduced to one
+            minimum and one maximum, usually the number of samples per channel
+            being displayed divided by the width of the plot in pixels.
+
+    Raises:
+        ValueError: a parameter is invalid.
+    """
+    def __init__(self, channel_count, bucket_size):
+        self._lib = _load_daqhats_library()
+        if self._lib == 0:
+            raise Exception("daqhats shared library is not installed.")
+
+        self._state = _MinMaxDecimator()
+        if self._lib.hat_decimate_init(byref(self._state), channel_count,
+                                       bucket_size) != 0:
+            raise ValueError("Invalid parameter.")
+
+    def reset(self):
+        """
+        Discard the partial bucket, for example when a new scan is started.
+        """
+        self._state.count = 0
+
+    def process(self, data):
+        """
+        Decimate a block of scan data.
+
+        Args:
+            data: The scan data, interleaved by channel, as a list of floats or
+                a C-contiguous buffer of float64 values such as the
+                :py:class:`array.array` blocks from
+                :py:func:`mcc118.a_in_scan_stream` or a NumPy array. The length
+                must be a multiple of the channel count.
+
+        Returns:
+            :py:class:`array.array`: The decimated data, float64 values
+            interleaved by channel, with two samples per channel for each bucket
+            completed by *data*.
+
+        Raises:
+            ValueError: *data* has an unsupported item type or a length that is
+                not a multiple of the channel count.
+        """
+        if isinstance(data, (list, tuple)):
+            data = array('d', data)
+        view = memoryview(data)
+        if view.format.lstrip('@=<') != 'd' or not view.c_contiguous:
+            raise ValueError("Data must be a C-contiguous float64 buffer.")
+
+        channel_count = self._state.channel_count
+        total = view.nbytes // view.itemsize
+        if total % channel_count != 0:
+            raise ValueError("Data length is not a multiple of the channel "
+                             "count.")
+        samples_per_channel = total // channel_count
+
+        if total == 0:
+            return array('d')
+        out = array('d', [0.0]) * (
+            2 * channel_count *
+            (samples_per_channel // self._state.bucket_size + 1))
+
+        if view.readonly:
+            c_data = (c_char * view.nbytes).from_buffer_copy(view)
+        else:
+            c_data = (c_char * view.nbytes).from_buffer(view)
+        c_out = (c_char * (len(out) * out.itemsize)).from_buffer(out)
+        written = c_uint(0)
+        result = self._lib.hat_decimate_minmax(
+            byref(self._state), c_data, samples_per_channel, c_out, len(out),
+            byref(written))
+        del c_data, c_out
+        if result != 0:
+            raise ValueError("Invalid parameter.")
+
+        del out[written.value * channel_count:]
+        return out
+
 class Hat(object): # pylint: disable=too-few-public-methods
     """
     DAQ HAT base class.
@@ -2,10 +2,108 @@
 Wraps all of the methods from the MCC 118 library for use in Python.
 """
 import sys
+from array import array
 from collections import namedtuple
 from ctypes import c_ubyte, c_int, c_ushort, c_ulong, c_long, c_double, \
-    POINTER, c_char_p, byref, create_string_buffer
-from daqhats.hats import Hat, HatError, OptionFlags
+    c_uint, c_ulonglong, POINTER, c_char_p, byref, create_string_buffer, \
+    Structure, c_char, c_void_p, cast
+from daqhats.hats import Hat, HatError, OptionFlags, _NATIVE, _event_loop, \
+    _eventfd_clear
+
+# Scan gap structure class
+class _ScanGap(Structure): # pylint: disable=too-few-public-methods
+    _fields_ = [("sample_index", c_ulonglong),
+                ("samples_lost", c_ulonglong)]
+
+# Scan config structure class
+class _ScanConfig(Structure): # pylint: disable=too-few-public-methods
+    _fields_ = [("target_latency", c_double),
+                ("max_block_size", c_ushort),
+                ("min_poll_interval_us", c_uint)]
+
+# Sampler statistics structure class
+class _SamplerStats(Structure): # pylint: disable=too-few-public-methods
+    _fields_ = [("sample_count", c_ulonglong),
+                ("missed_deadlines", c_ulonglong),
+                ("buffer_overruns", c_ulonglong),
+                ("samples_available", c_uint),
+                ("last_error", c_int),
+                ("actual_rate", c_double),
+                ("jitter_mean", c_double),
+                ("jitter_p50", c_double),
+                ("jitter_p99", c_double),
+                ("jitter_max", c_double)]
+
+class _ScanStream(object): # pylint: disable=too-few-public-methods
+    """
+    Asynchronous iterator returned by mcc118.a_in_scan_stream().
+    """
+    def __init__(self, hat, samples_per_channel, num_channels, fd):
+        self._hat = hat
+        self._samples_per_channel = samples_per_channel
+        self._num_channels = num_channels
+        self._fd = fd
+        self._future = None
+
+    def __aiter__(self):
+        return self
+
+    def __anext__(self):
+        self._future = _event_loop().create_future()
+        self._future.add_done_callback(self._done)
+        self._poll()
+        return self._future
+
+    def close(self):
+        """
+        Stop watching the scan ready file descriptor.  Call this before
+        stopping and cleaning up the scan if iteration did not end normally.
+        """
+        _event_loop().remove_reader(self._fd)
+        if self._future is not None and not self._future.done():
+            self._future.cancel()
+
+    def _done(self, future):
+        """
+        Remove the reader when the awaiting task is cancelled, so the file
+        descriptor is not watched after the scan is cleaned up.
+        """
+        if future.cancelled() and future is self._future:
+            _event_loop().remove_reader(self._fd)
+
+    def _ready(self):
+        """
+        Event loop reader for the scan ready file descriptor.
+        """
+        _event_loop().remove_reader(self._fd)
+        if not self._future.done():
+            self._poll()
+
+    def _poll(self):
+        """
+        Complete the pending future with a block of data if one is available,
+        otherwise wait for the scan ready file descriptor.
+        """
+        future = self._future
+        _eventfd_clear(self._fd)
+        try:
+            status = self._hat.a_in_scan_status()
+            if status.hardware_overrun or status.buffer_overrun:
+                raise HatError(self._hat.address(), "Scan overrun.")
+
+            if (status.samples_available >= self._samples_per_channel or
+                    (not status.running and status.samples_available > 0)):
+                count = min(status.samples_available,
+                            self._samples_per_channel)
+                block = array('d', bytes(8 * count * self._num_channels))
+                self._hat.a_in_scan_readinto(block, 0)
+                future.set_result(block)
+            elif not status.running:
+                future.set_exception(StopAsyncIteration())
+            else:
+                _event_loop().add_reader(self._fd, self._ready)
+        except HatError as error:
+            future.set_exception(error)
 
 class mcc118(Hat): # pylint: disable=invalid-name
     """
@@ -24,6 +122,13 @@ class mcc118(Hat): # pylint: disable=invalid-name
     _STATUS_BUFFER_OVERRUN = 0x0002
     _STATUS_TRIGGERED = 0x0004
     _STATUS_RUNNING = 0x0008
+    _STATUS_GAP = 0x0010
+
+    # buffer protocol item formats for a_in_scan_readinto() and the
+    # corresponding library sample formats
+    _SAMPLE_FORMATS = {'d': 0, 'f': 1, 'H': 2}
+
+    _MAX_SCAN_GAPS = 16
 
     _MAX_SAMPLE_RATE = 100000.0
 
@@ -42,6 +147,37 @@ class mcc118(Hat): # pylint: disable=invalid-name
         AI_MIN_RANGE=-10.0,
         AI_MAX_RANGE=+10.0)
 
+    # namedtuple classes for return values, created once rather than on every
+    # call
+    _version_info_type = namedtuple(
+        'MCC118VersionInfo', ['version', 'bootloader_version'])
+    _cal_info_type = namedtuple('MCC118CalInfo', ['slope', 'offset'])
+    _scan_config_type = namedtuple(
+        'MCC118ScanConfig',
+        ['target_latency', 'max_block_size', 'min_poll_interval_us'])
+    _scan_status_type = namedtuple(
+        'MCC118ScanStatus',
+        ['running', 'hardware_overrun', 'buffer_overrun', 'triggered',
+         'gap', 'samples_available'])
+    _scan_read_type = namedtuple(
+        'MCC118ScanRead',
+        ['running', 'hardware_overrun', 'buffer_overrun', 'triggered',
+         'gap', 'timeout', 'data'])
+    _scan_segment_type = namedtuple(
+        'MCC118ScanSegment',
+        ['segment', 'running', 'hardware_overrun', 'buffer_overrun',
+         'triggered', 'gap', 'timeout', 'data'])
+    _scan_gap_type = namedtuple(
+        'MCC118ScanGap', ['sample_index', 'samples_lost'])
+    _sample_time_type = namedtuple(
+        'MCC118SampleTime', ['monotonic', 'realtime'])
+    _clock_drift_type = namedtuple(
+        'MCC118ClockDrift', ['measured_rate', 'drift_ppm'])
+    _sampler_read_type = namedtuple(
+        'MCC118SamplerRead', ['timestamps', 'data'])
+    _sampler_stats_type = namedtuple(
+        'MCC118SamplerStats', [name for name, _ in _SamplerStats._fields_])
+
     def __init__(self, address=0):
         """
         Initialize the class.
@@ -49,6 +185,15 @@ class mcc118(Hat): # pylint: disable=invalid-name
         # call base class initializer
         Hat.__init__(self, address)
 
+        # samples per channel in each segment of a retriggered scan
+        self._segment_samples = 0
+        # number of channels read by the software-timed sampler
+        self._sampler_channels = 0
+        # separate function object for a_in_scan_read_numpy() so its numpy
+        # argtypes do not replace the ones used by a_in_scan_read(); created
+        # on first use
+        self._scan_read_numpy = None
+
         # set up library argtypes and restypes
         self._lib.mcc118_open.argtypes = [c_ubyte]
         self._lib.mcc118_open.restype = c_int
@@ -87,10 +232,26 @@ class mcc118(Hat): # pylint: disable=invalid-name
             c_ubyte, c_ubyte, c_ulong, POINTER(c_double)]
         self._lib.mcc118_a_in_read.restype = c_int
 
+        self._lib.mcc118_a_in_read_multi.argtypes = [
+            c_ubyte, c_ubyte, c_ulong, POINTER(c_double)]
+        self._lib.mcc118_a_in_read_multi.restype = c_int
+
         self._lib.mcc118_a_in_scan_actual_rate.argtypes = [
             c_ubyte, c_double, POINTER(c_double)]
         self._lib.mcc118_a_in_scan_actual_rate.restype = c_int
 
+        self._lib.mcc118_a_in_scan_config_preset.argtypes = [
+            c_ubyte, POINTER(_ScanConfig)]
+        self._lib.mcc118_a_in_scan_config_preset.restype = c_int
+
+        self._lib.mcc118_a_in_scan_config_write.argtypes = [
+            c_ubyte, POINTER(_ScanConfig)]
+        self._lib.mcc118_a_in_scan_config_write.restype = c_int
+
+        self._lib.mcc118_a_in_scan_config_read.argtypes = [
+            c_ubyte, POINTER(_ScanConfig)]
+        self._lib.mcc118_a_in_scan_config_read.restype = c_int
+
         self._lib.mcc118_a_in_scan_start.argtypes = [
             c_ubyte, c_ubyte, c_ulong, c_double, c_ulong]
         self._lib.mcc118_a_in_scan_start.restype = c_int
@@ -103,17 +264,72 @@ class mcc118(Hat): # pylint: disable=invalid-name
             c_ubyte, POINTER(c_ulong)]
         self._lib.mcc118_a_in_scan_buffer_size.restype = c_int
 
+        self._lib.mcc118_a_in_scan_read.argtypes = [
+            c_ubyte, POINTER(c_ushort), c_long, c_double, POINTER(c_double),
+            c_ulong, POINTER(c_ulong)]
         self._lib.mcc118_a_in_scan_read.restype = c_int
 
+        self._lib.mcc118_a_in_scan_read_format.argtypes = [
+            c_ubyte, POINTER(c_ushort), c_long, c_double, c_void_p, c_ulong,
+            c_ubyte, POINTER(c_ulong)]
+        self._lib.mcc118_a_in_scan_read_format.restype = c_int
+
+        self._lib.mcc118_a_in_scan_buffer_peek.argtypes = [
+            c_ubyte, POINTER(POINTER(c_double)), POINTER(c_ulong)]
+        self._lib.mcc118_a_in_scan_buffer_peek.restype = c_int
+
+        self._lib.mcc118_a_in_scan_buffer_release.argtypes = [c_ubyte, c_ulong]
+        self._lib.mcc118_a_in_scan_buffer_release.restype = c_int
+
+        self._lib.mcc118_a_in_scan_ready_fd.argtypes = [
+            c_ubyte, c_ulong, POINTER(c_int)]
+        self._lib.mcc118_a_in_scan_ready_fd.restype = c_int
+
         self._lib.mcc118_a_in_scan_stop.argtypes = [c_ubyte]
         self._lib.mcc118_a_in_scan_stop.restype = c_int
 
         self._lib.mcc118_a_in_scan_cleanup.argtypes = [c_ubyte]
         self._lib.mcc118_a_in_scan_cleanup.restype = c_int
 
+        self._lib.mcc118_a_in_scan_rearm.argtypes = [c_ubyte]
+        self._lib.mcc118_a_in_scan_rearm.restype = c_int
+
         self._lib.mcc118_a_in_scan_channel_count.argtypes = [c_ubyte]
         self._lib.mcc118_a_in_scan_channel_count.restype = c_ubyte
 
+        self._lib.mcc118_a_in_scan_sample_time.argtypes = [
+            c_ubyte, c_ulonglong, POINTER(c_double), POINTER(c_double)]
+        self._lib.mcc118_a_in_scan_sample_time.restype = c_int
+
+        self._lib.mcc118_a_in_scan_clock_drift.argtypes = [
+            c_ubyte, POINTER(c_double), POINTER(c_double)]
+        self._lib.mcc118_a_in_scan_clock_drift.restype = c_int
+
+        self._lib.mcc118_a_in_scan_read_segment.argtypes = [
+            c_ubyte, POINTER(c_ushort), c_double, POINTER(c_double), c_ulong,
+            POINTER(c_ulong)]
+        self._lib.mcc118_a_in_scan_read_segment.restype = c_int
+
+        self._lib.mcc118_a_in_scan_read_gaps.argtypes = [
+            c_ubyte, POINTER(_ScanGap), c_ushort, POINTER(c_ushort)]
+        self._lib.mcc118_a_in_scan_read_gaps.restype = c_int
+
+        self._lib.mcc118_a_in_sampler_start.argtypes = [
+            c_ubyte, c_ubyte, c_double, c_ulong, c_ulong]
+        self._lib.mcc118_a_in_sampler_start.restype = c_int
+
+        self._lib.mcc118_a_in_sampler_read.argtypes = [
+            c_ubyte, POINTER(c_double), POINTER(c_double), c_ulong,
+            POINTER(c_ulong)]
+        self._lib.mcc118_a_in_sampler_read.restype = c_int
+
+        self._lib.mcc118_a_in_sampler_stats.argtypes = [
+            c_ubyte, POINTER(_SamplerStats)]
+        self._lib.mcc118_a_in_sampler_stats.restype = c_int
+
+        self._lib.mcc118_a_in_sampler_stop.argtypes = [c_ubyte]
+        self._lib.mcc118_a_in_sampler_stop.restype = c_int
+
         self._lib.mcc118_test_clock.argtypes = [
             c_ubyte, c_ubyte, POINTER(c_ubyte)]
         self._lib.mcc118_test_clock.restype = c_int
@@ -183,9 +399,7 @@ class mcc118(Hat): # pylint: disable=invalid-name
             version.value >> 8, version.value & 0x00FF)
         boot_str = "{0:X}.{1:02X}".format(
             boot_version.value >> 8, boot_version.value & 0x00FF)
-        version_info = namedtuple(
-            'MCC118VersionInfo', ['version', 'bootloader_version'])
-        return version_info(
+        return self._version_info_type(
             version=version_str,
             bootloader_version=boot_str)
 
@@ -278,8 +492,7 @@ class mcc118(Hat): # pylint: disable=invalid-name
                 self._address, channel, byref(slope), byref(offset))
                 != self._RESULT_SUCCESS):
             raise HatError(self._address, "Incorrect response.")
-        cal_info = namedtuple('MCC118CalInfo', ['slope', 'offset'])
-        return cal_info(
+        return self._cal_info_type(
             slope=slope.value,
             offset=offset.value)
 
@@ -372,6 +585,10 @@ class mcc118(Hat): # pylint: disable=invalid-name
         if not self._initialized:
             raise HatError(self._address, "Not initialized.")
 
+        if _NATIVE is not None:
+            # checks the channel and raises the same errors as below
+            return _NATIVE.mcc118_a_in_read(self._address, channel, options)
+
         if channel not in range(self._AIN_NUM_CHANNELS):
             raise ValueError("Invalid channel {0}. Must be 0-{1}.".format(
                 channel, self._AIN_NUM_CHANNELS-1))
@@ -384,6 +601,45 @@ class mcc118(Hat): # pylint: disable=invalid-name
             raise HatError(self._address, "Incorrect response.")
         return data_value.value
 
+    def a_in_read_multi(self, channel_mask, options=OptionFlags.DEFAULT):
+        """
+        Read several analog input channels in one operation.
+
+        Reads each channel in **channel_mask** like :py:func:`a_in_read` but
+        obtains the SPI bus lock and selects the board only once for all of the
+        channels, which has less overhead than reading them one at a time.
+
+        Args:
+            channel_mask (int): A bit mask of the channels to read, the LSB
+                corresponds to channel 0.
+            options (int): ORed combination of :py:class:`OptionFlags`,
+                :py:const:`OptionFlags.DEFAULT` if unspecified. The valid flags
+                are the same as :py:func:`a_in_read`.
+
+        Returns:
+            list of float: the read values in order of increasing channel
+            number
+
+        Raises:
+            HatError: the board is not initialized, does not respond, or
+                responds incorrectly.
+            ValueError: the channel mask is invalid.
+        """
+        if not self._initialized:
+            raise HatError(self._address, "Not initialized.")
+
+        if channel_mask not in range(1, 1 << self._AIN_NUM_CHANNELS):
+            raise ValueError("Invalid channel mask {}.".format(channel_mask))
+
+        values = (c_double * self._AIN_NUM_CHANNELS)()
+        if (self._lib.mcc118_a_in_read_multi(
+                self._address, channel_mask, options, values)
+                != self._RESULT_SUCCESS):
+            raise HatError(self._address, "Incorrect response.")
+
+        count = bin(channel_mask).count('1')
+        return values[:count]
+
     def a_in_scan_actual_rate(self, channel_count, sample_rate_per_channel):
         """
         Read the actual sample rate per channel for a requested sample rate.
@@ -418,6 +674,114 @@ class mcc118(Hat): # pylint: disable=invalid-name
                 "capabilities.")
         return data_value.value
 
+    def a_in_scan_config_profile(self, profile):
+        """
+        Use the scan transfer settings for a profile in subsequent scans.
+
+        The available profiles are:
+
+        * :py:const:`ScanProfiles.DEFAULT`: Read data from the device at least
+          every 100 ms.
+        * :py:const:`ScanProfiles.LOW_LATENCY`: Small, frequent reads so data
+          reaches the scan buffer within a few milliseconds, at the cost of
+          more CPU and SPI bus usage.
+        * :py:const:`ScanProfiles.THROUGHPUT`: Large, infrequent reads for the
+          lowest overhead.
+
+        Args:
+            profile (:py:class:`ScanProfiles`): The profile.
+
+        Raises:
+            HatError: a scan is active or the board is not initialized.
+            ValueError: the profile is invalid.
+        """
+        if not self._initialized:
+            raise HatError(self._address, "Not initialized.")
+
+        config = _ScanConfig()
+        if (self._lib.mcc118_a_in_scan_config_preset(profile, byref(config))
+                != self._RESULT_SUCCESS):
+            raise ValueError("Invalid profile {}.".format(profile))
+        self._scan_config_write(config)
+        return
+
+    def a_in_scan_config_write(self, target_latency, max_block_size,
+                               min_poll_interval_us):
+        """
+        Set the scan transfer settings used by subsequent scans.
+
+        The scan thread reads data from the device once enough samples have
+        been acquired that they would otherwise wait longer than
+        **target_latency**, and never more than half of **max_block_size** at
+        a time. While waiting for data it reads the device status at
+        intervals starting at **min_poll_interval_us** and backing off to half
+        of **target_latency**. Lower latency settings use more CPU and SPI bus
+        time. The settings default to :py:const:`ScanProfiles.DEFAULT` when
+        the class is initialized.
+
+        Args:
+            target_latency (float): The longest time in seconds that acquired
+                data should wait on the device.
+            max_block_size (int): The maximum number of samples transferred in
+                one read, 2-2045.
+            min_poll_interval_us (int): The minimum time in microseconds
+                between status reads.
+
+        Raises:
+            HatError: a scan is active or the board is not initialized.
+            ValueError: a setting is invalid.
+        """
+        if not self._initialized:
+            raise HatError(self._address, "Not initialized.")
+
+        if target_latency <= 0.0 or max_block_size not in range(2, 2046):
+            raise ValueError("Invalid scan config.")
+
+        config = _ScanConfig(target_latency, max_block_size,
+                             min_poll_interval_us)
+        self._scan_config_write(config)
+        return
+
+    def _scan_config_write(self, config):
+        result = self._lib.mcc118_a_in_scan_config_write(
+            self._address, byref(config))
+        if result == self._RESULT_BUSY:
+            raise HatError(self._address,
+                           "Cannot change the scan config while a scan is "
+                           "active.")
+        elif result != self._RESULT_SUCCESS:
+            raise HatError(self._address, "Incorrect response {}.".format(
+                result))
+
+    def a_in_scan_config_read(self):
+        """
+        Read the scan transfer settings.
+
+        Returns:
+            namedtuple: a namedtuple containing the following field names:
+
+            * **target_latency** (float): The target latency in seconds.
+            * **max_block_size** (int): The maximum samples per read.
+            * **min_poll_interval_us** (int): The minimum time in microseconds
+              between status reads.
+
+        Raises:
+            HatError: the board is not initialized.
+        """
+        if not self._initialized:
+            raise HatError(self._address, "Not initialized.")
+
+        config = _ScanConfig()
+        if (self._lib.mcc118_a_in_scan_config_read(self._address,
+                                                   byref(config))
+                != self._RESULT_SUCCESS):
+            raise HatError(self._address, "Incorrect response.")
+
+        return self._scan_config_type(
+            target_latency=config.target_latency,
+            max_block_size=config.max_block_size,
+            min_poll_interval_us=config.min_poll_interval_us)
+
     def a_in_scan_start(self, channel_mask, samples_per_channel,
                         sample_rate_per_channel, options):
         """
@@ -466,6 +830,18 @@ class mcc118(Hat): # pylint: disable=invalid-name
           circular buffer. The data must be read before being overwritten to
           avoid a buffer overrun error. **samples_per_channel** is only used for
           buffer sizing.
+        * :py:const:`OptionFlags.AUTORECOVER`: Only valid with
+          :py:const:`OptionFlags.CONTINUOUS`. Instead of ending the scan on an
+          overrun, the library restarts the device scan after a hardware
+          overrun or discards incoming data while the scan buffer is full, and
+          records the lost data as a gap that is read with
+          :py:func:`a_in_scan_read_gaps`.
+        * :py:const:`OptionFlags.RETRIGGER`: Only valid with
+          :py:const:`OptionFlags.EXTTRIGGER` for a finite scan. After each
+          capture of **samples_per_channel** completes, the scan thread
+          immediately re-arms the device to wait for the next trigger, and the
+          scan runs until stopped with :py:func:`a_in_scan_stop`. Each capture
+          is read as a numbered segment with :py:func:`a_in_scan_read_segment`.
 
         The scan buffer size will be allocated as follows:
 
@@ -540,6 +916,11 @@ class mcc118(Hat): # pylint: disable=invalid-name
         elif result != self._RESULT_SUCCESS:
             raise HatError(self._address, "Incorrect response {}.".format(
                 result))
+
+        if options & OptionFlags.RETRIGGER:
+            self._segment_samples = samples_per_channel
+        else:
+            self._segment_samples = 0
         return
 
     def a_in_scan_buffer_size(self):
@@ -591,6 +972,8 @@ class mcc118(Hat): # pylint: disable=invalid-name
               not read fast enough and data was lost.
             * **triggered** (bool): True if the trigger conditions have been met
               and data acquisition started.
+            * **gap** (bool): True if an auto-recovering scan has recorded gaps
+              that have not been read with :py:func:`a_in_scan_read_gaps`.
             * **samples_available** (int): The number of samples per channel
               currently in the scan buffer.
 
@@ -613,15 +996,12 @@ class mcc118(Hat): # pylint: disable=invalid-name
             raise HatError(self._address, "Incorrect response {}.".format(
                 result))
 
-        scan_status = namedtuple(
-            'MCC118ScanStatus',
-            ['running', 'hardware_overrun', 'buffer_overrun', 'triggered',
-             'samples_available'])
-        return scan_status(
+        return self._scan_status_type(
             running=(status.value & self._STATUS_RUNNING) != 0,
             hardware_overrun=(status.value & self._STATUS_HW_OVERRUN) != 0,
             buffer_overrun=(status.value & self._STATUS_BUFFER_OVERRUN) != 0,
             triggered=(status.value & self._STATUS_TRIGGERED) != 0,
+            gap=(status.value & self._STATUS_GAP) != 0,
             samples_available=samples_available.value)
 
     def a_in_scan_read(self, samples_per_channel, timeout):
@@ -657,6 +1037,8 @@ class mcc118(Hat): # pylint: disable=invalid-name
               not read fast enough and data was lost.
             * **triggered** (bool): True if the trigger conditions have been met
               and data acquisition started.
+            * **gap** (bool): True if an auto-recovering scan has recorded gaps
+              that have not been read with :py:func:`a_in_scan_read_gaps`.
             * **timeout** (bool): True if the timeout time expired before the
               specified number of samples were read.
             * **data** (list of float): The data that was read from the scan
@@ -672,10 +1054,6 @@ class mcc118(Hat): # pylint: disable=invalid-name
 
         num_channels = self._lib.mcc118_a_in_scan_channel_count(self._address)
 
-        self._lib.mcc118_a_in_scan_read.argtypes = [
-            c_ubyte, POINTER(c_ushort), c_long, c_double, POINTER(c_double),
-            c_ulong, POINTER(c_ulong)]
-
         samples_read_per_channel = c_ulong(0)
         samples_to_read = 0
         status = c_ushort(0)
@@ -735,15 +1113,12 @@ class mcc118(Hat): # pylint: disable=invalid-name
         else:
             data_list = [data_buffer[i] for i in xrange(total_read)]
 
-        scan_status = namedtuple(
-            'MCC118ScanRead',
-            ['running', 'hardware_overrun', 'buffer_overrun', 'triggered',
-             'timeout', 'data'])
-        return scan_status(
+        return self._scan_read_type(
             running=(status.value & self._STATUS_RUNNING) != 0,
             hardware_overrun=(status.value & self._STATUS_HW_OVERRUN) != 0,
             buffer_overrun=(status.value & self._STATUS_BUFFER_OVERRUN) != 0,
             triggered=(status.value & self._STATUS_TRIGGERED) != 0,
+            gap=(status.value & self._STATUS_GAP) != 0,
             timeout=timed_out,
             data=data_list)
 
@@ -780,6 +1155,8 @@ class mcc118(Hat): # pylint: disable=invalid-name
               not read fast enough and data was lost.
             * **triggered** (bool): True if the trigger conditions have been met
               and data acquisition started.
+            * **gap** (bool): True if an auto-recovering scan has recorded gaps
+              that have not been read with :py:func:`a_in_scan_read_gaps`.
             * **timeout** (bool): True if the timeout time expired before the
               specified number of samples were read.
             * **data** (NumPy array of float64): The data that was read from the
@@ -799,10 +1176,13 @@ class mcc118(Hat): # pylint: disable=invalid-name
         if not self._initialized:
             raise HatError(self._address, "Not initialized.")
 
-        self._lib.mcc118_a_in_scan_read.argtypes = [
-            c_ubyte, POINTER(c_ushort), c_long, c_double,
-            ndpointer(c_double, flags="C_CONTIGUOUS"), c_ulong,
-            POINTER(c_ulong)]
+        if self._scan_read_numpy is None:
+            self._scan_read_numpy = self._lib['mcc118_a_in_scan_read']
+            self._scan_read_numpy.argtypes = [
+                c_ubyte, POINTER(c_ushort), c_long, c_double,
+                ndpointer(c_double, flags="C_CONTIGUOUS"), c_ulong,
+                POINTER(c_ulong)]
+            self._scan_read_numpy.restype = c_int
 
         num_channels = self._lib.mcc118_a_in_scan_channel_count(self._address)
         samples_read_per_channel = c_ulong()
@@ -842,7 +1222,7 @@ class mcc118(Hat): # pylint: disable=invalid-name
             raise ValueError("Invalid samples_per_channel {}.".format(
                 samples_per_channel))
 
-        result = self._lib.mcc118_a_in_scan_read(
+        result = self._scan_read_numpy(
             self._address, byref(status), samples_to_read, timeout, data_buffer,
             buffer_size, byref(samples_read_per_channel))
 
@@ -861,18 +1241,347 @@ class mcc118(Hat): # pylint: disable=invalid-name
         if total_read < buffer_size:
             data_buffer = numpy.resize(data_buffer, (total_read,))
 
-        scan_status = namedtuple(
-            'MCC118ScanRead',
-            ['running', 'hardware_overrun', 'buffer_overrun', 'triggered',
-             'timeout', 'data'])
-        return scan_status(
+        return self._scan_read_type(
             running=(status.value & self._STATUS_RUNNING) != 0,
             hardware_overrun=(status.value & self._STATUS_HW_OVERRUN) != 0,
             buffer_overrun=(status.value & self._STATUS_BUFFER_OVERRUN) != 0,
             triggered=(status.value & self._STATUS_TRIGGERED) != 0,
+            gap=(status.value & self._STATUS_GAP) != 0,
             timeout=timed_out,
             data=data_buffer)
 
+    def a_in_scan_readinto(self, out, timeout):
+        """
+        Read scan data into an existing buffer.
+
+        This reads scan data without allocating any memory, so a read loop can
+        reuse the same buffer on every call. *out* may be any writable,
+        C-contiguous object that supports the buffer protocol with one of the
+        following item types, such as a NumPy array or :py:class:`array.array`:
+
+        * float64 (format 'd'): the same values as :py:func:`a_in_scan_read`.
+        * float32 (format 'f'): the values converted to single precision.
+        * uint16 (format 'H'): the ADC codes. The scan must have been started
+          with :py:const:`OptionFlags.NOSCALEDATA` and
+          :py:const:`OptionFlags.NOCALIBRATEDATA`.
+
+        The data is interleaved by channel, so a 2D NumPy array with one
+        column per scan channel receives one sample per channel in each row. As
+        many complete samples per channel as will fit in *out* are read; any
+        remaining items are not changed.
+
+        The scan status is not returned; use :py:func:`a_in_scan_status` to
+        check it. Like :py:meth:`io.RawIOBase.readinto`, a return value of 0
+        when *timeout* is negative means the scan has stopped or overrun and no
+        more data will be read. This function requires Python 3.
+
+        Args:
+            out (buffer): The buffer that receives the data.
+            timeout (float): The amount of time in seconds to wait for *out* to
+                be filled.  Specify a negative number to wait indefinitely, or 0
+                to return immediately with the samples that are already in the
+                scan buffer.
+
+        Returns:
+            int: The number of samples per channel that were read.
+
+        Raises:
+            HatError: A scan is not active, the board is not initialized, does
+                not respond, or responds incorrectly.
+            ValueError: *out* is not writable, not C-contiguous, has an
+                unsupported item type or is too small for one sample per
+                channel, or raw codes were requested from a scan that converts
+                them.
+        """
+        if not self._initialized:
+            raise HatError(self._address, "Not initialized.")
+
+        view = memoryview(out)
+        sample_format = self._SAMPLE_FORMATS.get(view.format.lstrip('@=<'))
+        if sample_format is None:
+            raise ValueError("Unsupported buffer format {}.".format(
+                view.format))
+        if view.readonly or not view.c_contiguous:
+            raise ValueError("Buffer must be writable and C-contiguous.")
+
+        num_channels = self._lib.mcc118_a_in_scan_channel_count(self._address)
+        if num_channels == 0:
+            raise HatError(self._address, "Scan not active.")
+
+        buffer_size = view.nbytes // view.itemsize
+        samples_per_channel = buffer_size // num_channels
+        if samples_per_channel == 0:
+            raise ValueError("Buffer is too small.")
+
+        c_buffer = (c_char * view.nbytes).from_buffer(view)
+        status = c_ushort(0)
+        samples_read_per_channel = c_ulong(0)
+        result = self._lib.mcc118_a_in_scan_read_format(
+            self._address, byref(status), samples_per_channel, timeout,
+            c_buffer, buffer_size, sample_format,
+            byref(samples_read_per_channel))
+
+        if result == self._RESULT_BAD_PARAMETER:
+            raise ValueError("Invalid parameter.")
+        elif result == self._RESULT_RESOURCE_UNAVAIL:
+            raise HatError(self._address, "Scan not active.")
+        elif (result != self._RESULT_SUCCESS and
+              result != self._RESULT_TIMEOUT):
+            raise HatError(self._address, "Incorrect response {}.".format(
+                result))
+
+        return samples_read_per_channel.value
+
+    def a_in_scan_buffer_view(self):
+        """
+        Get a view of the unread data in the scan buffer.
+
+        Returns a :py:class:`memoryview` of float64 values (format 'd') over
+        the library scan buffer, so the data can be processed without copying
+        it, for example with :py:func:`numpy.frombuffer`. The data is
+        interleaved by channel, the same as :py:func:`a_in_scan_read`.
+
+        Because the scan buffer is circular, the view only reaches the end of
+        the buffer; after releasing it, call this again to get the data at the
+        start. The data stays in the buffer until
+        :py:func:`a_in_scan_buffer_release` is called; the scan never
+        overwrites it. When the buffer is full the scan stops with a buffer
+        overrun, or with :py:const:`OptionFlags.AUTORECOVER` the new data is
+        discarded and recorded as a gap. The view must not be used after the
+        data is released or the scan is cleaned up. This function requires
+        Python 3.
+
+        Returns:
+            memoryview: The unread data, which may be empty.
+
+        Raises:
+            HatError: A scan is not active, or the board is not initialized.
+        """
+        if not self._initialized:
+            raise HatError(self._address, "Not initialized.")
+
+        data = POINTER(c_double)()
+        samples_per_channel = c_ulong(0)
+        result = self._lib.mcc118_a_in_scan_buffer_peek(
+            self._address, byref(data), byref(samples_per_channel))
+        if result == self._RESULT_RESOURCE_UNAVAIL:
+            raise HatError(self._address, "Scan not active.")
+        elif result != self._RESULT_SUCCESS:
+            raise HatError(self._address, "Incorrect response {}.".format(
+                result))
+
+        count = (samples_per_channel.value *
+                 self._lib.mcc118_a_in_scan_channel_count(self._address))
+        if count == 0:
+            return memoryview(b'').cast('d')
+
+        array = cast(data, POINTER(c_double * count)).contents
+        return memoryview(array).cast('B').cast('d')
+
+    def a_in_scan_buffer_release(self, samples_per_channel):
+        """
+        Remove data returned by :py:func:`a_in_scan_buffer_view` from the scan
+        buffer.
+
+        Args:
+            samples_per_channel (int): The number of samples per channel to
+                remove. This may not be more than the last view contained.
+
+        Raises:
+            HatError: A scan is not active, or the board is not initialized.
+            ValueError: More data was released than is available.
+        """
+        if not self._initialized:
+            raise HatError(self._address, "Not initialized.")
+
+        result = self._lib.mcc118_a_in_scan_buffer_release(
+            self._address, samples_per_channel)
+        if result == self._RESULT_BAD_PARAMETER:
+            raise ValueError("Invalid samples_per_channel {}.".format(
+                samples_per_channel))
+        elif result == self._RESULT_RESOURCE_UNAVAIL:
+            raise HatError(self._address, "Scan not active.")
+        elif result != self._RESULT_SUCCESS:
+            raise HatError(self._address, "Incorrect response {}.".format(
+                result))
+
+    def a_in_scan_stream(self, samples_per_channel):
+        """
+        Read scan data in blocks from an asyncio event loop.
+
+        Returns an asynchronous iterator that yields blocks of scan data as
+        they become available, for example: ::
+
+            hat.a_in_scan_start(channel_mask, 0, 10000, OptionFlags.CONTINUOUS)
+            async for block in hat.a_in_scan_stream(1000):
+                process(block)
+
+        The iterator waits on a file descriptor that the library signals when
+        enough data is in the scan buffer, registered with the event loop, so
+        no thread is blocked and several boards can be streamed from one event
+        loop. Each block is an :py:class:`array.array` of float64 values
+        interleaved by channel, the same as the data from
+        :py:func:`a_in_scan_read`, and may be used with
+        :py:func:`numpy.frombuffer` without copying. Every block holds
+        *samples_per_channel* samples per channel except the last one of a
+        finite scan, which may be smaller. Iteration ends when the scan stops
+        and all of the data has been read.
+
+        The scan must already be started and must not be read with other
+        functions while streaming. If iteration is abandoned before the scan
+        ends, call the iterator's ``close()`` method before
+        :py:func:`a_in_scan_cleanup`. Requires Python 3.5 or later.
+
+        Args:
+            samples_per_channel (int): The number of samples per channel in
+                each block. This is limited to the size of the scan buffer.
+
+        Returns:
+            An asynchronous iterator of :py:class:`array.array` blocks.
+
+        Raises:
+            HatError: A scan is not active, the board is not initialized, or
+                the scan overruns while streaming.
+            ValueError: Incorrect argument.
+        """
+        if not self._initialized:
+            raise HatError(self._address, "Not initialized.")
+
+        if samples_per_channel < 1:
+            raise ValueError("Invalid samples_per_channel {}.".format(
+                samples_per_channel))
+
+        buffer_size = self.a_in_scan_buffer_size()
+        num_channels = self._lib.mcc118_a_in_scan_channel_count(self._address)
+        samples_per_channel = min(samples_per_channel,
+                                  buffer_size // num_channels)
+
+        fd = c_int(-1)
+        result = self._lib.mcc118_a_in_scan_ready_fd(
+            self._address, samples_per_channel, byref(fd))
+        if result == self._RESULT_RESOURCE_UNAVAIL:
+            raise HatError(self._address, "Scan not active.")
+        elif result != self._RESULT_SUCCESS:
+            raise HatError(self._address, "Incorrect response {}.".format(
+                result))
+
+        return _ScanStream(self, samples_per_channel, num_channels, fd.value)
+
+    def a_in_scan_read_segment(self, timeout):
+        """
+        Read the next complete segment of a retriggered scan.
+
+        Waits for a complete capture from a scan started with
+        :py:const:`OptionFlags.RETRIGGER` and returns it. Nothing is read if the
+        timeout expires first, so segments stay aligned. Reading data with
+        :py:func:`a_in_scan_read` during the same scan will misalign the
+        segments.
+
+        Args:
+            timeout (float): The amount of time in seconds to wait for a
+                complete segment. Specify a negative number to wait
+                indefinitely or 0 to return immediately.
+
+        Returns:
+            namedtuple: a namedtuple containing the following field names:
+
+            * **segment** (int): The segment number, starting at 0, or None if
+              no segment was read.
+            * **running** (bool): True if the scan is running, False if it has
+              stopped.
+            * **hardware_overrun** (bool): True if the hardware could not
+              acquire and unload samples fast enough and data was lost.
+            * **buffer_overrun** (bool): True if the background scan buffer was
+              not read fast enough and data was lost.
+            * **triggered** (bool): True if the trigger conditions have been met
+              for the segment being acquired.
+            * **gap** (bool): True if an auto-recovering scan has recorded gaps
+              that have not been read with :py:func:`a_in_scan_read_gaps`.
+            * **timeout** (bool): True if the timeout time expired before a
+              segment was complete.
+            * **data** (list of float): The segment data, or an empty list if
+              no segment was read.
+
+        Raises:
+            HatError: A retriggered scan is not active or the board is not
+                initialized, does not respond, or responds incorrectly.
+        """
+        if not self._initialized:
+            raise HatError(self._address, "Not initialized.")
+
+        buffer_size = self._segment_samples * \
+            self._lib.mcc118_a_in_scan_channel_count(self._address)
+        data_buffer = (c_double * max(buffer_size, 1))()
+        status = c_ushort(0)
+        segment_number = c_ulong(0)
+        timed_out = False
+        data_list = []
+        segment = None
+
+        result = self._lib.mcc118_a_in_scan_read_segment(
+            self._address, byref(status), timeout, data_buffer, buffer_size,
+            byref(segment_number))
+
+        if result == self._RESULT_SUCCESS:
+            segment = segment_number.value
+            data_list = data_buffer[:buffer_size]
+        elif result == self._RESULT_TIMEOUT:
+            timed_out = True
+        elif result == self._RESULT_RESOURCE_UNAVAIL:
+            if self._segment_samples == 0:
+                raise HatError(self._address, "Retriggered scan not active.")
+        else:
+            raise HatError(self._address, "Incorrect response {}.".format(
+                result))
+
+        return self._scan_segment_type(
+            segment=segment,
+            running=(status.value & self._STATUS_RUNNING) != 0,
+            hardware_overrun=(status.value & self._STATUS_HW_OVERRUN) != 0,
+            buffer_overrun=(status.value & self._STATUS_BUFFER_OVERRUN) != 0,
+            triggered=(status.value & self._STATUS_TRIGGERED) != 0,
+            gap=(status.value & self._STATUS_GAP) != 0,
+            timeout=timed_out,
+            data=data_list)
+
+    def a_in_scan_read_gaps(self):
+        """
+        Read the gaps recorded by an auto-recovering scan.
+
+        When a scan is started with :py:const:`OptionFlags.AUTORECOVER` the
+        library records a gap every time data is lost, then continues the scan.
+        This method returns the unread gaps and removes them from the list.
+
+        Returns:
+            list: A list of namedtuples, one per gap, each containing the
+            following field names:
+
+            * **sample_index** (int): The per-channel index in the scan data of
+              the first sample after the gap.
+            * **samples_lost** (int): The number of samples per channel that
+              were lost (estimated for hardware overruns.)
+
+        Raises:
+            HatError: A scan is not active or the board is not initialized.
+        """
+        if not self._initialized:
+            raise HatError(self._address, "Not initialized.")
+
+        gap_buffer = (_ScanGap * self._MAX_SCAN_GAPS)()
+        gaps_read = c_ushort(0)
+        result = self._lib.mcc118_a_in_scan_read_gaps(
+            self._address, gap_buffer, self._MAX_SCAN_GAPS, byref(gaps_read))
+
+        if result == self._RESULT_RESOURCE_UNAVAIL:
+            raise HatError(self._address, "Scan not active.")
+        elif result != self._RESULT_SUCCESS:
+            raise HatError(self._address, "Incorrect response {}.".format(
+                result))
+
+        return [self._scan_gap_type(sample_index=gap.sample_index,
+                                    samples_lost=gap.samples_lost)
+                for gap in gap_buffer[:gaps_read.value]]
+
     def a_in_scan_channel_count(self):
         """
         Read the number of channels in the current analog input scan.
@@ -890,6 +1599,89 @@ class mcc118(Hat): # pylint: disable=invalid-name
         num_channels = self._lib.mcc118_a_in_scan_channel_count(self._address)
         return num_channels
 
+    def a_in_scan_sample_time(self, sample_index):
+        """
+        Estimate the time that a scan sample was acquired.
+
+        The background scan thread saves the number of samples acquired by the
+        device along with the host clock times each time it reads a block of
+        data. This method fits a line through the most recent of these points
+        and uses it to estimate the acquisition time of any sample in the scan,
+        which removes most of the jitter of the host read times.
+
+        Args:
+            sample_index (int): The per-channel index of the sample, counted
+                from the start of the scan (the first sample read for each
+                channel is index 0.)
+
+        Returns:
+            namedtuple: a namedtuple containing the following field names:
+
+            * **monotonic** (float): The estimated CLOCK_MONOTONIC time in
+              seconds, comparable to :py:func:`time.monotonic`.
+            * **realtime** (float): The estimated CLOCK_REALTIME time in
+              seconds, comparable to :py:func:`time.time`.
+
+        Raises:
+            HatError: A scan is not active or has not acquired any data, or the
+                board is not initialized.
+        """
+        if not self._initialized:
+            raise HatError(self._address, "Not initialized.")
+
+        monotonic_time = c_double()
+        real_time = c_double()
+        result = self._lib.mcc118_a_in_scan_sample_time(
+            self._address, sample_index, byref(monotonic_time),
+            byref(real_time))
+
+        if result == self._RESULT_RESOURCE_UNAVAIL:
+            raise HatError(self._address, "No scan data available.")
+        elif result != self._RESULT_SUCCESS:
+            raise HatError(self._address, "Incorrect response {}.".format(
+                result))
+
+        return self._sample_time_type(
+            monotonic=monotonic_time.value,
+            realtime=real_time.value)
+
+    def a_in_scan_clock_drift(self):
+        """
+        Read the scan rate measured against the host clock.
+
+        Uses the same timing information as :py:func:`a_in_scan_sample_time` to
+        measure the actual scan rate and compare it to the nominal rate returned
+        by :py:func:`a_in_scan_actual_rate`.
+
+        Returns:
+            namedtuple: a namedtuple containing the following field names:
+
+            * **measured_rate** (float): The measured sample rate per channel.
+            * **drift_ppm** (float): The difference between the measured and
+              nominal rates in parts per million.
+
+        Raises:
+            HatError: A scan is not active or has not acquired enough data to
+                measure the rate, or the board is not initialized.
+        """
+        if not self._initialized:
+            raise HatError(self._address, "Not initialized.")
+
+        measured_rate = c_double()
+        drift_ppm = c_double()
+        result = self._lib.mcc118_a_in_scan_clock_drift(
+            self._address, byref(measured_rate), byref(drift_ppm))
+
+        if result == self._RESULT_RESOURCE_UNAVAIL:
+            raise HatError(self._address, "Not enough scan data available.")
+        elif result != self._RESULT_SUCCESS:
+            raise HatError(self._address, "Incorrect response {}.".format(
+                result))
+
+        return self._clock_drift_type(
+            measured_rate=measured_rate.value,
+            drift_ppm=drift_ppm.value)
+
     def a_in_scan_stop(self):
         """
         Stops an analog input scan.
@@ -915,9 +1707,10 @@ class mcc118(Hat): # pylint: disable=invalid-name
         """
         Free analog input scan resources after the scan is complete.
 
-        This will free the scan buffer and other resources used by the
-        background scan and make it possible to start another scan with
-        :py:func:`a_in_scan_start`.
+        This will free the resources used by the background scan and make it
+        possible to start another scan with :py:func:`a_in_scan_start`. The
+        scan buffer is kept for reuse by the next scan until the class is
+        destroyed.
 
         Raises:
             HatError: the board is not initialized, does not respond, or
@@ -929,7 +1722,194 @@ class mcc118(Hat): # pylint: disable=invalid-name
         if (self._lib.mcc118_a_in_scan_cleanup(self._address)
                 != self._RESULT_SUCCESS):
             raise HatError(self._address, "Incorrect response.")
+        self._segment_samples = 0
+
+        return
+
+    def a_in_scan_rearm(self):
+        """
+        Start a finished scan again with the same parameters.
+
+        Re-arms the scan started by :py:func:`a_in_scan_start` without
+        freeing and reallocating the scan resources, which avoids the setup
+        time for repeated captures such as externally triggered finite scans.
+        The scan must have completed or been stopped with
+        :py:func:`a_in_scan_stop`. Any unread data and status from the
+        previous scan are discarded.
+
+        Raises:
+            HatError: there is no scan to re-arm, the scan is still running,
+                or the board is not initialized, does not respond, or
+                responds incorrectly.
+        """
+        if not self._initialized:
+            raise HatError(self._address, "Not initialized.")
+
+        result = self._lib.mcc118_a_in_scan_rearm(self._address)
+        if result == self._RESULT_BUSY:
+            raise HatError(self._address, "The scan is still running.")
+        elif result == self._RESULT_RESOURCE_UNAVAIL:
+            raise HatError(self._address, "Scan not active.")
+        elif result != self._RESULT_SUCCESS:
+            raise HatError(self._address, "Incorrect response {}.".format(
+                result))
+        return
+
+    def a_in_sampler_start(self, channel_mask, sample_rate, buffer_size=0,
+                           options=OptionFlags.DEFAULT):
+        """
+        Start software-timed sampling of a set of channels.
+
+        Starts a library thread that reads the channels in **channel_mask**
+        with :py:func:`a_in_read_multi` at a fixed rate, using absolute
+        deadlines so the interval does not drift with the read time, and stores
+        each sample with its :py:func:`time.monotonic` timestamp. Use this when
+        a hardware-paced scan is not possible, such as when other processes
+        also perform single reads on the board. The timing depends on the host
+        scheduler, so :py:func:`a_in_sampler_stats` reports the achieved rate
+        and timing jitter. A hardware-paced scan cannot run at the same time.
+
+        Args:
+            channel_mask (int): A bit mask of the channels to read, the LSB
+                corresponds to channel 0.
+            sample_rate (float): The number of samples per second per channel,
+                max 10,000.
+            buffer_size (int): The size of the buffer in samples per channel,
+                or 0 to hold 10 seconds of data. When the buffer is full the
+                oldest samples are dropped.
+            options (int): ORed combination of :py:class:`OptionFlags`,
+                :py:const:`OptionFlags.DEFAULT` if unspecified. The valid flags
+                are the same as :py:func:`a_in_read`.
+
+        Raises:
+            HatError: a scan or sampler is already running, memory could not be
+                allocated, or the board is not initialized.
+            ValueError: an argument is invalid.
+        """
+        if not self._initialized:
+            raise HatError(self._address, "Not initialized.")
+
+        if channel_mask not in range(1, 1 << self._AIN_NUM_CHANNELS):
+            raise ValueError("Invalid channel mask {}.".format(channel_mask))
+
+        result = self._lib.mcc118_a_in_sampler_start(
+            self._address, channel_mask, sample_rate, buffer_size, options)
+        if result == self._RESULT_BAD_PARAMETER:
+            raise ValueError("Invalid sampler parameter.")
+        elif result == self._RESULT_BUSY:
+            raise HatError(self._address,
+                           "A scan or sampler is already active.")
+        elif result == self._RESULT_RESOURCE_UNAVAIL:
+            raise HatError(self._address, "Memory could not be allocated.")
+        elif result != self._RESULT_SUCCESS:
+            raise HatError(self._address, "Incorrect response {}.".format(
+                result))
+
+        self._sampler_channels = bin(channel_mask).count('1')
+        return
+
+    def a_in_sampler_read(self, max_samples=1000):
+        """
+        Read samples from the software-timed sampler.
+
+        Returns immediately with up to **max_samples** of the oldest samples in
+        the buffer.
+
+        Args:
+            max_samples (int): The maximum number of samples per channel to
+                read.
+
+        Returns:
+            namedtuple: a namedtuple containing the following field names:
+
+            * **timestamps** (list of float): The :py:func:`time.monotonic`
+              time of each sample.
+            * **data** (list of float): The values, interleaved by channel in
+              order of increasing channel number.
+
+        Raises:
+            HatError: the sampler is not running or the board is not
+                initialized.
+        """
+        if not self._initialized:
+            raise HatError(self._address, "Not initialized.")
+
+        channels = max(self._sampler_channels, 1)
+        timestamps = (c_double * max_samples)()
+        values = (c_double * (max_samples * channels))()
+        samples_read = c_ulong(0)
+
+        result = self._lib.mcc118_a_in_sampler_read(
+            self._address, timestamps, values, max_samples,
+            byref(samples_read))
+        if result == self._RESULT_RESOURCE_UNAVAIL:
+            raise HatError(self._address, "Sampler not active.")
+        elif result != self._RESULT_SUCCESS:
+            raise HatError(self._address, "Incorrect response {}.".format(
+                result))
+
+        count = samples_read.value
+        return self._sampler_read_type(timestamps=timestamps[:count],
+                                       data=values[:count * channels])
+
+    def a_in_sampler_stats(self):
+        """
+        Read the software-timed sampler statistics.
+
+        Returns:
+            namedtuple: a namedtuple containing the following field names:
+
+            * **sample_count** (int): The number of samples acquired.
+            * **missed_deadlines** (int): The number of sample times that were
+              skipped because a read was late.
+            * **buffer_overruns** (int): The number of samples dropped because
+              the buffer was full.
+            * **samples_available** (int): The number of samples per channel
+              waiting in the buffer.
+            * **last_error** (int): The result code of the most recent failed
+              read, or 0.
+            * **actual_rate** (float): The achieved sample rate in S/s.
+            * **jitter_mean** (float): The mean delay in seconds between the
+              sample deadline and the read.
+            * **jitter_p50** (float): The median delay in seconds.
+            * **jitter_p99** (float): The 99th percentile delay in seconds.
+            * **jitter_max** (float): The largest delay in seconds.
 
+        Raises:
+            HatError: the sampler is not running or the board is not
+                initialized.
+        """
+        if not self._initialized:
+            raise HatError(self._address, "Not initialized.")
+
+        stats = _SamplerStats()
+        result = self._lib.mcc118_a_in_sampler_stats(self._address,
+                                                     byref(stats))
+        if result == self._RESULT_RESOURCE_UNAVAIL:
+            raise HatError(self._address, "Sampler not active.")
+        elif result != self._RESULT_SUCCESS:
+            raise HatError(self._address, "Incorrect response {}.".format(
+                result))
+
+        return self._sampler_stats_type(
+            *[getattr(stats, name) for name in self._sampler_stats_type._fields])
+
+    def a_in_sampler_stop(self):
+        """
+        Stop the software-timed sampler and free its resources.
+
+        Unread samples are discarded.
+
+        Raises:
+            HatError: the board is not initialized.
+        """
+        if not self._initialized:
+            raise HatError(self._address, "Not initialized.")
+
+        if (self._lib.mcc118_a_in_sampler_stop(self._address)
+                != self._RESULT_SUCCESS):
+            raise HatError(self._address, "Incorrect response.")
+        self._sampler_channels = 0
         return
 
     def test_clock(self, mode):
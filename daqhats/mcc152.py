@@ -3,10 +3,11 @@
 Wraps all of the methods from the MCC 152 library for use in Python.
 """
 from collections import namedtuple
-from ctypes import c_ubyte, c_int, c_char_p, c_ulong, c_double, POINTER, \
-    create_string_buffer, byref
+from ctypes import c_ubyte, c_int, c_char_p, c_ulong, c_ulonglong, c_double, \
+    POINTER, Structure, create_string_buffer, byref
 from enum import IntEnum, unique
-from daqhats.hats import Hat, HatError, OptionFlags
+from daqhats.hats import Hat, HatError, OptionFlags, _NATIVE, \
+    _load_daqhats_library
 
 @unique
 class DIOConfigItem(IntEnum):
@@ -19,6 +20,23 @@ class DIOConfigItem(IntEnum):
     OUTPUT_TYPE = 5     #: Configure output type
     INT_MASK = 6        #: Configure interrupt mask
 
+class _OutScanStatus(Structure): # pylint: disable=too-few-public-methods
+    _fields_ = [("update_count", c_ulonglong),
+                ("underruns", c_ulonglong),
+                ("last_error", c_int),
+                ("running", c_int),
+                ("actual_rate", c_double),
+                ("jitter_mean", c_double),
+                ("jitter_p50", c_double),
+                ("jitter_p99", c_double),
+                ("jitter_max", c_double)]
+
+class _DIOEvent(Structure): # pylint: disable=too-few-public-methods
+    _fields_ = [("timestamp_ns", c_ulonglong),
+                ("address", c_ubyte),
+                ("channel", c_ubyte),
+                ("value", c_ubyte)]
+
 class mcc152(Hat): # pylint: disable=invalid-name,too-many-public-methods
     """
     The class for an MCC 152 board.
@@ -56,6 +74,18 @@ class mcc152(Hat): # pylint: disable=invalid-name,too-many-public-methods
         AO_MIN_RANGE=0.0,
         AO_MAX_RANGE=5.0)
 
+    # namedtuple classes for return values, created once rather than on every
+    # call
+    _out_scan_status_type = namedtuple(
+        'MCC152OutScanStatus', [name for name, _ in _OutScanStatus._fields_])
+    _dio_event_type = namedtuple(
+        'MCC152DIOEvent', ['timestamp', 'address', 'channel', 'value'])
+    _dio_event_status_type = namedtuple(
+        'MCC152DIOEventStatus', ['events_available', 'overruns'])
+
+    # set once the DIO event function argtypes have been set in the library
+    _event_lib_ready = False
+
     def __init__(self, address=0): # pylint: disable=similarities
         """
         Initialize the class.
@@ -81,9 +111,27 @@ class mcc152(Hat): # pylint: disable=invalid-name,too-many-public-methods
             c_ubyte, c_ulong, POINTER(c_double)]
         self._lib.mcc152_a_out_write_all.restype = c_int
 
+        self._lib.mcc152_a_out_write_sync.argtypes = [
+            c_ubyte, POINTER(c_ubyte), c_ulong, POINTER(c_double)]
+        self._lib.mcc152_a_out_write_sync.restype = c_int
+
+        self._lib.mcc152_a_out_scan_start.argtypes = [
+            c_ubyte, c_ubyte, c_double, POINTER(c_double), c_ulong, c_ulong]
+        self._lib.mcc152_a_out_scan_start.restype = c_int
+
+        self._lib.mcc152_a_out_scan_status.argtypes = [
+            c_ubyte, POINTER(_OutScanStatus)]
+        self._lib.mcc152_a_out_scan_status.restype = c_int
+
+        self._lib.mcc152_a_out_scan_stop.argtypes = [c_ubyte]
+        self._lib.mcc152_a_out_scan_stop.restype = c_int
+
         self._lib.mcc152_dio_reset.argtypes = [c_ubyte]
         self._lib.mcc152_dio_reset.restype = c_int
 
+        self._lib.mcc152_dio_cache_invalidate.argtypes = [c_ubyte]
+        self._lib.mcc152_dio_cache_invalidate.restype = c_int
+
         self._lib.mcc152_dio_input_read_bit.argtypes = [
             c_ubyte, c_ubyte, POINTER(c_ubyte)]
         self._lib.mcc152_dio_input_read_bit.restype = c_int
@@ -214,6 +262,12 @@ class mcc152(Hat): # pylint: disable=invalid-name,too-many-public-methods
         if not self._initialized:
             raise HatError(self._address, "Not initialized.")
 
+        if _NATIVE is not None:
+            # checks the channel, limits the value and raises the same errors
+            # as below
+            _NATIVE.mcc152_a_out_write(self._address, channel, value, options)
+            return
+
         if channel not in range(self._AOUT_NUM_CHANNELS):
             raise ValueError("Invalid channel {0}. Must be 0-{1}.".
                              format(channel, self._AOUT_NUM_CHANNELS-1))
@@ -289,6 +343,192 @@ class mcc152(Hat): # pylint: disable=invalid-name,too-many-public-methods
             raise HatError(self._address, "Incorrect response.")
         return
 
+    @staticmethod
+    def a_out_write_sync(boards, values, options=OptionFlags.DEFAULT):
+        """
+        Write all analog output channels on several boards with a synchronized
+        update.
+
+        The new values are written to every board without changing the
+        outputs, then the load commands are sent back to back so the outputs of
+        all of the boards change together. The SPI bus lock is obtained once
+        for the whole operation. No board is written if a value is outside
+        the output range.
+
+        **options** is an OptionFlags value. Valid flags for this method are:
+
+        * :py:const:`OptionFlags.DEFAULT`: Write voltage values (0 - 5).
+        * :py:const:`OptionFlags.NOSCALEDATA`: Write DAC codes (values
+          between 0 and 4095) rather than voltage.
+
+        Args:
+            boards (list of mcc152): The boards to update. Each board may only
+                appear once.
+            values (list of float): The values to write, 2 per board in the
+                same order as **boards** (channel 0 then channel 1.)
+            options (int): An :py:class:`OptionFlags` value,
+                :py:const:`OptionFlags.DEFAULT` if unspecified.
+
+        Raises:
+            HatError: a board is not initialized, has an analog output scan
+                running, or does not respond.
+            ValueError: an argument is invalid.
+        """
+        if not boards:
+            raise ValueError("No boards.")
+        for board in boards:
+            if not board._initialized: # pylint: disable=protected-access
+                raise HatError(board.address(), "Not initialized.")
+
+        count = len(boards)
+        values_needed = count * mcc152._AOUT_NUM_CHANNELS
+        if len(values) < values_needed:
+            raise ValueError(
+                "Not enough elements in values. Must be at least {}".
+                format(values_needed))
+
+        address_array = (c_ubyte * count)(*[board.address() for board in
+                                            boards])
+        data_array = (c_double * values_needed)(*values[:values_needed])
+        lib = boards[0]._lib # pylint: disable=protected-access
+        result = lib.mcc152_a_out_write_sync(count, address_array, options,
+                                             data_array)
+        if result == mcc152._RESULT_BAD_PARAMETER:
+            raise ValueError("Invalid board list or value out of range.")
+        elif result == mcc152._RESULT_BUSY:
+            raise HatError(boards[0].address(),
+                           "An analog output scan is active.")
+        elif result != mcc152._RESULT_SUCCESS:
+            raise HatError(boards[0].address(), "Incorrect response.")
+        return
+
+    def a_out_scan_start(self, channel_mask, rate, data,
+                         options=OptionFlags.DEFAULT):
+        """
+        Start a timed analog output scan.
+
+        Starts a library thread that writes **data** to the analog outputs at
+        **rate** updates per second. The SPI frames for every update are built
+        when the scan starts and each update is sent at an absolute deadline,
+        so the interval does not drift with the write time. When both channels
+        are in **channel_mask** they are updated simultaneously.
+
+        The timing depends on the host scheduler. If an update is late, the
+        update times that have already passed are skipped so the waveform stays
+        aligned with the clock, and are reported as underruns by
+        :py:func:`a_out_scan_status`. :py:func:`a_out_write` and
+        :py:func:`a_out_write_all` cannot be used until
+        :py:func:`a_out_scan_stop` is called.
+
+        **options** is an ORed combination of OptionFlags. Valid flags for this
+        method are:
+
+        * :py:const:`OptionFlags.DEFAULT`: The data is voltages (0 - 5) and the
+          buffer is output once.
+        * :py:const:`OptionFlags.NOSCALEDATA`: The data is DAC codes (values
+          between 0 and 4095) rather than voltages.
+        * :py:const:`OptionFlags.CONTINUOUS`: Repeat the data until
+          :py:func:`a_out_scan_stop` is called.
+
+        Args:
+            channel_mask (int): A bit mask of the channels to update, the LSB
+                corresponds to channel 0.
+            rate (float): The number of updates per second, max 10,000.
+            data (list of float): The output values, interleaved in order of
+                increasing channel number when both channels are used.
+            options (int): ORed combination of :py:class:`OptionFlags`,
+                :py:const:`OptionFlags.DEFAULT` if unspecified.
+
+        Raises:
+            HatError: a scan is already running, memory could not be
+                allocated, or the board is not initialized.
+            ValueError: an argument is invalid.
+        """
+        if not self._initialized:
+            raise HatError(self._address, "Not initialized.")
+
+        if channel_mask not in range(1, 1 << self._AOUT_NUM_CHANNELS):
+            raise ValueError("Invalid channel mask {}.".format(channel_mask))
+
+        channel_count = bin(channel_mask).count('1')
+        count = len(data) // channel_count
+        if count == 0:
+            raise ValueError("No data.")
+
+        data_array = (c_double * (count * channel_count))(
+            *data[:count * channel_count])
+        result = self._lib.mcc152_a_out_scan_start(
+            self._address, channel_mask, rate, data_array, count, options)
+        if result == self._RESULT_BAD_PARAMETER:
+            raise ValueError("Invalid scan parameter or value out of range.")
+        elif result == self._RESULT_BUSY:
+            raise HatError(self._address, "A scan is already active.")
+        elif result == self._RESULT_RESOURCE_UNAVAIL:
+            raise HatError(self._address, "Memory could not be allocated.")
+        elif result != self._RESULT_SUCCESS:
+            raise HatError(self._address, "Incorrect response {}.".format(
+                result))
+        return
+
+    def a_out_scan_status(self):
+        """
+        Read the analog output scan status and timing statistics.
+
+        Returns:
+            namedtuple: a namedtuple containing the following field names:
+
+            * **update_count** (int): The number of output updates made.
+            * **underruns** (int): The number of update times that were skipped
+              because an update was late.
+            * **last_error** (int): The result code of the most recent failed
+              update, or 0.
+            * **running** (int): 1 while the scan is updating the outputs, 0
+              when a finite scan has completed.
+            * **actual_rate** (float): The achieved update rate in S/s.
+            * **jitter_mean** (float): The mean delay in seconds between the
+              update deadline and the update.
+            * **jitter_p50** (float): The median delay in seconds.
+            * **jitter_p99** (float): The 99th percentile delay in seconds.
+            * **jitter_max** (float): The largest delay in seconds.
+
+        Raises:
+            HatError: a scan has not been started or the board is not
+                initialized.
+        """
+        if not self._initialized:
+            raise HatError(self._address, "Not initialized.")
+
+        status = _OutScanStatus()
+        result = self._lib.mcc152_a_out_scan_status(self._address,
+                                                    byref(status))
+        if result == self._RESULT_RESOURCE_UNAVAIL:
+            raise HatError(self._address, "Scan not active.")
+        elif result != self._RESULT_SUCCESS:
+            raise HatError(self._address, "Incorrect response {}.".format(
+                result))
+
+        return self._out_scan_status_type(
+            *[getattr(status, name)
+              for name in self._out_scan_status_type._fields])
+
+    def a_out_scan_stop(self):
+        """
+        Stop the analog output scan and free its resources.
+
+        The outputs keep their last value. This must be called after a finite
+        scan completes before the outputs can be written again.
+
+        Raises:
+            HatError: the board is not initialized.
+        """
+        if not self._initialized:
+            raise HatError(self._address, "Not initialized.")
+
+        if (self._lib.mcc152_a_out_scan_stop(self._address)
+                != self._RESULT_SUCCESS):
+            raise HatError(self._address, "Incorrect response.")
+        return
+
     def dio_reset(self):
         """
         Reset the DIO to the default configuration.
@@ -313,6 +553,28 @@ class mcc152(Hat): # pylint: disable=invalid-name,too-many-public-methods
 
         return
 
+    def dio_cache_invalidate(self):
+        """
+        Discard the cached DIO configuration.
+
+        The library keeps a copy of the DIO output and configuration registers
+        so reading those settings and writing single channels does not need
+        extra bus transfers. If another process changes the DIO settings on
+        this board, call this before using them so the registers are read from
+        the device again on the next access.
+
+        Raises:
+            HatError: the board is not initialized.
+        """
+        if not self._initialized:
+            raise HatError(self._address, "Not initialized.")
+
+        if (self._lib.mcc152_dio_cache_invalidate(self._address) !=
+                self._RESULT_SUCCESS):
+            raise HatError(self._address, "Incorrect response.")
+
+        return
+
     def dio_input_read_bit(self, channel):
         """
         Read a single digital input channel.
@@ -345,6 +607,10 @@ class mcc152(Hat): # pylint: disable=invalid-name,too-many-public-methods
         if not self._initialized:
             raise HatError(self._address, "Not initialized.")
 
+        if _NATIVE is not None:
+            # checks the channel and raises the same errors as below
+            return _NATIVE.mcc152_dio_input_read_bit(self._address, channel)
+
         if channel not in range(self._DIO_NUM_CHANNELS):
             raise ValueError("Invalid channel {}.".format(channel))
 
@@ -1264,3 +1530,149 @@ class mcc152(Hat): # pylint: disable=invalid-name,too-many-public-methods
             self._DIO_NUM_CHANNELS))
 
         return mytuple
+
+    @staticmethod
+    def _event_lib():
+        """
+        Load the library and set the argtypes for the DIO event functions.
+        """
+        lib = _load_daqhats_library()
+        if lib == 0:
+            raise HatError(0, "Library not loaded.")
+        if mcc152._event_lib_ready:
+            return lib
+
+        lib.mcc152_dio_event_start.argtypes = [c_ulong]
+        lib.mcc152_dio_event_start.restype = c_int
+
+        lib.mcc152_dio_event_read.argtypes = [
+            POINTER(_DIOEvent), c_ulong, c_double, POINTER(c_ulong)]
+        lib.mcc152_dio_event_read.restype = c_int
+
+        lib.mcc152_dio_event_status.argtypes = [
+            POINTER(c_ulong), POINTER(c_ulonglong)]
+        lib.mcc152_dio_event_status.restype = c_int
+
+        lib.mcc152_dio_event_stop.argtypes = []
+        lib.mcc152_dio_event_stop.restype = c_int
+        mcc152._event_lib_ready = True
+        return lib
+
+    @staticmethod
+    def dio_event_start(buffer_size=0):
+        """
+        Start capturing digital input changes on all MCC 152 boards.
+
+        Installs a library handler on the shared DAQ HAT interrupt line. On
+        each interrupt the handler reads the interrupt status and inputs of
+        every open MCC 152 in one combined I2C transfer, and adds an event for
+        each channel with a pending interrupt to an event ring, along with the
+        kernel timestamp of the interrupt edge. Read the events with
+        :py:func:`dio_event_read`.
+
+        Enable interrupts for the channels of interest with the
+        :py:const:`DIOConfigItem.INT_MASK` configuration item. Reading the
+        inputs clears the interrupts, so a callback set with
+        :py:func:`interrupt_callback_enable` still runs after the handler but
+        will find the MCC 152 interrupts already cleared.
+
+        Args:
+            buffer_size (int): The number of events the ring can hold, rounded
+                up to a power of 2, or 0 for 4096. When the ring is full new
+                events are dropped and counted as overruns.
+
+        Raises:
+            HatError: the engine is already running or could not be started.
+            ValueError: the buffer size is invalid.
+        """
+        lib = mcc152._event_lib()
+        result = lib.mcc152_dio_event_start(buffer_size)
+        if result == mcc152._RESULT_BAD_PARAMETER:
+            raise ValueError("Invalid buffer size {}.".format(buffer_size))
+        elif result == mcc152._RESULT_BUSY:
+            raise HatError(0, "The DIO event engine is already running.")
+        elif result != mcc152._RESULT_SUCCESS:
+            raise HatError(0, "Could not start the DIO event engine.")
+        return
+
+    @staticmethod
+    def dio_event_read(max_events=1000, timeout=0):
+        """
+        Read captured digital input changes.
+
+        Returns the oldest events, in the order they were captured. Only one
+        thread should read events at a time.
+
+        Args:
+            max_events (int): The maximum number of events to read.
+            timeout (float): The time in seconds to wait for at least one
+                event; a negative value waits indefinitely and 0 returns
+                immediately.
+
+        Returns:
+            list of namedtuple: a list of namedtuples containing the following
+            field names:
+
+            * **timestamp** (float): The :py:func:`time.monotonic` time of the
+              interrupt.
+            * **address** (int): The board address.
+            * **channel** (int): The DIO channel that caused the interrupt.
+            * **value** (int): The input value read after the interrupt.
+
+            The list is empty if no event arrived before the timeout.
+
+        Raises:
+            HatError: the engine is not running.
+        """
+        lib = mcc152._event_lib()
+        events = (_DIOEvent * max_events)()
+        events_read = c_ulong(0)
+        result = lib.mcc152_dio_event_read(events, max_events, timeout,
+                                           byref(events_read))
+        if result == mcc152._RESULT_TIMEOUT:
+            return []
+        elif result == mcc152._RESULT_RESOURCE_UNAVAIL:
+            raise HatError(0, "The DIO event engine is not running.")
+        elif result != mcc152._RESULT_SUCCESS:
+            raise HatError(0, "Incorrect response {}.".format(result))
+
+        return [mcc152._dio_event_type(timestamp=event.timestamp_ns / 1e9,
+                                       address=event.address,
+                                       channel=event.channel,
+                                       value=event.value)
+                for event in events[:events_read.value]]
+
+    @staticmethod
+    def dio_event_status():
+        """
+        Read the digital input event engine status.
+
+        Returns:
+            namedtuple: a namedtuple containing the following field names:
+
+            * **events_available** (int): The number of unread events.
+            * **overruns** (int): The number of events dropped because the
+              ring was full.
+
+        Raises:
+            HatError: the engine is not running.
+        """
+        lib = mcc152._event_lib()
+        available = c_ulong(0)
+        overruns = c_ulonglong(0)
+        result = lib.mcc152_dio_event_status(byref(available),
+                                             byref(overruns))
+        if result != mcc152._RESULT_SUCCESS:
+            raise HatError(0, "The DIO event engine is not running.")
+
+        return mcc152._dio_event_status_type(
+            events_available=available.value, overruns=overruns.value)
+
+    @staticmethod
+    def dio_event_stop():
+        """
+        Stop capturing digital input changes and discard any unread events.
+        """
+        lib = mcc152._event_lib()
+        lib.mcc152_dio_event_stop()
+        return
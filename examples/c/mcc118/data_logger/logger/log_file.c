@@ -131,7 +131,8 @@ int init_log_file(FILE* log_file_ptr, uint8_t current_channel_mask)
         if (chanMask & 1)
         {
             //print channel
-            write_status = fprintf(log_file_ptr, "Chan %d, ", i);
+            write_status = fprintf(log_file_ptr, "%sChan %d",
+                (num_channels > 0) ? "," : "", i);
             if (write_status <= 0)
             {
                 // Break if an error occurred.
@@ -153,42 +154,39 @@ int init_log_file(FILE* log_file_ptr, uint8_t current_channel_mask)
 int write_log_file(FILE* log_file_ptr, double* read_buf, int samplesPerChannel,
     int numberOfChannels)
 {
-    int i = 0;
-    int j = 0;
+    // Large enough to hold many rows, so the file is written with few
+    // system calls.
+    static char text_buf[65536];
+    uint32_t rows_written = 0;
+    uint32_t bytes_written = 0;
     int write_status = 1;
-
-    char str[1000];
-    char buf[256];
-    int scan_start_index = 0;
-
-    strcpy(str, "");
+    int row = 0;
 
     // Write the data to the file.
-    for (i = 0; i < samplesPerChannel; i++)
+    while (row < samplesPerChannel)
     {
-        // Initialize the string to be written to the file.
-        strcpy(str, "");
-
-        // Write a sample for each channel in the scan.
-        for (j = 0; j < numberOfChannels; j++)
+        // Convert as many rows as will fit in the text buffer.
+        write_status = hat_csv_format(
+            &read_buf[row * numberOfChannels], samplesPerChannel - row,
+            numberOfChannels, 6, text_buf, sizeof(text_buf), &rows_written,
+            &bytes_written);
+        if (write_status != RESULT_SUCCESS)
         {
-            // Convert the data sample to ASCII
-            sprintf(buf,"%2.6lf,", read_buf[scan_start_index+j]);
-
-            // Add the data sample to the string to be written.
-            strcat(str, buf);
+            // Break if the data could not be converted.
+            write_status = -2;
+            break;
         }
 
         // Write the ASCII scan data to the file.
-        write_status = fprintf(log_file_ptr, "%s\n", str);
-        if (write_status <= 0)
+        if (fwrite(text_buf, 1, bytes_written, log_file_ptr) != bytes_written)
         {
             // Break if an error occurred.
+            write_status = -1;
             break;
         }
+        write_status = bytes_written;
 
-        // Get the index to the start of the next scan.
-        scan_start_index += numberOfChannels;
+        row += rows_written;
     }
 
     // Flush the file to insure all data is written.
@@ -146,8 +146,11 @@ void set_enable_state_for_controls(gboolean state)
 
 // Copy the data for the specified channel from the interleaved 
 // HAT buffer to the array for the specified channel.
+// The index of each point is multiplied by x_scale so decimated data is
+// plotted against the original sample numbers.
 void copy_data_to_xy_arrays(double* hat_read_buf, int read_buf_start_index,
-    int channel, int stride, int buffer_size_samples, gboolean first_block)
+    int channel, int stride, int buffer_size_samples, gboolean first_block,
+    gfloat x_scale)
 {
     // Get the arrays for this channel
     gfloat* X = graphChannelInfo[channel].X;
@@ -162,7 +165,7 @@ void copy_data_to_xy_arrays(double* hat_read_buf, int read_buf_start_index,
         // Set indices and data
         for (int i = read_buf_start_index; i < buffer_size_samples; i+=stride)
         {
-            X[ii] = (gfloat)ii;
+            X[ii] = (gfloat)ii * x_scale;
             Y[ii] = (gfloat)hat_read_buf[i];
 
             ii++;
@@ -312,7 +315,7 @@ void analog_in_finite ()
             {
                 // Get the data for this channel
                 copy_data_to_xy_arrays(hat_read_buf, read_buf_index, channel,
-                    num_channels, buffer_size_samples, TRUE);
+                    num_channels, buffer_size_samples, TRUE, 1.0f);
 
                 // Graph the data
                 gfloat* X = graphChannelInfo[channel].X;
@@ -358,59 +361,315 @@ void analog_in_finite ()
 }
 
 
-// While the scan is running, read the data, write it to a 
-// CSV file, and plot it in the graph.
+// Report a log file write error on the main thread.
+static void show_log_file_error(int retval)
+{
+    static int error_code;
+
+    switch (retval)
+    {
+    case -1:
+        error_code = MAXIMUM_FILE_SIZE_EXCEEDED;
+        break;
+
+    default:
+        error_code = UNKNOWN_ERROR;
+        break;
+    }
+
+    // Error dialog must be displayed on the main thread.
+    g_main_context_invoke(context,
+        (GSourceFunc)show_mcc118_error_main_thread, &error_code);
+}
+
+
+// Create the blocks and queues that connect the pipeline stages.  Any blocks
+// left from the previous scan are freed first.  Called on the main thread.
+int pipeline_init(int num_channels)
+{
+    int i;
+
+    // Stop the display stage of the previous scan.
+    if (display_source_id != 0)
+    {
+        g_source_remove(display_source_id);
+        display_source_id = 0;
+    }
+    block_pool_destroy(block_pool, PIPELINE_BLOCKS);
+    free(display_buffer);
+    display_buffer = NULL;
+
+    block_pool = block_pool_create(PIPELINE_BLOCKS,
+        iNumSamplesPerChannel * num_channels);
+    if (block_pool == NULL)
+    {
+        return -1;
+    }
+
+    // Plot large blocks as the minimum and maximum of each bucket of samples,
+    // two points per bucket.
+    display_points = iNumSamplesPerChannel;
+    display_x_scale = 1.0f;
+    if (iNumSamplesPerChannel > DISPLAY_MAX_POINTS)
+    {
+        uint32_t bucket_size = (iNumSamplesPerChannel +
+            DISPLAY_MAX_POINTS / 2 - 1) / (DISPLAY_MAX_POINTS / 2);
+
+        if (hat_decimate_init(&display_decimator, (uint8_t)num_channels,
+            bucket_size) != RESULT_SUCCESS)
+        {
+            return -1;
+        }
+        display_buffer_size = 2 * num_channels *
+            (iNumSamplesPerChannel / bucket_size + 1);
+        display_buffer = (double*)malloc(display_buffer_size * sizeof(double));
+        if (display_buffer == NULL)
+        {
+            return -1;
+        }
+        display_points = 2 * (iNumSamplesPerChannel / bucket_size);
+        display_x_scale = (gfloat)bucket_size / 2.0f;
+    }
+
+    block_queue_init(&write_queue);
+    block_queue_init(&display_queue);
+    block_queue_init(&acquire_free_queue);
+    block_queue_init(&display_free_queue);
+
+    // All of the blocks start out free for the acquire stage.
+    for (i = 0; i < PIPELINE_BLOCKS; i++)
+    {
+        block_queue_push(&acquire_free_queue, &block_pool[i]);
+    }
+
+    pipeline_channels = num_channels;
+    display_first_block = TRUE;
+    __atomic_store_n(&acquire_finished, FALSE, __ATOMIC_RELEASE);
+    __atomic_store_n(&write_finished, FALSE, __ATOMIC_RELEASE);
+    return 0;
+}
+
+
+// Get a free block for the acquire stage, or NULL if every block is still
+// waiting to be written or displayed.
+static DataBlock* pipeline_free_block(void)
+{
+    DataBlock* block = block_queue_pop(&acquire_free_queue);
+
+    if (block == NULL)
+    {
+        block = block_queue_pop(&display_free_queue);
+    }
+    return block;
+}
+
+
+// Write stage: write each block to the log file, then pass it to the display
+// stage.  If the display stage has fallen behind, the block is recycled
+// without being displayed.  This function runs as a background thread for
+// the duration of the scan.
+static void * write_stage (void* arg)
+{
+    DataBlock* block;
+    gboolean write_error = FALSE;
+    int retval = 0;
+
+    (void)arg;
+
+    while (TRUE)
+    {
+        block = block_queue_pop(&write_queue);
+        if (block == NULL)
+        {
+            // Exit once the acquire stage has stopped and every block has
+            // been written.
+            if (__atomic_load_n(&acquire_finished, __ATOMIC_ACQUIRE) &&
+                block_queue_empty(&write_queue))
+            {
+                break;
+            }
+            usleep(1000);
+            continue;
+        }
+
+        if (!write_error)
+        {
+            // Write the data to a log file as CSV data
+            retval = write_log_file(log_file_ptr, block->data,
+                block->samples_per_channel, pipeline_channels);
+            if (retval < 0)
+            {
+                show_log_file_error(retval);
+
+                // Stop the acquisition.
+                write_error = TRUE;
+                done = TRUE;
+            }
+        }
+
+        if (!block_queue_push(&display_queue, block))
+        {
+            block_queue_push(&acquire_free_queue, block);
+        }
+    }
+
+    __atomic_store_n(&write_finished, TRUE, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+
+// Plot a block of data in the graph.  Called on the main thread.
+static void display_block(DataBlock* block)
+{
+    int chanMask = channel_mask;
+    int channel = 0;
+    int read_buf_index = 0;
+    double* data = block->data;
+    uint32_t samples_per_channel = block->samples_per_channel;
+    int buffer_size_samples;
+
+    if (display_buffer != NULL)
+    {
+        // Each block is plotted on its own, so start with an empty bucket.
+        hat_decimate_init(&display_decimator, display_decimator.channel_count,
+            display_decimator.bucket_size);
+        hat_decimate_minmax(&display_decimator, block->data,
+            block->samples_per_channel, display_buffer, display_buffer_size,
+            &samples_per_channel);
+        data = display_buffer;
+    }
+    buffer_size_samples = samples_per_channel * pipeline_channels;
+
+    // While there are channels to plot.
+    while (chanMask > 0)
+    {
+        // If this channel is included in the acquisition, plot its data.
+        if (chanMask & 1)
+        {
+            if (display_first_block)
+            {
+                // If this is the first block we need to set the indices and
+                // the data.
+                copy_data_to_xy_arrays(data, read_buf_index,
+                    channel, pipeline_channels, buffer_size_samples, TRUE,
+                    display_x_scale);
+
+                gfloat* X = graphChannelInfo[channel].X;
+                gfloat* Y = graphChannelInfo[channel].Y;
+
+                graphChannelInfo[channel].graph = gtk_databox_lines_new
+                    ((guint)display_points, X, Y,
+                    graphChannelInfo[channel].color, 2);
+
+                gtk_databox_graph_add(GTK_DATABOX (box),
+                    GTK_DATABOX_GRAPH(graphChannelInfo[channel].graph));
+
+                gtk_databox_set_total_limits(GTK_DATABOX (box), 0.0,
+                    (gfloat)iNumSamplesPerChannel, 10.0, -10.0);
+            }
+            else
+            {
+                // If this is not the first block, just update the data.
+                copy_data_to_xy_arrays(data, read_buf_index,
+                    channel, pipeline_channels, buffer_size_samples, FALSE,
+                    display_x_scale);
+            }
+
+            // Set the index to start at the first 
+            // sample of the next channel.
+            read_buf_index++;
+        }
+        channel++;
+        chanMask >>= 1;
+    }
+
+    display_first_block = FALSE;
+
+    refresh_graph(box);
+}
+
+
+// Display stage: plot the newest block and recycle any older blocks that
+// were not displayed, so a slow display drops frames rather than stalling
+// the acquisition.  Called periodically on the main thread.
+static gboolean display_stage(gpointer data)
+{
+    DataBlock* block;
+    DataBlock* newest = NULL;
+    gboolean finished;
+
+    (void)data;
+
+    // Check before emptying the queue so the last block is not missed.
+    finished = __atomic_load_n(&write_finished, __ATOMIC_ACQUIRE);
+
+    while ((block = block_queue_pop(&display_queue)) != NULL)
+    {
+        if (newest != NULL)
+        {
+            block_queue_push(&display_free_queue, newest);
+        }
+        newest = block;
+    }
+
+    if (newest != NULL)
+    {
+        display_block(newest);
+        block_queue_push(&display_free_queue, newest);
+    }
+
+    if (finished)
+    {
+        display_source_id = 0;
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+
+// Acquire stage: while the scan is running, read the data into free blocks
+// and pass them to the write stage.  The write and display stages run
+// separately so a slow SD card or graph redraw does not delay the reads.
 // This function runs as a background thread 
 // for the duration of the scan.
 static void * analog_in_continuous ()
 {
-
-    int chanMask = 0;
-    int channel = 0;
     uint32_t samples_read_per_channel = 0;
     uint32_t buffer_size_samples = 0;
     int retval = 0;
     uint16_t read_status;
+    DataBlock* block;
+    gboolean write_started = FALSE;
 
-    // Allocate arrays for the indices and data
-    // for each channel in the scan.
-    int num_channels = allocate_channel_xy_arrays(channel_mask,
-        iNumSamplesPerChannel);
+    int num_channels = pipeline_channels;
 
     // Set the timeout
     double scan_timeout = num_channels *
 		iNumSamplesPerChannel / iRatePerChannel * 10;
 
-    // Setup the sample buffer.
     buffer_size_samples = iNumSamplesPerChannel*num_channels;
-    double hat_read_buf[buffer_size_samples];
 
     // Write channel numbers to file header
 	retval = init_log_file(log_file_ptr, channel_mask);
 	if (retval < 0)
 	{
-		int error_code;
-		switch (retval)
-		{
-		case -1:
-			error_code = MAXIMUM_FILE_SIZE_EXCEEDED;
-			break;
-
-		default:
-			error_code = UNKNOWN_ERROR;
-			break;
-		}
+		show_log_file_error(retval);
 
-		// Error dialog must be displayed on the main thread.
-		g_main_context_invoke(context,
-			(GSourceFunc)show_mcc118_error_main_thread, &error_code);
-
-		// Call the Start/Stop event handler to reset the UI
-		start_stop_event_handler(btnStart_Stop, NULL);
-
-		return NULL;
+		// Stop the acquisition; the user resets the UI with the Stop button.
+		done = TRUE;
 	}
 
+    // Start the write stage.
+    if (pthread_create(&write_threadh, NULL, &write_stage, NULL) == 0)
+    {
+        write_started = TRUE;
+    }
+    else
+    {
+        printf("error creating thread..\n");
+        done = TRUE;
+    }
+
     // Wait for the scan to start running.
     do
     {
@@ -425,34 +684,26 @@ static void * analog_in_continuous ()
             // reset the app to start again
             g_print("Scan failure, Return code:  %d,  ReadStatus:  %d\n",
                 retval, read_status);
-            retval = mcc118_a_in_scan_stop(address);
-            if (retval != RESULT_SUCCESS)
-            {
-                show_mcc118_error(retval);
-            }
-
-            retval = mcc118_a_in_scan_cleanup(address);
-            if (retval != RESULT_SUCCESS)
-            {
-                show_mcc118_error(retval);
-            }
-
             done = TRUE;
-            pthread_join (threadh, NULL);
-
-            gtk_button_set_label (GTK_BUTTON(btnStart_Stop), "Start");
-            return NULL;
         }
-    } while ((retval == RESULT_SUCCESS) &&
+    } while ((done == FALSE) &&
              ((read_status & STATUS_RUNNING) != STATUS_RUNNING));
 
     // Loop to read data continuously
-    gboolean first_block = TRUE;
     while  (done == FALSE)
     {
+        // Get a free block.  If none are free the write stage is behind, so
+        // wait for it while the library buffers the scan data.
+        block = pipeline_free_block();
+        if (block == NULL)
+        {
+            usleep(1000);
+            continue;
+        }
+
         // Read the data from the device
         retval = mcc118_a_in_scan_read(address, &read_status,
-            iNumSamplesPerChannel, scan_timeout, hat_read_buf,
+            iNumSamplesPerChannel, scan_timeout, block->data,
             buffer_size_samples, &samples_read_per_channel);
 
         if (retval != RESULT_SUCCESS)
@@ -471,97 +722,22 @@ static void * analog_in_continuous ()
             break;
         }
 
-        // Write the data to a log file as CSV data
-        retval = write_log_file(log_file_ptr, hat_read_buf,
-            samples_read_per_channel, num_channels);
-        if (retval < 0)
-        {
-            int error_code;
-            switch (retval)
-            {
-            case -1:
-                error_code = MAXIMUM_FILE_SIZE_EXCEEDED;
-                break;
-
-            default:
-                error_code = UNKNOWN_ERROR;
-                break;
-            }
-
-            // Error dialog must be displayed on the main thread.
-            g_main_context_invoke(context,
-                (GSourceFunc)show_mcc118_error_main_thread, &error_code);
-
-            // Call the Start?Stop event handler to reset the UI
-            start_stop_event_handler(btnStart_Stop, NULL);
-
-            done = TRUE;
-
-            break;
-        }
-
-        // Set a mutex to prevent the data from changing while we plot it
-        g_mutex_lock (&data_mutex);
-
-        chanMask = channel_mask;
-        channel = 0;
-        int read_buf_index = 0;
-
-        // While there are channels to plot.
-        while (chanMask > 0)
-        {
-            // If this channel is included in the acquisition, plot its data.
-            if (chanMask & 1)
-            {
-                if (first_block)
-                {
-                    // If this is the first block we need to set the indices and
-                    // the data.
-                    copy_data_to_xy_arrays(hat_read_buf, read_buf_index,
-                        channel, num_channels, buffer_size_samples, TRUE);
-
-                    gfloat* X = graphChannelInfo[channel].X;
-                    gfloat* Y = graphChannelInfo[channel].Y;
-
-                    graphChannelInfo[channel].graph = gtk_databox_lines_new
-                        ((guint)iNumSamplesPerChannel, X, Y,
-                        graphChannelInfo[channel].color, 2);
-
-                    gtk_databox_graph_add(GTK_DATABOX (box),
-                        GTK_DATABOX_GRAPH(graphChannelInfo[channel].graph));
-
-                    gtk_databox_set_total_limits(GTK_DATABOX (box), 0.0,
-                        (gfloat)iNumSamplesPerChannel, 10.0, -10.0);
-                }
-                else
-                {
-                    // If this is not the first block, just update the data.
-                    copy_data_to_xy_arrays(hat_read_buf, read_buf_index,
-                        channel, num_channels, buffer_size_samples, FALSE);
-                }
-
-                // Set the index to start at the first 
-                // sample of the next channel.
-                read_buf_index++;
-            }
-            channel++;
-            chanMask >>= 1;
-        }
-
-        // Done with the data so fill the buffer with zeros.
-        memset(hat_read_buf, 0, buffer_size_samples * sizeof(double));
-
-        first_block = FALSE;
-
-        // Set the condition to cause the display 
-        // update function to update the display.
-        g_main_context_invoke(context, (GSourceFunc)refresh_graph, box);
-
-        // Release the mutex
-        g_mutex_unlock(&data_mutex);
+        // Pass the block to the write stage.  The queue holds every block,
+        // so it cannot be full.
+        block->samples_per_channel = samples_read_per_channel;
+        block_queue_push(&write_queue, block);
+    }
 
-        // Allow idle time for the display to update
-        usleep(1);
+    // Let the write stage finish the queued blocks.
+    __atomic_store_n(&acquire_finished, TRUE, __ATOMIC_RELEASE);
+    if (write_started)
+    {
+        pthread_join(write_threadh, NULL);
+    }
+    else
+    {
+        // Nothing was written; let the display stage finish.
+        __atomic_store_n(&write_finished, TRUE, __ATOMIC_RELEASE);
     }
 
     // Stop the scan.
@@ -645,6 +821,26 @@ void start_stop_event_handler(GtkWidget *widget, gpointer data)
 
         if ((options & OPTS_CONTINUOUS) == OPTS_CONTINUOUS)
         {
+            // Allocate arrays for the indices and data
+            // for each channel in the scan.
+            int num_channels = allocate_channel_xy_arrays(channel_mask,
+                iNumSamplesPerChannel);
+
+            // Create the pipeline and start the display stage, which runs
+            // on this thread.
+            if (pipeline_init(num_channels) != 0)
+            {
+                show_mcc118_error(RESULT_RESOURCE_UNAVAIL);
+                mcc118_a_in_scan_stop(address);
+                mcc118_a_in_scan_cleanup(address);
+                set_enable_state_for_controls(TRUE);
+                gtk_button_set_label(GTK_BUTTON(btnStart_Stop), "Start");
+                done = TRUE;
+                return;
+            }
+            display_source_id = g_timeout_add(DISPLAY_INTERVAL_MS,
+                display_stage, NULL);
+
             // If continuous scan, start a thread 
             // to read the data from the device
             if (pthread_create(&threadh, NULL, &analog_in_continuous, &tinfo) !=
@@ -668,9 +864,11 @@ void start_stop_event_handler(GtkWidget *widget, gpointer data)
         gtk_button_set_label(GTK_BUTTON(widget), "Start");
 
         done = TRUE;
-        retval =  mcc118_a_in_scan_cleanup(address);
 
+        // Wait for the acquire and write stages to finish before freeing
+        // the scan buffer they read from.
         pthread_join(threadh, NULL);
+        retval =  mcc118_a_in_scan_cleanup(address);
     }
 }
 
@@ -10,9 +10,42 @@
 #include "globals.h"
 #include "log_file.h"
 #include "errors.h"
+#include "pipeline.h"
+
+// Number of blocks passed between the pipeline stages
+#define PIPELINE_BLOCKS         BLOCK_QUEUE_SIZE
+// Time between display updates
+#define DISPLAY_INTERVAL_MS     50
+// Most points per channel plotted for each block of a continuous scan
+#define DISPLAY_MAX_POINTS      2000
 
 GtkWidget *labelFile;
 
+// Continuous scan pipeline: the acquire stage reads the scan into free blocks
+// and queues them for the write stage, which queues them for the display
+// stage.  Each queue has a single producer and consumer, so the free blocks
+// are returned on separate queues by the write and display stages.
+DataBlock* block_pool = NULL;
+BlockQueue write_queue;
+BlockQueue display_queue;
+BlockQueue acquire_free_queue;
+BlockQueue display_free_queue;
+int pipeline_channels;
+gboolean acquire_finished;
+gboolean write_finished;
+gboolean display_first_block;
+guint display_source_id = 0;
+pthread_t write_threadh;
+
+// Blocks larger than DISPLAY_MAX_POINTS are reduced to a min/max envelope
+// before they are plotted, so the graph redraw time depends on the width of
+// the display rather than the number of samples.
+struct HatMinMaxDecimator display_decimator;
+double* display_buffer = NULL;
+uint32_t display_buffer_size = 0;
+uint32_t display_points;
+gfloat display_x_scale;
+
 // function declarations
 void initialize_graph_channel_info (void);
 void show_file_name();
@@ -25,8 +58,10 @@ void set_enable_state_for_controls(gboolean state);
 
 gboolean refresh_graph(GtkWidget *box);
 void copy_data_to_xy_arrays(double* hat_read_buf, int read_buf_start_index,
-    int channel, int stride, int buffer_size_samples, gboolean first_block);
+    int channel, int stride, int buffer_size_samples, gboolean first_block,
+    gfloat x_scale);
 
+int pipeline_init(int num_channels);
 void analog_in_finite ();
 static void * analog_in_continuous ();
 
@@ -0,0 +1,104 @@
+#include <stdlib.h>
+#include "pipeline.h"
+
+
+// Initialize an empty queue.
+void block_queue_init(BlockQueue* queue)
+{
+    queue->head = 0;
+    queue->tail = 0;
+}
+
+
+// Add a block to the queue.  Only called by the producer thread.
+// Returns 1 if the block was added or 0 if the queue is full.
+int block_queue_push(BlockQueue* queue, DataBlock* block)
+{
+    unsigned int head = queue->head;
+    unsigned int tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+
+    if ((head - tail) >= BLOCK_QUEUE_SIZE)
+    {
+        return 0;
+    }
+
+    queue->blocks[head % BLOCK_QUEUE_SIZE] = block;
+
+    // Publish the block after it is stored.
+    __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+
+// Remove the oldest block from the queue.  Only called by the consumer
+// thread.  Returns NULL if the queue is empty.
+DataBlock* block_queue_pop(BlockQueue* queue)
+{
+    DataBlock* block;
+    unsigned int tail = queue->tail;
+    unsigned int head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+
+    if (head == tail)
+    {
+        return NULL;
+    }
+
+    block = queue->blocks[tail % BLOCK_QUEUE_SIZE];
+
+    // Free the slot after the block is read.
+    __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+    return block;
+}
+
+
+// Check if the queue is empty.
+int block_queue_empty(BlockQueue* queue)
+{
+    return __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) ==
+        __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+}
+
+
+// Allocate a set of blocks, each holding block_size samples.
+// Returns NULL if the memory could not be allocated.
+DataBlock* block_pool_create(int block_count, uint32_t block_size)
+{
+    DataBlock* pool;
+    int i;
+
+    pool = calloc(block_count, sizeof(DataBlock));
+    if (pool == NULL)
+    {
+        return NULL;
+    }
+
+    for (i = 0; i < block_count; i++)
+    {
+        pool[i].data = calloc(block_size, sizeof(double));
+        if (pool[i].data == NULL)
+        {
+            block_pool_destroy(pool, block_count);
+            return NULL;
+        }
+    }
+
+    return pool;
+}
+
+
+// Free a set of blocks allocated with block_pool_create.
+void block_pool_destroy(DataBlock* pool, int block_count)
+{
+    int i;
+
+    if (pool == NULL)
+    {
+        return;
+    }
+
+    for (i = 0; i < block_count; i++)
+    {
+        free(pool[i].data);
+    }
+    free(pool);
+}
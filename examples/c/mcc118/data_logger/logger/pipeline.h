@@ -0,0 +1,33 @@
+#ifndef PIPELINE_H_INCLUDED
+#define PIPELINE_H_INCLUDED
+
+#include <stdint.h>
+
+// Number of slots in a block queue; must be a power of 2.
+#define BLOCK_QUEUE_SIZE 16
+
+// A block of interleaved scan data passed between the pipeline stages.
+typedef struct data_block
+{
+    double*     data;
+    uint32_t    samples_per_channel;
+} DataBlock;
+
+// A bounded lock-free queue of blocks with one producer thread and one
+// consumer thread.
+typedef struct block_queue
+{
+    DataBlock*      blocks[BLOCK_QUEUE_SIZE];
+    unsigned int    head;       // next slot to write, owned by the producer
+    unsigned int    tail;       // next slot to read, owned by the consumer
+} BlockQueue;
+
+extern void block_queue_init(BlockQueue* queue);
+extern int block_queue_push(BlockQueue* queue, DataBlock* block);
+extern DataBlock* block_queue_pop(BlockQueue* queue);
+extern int block_queue_empty(BlockQueue* queue);
+
+extern DataBlock* block_pool_create(int block_count, uint32_t block_size);
+extern void block_pool_destroy(DataBlock* pool, int block_count);
+
+#endif // PIPELINE_H_INCLUDED
@@ -0,0 +1,390 @@
+#!/usr/bin/env python3
+#  -*- coding: utf-8 -*-
+"""
+This example demonstrates a web server that streams data from a MCC 118 DAQ
+HAT device to any number of clients over a WebSocket.  Unlike web_server.py,
+which polls the server and re-sends the whole chart as JSON on every update,
+the server reads the scan in an asyncio task, reduces it to a min/max envelope
+of about DISPLAY_POINTS points per window and pushes only the new points to
+each client as binary frames.  The work per update therefore depends on the
+width of the chart rather than the sample rate or the window length.  To
+install the dependencies for this example, run:
+   $ pip3 install aiohttp
+
+Running this example:
+1. Start the server by running the stream_server.py module in a terminal.
+   $ ./stream_server.py
+2. Open a web browser on a device on the same network as the host device and
+   enter http://<host>:8080 in the address bar,
+   replacing <host> with the IP Address or hostname of the host device.
+
+Other clients can connect to ws://<host>:8080/stream.  The first message is a
+JSON text message describing the stream:
+   {"channels": [0, 1], "sample_rate": 10000.0, "step": 100.0,
+    "window_points": 1000, "bucket_size": 200, "header_size": 20}
+Each following binary message is a frame holding a little-endian header
+   uint64 index of the first point, uint32 points per channel,
+   float32 samples per point (step), uint8 channel count, 3 bytes padding
+followed by the points as float32 values interleaved by channel.  Point i is
+at sample number i * step.  When bucket_size is not 0, each bucket of samples
+is sent as a pair of points, its minimum and maximum, so narrow peaks are kept.
+A JSON text message {"error": "..."} is sent if the scan stops.
+
+Each client has a short queue of frames.  If a client can't keep up, its oldest
+frames are dropped rather than slowing the scan or the other clients; the
+client sees a gap in the point index.
+
+Stopping this example:
+1. To stop the server press Ctrl+C in the terminal window where the server
+   was started.
+"""
+import asyncio
+import json
+import socket
+import struct
+from array import array
+from aiohttp import web, WSMsgType
+from daqhats import hat_list, mcc118, HatIDs, HatError, OptionFlags, \
+    MinMaxDecimator
+
+CHANNELS = [0, 1]
+SAMPLE_RATE = 10000.0       # Samples per second per channel
+WINDOW_SECONDS = 10.0       # Length of the strip chart
+DISPLAY_POINTS = 1000       # Points per channel in the strip chart
+UPDATES_PER_SECOND = 20
+CLIENT_QUEUE_FRAMES = 8     # Frames held for a slow client before dropping
+
+FRAME_HEADER = struct.Struct('<QIfB3x')
+
+INDEX_HTML = """<!DOCTYPE html>
+<html>
+<head>
+<meta charset="utf-8">
+<title>MCC 118 DAQ HAT Streaming Web Server Example</title>
+<style>
+  body { font-family: sans-serif; margin: 20px; }
+  canvas { width: 100%; height: 450px; border: 1px solid #ccc; }
+  #status { font-weight: bold; color: red; }
+</style>
+</head>
+<body>
+<h1>MCC 118 DAQ HAT Streaming Web Server Example</h1>
+<canvas id="chart"></canvas>
+<div id="legend"></div>
+<div id="status"></div>
+<script>
+var COLORS = ['#DD3222', '#FFC000', '#3482CB', '#FF6A00',
+              '#75B54A', '#808080', '#6E1911', '#806000'];
+var canvas = document.getElementById('chart');
+var config = null;
+var xs, ys, head = 0, length = 0, nextPoint = null, drawPending = false;
+
+function addPoint(x, values, offset) {
+  xs[head] = x;
+  for (var chan = 0; chan < ys.length; chan++) {
+    ys[chan][head] = values === null ? NaN : values[offset + chan];
+  }
+  head = (head + 1) % xs.length;
+  length = Math.min(length + 1, xs.length);
+}
+
+function onFrame(buffer) {
+  var view = new DataView(buffer);
+  var first = view.getUint32(0, true) + view.getUint32(4, true) * 4294967296;
+  var count = view.getUint32(8, true);
+  var step = view.getFloat32(12, true);
+  var channels = view.getUint8(16);
+  var values = new Float32Array(buffer, config.header_size, count * channels);
+
+  if (nextPoint !== null && first !== nextPoint) {
+    // Frames were dropped, so break the lines.
+    addPoint(first * step, null, 0);
+  }
+  for (var i = 0; i < count; i++) {
+    addPoint((first + i) * step, values, i * channels);
+  }
+  nextPoint = first + count;
+
+  if (!drawPending) {
+    drawPending = true;
+    window.requestAnimationFrame(draw);
+  }
+}
+
+function draw() {
+  drawPending = false;
+  var width = canvas.width = canvas.clientWidth;
+  var height = canvas.height = canvas.clientHeight;
+  var ctx = canvas.getContext('2d');
+  if (length === 0) {
+    return;
+  }
+  var newest = (head + xs.length - 1) % xs.length;
+  var xMax = xs[newest];
+  var xMin = xMax - config.window_points * config.step;
+  var xScale = width / (xMax - xMin);
+  var yScale = height / 20.0;
+
+  for (var chan = 0; chan < ys.length; chan++) {
+    ctx.strokeStyle = COLORS[config.channels[chan]];
+    ctx.beginPath();
+    var penDown = false;
+    for (var i = 0; i < length; i++) {
+      var index = (head - length + i + xs.length) % xs.length;
+      var y = ys[chan][index];
+      if (isNaN(y)) {
+        penDown = false;
+        continue;
+      }
+      var px = (xs[index] - xMin) * xScale;
+      var py = (10.0 - y) * yScale;
+      if (penDown) {
+        ctx.lineTo(px, py);
+      } else {
+        ctx.moveTo(px, py);
+        penDown = true;
+      }
+    }
+    ctx.stroke();
+  }
+}
+
+var ws = new WebSocket('ws://' + window.location.host + '/stream');
+ws.binaryType = 'arraybuffer';
+ws.onmessage = function (event) {
+  if (typeof event.data !== 'string') {
+    onFrame(event.data);
+    return;
+  }
+  var message = JSON.parse(event.data);
+  if (message.error) {
+    document.getElementById('status').textContent = message.error;
+    return;
+  }
+  config = message;
+  xs = new Float64Array(config.window_points);
+  ys = config.channels.map(function () {
+    return new Float32Array(config.window_points);
+  });
+  document.getElementById('legend').innerHTML = config.channels.map(
+    function (channel) {
+      return '<span style="color:' + COLORS[channel] + '">Channel ' +
+        channel + '</span>';
+    }).join(' ');
+};
+ws.onclose = function () {
+  document.getElementById('status').textContent = 'Disconnected';
+};
+</script>
+</body>
+</html>
+"""
+
+
+class StreamClient(object):
+    """
+    A connected client and the frames waiting to be sent to it.
+    """
+    def __init__(self):
+        self.queue = asyncio.Queue(maxsize=CLIENT_QUEUE_FRAMES)
+        self.dropped = 0
+
+    def send(self, message):
+        """
+        Queue a message for the client, dropping the oldest frame if the
+        client has fallen behind.
+
+        Args:
+            message (bytes or str): A binary frame or a JSON text message.
+        """
+        if self.queue.full():
+            self.queue.get_nowait()
+            self.dropped += 1
+        self.queue.put_nowait(message)
+
+
+def make_frame(first_point, step, num_channels, points):
+    """
+    Creates a binary frame from points interleaved by channel.
+
+    Args:
+        first_point (int): The index of the first point in the stream.
+        step (float): The number of samples per point.
+        num_channels (int): The number of channels.
+        points (array.array): The points, interleaved by channel.
+
+    Returns:
+        bytes: The frame.
+    """
+    count = len(points) // num_channels
+    return (FRAME_HEADER.pack(first_point, count, step, num_channels) +
+            array('f', points).tobytes())
+
+
+def get_stream_config():
+    """
+    Calculates the number of samples per point for the configured window.
+
+    Returns:
+        tuple: The min/max bucket size in samples per channel, or 0 to send
+        every sample, and the number of samples per point.
+    """
+    window_samples = int(WINDOW_SECONDS * SAMPLE_RATE)
+    bucket_size = -(-window_samples // (DISPLAY_POINTS // 2))
+    if bucket_size <= 2:
+        # Min/max pairs would not reduce the data.
+        return 0, 1.0
+    return bucket_size, bucket_size / 2.0
+
+
+async def read_scan(app):
+    """
+    Reads the scan and queues the new points for each client.  Runs as a
+    task for the life of the server.
+
+    Args:
+        app (aiohttp.web.Application): The application.
+    """
+    hat = app['hat']
+    clients = app['clients']
+    num_channels = len(CHANNELS)
+    bucket_size, step = get_stream_config()
+    decimator = None
+    if bucket_size > 0:
+        decimator = MinMaxDecimator(num_channels, bucket_size)
+
+    channel_mask = 0x0
+    for channel in CHANNELS:
+        channel_mask |= 1 << channel
+    block_size = max(1, int(SAMPLE_RATE / UPDATES_PER_SECOND))
+    # Buffer 5 seconds of data
+    samples_to_buffer = int(5 * SAMPLE_RATE)
+
+    hat.a_in_scan_start(channel_mask, samples_to_buffer, SAMPLE_RATE,
+                        OptionFlags.CONTINUOUS)
+    next_point = 0
+    stream = hat.a_in_scan_stream(block_size)
+    try:
+        async for block in stream:
+            points = block if decimator is None else decimator.process(block)
+            if not points:
+                continue
+            frame = make_frame(next_point, step, num_channels, points)
+            next_point += len(points) // num_channels
+            for client in clients:
+                client.send(frame)
+    except HatError as error:
+        message = json.dumps({'error': str(error)})
+        for client in clients:
+            client.send(message)
+    finally:
+        # the event loop must stop watching the scan before it is cleaned up
+        stream.close()
+        hat.a_in_scan_stop()
+        hat.a_in_scan_cleanup()
+
+
+async def index_handler(_request):
+    """ Serves the strip chart page. """
+    return web.Response(text=INDEX_HTML, content_type='text/html')
+
+
+async def send_frames(ws, client):
+    """
+    Sends queued frames to a client.  Sending waits while the client's socket
+    buffer is full, so the client's queue fills and old frames are dropped.
+
+    Args:
+        ws (aiohttp.web.WebSocketResponse): The client's WebSocket.
+        client (StreamClient): The client.
+    """
+    while True:
+        message = await client.queue.get()
+        if isinstance(message, str):
+            await ws.send_str(message)
+        else:
+            await ws.send_bytes(message)
+
+
+async def stream_handler(request):
+    """
+    Streams frames to a WebSocket client until it disconnects.
+    """
+    bucket_size, step = get_stream_config()
+    ws = web.WebSocketResponse()
+    await ws.prepare(request)
+    await ws.send_str(json.dumps({
+        'channels': CHANNELS,
+        'sample_rate': SAMPLE_RATE,
+        'step': step,
+        'window_points': int(WINDOW_SECONDS * SAMPLE_RATE / step),
+        'bucket_size': bucket_size,
+        'header_size': FRAME_HEADER.size}))
+
+    client = StreamClient()
+    request.app['clients'].add(client)
+    sender = asyncio.ensure_future(send_frames(ws, client))
+    try:
+        # The page sends nothing; reading handles the close handshake.
+        async for message in ws:
+            if message.type == WSMsgType.ERROR:
+                break
+    finally:
+        sender.cancel()
+        request.app['clients'].discard(client)
+        if client.dropped > 0:
+            print('Client dropped {} frames'.format(client.dropped))
+    return ws
+
+
+async def start_reader(app):
+    """ Starts the scan when the server starts. """
+    app['reader'] = asyncio.ensure_future(read_scan(app))
+
+
+async def stop_reader(app):
+    """ Stops the scan when the server stops. """
+    app['reader'].cancel()
+    try:
+        await app['reader']
+    except asyncio.CancelledError:
+        pass
+
+
+def get_ip_address():
+    """ Utility function to get the IP address of the device. """
+    ip_address = '127.0.0.1'  # Default to localhost
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+
+    try:
+        sock.connect(('1.1.1.1', 1))  # Does not have to be reachable
+        ip_address = sock.getsockname()[0]
+    finally:
+        sock.close()
+
+    return ip_address
+
+
+def main():
+    """
+    This function is executed automatically when the module is run directly.
+    """
+    hats = hat_list(filter_by_id=HatIDs.MCC_118)
+    if not hats:
+        print('No MCC 118 HAT devices found')
+        return
+
+    app = web.Application()
+    app['hat'] = mcc118(hats[0].address)
+    app['clients'] = set()
+    app.router.add_get('/', index_handler)
+    app.router.add_get('/stream', stream_handler)
+    app.on_startup.append(start_reader)
+    app.on_cleanup.append(stop_reader)
+
+    web.run_app(app, host=get_ip_address(), port=8080)
+
+
+if __name__ == '__main__':
+    # This will only be run when the module is called directly.
+    main()
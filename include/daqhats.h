@@ -66,6 +66,10 @@ enum ResultCode
 #define OPTS_EXTTRIGGER         (0x0008)
 /// Run until explicitly stopped.
 #define OPTS_CONTINUOUS         (0x0010)
+/// Restart a continuous scan after an overrun instead of stopping.
+#define OPTS_AUTORECOVER        (0x0020)
+/// Re-arm a finite triggered scan after each capture.
+#define OPTS_RETRIGGER          (0x0040)
 
 /// Contains information about a specific board.
 struct HatInfo
@@ -80,6 +84,41 @@ struct HatInfo
     char product_name[256];
 };
 
+/// Statistics for the interrupt callback function.
+struct HatCallbackStats
+{
+    /// The number of times the callback was called.
+    uint64_t count;
+    /// The mean time in seconds from the interrupt edge to the callback 
+    /// returning.
+    double mean_latency;
+    /// The longest time in seconds from the interrupt edge to the callback 
+    /// returning.
+    double max_latency;
+};
+
+/// The maximum number of channels for struct HatMinMaxDecimator.
+#define HAT_DECIMATE_MAX_CHANNELS   8
+
+/// State for min/max decimation of scan data, see hat_decimate_minmax().
+struct HatMinMaxDecimator
+{
+    /// The number of samples per channel in each bucket.
+    uint32_t bucket_size;
+    /// The number of samples per channel in the current, partial bucket.
+    uint32_t count;
+    /// The number of channels in each sample.
+    uint8_t channel_count;
+    /// The minimum value of each channel in the current bucket.
+    double min[HAT_DECIMATE_MAX_CHANNELS];
+    /// The maximum value of each channel in the current bucket.
+    double max[HAT_DECIMATE_MAX_CHANNELS];
+    /// The position of the minimum value in the current bucket.
+    uint32_t min_index[HAT_DECIMATE_MAX_CHANNELS];
+    /// The position of the maximum value in the current bucket.
+    uint32_t max_index[HAT_DECIMATE_MAX_CHANNELS];
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -93,6 +132,11 @@ extern "C" {
 *   multiple boards you must extract the EEPROM images using the
 *   \b daqhats_read_eeproms tool.
 *
+*   The board information is read once and cached by the library.  The cache
+*   is refreshed automatically when the EEPROM images in /etc/mcc/hats change,
+*   such as when \b daqhats_read_eeproms is run, so calling this function 
+*   frequently does not read the files each time.
+*
 *   Example usage:
 *   @code
 *       int count = hat_list(HAT_ID_ANY, NULL);
@@ -123,6 +167,50 @@ extern "C" {
 */
 int hat_list(uint16_t filter_id, struct HatInfo* list);
 
+/**
+*   Set the root directory used to find the DAQ HAT board information.
+*
+*   The board information used by hat_list() and the board open functions is
+*   read from /proc/device-tree/hat and /etc/mcc/hats.  This function places
+*   both directories below another root directory, for example to use EEPROM 
+*   images prepared for a container or a test fixture.  The cached information
+*   is discarded and read again from the new location when it is next used.
+*
+*   @param path     The root directory, or NULL or "" for the system root.
+*   @return [RESULT_SUCCESS](@ref RESULT_SUCCESS) or
+*       [RESULT_BAD_PARAMETER](@ref RESULT_BAD_PARAMETER) if the path is longer
+*       than 255 characters.
+*/
+int hat_set_root_directory(const char* path);
+
+/**
+*   Open every detected DAQ HAT board.
+*
+*   Each board is opened in its own thread, so reading and parsing the board
+*   information for one board overlaps the others.  Transfers on the SPI bus
+*   are still made one at a time, under the same lock that other threads and
+*   processes use.  The calibration data parsed from the EEPROM is saved in
+*   $XDG_CACHE_HOME/daqhats or ~/.cache/daqhats and used by later opens of the
+*   same board, as long as the EEPROM contents have not changed.
+*
+*   Each board that opens successfully must be closed with the close function
+*   for its type, such as mcc118_close().  Boards with an ID that does not have
+*   an open function report [RESULT_INVALID_DEVICE](@ref RESULT_INVALID_DEVICE).
+*
+*   @param filter_id  An optional [ID](@ref HatIDs) filter to only open boards
+*       with a specific ID. Use [HAT_ID_ANY](@ref HAT_ID_ANY) to open all
+*       boards.
+*   @param list    A pointer to a user-allocated array of
+*       [MAX_NUMBER_HATS](@ref MAX_NUMBER_HATS) struct HatInfo that receives
+*       the information about the boards, in the same order as hat_list(), or
+*       NULL.
+*   @param results  A pointer to a user-allocated array of
+*       [MAX_NUMBER_HATS](@ref MAX_NUMBER_HATS) int that receives the
+*       [result code](@ref ResultCode) of opening each board, or NULL.
+*   @return The number of boards found.
+*/
+int hat_open_all(uint16_t filter_id, struct HatInfo* list, int* results);
+
 /**
 *   Return a text description for a DAQ HAT result code.
 *
@@ -132,6 +220,87 @@ int hat_list(uint16_t filter_id, struct HatInfo* list);
 */
 const char* hat_error_message(int result);
 
+/**
+*   Format scan data as comma-separated text.
+*
+*   Converts interleaved scan data, such as the data read by 
+*   mcc118_a_in_scan_read(), into CSV text with one row per sample and one 
+*   column per channel.  Each value is written with a fixed number of decimal 
+*   places, the same as printf("%.*f"), but without the overhead of printf, so 
+*   large blocks of data can be logged at high scan rates.  Values with a 
+*   magnitude of 1e15 or more are written in exponent notation.
+*
+*   The text is not NUL-terminated.  Rows are only written when they fit 
+*   completely in \b buffer; a buffer of 64 KB or more is recommended so the 
+*   text can be written to a file with few system calls.  Call the function 
+*   again with the remaining data when fewer rows are written than requested.
+*
+*   @param data     The scan data, interleaved by channel.
+*   @param samples_per_channel  The number of samples per channel in \b data.
+*   @param channel_count    The number of channels in each sample (1 - 255).
+*   @param decimals     The number of decimal places to write (0 - 9).
+*   @param buffer   Receives the text.
+*   @param buffer_size  The size of \b buffer in bytes.  It must hold at least
+*       32 bytes per channel.
+*   @param samples_per_channel_written  Receives the number of rows written.
+*   @param bytes_written    Receives the number of bytes written.
+*   @return [RESULT_SUCCESS](@ref RESULT_SUCCESS) or
+*       [RESULT_BAD_PARAMETER](@ref RESULT_BAD_PARAMETER).
+*/
+int hat_csv_format(const double* data, uint32_t samples_per_channel,
+    uint8_t channel_count, uint8_t decimals, char* buffer,
+    uint32_t buffer_size, uint32_t* samples_per_channel_written,
+    uint32_t* bytes_written);
+
+/**
+*   Initialize the state for min/max decimation.
+*
+*   Call this before the first call to hat_decimate_minmax() and whenever a new
+*   scan is started.
+*
+*   @param state    The decimation state to initialize.
+*   @param channel_count    The number of channels in each sample (1 - 
+*       [HAT_DECIMATE_MAX_CHANNELS](@ref HAT_DECIMATE_MAX_CHANNELS)).
+*   @param bucket_size  The number of samples per channel that are reduced to 
+*       one minimum and one maximum, usually the number of samples per channel
+*       being displayed divided by the width of the plot in pixels.
+*   @return [RESULT_SUCCESS](@ref RESULT_SUCCESS) or
+*       [RESULT_BAD_PARAMETER](@ref RESULT_BAD_PARAMETER).
+*/
+int hat_decimate_init(struct HatMinMaxDecimator* state, uint8_t channel_count,
+    uint32_t bucket_size);
+
+/**
+*   Reduce scan data to a min/max envelope for display.
+*
+*   Each bucket of \b bucket_size samples per channel is reduced to two samples
+*   per channel: the minimum and the maximum of the bucket, in the order they
+*   occurred.  Plotting the result draws the same envelope as plotting every 
+*   sample, so narrow peaks are not lost, while the number of points scales 
+*   with the width of the plot rather than the scan rate.
+*
+*   The function can be called with each block of data as it is read.  A
+*   partial bucket at the end of \b data is kept in \b state and completed by 
+*   the next call.  The output is interleaved by channel in the same way as the
+*   input.
+*
+*   @param state    The decimation state, initialized with hat_decimate_init().
+*   @param data     The scan data, interleaved by channel.
+*   @param samples_per_channel  The number of samples per channel in \b data.
+*   @param buffer   Receives the decimated data.
+*   @param buffer_size_samples  The size of \b buffer in samples (not bytes). 
+*       It must hold two samples per channel for every bucket completed by this
+*       call; 2 * channel_count * (samples_per_channel / bucket_size + 1) 
+*       samples is always enough.
+*   @param samples_per_channel_written  Receives the number of samples per 
+*       channel written to \b buffer.
+*   @return [RESULT_SUCCESS](@ref RESULT_SUCCESS) or
+*       [RESULT_BAD_PARAMETER](@ref RESULT_BAD_PARAMETER).
+*/
+int hat_decimate_minmax(struct HatMinMaxDecimator* state, const double* data,
+    uint32_t samples_per_channel, double* buffer,
+    uint32_t buffer_size_samples, uint32_t* samples_per_channel_written);
+
 /**
 *   Read the current interrupt status.
 *
@@ -148,7 +317,15 @@ int hat_interrupt_state(void);
 *   Wait for an interrupt to occur.
 *
 *   It waits for the interrupt signal to become active, with a timeout
-*   parameter.
+*   parameter. The wait blocks in the kernel on the GPIO character device 
+*   (or sysfs on older kernels) without periodic wakeups.  If an interrupt 
+*   callback or interrupt file descriptor is active in this process, the wait 
+*   is woken by its handler instead.
+*
+*   The GPIO character device lets only one process use the interrupt signal 
+*   at a time.  If another process is already using it, the signal is polled 
+*   every millisecond instead, so several processes can still wait for 
+*   interrupts at the same time.
 *
 *   @param timeout  Wait timeout in milliseconds. -1 to wait forever, 0 to
 *       return immediately.
@@ -158,6 +335,22 @@ int hat_interrupt_state(void);
 */
 int hat_wait_for_interrupt(int timeout);
 
+/**
+*   Read the time of the most recent interrupt.
+*
+*   Returns the CLOCK_MONOTONIC time, in nanoseconds, of the last interrupt 
+*   edge seen by the callback handler or hat_wait_for_interrupt().  When the 
+*   GPIO character device is available the time is captured by the kernel when 
+*   the edge occurs, so it is not affected by thread scheduling delays; 
+*   otherwise it is the time the library received the interrupt.
+*
+*   @param timestamp_ns Receives the time in nanoseconds.
+*   @return [RESULT_SUCCESS](@ref RESULT_SUCCESS), or
+*       [RESULT_RESOURCE_UNAVAIL](@ref RESULT_RESOURCE_UNAVAIL) if no interrupt 
+*       has been seen.
+*/
+int hat_interrupt_timestamp(uint64_t* timestamp_ns);
+
 /**
 *   Enable an interrupt callback function.
 *
@@ -185,6 +378,10 @@ int hat_wait_for_interrupt(int timeout);
 *
 *   The callback function may be disabled with hat_interrupt_callback_disable().
 *
+*   If another process is already using the interrupt signal, the signal is 
+*   polled every millisecond and the callback is called when it becomes 
+*   active, without a kernel timestamp.
+*
 *   @param function     The callback function.
 *   @param user_data    The data to pass to the callback function.
 *   @return [RESULT_SUCCESS](@ref RESULT_SUCCESS) or 
@@ -192,6 +389,22 @@ int hat_wait_for_interrupt(int timeout);
 */
 int hat_interrupt_callback_enable(void (*function)(void*), void* user_data);
 
+/**
+*   Read the interrupt callback statistics.
+*
+*   The callback runs on the library interrupt dispatcher thread, which waits 
+*   on all interrupt sources with one epoll instance.  The latency is measured 
+*   from the kernel timestamp of the interrupt edge, so it includes both the 
+*   dispatch delay and the time spent in the callback.  The statistics are 
+*   reset when the callback is enabled.
+*
+*   @param stats    Receives the statistics.
+*   @return [RESULT_SUCCESS](@ref RESULT_SUCCESS), or
+*       [RESULT_RESOURCE_UNAVAIL](@ref RESULT_RESOURCE_UNAVAIL) if no callback 
+*       is enabled.
+*/
+int hat_interrupt_callback_stats(struct HatCallbackStats* stats);
+
 /**
 *   Disable interrupt callbacks.
 *
@@ -202,6 +415,35 @@ int hat_interrupt_callback_enable(void (*function)(void*), void* user_data);
 */
 int hat_interrupt_callback_disable(void);
 
+/**
+*   Get a file descriptor for waiting on interrupts in an event loop.
+*
+*   Returns a file descriptor that becomes readable each time the DAQ HAT 
+*   interrupt signal becomes active, so the interrupt can be waited for with 
+*   poll(), epoll or an event loop instead of a blocking thread.  Read 8 bytes 
+*   from it to clear it; it is non-blocking, and several interrupts may be 
+*   combined into one read.  The descriptor is created on the first call and 
+*   later calls return the same one.  It uses the same interrupt handler as 
+*   hat_interrupt_callback_enable() and may be used at the same time as a 
+*   callback.
+*
+*   @param fd   Receives the file descriptor.  Do not close it; use 
+*       hat_interrupt_fd_close().
+*   @return [RESULT_SUCCESS](@ref RESULT_SUCCESS), 
+*       [RESULT_RESOURCE_UNAVAIL](@ref RESULT_RESOURCE_UNAVAIL) if the 
+*       descriptor could not be created, or 
+*       [RESULT_UNDEFINED](@ref RESULT_UNDEFINED).
+*/
+int hat_interrupt_fd_open(int* fd);
+
+/**
+*   Close the file descriptor returned by hat_interrupt_fd_open().
+*
+*   @return [RESULT_SUCCESS](@ref RESULT_SUCCESS) or
+*       [RESULT_UNDEFINED](@ref RESULT_UNDEFINED).
+*/
+int hat_interrupt_fd_close(void);
+
 #ifdef __cplusplus
 }
 #endif
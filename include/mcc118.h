@@ -52,7 +52,85 @@ enum TriggerMode
 #define STATUS_TRIGGERED        (0x0004)
 /// The scan is running (actively acquiring data.)
 #define STATUS_RUNNING          (0x0008)
+/// Data was lost and the scan recovered; read the gaps with 
+/// mcc118_a_in_scan_read_gaps().
+#define STATUS_GAP              (0x0010)
 
+/// A gap in the data from an auto-recovering scan.
+struct MCC118ScanGap
+{
+    /// The per-channel index in the scan data of the first sample after the 
+    /// gap.
+    uint64_t sample_index;
+    /// The number of samples per channel that were lost (estimated for 
+    /// hardware overruns.)
+    uint64_t samples_lost;
+};
+
+/// Scan transfer profiles for mcc118_a_in_scan_config_preset().
+enum ScanProfile
+{
+    /// Balanced settings, read data at least every 100 ms.
+    SCAN_PROFILE_DEFAULT        = 0,
+    /// Small, frequent reads for the lowest delay between acquisition and 
+    /// availability in the scan buffer.
+    SCAN_PROFILE_LOW_LATENCY    = 1,
+    /// Large, infrequent reads for the lowest CPU and SPI bus overhead.
+    SCAN_PROFILE_THROUGHPUT     = 2
+};
+
+/// Sample formats for mcc118_a_in_scan_read_format().
+enum SampleFormat
+{
+    /// 8-byte \b double values, the same as mcc118_a_in_scan_read().
+    SAMPLE_FORMAT_DOUBLE        = 0,
+    /// 4-byte \b float values.
+    SAMPLE_FORMAT_FLOAT         = 1,
+    /// 2-byte \b uint16_t ADC codes. The scan must be started with 
+    /// [OPTS_NOSCALEDATA](@ref OPTS_NOSCALEDATA) and 
+    /// [OPTS_NOCALIBRATEDATA](@ref OPTS_NOCALIBRATEDATA).
+    SAMPLE_FORMAT_RAW           = 2
+};
+
+/// Scan transfer settings that trade latency for throughput.
+struct MCC118ScanConfig
+{
+    /// The longest time in seconds that acquired data should wait on the 
+    /// device before being transferred to the scan buffer.
+    double target_latency;
+    /// The maximum number of samples transferred from the device in one read 
+    /// (2 - 2045.)
+    uint16_t max_block_size;
+    /// The minimum time in microseconds between device status reads.
+    uint32_t min_poll_interval_us;
+};
+
+
+/// Statistics for software-timed sampling.
+struct MCC118SamplerStats
+{
+    /// The number of samples acquired.
+    uint64_t sample_count;
+    /// The number of sample times that were skipped because a read was late.
+    uint64_t missed_deadlines;
+    /// The number of samples dropped because the buffer was full.
+    uint64_t buffer_overruns;
+    /// The number of samples per channel waiting in the buffer.
+    uint32_t samples_available;
+    /// The [result code](@ref ResultCode) of the most recent failed read, or 
+    /// 0.
+    int last_error;
+    /// The achieved sample rate in S/s.
+    double actual_rate;
+    /// The mean delay in seconds between the sample deadline and the read.
+    double jitter_mean;
+    /// The median delay in seconds (10 us resolution.)
+    double jitter_p50;
+    /// The 99th percentile delay in seconds (10 us resolution.)
+    double jitter_p99;
+    /// The largest delay in seconds.
+    double jitter_max;
+};
 
 #ifdef __cplusplus
 extern "C" {
@@ -215,6 +293,28 @@ int mcc118_calibration_coefficient_write(uint8_t address, uint8_t channel,
 int mcc118_a_in_read(uint8_t address, uint8_t channel, uint32_t options, 
     double* value);
 
+/**
+*   @brief Read several analog input channels in one operation.
+*
+*   Reads each channel in \b channel_mask like mcc118_a_in_read() but obtains 
+*   the SPI bus lock and selects the board only once for all of the channels, 
+*   so other processes cannot interleave with the reads and the per-read 
+*   overhead is lower.
+*
+*   @param address  The board address (0 - 7). Board must already be opened.
+*   @param channel_mask A bit mask of the channels to read, the LSB 
+*       corresponds to channel 0.
+*   @param options  Options bitmask, the same as mcc118_a_in_read().
+*   @param values   Receives one value for each bit set in \b channel_mask, 
+*       in order of increasing channel number.  Must hold at least as many 
+*       values as there are channels in the mask; for example, a mask of 0x05 
+*       returns channel 0 in values[0] and channel 2 in values[1].
+*   @return [Result code](@ref ResultCode), 
+*       [RESULT_SUCCESS](@ref RESULT_SUCCESS) if successful.
+*/
+int mcc118_a_in_read_multi(uint8_t address, uint8_t channel_mask, 
+    uint32_t options, double* values);
+
 /**
 *   @brief Set the trigger input mode.
 *
@@ -247,6 +347,52 @@ int mcc118_trigger_mode(uint8_t address, uint8_t mode);
 int mcc118_a_in_scan_actual_rate(uint8_t channel_count, 
     double sample_rate_per_channel, double* actual_sample_rate_per_channel);
 
+/**
+*   @brief Fill a struct MCC118ScanConfig with the settings for a profile.
+*
+*   This function does not perform any actions with a board; pass the result to
+*   mcc118_a_in_scan_config_write() to use it.
+*
+*   @param profile  The [profile](@ref ScanProfile).
+*   @param config   Receives the settings.
+*   @return [Result code](@ref ResultCode), 
+*       [RESULT_SUCCESS](@ref RESULT_SUCCESS) if successful.
+*/
+int mcc118_a_in_scan_config_preset(uint8_t profile, 
+    struct MCC118ScanConfig* config);
+
+/**
+*   @brief Set the scan transfer settings used by subsequent scans.
+*
+*   The scan thread reads data from the device once a threshold of samples 
+*   has been acquired, sized so the data is read within \b target_latency, and 
+*   no larger than half of \b max_block_size. Status reads back off from
+*   \b min_poll_interval_us up to half of \b target_latency while waiting for 
+*   data. Lower latency settings increase CPU and SPI bus usage. The settings 
+*   default to [SCAN_PROFILE_DEFAULT](@ref SCAN_PROFILE_DEFAULT) when the board 
+*   is opened.
+*
+*   This function will return RESULT_BUSY if called while a scan is active.
+*
+*   @param address  The board address (0 - 7). Board must already be opened.
+*   @param config   The new settings.
+*   @return [Result code](@ref ResultCode), 
+*       [RESULT_SUCCESS](@ref RESULT_SUCCESS) if successful.
+*/
+int mcc118_a_in_scan_config_write(uint8_t address, 
+    struct MCC118ScanConfig* config);
+
+/**
+*   @brief Read the scan transfer settings.
+*
+*   @param address  The board address (0 - 7). Board must already be opened.
+*   @param config   Receives the current settings.
+*   @return [Result code](@ref ResultCode), 
+*       [RESULT_SUCCESS](@ref RESULT_SUCCESS) if successful.
+*/
+int mcc118_a_in_scan_config_read(uint8_t address, 
+    struct MCC118ScanConfig* config);
+
 /**
 *   @brief Start a hardware-paced analog input scan.
 *
@@ -288,6 +434,23 @@ int mcc118_a_in_scan_actual_rate(uint8_t channel_count,
 *           data to a circular buffer. The data must be read before being 
 *           overwritten to avoid a buffer overrun error. \b samples_per_channel 
 *           is only used for buffer sizing.
+*       - [OPTS_AUTORECOVER](@ref OPTS_AUTORECOVER): Only valid with 
+*           [OPTS_CONTINUOUS](@ref OPTS_CONTINUOUS). Instead of ending the scan 
+*           on an overrun, the library restarts the device scan after a 
+*           hardware overrun or discards incoming data while the scan buffer 
+*           is full, and records the lost data as a gap. The gaps are read with 
+*           mcc118_a_in_scan_read_gaps() and 
+*           [STATUS_GAP](@ref STATUS_GAP) is set in the scan status while 
+*           there are unread gaps.
+*       - [OPTS_RETRIGGER](@ref OPTS_RETRIGGER): Only valid with 
+*           [OPTS_EXTTRIGGER](@ref OPTS_EXTTRIGGER) for a finite scan. After 
+*           each capture of \b samples_per_channel completes, the scan thread 
+*           immediately re-arms the device to wait for the next trigger, and 
+*           the scan runs until stopped with mcc118_a_in_scan_stop(). Each 
+*           capture is a numbered segment in the scan buffer that is read with 
+*           mcc118_a_in_scan_read_segment(). Sample times from 
+*           mcc118_a_in_scan_sample_time() are only valid for the segment 
+*           currently being acquired.
 *
 *   The options parameter is set to 0 or [OPTS_DEFAULT](@ref OPTS_DEFAULT) for 
 *   default operation, which is scaled and calibrated data, internal scan clock, 
@@ -382,6 +545,8 @@ int mcc118_a_in_scan_buffer_size(uint8_t address,
 *       - [STATUS_TRIGGERED](@ref STATUS_TRIGGERED): The trigger conditions have 
 *           been met.
 *       - [STATUS_RUNNING](@ref STATUS_RUNNING): The scan is running.
+*       - [STATUS_GAP](@ref STATUS_GAP): An auto-recovering scan lost data 
+*           and there are unread gaps.
 *   @param samples_per_channel  Receives the number of samples per channel 
 *       available in the scan thread buffer.
 *   @return [Result code](@ref ResultCode), 
@@ -409,6 +574,8 @@ int mcc118_a_in_scan_status(uint8_t address, uint16_t* status,
 *       - [STATUS_TRIGGERED](@ref STATUS_TRIGGERED): The trigger conditions have 
 *           been met.
 *       - [STATUS_RUNNING](@ref STATUS_RUNNING): The scan is running.
+*       - [STATUS_GAP](@ref STATUS_GAP): An auto-recovering scan lost data 
+*           and there are unread gaps.
 *   @param samples_per_channel  The number of samples per channel to read.  
 *       Specify \b -1 to read all available samples in the scan thread buffer,
 *       ignoring \b timeout. If \b buffer does not contain enough space then the
@@ -431,6 +598,173 @@ int mcc118_a_in_scan_read(uint8_t address, uint16_t* status,
     int32_t samples_per_channel, double timeout, double* buffer,
     uint32_t buffer_size_samples, uint32_t* samples_read_per_channel);
 
+/**
+*   @brief Reads status and multiple samples from an analog input scan in a 
+*       specified sample format.
+*
+*   This works like mcc118_a_in_scan_read() but converts the samples while 
+*   copying them into \b buffer, so smaller sample types can be read without a
+*   separate conversion pass.
+*
+*   @param address  The board address (0 - 7). Board must already be opened.
+*   @param status   Receives the scan status, the same as 
+*       mcc118_a_in_scan_read().
+*   @param samples_per_channel  The number of samples per channel to read.  
+*       Specify \b -1 to read all available samples in the scan thread buffer,
+*       ignoring \b timeout.
+*   @param timeout  The amount of time in seconds to wait for the samples to be
+*       read. Specify a negative number to wait indefinitely or \b 0 to return
+*       immediately with whatever samples are available.
+*   @param buffer   The user data buffer that receives the samples.
+*   @param buffer_size_samples  The size of the buffer in samples of the 
+*       specified format.
+*   @param format   The [sample format](@ref SampleFormat) of \b buffer.
+*   @param samples_read_per_channel Returns the actual number of samples read 
+*       from each channel.
+*   @return [Result code](@ref ResultCode), 
+*       [RESULT_SUCCESS](@ref RESULT_SUCCESS) if successful,
+*       [RESULT_BAD_PARAMETER](@ref RESULT_BAD_PARAMETER) if the format is 
+*           invalid or raw codes were requested from a scan that converts them,
+*       [RESULT_RESOURCE_UNAVAIL](@ref RESULT_RESOURCE_UNAVAIL) if a scan is not
+*           active.
+*/
+int mcc118_a_in_scan_read_format(uint8_t address, uint16_t* status, 
+    int32_t samples_per_channel, double timeout, void* buffer,
+    uint32_t buffer_size_samples, uint8_t format, 
+    uint32_t* samples_read_per_channel);
+
+/**
+*   @brief Get a pointer to the unread data in the scan buffer.
+*
+*   Returns the unread data in place, without copying it. Because the scan 
+*   buffer is circular, only the data up to the end of the buffer is returned;
+*   after releasing it, call this again to get the data at the start of the 
+*   buffer. The samples are \b double values interleaved by channel. The data 
+*   stays valid until it is released with mcc118_a_in_scan_buffer_release() or
+*   the scan is cleaned up. The scan thread checks for space before reading 
+*   from the device and never overwrites unread data: when the buffer is full 
+*   the scan stops with a buffer overrun, or with 
+*   [OPTS_AUTORECOVER](@ref OPTS_AUTORECOVER) the new data is discarded and 
+*   recorded as a gap.
+*
+*   @param address  The board address (0 - 7). Board must already be opened.
+*   @param data     Receives a pointer to the first unread sample.
+*   @param samples_per_channel  Receives the number of samples per channel 
+*       available at \b data.
+*   @return [Result code](@ref ResultCode), 
+*       [RESULT_SUCCESS](@ref RESULT_SUCCESS) if successful,
+*       [RESULT_RESOURCE_UNAVAIL](@ref RESULT_RESOURCE_UNAVAIL) if a scan is not
+*           active.
+*/
+int mcc118_a_in_scan_buffer_peek(uint8_t address, double** data,
+    uint32_t* samples_per_channel);
+
+/**
+*   @brief Get a file descriptor that signals when scan data is ready.
+*
+*   Returns a file descriptor that becomes readable when the scan buffer holds
+*   at least \b samples_per_channel samples per channel, and when the scan 
+*   ends, so a scan can be read from poll(), epoll or an event loop instead of 
+*   a blocking thread.  Read 8 bytes from it to clear it before reading the 
+*   data; it is non-blocking and may signal more than once for the same data.
+*   Calling this again changes the threshold and returns the same descriptor.
+*   The descriptor is closed by mcc118_a_in_scan_cleanup().
+*
+*   @param address  The board address (0 - 7). Board must already be opened.
+*   @param samples_per_channel  The number of samples per channel that makes 
+*       the descriptor readable. 0 is treated as 1 and values larger than the 
+*       scan buffer are limited to the buffer size.
+*   @param fd       Receives the file descriptor.
+*   @return [Result code](@ref ResultCode), 
+*       [RESULT_SUCCESS](@ref RESULT_SUCCESS) if successful,
+*       [RESULT_RESOURCE_UNAVAIL](@ref RESULT_RESOURCE_UNAVAIL) if a scan is not
+*           active or the descriptor could not be created.
+*/
+int mcc118_a_in_scan_ready_fd(uint8_t address, uint32_t samples_per_channel,
+    int* fd);
+
+/**
+*   @brief Remove data returned by mcc118_a_in_scan_buffer_peek() from the scan
+*       buffer.
+*
+*   @param address  The board address (0 - 7). Board must already be opened.
+*   @param samples_per_channel  The number of samples per channel to remove. 
+*       This may not be more than the last peek returned.
+*   @return [Result code](@ref ResultCode), 
+*       [RESULT_SUCCESS](@ref RESULT_SUCCESS) if successful,
+*       [RESULT_BAD_PARAMETER](@ref RESULT_BAD_PARAMETER) if more data was 
+*           released than is available,
+*       [RESULT_RESOURCE_UNAVAIL](@ref RESULT_RESOURCE_UNAVAIL) if a scan is not
+*           active.
+*/
+int mcc118_a_in_scan_buffer_release(uint8_t address, 
+    uint32_t samples_per_channel);
+
+/**
+*   @brief Read the next complete segment of a retriggered scan.
+*
+*   Waits for a complete capture from a scan started with 
+*   [OPTS_RETRIGGER](@ref OPTS_RETRIGGER) and reads it into \b buffer.  
+*   Nothing is read if the timeout expires first, so segments stay aligned.  
+*   Mixing calls to mcc118_a_in_scan_read() that read data with this function 
+*   will misalign the segments.
+*
+*   @param address  The board address (0 - 7). Board must already be opened.
+*   @param status   Receives the scan status, an ORed combination of the flags:
+*       - [STATUS_HW_OVERRUN](@ref STATUS_HW_OVERRUN): The device scan buffer 
+*           was not read fast enough and data was lost.
+*       - [STATUS_BUFFER_OVERRUN](@ref STATUS_BUFFER_OVERRUN): The thread scan 
+*           buffer was not read by the user fast enough and data was lost.
+*       - [STATUS_TRIGGERED](@ref STATUS_TRIGGERED): The trigger conditions 
+*           have been met for the segment being acquired.
+*       - [STATUS_RUNNING](@ref STATUS_RUNNING): The scan is running.
+*   @param timeout  The amount of time in seconds to wait for a complete 
+*       segment. Specify a negative number to wait indefinitely or 0 to return 
+*       immediately.
+*   @param buffer   The user data buffer that receives the segment.
+*   @param buffer_size_samples  The size of the buffer in samples. Must hold 
+*       at least \b samples_per_channel times the number of channels in the 
+*       scan.
+*   @param segment_number   Receives the number of the segment, starting at 0.
+*       May be NULL.
+*   @return [Result code](@ref ResultCode), 
+*       [RESULT_SUCCESS](@ref RESULT_SUCCESS) if successful,
+*       [RESULT_TIMEOUT](@ref RESULT_TIMEOUT) if a segment was not completed 
+*           in time,
+*       [RESULT_RESOURCE_UNAVAIL](@ref RESULT_RESOURCE_UNAVAIL) if a 
+*           retriggered scan is not active or it ended without another 
+*           complete segment.
+*/
+int mcc118_a_in_scan_read_segment(uint8_t address, uint16_t* status, 
+    double timeout, double* buffer, uint32_t buffer_size_samples, 
+    uint32_t* segment_number);
+
+/**
+*   @brief Read the gaps recorded by an auto-recovering scan.
+*
+*   When a scan is started with [OPTS_AUTORECOVER](@ref OPTS_AUTORECOVER) the 
+*   library records a gap every time data is lost, then continues the scan.  
+*   This function returns the oldest unread gaps and removes them from the 
+*   list.  Gaps at the same sample index are merged, and if more than 16 gaps 
+*   occur before being read the newest gaps are merged into the last entry.
+*
+*   Sample times are estimated again from the data after a gap, so 
+*   mcc118_a_in_scan_sample_time() should not be used for samples before the 
+*   most recent gap.
+*
+*   @param address  The board address (0 - 7). Board must already be opened.
+*   @param gaps     A user-allocated array of struct MCC118ScanGap that 
+*       receives the gaps.
+*   @param max_gaps The number of elements in \b gaps.
+*   @param gaps_read    Receives the number of gaps that were read.
+*   @return [Result code](@ref ResultCode), 
+*       [RESULT_SUCCESS](@ref RESULT_SUCCESS) if successful,
+*       [RESULT_RESOURCE_UNAVAIL](@ref RESULT_RESOURCE_UNAVAIL) if a scan is not
+*           active.
+*/
+int mcc118_a_in_scan_read_gaps(uint8_t address, struct MCC118ScanGap* gaps,
+    uint16_t max_gaps, uint16_t* gaps_read);
+
 /**
 *   @brief Stops an analog input scan.
 *
@@ -446,12 +780,34 @@ int mcc118_a_in_scan_stop(uint8_t address);
 /**
 *   @brief Free analog input scan resources after the scan is complete.
 *
+*   The scan buffer is kept and reused by the next scan on this board if it is 
+*   large enough, and the scan thread waits idle for the next scan; both are 
+*   freed when the board is closed.
+*
 *   @param address  The board address (0 - 7). Board must already be opened.
 *   @return [Result code](@ref ResultCode), 
 *       [RESULT_SUCCESS](@ref RESULT_SUCCESS) if successful.
 */
 int mcc118_a_in_scan_cleanup(uint8_t address);
 
+/**
+*   @brief Start a finished scan again with the same parameters.
+*
+*   Re-arms the scan started by mcc118_a_in_scan_start() without freeing and 
+*   reallocating the scan resources, which avoids the setup time for repeated 
+*   captures such as externally triggered finite scans. The scan must have 
+*   completed or been stopped with mcc118_a_in_scan_stop(). Any unread data and 
+*   status from the previous scan are discarded.
+*
+*   @param address  The board address (0 - 7). Board must already be opened.
+*   @return [Result code](@ref ResultCode), 
+*       [RESULT_SUCCESS](@ref RESULT_SUCCESS) if successful,
+*       [RESULT_RESOURCE_UNAVAIL](@ref RESULT_RESOURCE_UNAVAIL) if there is no 
+*       scan to re-arm,
+*       [RESULT_BUSY](@ref RESULT_BUSY) if the scan is still running.
+*/
+int mcc118_a_in_scan_rearm(uint8_t address);
+
 /**
 *   @brief Return the number of channels in the current analog input scan.
 *
@@ -462,6 +818,135 @@ int mcc118_a_in_scan_cleanup(uint8_t address);
 */
 int mcc118_a_in_scan_channel_count(uint8_t address);
 
+/**
+*   @brief Estimate the time that a scan sample was acquired.
+*
+*   The scan thread saves the number of samples acquired by the device along 
+*   with the CLOCK_MONOTONIC and CLOCK_REALTIME times each time it reads a block 
+*   of data.  This function fits a line through the most recent of these points 
+*   and uses it to estimate the acquisition time of any sample in the scan, 
+*   which removes most of the jitter of the host read times.  If only one point 
+*   has been saved the nominal scan rate is used.
+*
+*   The sample index is counted per channel from the start of the scan, so the 
+*   first sample returned by mcc118_a_in_scan_read() for each channel is index 
+*   0.  The times are returned in seconds in the same format as the tv_sec and 
+*   tv_nsec fields of the clock, i.e. 
+*   @code
+*       time = ts.tv_sec + ts.tv_nsec / 1e9;
+*   @endcode
+*
+*   @param address  The board address (0 - 7). Board must already be opened.
+*   @param sample_index  The per-channel index of the sample.
+*   @param monotonic_time  Receives the estimated CLOCK_MONOTONIC time in 
+*       seconds. May be NULL.
+*   @param real_time  Receives the estimated CLOCK_REALTIME time in seconds. May 
+*       be NULL.
+*   @return [Result code](@ref ResultCode), 
+*       [RESULT_SUCCESS](@ref RESULT_SUCCESS) if successful,
+*       [RESULT_RESOURCE_UNAVAIL](@ref RESULT_RESOURCE_UNAVAIL) if a scan is not 
+*       active or has not acquired any data yet.
+*/
+int mcc118_a_in_scan_sample_time(uint8_t address, uint64_t sample_index,
+    double* monotonic_time, double* real_time);
+
+/**
+*   @brief Read the scan rate measured against the host clock.
+*
+*   Uses the same timing information as mcc118_a_in_scan_sample_time() to 
+*   measure the actual scan rate and compare it to the nominal rate returned by 
+*   mcc118_a_in_scan_actual_rate(). When using an external scan clock the drift 
+*   is calculated against the \b sample_rate_per_channel passed to 
+*   mcc118_a_in_scan_start().
+*
+*   @param address  The board address (0 - 7). Board must already be opened.
+*   @param measured_rate_per_channel  Receives the measured sample rate per 
+*       channel in S/s. May be NULL.
+*   @param drift_ppm  Receives the difference between the measured and nominal 
+*       rates in parts per million. May be NULL.
+*   @return [Result code](@ref ResultCode), 
+*       [RESULT_SUCCESS](@ref RESULT_SUCCESS) if successful,
+*       [RESULT_RESOURCE_UNAVAIL](@ref RESULT_RESOURCE_UNAVAIL) if a scan is not 
+*       active or not enough data has been acquired to measure the rate.
+*/
+int mcc118_a_in_scan_clock_drift(uint8_t address, 
+    double* measured_rate_per_channel, double* drift_ppm);
+
+/**
+*   @brief Start software-timed sampling of a set of channels.
+*
+*   Starts a library thread that reads the channels in \b channel_mask with 
+*   mcc118_a_in_read_multi() at a fixed rate, using absolute deadlines so the 
+*   interval does not drift with the read time, and stores each sample with 
+*   its CLOCK_MONOTONIC timestamp in a circular buffer.  Use this when a 
+*   hardware-paced scan is not possible, such as when other processes also 
+*   perform single reads on the board; the timing depends on the host 
+*   scheduler, so mcc118_a_in_sampler_stats() reports the achieved rate and 
+*   timing jitter.  A hardware-paced scan cannot run at the same time.
+*
+*   @param address  The board address (0 - 7). Board must already be opened.
+*   @param channel_mask A bit mask of the channels to read, the LSB 
+*       corresponds to channel 0.
+*   @param sample_rate  The number of samples per second per channel, max 
+*       10,000.
+*   @param buffer_size  The size of the buffer in samples per channel, or 0 
+*       to hold 10 seconds of data (at least 1000 samples.)  When the buffer 
+*       is full the oldest samples are dropped.
+*   @param options  Options bitmask, the same as mcc118_a_in_read().
+*   @return [Result code](@ref ResultCode), 
+*       [RESULT_SUCCESS](@ref RESULT_SUCCESS) if successful,
+*       [RESULT_BUSY](@ref RESULT_BUSY) if a scan or sampler is already 
+*           running.
+*/
+int mcc118_a_in_sampler_start(uint8_t address, uint8_t channel_mask, 
+    double sample_rate, uint32_t buffer_size, uint32_t options);
+
+/**
+*   @brief Read samples from the software-timed sampler.
+*
+*   Returns immediately with up to \b max_samples of the oldest samples in 
+*   the buffer.
+*
+*   @param address  The board address (0 - 7). Board must already be opened.
+*   @param timestamps   Receives the CLOCK_MONOTONIC time in seconds of each 
+*       sample. May be NULL.
+*   @param values   Receives the values, \b max_samples times the number of 
+*       channels in size, interleaved by channel in order of increasing channel 
+*       number.
+*   @param max_samples  The maximum number of samples per channel to read.
+*   @param samples_read Receives the number of samples per channel read.
+*   @return [Result code](@ref ResultCode), 
+*       [RESULT_SUCCESS](@ref RESULT_SUCCESS) if successful,
+*       [RESULT_RESOURCE_UNAVAIL](@ref RESULT_RESOURCE_UNAVAIL) if the sampler 
+*           is not running.
+*/
+int mcc118_a_in_sampler_read(uint8_t address, double* timestamps, 
+    double* values, uint32_t max_samples, uint32_t* samples_read);
+
+/**
+*   @brief Read the software-timed sampler statistics.
+*
+*   @param address  The board address (0 - 7). Board must already be opened.
+*   @param stats    Receives the statistics.
+*   @return [Result code](@ref ResultCode), 
+*       [RESULT_SUCCESS](@ref RESULT_SUCCESS) if successful,
+*       [RESULT_RESOURCE_UNAVAIL](@ref RESULT_RESOURCE_UNAVAIL) if the sampler 
+*           is not running.
+*/
+int mcc118_a_in_sampler_stats(uint8_t address, 
+    struct MCC118SamplerStats* stats);
+
+/**
+*   @brief Stop the software-timed sampler and free its resources.
+*
+*   Unread samples are discarded.
+*
+*   @param address  The board address (0 - 7). Board must already be opened.
+*   @return [Result code](@ref ResultCode), 
+*       [RESULT_SUCCESS](@ref RESULT_SUCCESS) if successful.
+*/
+int mcc118_a_in_sampler_stop(uint8_t address);
+
 /**
 *   @brief Test the CLK pin.
 *
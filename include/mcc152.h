@@ -50,6 +50,45 @@ enum DIOConfigItem
     DIO_INT_MASK        = 6
 };
 
+/// MCC 152 analog output scan status and timing statistics.
+struct MCC152OutScanStatus
+{
+    /// The number of output updates made.
+    uint64_t update_count;
+    /// The number of update times that were skipped because an update was 
+    /// late.
+    uint64_t underruns;
+    /// The [result code](@ref ResultCode) of the most recent failed update, 
+    /// or 0.
+    int last_error;
+    /// 1 while the scan is updating the outputs, 0 when a finite scan has 
+    /// completed.
+    int running;
+    /// The achieved update rate in S/s.
+    double actual_rate;
+    /// The mean delay in seconds between the update deadline and the update.
+    double jitter_mean;
+    /// The median delay in seconds (10 us resolution.)
+    double jitter_p50;
+    /// The 99th percentile delay in seconds (10 us resolution.)
+    double jitter_p99;
+    /// The largest delay in seconds.
+    double jitter_max;
+};
+
+/// A digital input change captured by the DIO event engine.
+struct MCC152DIOEvent
+{
+    /// The CLOCK_MONOTONIC time of the interrupt, in nanoseconds.
+    uint64_t timestamp_ns;
+    /// The board address.
+    uint8_t address;
+    /// The DIO channel that caused the interrupt.
+    uint8_t channel;
+    /// The input value read after the interrupt.
+    uint8_t value;
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -132,6 +171,100 @@ int mcc152_a_out_write(uint8_t address, uint8_t channel, uint32_t options,
 */
 int mcc152_a_out_write_all(uint8_t address, uint32_t options, double* values);
 
+/**
+*   @brief Write all analog output channels on several boards with a 
+*       synchronized update.
+*
+*   The new values are written to every board without changing the outputs,
+*   then the load commands are sent back to back so the outputs of all of the
+*   boards change together. The whole operation holds the SPI bus lock once, 
+*   so it is also faster than calling mcc152_a_out_write_all() for each board.
+*   No board is written if any value is outside the output range.
+*
+*   @param count    The number of boards, 1 - 8.
+*   @param addresses    The board addresses. Each board must already be 
+*       opened and may only appear once.
+*   @param options  Options bitmask
+*       - [OPTS_NOSCALEDATA](@ref OPTS_NOSCALEDATA): the values are DAC codes 
+*         rather than voltages.
+*   @param values   The output values, 2 per board in the same order as 
+*       \b addresses (channel 0 then channel 1.)
+*   @return [Result code](@ref ResultCode),
+*       [RESULT_SUCCESS](@ref RESULT_SUCCESS) if successful,
+*       [RESULT_BAD_PARAMETER](@ref RESULT_BAD_PARAMETER) if a value is outside
+*       0 - 5V (0 - 4095 with OPTS_NOSCALEDATA),
+*       [RESULT_BUSY](@ref RESULT_BUSY) if an analog output scan is running on
+*       one of the boards.
+*/
+int mcc152_a_out_write_sync(uint8_t count, uint8_t* addresses, 
+    uint32_t options, double* values);
+
+/**
+*   @brief Start a timed analog output scan.
+*
+*   Starts a library thread that writes the values in \b buffer to the
+*   analog outputs at \b rate updates per second. The SPI frames for every
+*   update are built when the scan starts and each update is sent at an
+*   absolute deadline, so the interval does not drift with the write time. When
+*   both channels are in \b channel_mask they are updated simultaneously.
+*
+*   The timing depends on the host scheduler. If an update is late, the 
+*   update times that have already passed are skipped so the waveform stays 
+*   aligned with the clock, and are reported as underruns by 
+*   mcc152_a_out_scan_status().
+*
+*   The buffer is copied, so it may be freed or reused after this function 
+*   returns. mcc152_a_out_write() and mcc152_a_out_write_all() return
+*   [RESULT_BUSY](@ref RESULT_BUSY) until mcc152_a_out_scan_stop() is called.
+*   The outputs keep their last value when the scan ends.
+*
+*   @param address  The board address (0 - 7). Board must already be opened.
+*   @param channel_mask A bit mask of the channels to update, the LSB
+*       corresponds to channel 0.
+*   @param rate     The number of updates per second, max 10,000.
+*   @param buffer   The output values; \b count samples per channel, 
+*       interleaved in order of increasing channel number.
+*   @param count    The number of samples per channel in \b buffer.
+*   @param options  Options bitmask
+*       - [OPTS_NOSCALEDATA](@ref OPTS_NOSCALEDATA): the values are DAC codes 
+*         rather than voltages.
+*       - [OPTS_CONTINUOUS](@ref OPTS_CONTINUOUS): repeat the buffer until 
+*         mcc152_a_out_scan_stop() is called.  Otherwise the buffer is output 
+*         once.
+*   @return [Result code](@ref ResultCode),
+*       [RESULT_SUCCESS](@ref RESULT_SUCCESS) if successful,
+*       [RESULT_BAD_PARAMETER](@ref RESULT_BAD_PARAMETER) if a value in 
+*       \b buffer is outside 0 - 5V (0 - 4095 with OPTS_NOSCALEDATA),
+*       [RESULT_BUSY](@ref RESULT_BUSY) if a scan is already running.
+*/
+int mcc152_a_out_scan_start(uint8_t address, uint8_t channel_mask, 
+    double rate, double* buffer, uint32_t count, uint32_t options);
+
+/**
+*   @brief Read the analog output scan status and timing statistics.
+*
+*   @param address  The board address (0 - 7). Board must already be opened.
+*   @param status   Receives the status.
+*   @return [Result code](@ref ResultCode),
+*       [RESULT_SUCCESS](@ref RESULT_SUCCESS) if successful,
+*       [RESULT_RESOURCE_UNAVAIL](@ref RESULT_RESOURCE_UNAVAIL) if a scan has
+*       not been started.
+*/
+int mcc152_a_out_scan_status(uint8_t address, 
+    struct MCC152OutScanStatus* status);
+
+/**
+*   @brief Stop the analog output scan and free its resources.
+*
+*   The outputs keep their last value. This must be called after a finite scan
+*   completes before the outputs can be written again.
+*
+*   @param address  The board address (0 - 7). Board must already be opened.
+*   @return [Result code](@ref ResultCode),
+*       [RESULT_SUCCESS](@ref RESULT_SUCCESS) if successful.
+*/
+int mcc152_a_out_scan_stop(uint8_t address);
+
 /**
 *   @brief Reset the digital I/O to the default configuration.
 *
@@ -149,6 +282,21 @@ int mcc152_a_out_write_all(uint8_t address, uint32_t options, double* values);
 */
 int mcc152_dio_reset(uint8_t address);
 
+/**
+*   @brief Discard the cached digital I/O configuration.
+*
+*   The library keeps a copy of the digital I/O output and configuration
+*   registers so reads of those settings and single channel writes do not need
+*   extra bus transfers. If another process changes the digital I/O settings on
+*   this board, call this function before using them so the registers are read
+*   from the device again on the next access.
+*
+*   @param address  The board address (0 - 7). Board must already be opened.
+*   @return [Result code](@ref ResultCode),
+*       [RESULT_SUCCESS](@ref RESULT_SUCCESS) if successful.
+*/
+int mcc152_dio_cache_invalidate(uint8_t address);
+
 /**
 *   @brief Read a single digital input channel.
 *
@@ -503,6 +651,77 @@ int mcc152_dio_config_read_bit(uint8_t address, uint8_t channel, uint8_t item,
 */
 int mcc152_dio_config_read_port(uint8_t address, uint8_t item, uint8_t* value);
 
+/**
+*   @brief Start the DIO event engine.
+*
+*   Installs a library handler on the shared DAQ HAT interrupt line. On each
+*   interrupt the handler reads the interrupt status of every open MCC 152 in
+*   one combined I2C transfer and the inputs of the interrupted boards in a 
+*   second, and adds an event for each channel with a pending interrupt to an
+*   event ring, along with the kernel timestamp of the interrupt edge. Read
+*   the events with mcc152_dio_event_read().
+*
+*   Enable interrupts for the channels of interest with 
+*   mcc152_dio_config_write_bit() or mcc152_dio_config_write_port() and the 
+*   [DIO_INT_MASK](@ref DIO_INT_MASK) item. Reading the inputs clears the 
+*   interrupts, so a callback set with hat_interrupt_callback_enable() still 
+*   runs after the handler but will find the MCC 152 interrupts already 
+*   cleared.
+*
+*   @param buffer_size  The number of events the ring can hold, rounded up to
+*       a power of 2, or 0 for 4096. When the ring is full new events are 
+*       dropped and counted as overruns.
+*   @return [Result code](@ref ResultCode),
+*       [RESULT_SUCCESS](@ref RESULT_SUCCESS) if successful,
+*       [RESULT_BUSY](@ref RESULT_BUSY) if the engine is already running.
+*/
+int mcc152_dio_event_start(uint32_t buffer_size);
+
+/**
+*   @brief Read events captured by the DIO event engine.
+*
+*   Returns the oldest events in the ring, in the order they were captured.
+*   Only one thread should read events at a time.
+*
+*   @param events   Receives the events.
+*   @param max_events   The maximum number of events to read.
+*   @param timeout  The time in seconds to wait for at least one event; a 
+*       negative value waits indefinitely and 0 returns immediately.
+*   @param events_read  Receives the number of events read.
+*   @return [Result code](@ref ResultCode),
+*       [RESULT_SUCCESS](@ref RESULT_SUCCESS) if successful,
+*       [RESULT_TIMEOUT](@ref RESULT_TIMEOUT) if no event arrived before the
+*       timeout, [RESULT_RESOURCE_UNAVAIL](@ref RESULT_RESOURCE_UNAVAIL) if the
+*       engine is not running.
+*/
+int mcc152_dio_event_read(struct MCC152DIOEvent* events, uint32_t max_events,
+    double timeout, uint32_t* events_read);
+
+/**
+*   @brief Read the DIO event engine status.
+*
+*   @param events_available Receives the number of unread events. May be NULL.
+*   @param overruns Receives the number of events dropped because the ring was
+*       full. May be NULL.
+*   @return [Result code](@ref ResultCode),
+*       [RESULT_SUCCESS](@ref RESULT_SUCCESS) if successful,
+*       [RESULT_RESOURCE_UNAVAIL](@ref RESULT_RESOURCE_UNAVAIL) if the engine
+*       is not running.
+*/
+int mcc152_dio_event_status(uint32_t* events_available, uint64_t* overruns);
+
+/**
+*   @brief Stop the DIO event engine and discard any unread events.
+*
+*   A call to mcc152_dio_event_read() waiting in another thread returns 
+*   [RESULT_RESOURCE_UNAVAIL](@ref RESULT_RESOURCE_UNAVAIL) before the engine
+*   is stopped.
+*
+*   @return [Result code](@ref ResultCode),
+*       [RESULT_SUCCESS](@ref RESULT_SUCCESS) if successful.
+*/
+int mcc152_dio_event_stop(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -9,6 +9,7 @@ fi
 echo "Building and installing library"
 echo
 make -C lib all
+make -C lib check
 make -C lib install
 make -C lib clean
 
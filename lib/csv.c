@@ -0,0 +1,202 @@
+/*
+*   csv.c
+*   author Measurement Computing Corp.
+*   brief This file contains functions for writing scan data as text.
+*
+*   date 10/18/2026
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "daqhats.h"
+
+// The most characters written for one value, including the separator
+#define CSV_FIELD_MAX           32
+// Largest magnitude written in fixed-point notation
+#define CSV_FIXED_MAX           1e15
+#define CSV_MAX_DECIMALS        9
+// Largest scaled value rounded with integer arithmetic
+#define CSV_SCALED_MAX          9e18
+// Scaling can be off by half a unit in the last place, so scaled values this 
+// close (relative) to a rounding boundary are formatted with printf
+#define CSV_ROUND_TOLERANCE     (4 * DBL_EPSILON)
+
+static const double POWERS_OF_10[CSV_MAX_DECIMALS + 1] =
+{
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9
+};
+
+static const char DIGIT_PAIRS[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/******************************************************************************
+  Write the decimal digits of an unsigned value, least significant first, to
+  the end of a temporary buffer and return a pointer to the first digit.
+ *****************************************************************************/
+static char* _csv_digits(char* end, uint64_t value)
+{
+    char* p = end;
+
+    while (value >= 100)
+    {
+        uint32_t pair = (uint32_t)(value % 100) * 2;
+        value /= 100;
+        *--p = DIGIT_PAIRS[pair + 1];
+        *--p = DIGIT_PAIRS[pair];
+    }
+    if (value >= 10)
+    {
+        *--p = DIGIT_PAIRS[value * 2 + 1];
+        *--p = DIGIT_PAIRS[value * 2];
+    }
+    else
+    {
+        *--p = (char)('0' + value);
+    }
+    return p;
+}
+
+/******************************************************************************
+  Format one value with a fixed number of decimal places, the same as printf
+  "%.*f", and return a pointer to the character after it.  Values too large
+  for fixed-point notation use printf exponent notation.  Values the integer
+  path can't round exactly, such as those within rounding error of a half, are
+  formatted with printf.
+ *****************************************************************************/
+static char* _csv_format_value(char* p, double value, uint8_t decimals)
+{
+    char temp[24];
+    char* digits;
+    double magnitude;
+    double scaled_value;
+    double remainder;
+    uint64_t scaled;
+    uint64_t divisor;
+    uint64_t integer;
+    uint64_t fraction;
+    size_t length;
+    int i;
+
+    if (isnan(value))
+    {
+        memcpy(p, "nan", 3);
+        return p + 3;
+    }
+
+    if (signbit(value))
+    {
+        *p++ = '-';
+    }
+    magnitude = fabs(value);
+
+    if (isinf(magnitude))
+    {
+        memcpy(p, "inf", 3);
+        return p + 3;
+    }
+    if (magnitude >= CSV_FIXED_MAX)
+    {
+        return p + snprintf(p, CSV_FIELD_MAX - 1, "%.*e", decimals, magnitude);
+    }
+    scaled_value = magnitude * POWERS_OF_10[decimals];
+    if (scaled_value >= CSV_SCALED_MAX)
+    {
+        // too many digits for the integer path
+        return p + snprintf(p, CSV_FIELD_MAX - 1, "%.*f", decimals, magnitude);
+    }
+
+    // printf rounds the exact value of the double, which the scaled value may
+    // not represent closely enough to decide a value near a half; let printf
+    // format those
+    remainder = scaled_value - floor(scaled_value);
+    if (fabs(remainder - 0.5) <= (scaled_value * CSV_ROUND_TOLERANCE))
+    {
+        return p + snprintf(p, CSV_FIELD_MAX - 1, "%.*f", decimals, magnitude);
+    }
+
+    // round to the requested number of decimal places in integer arithmetic
+    scaled = (uint64_t)(scaled_value + 0.5);
+    divisor = (uint64_t)POWERS_OF_10[decimals];
+    integer = scaled / divisor;
+    fraction = scaled % divisor;
+
+    digits = _csv_digits(&temp[sizeof(temp)], integer);
+    length = &temp[sizeof(temp)] - digits;
+    memcpy(p, digits, length);
+    p += length;
+
+    if (decimals > 0)
+    {
+        *p++ = '.';
+        for (i = decimals - 1; i >= 0; i--)
+        {
+            p[i] = (char)('0' + (fraction % 10));
+            fraction /= 10;
+        }
+        p += decimals;
+    }
+    return p;
+}
+
+/******************************************************************************
+  Format interleaved scan data as comma-separated text, one row per sample.
+ *****************************************************************************/
+int hat_csv_format(const double* data, uint32_t samples_per_channel,
+    uint8_t channel_count, uint8_t decimals, char* buffer,
+    uint32_t buffer_size, uint32_t* samples_per_channel_written,
+    uint32_t* bytes_written)
+{
+    char* p;
+    char* row_limit;
+    uint32_t row;
+    uint8_t channel;
+    uint32_t row_max;
+
+    if ((data == NULL) ||
+        (channel_count == 0) ||
+        (decimals > CSV_MAX_DECIMALS) ||
+        (buffer == NULL) ||
+        (samples_per_channel_written == NULL) ||
+        (bytes_written == NULL))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    // only start a row when the longest possible row still fits
+    row_max = (uint32_t)channel_count * CSV_FIELD_MAX;
+    if (buffer_size < row_max)
+    {
+        *samples_per_channel_written = 0;
+        *bytes_written = 0;
+        return (samples_per_channel == 0) ? RESULT_SUCCESS :
+            RESULT_BAD_PARAMETER;
+    }
+    row_limit = buffer + buffer_size - row_max;
+
+    p = buffer;
+    for (row = 0; (row < samples_per_channel) && (p <= row_limit); row++)
+    {
+        for (channel = 0; channel < channel_count; channel++)
+        {
+            p = _csv_format_value(p, *data++, decimals);
+            *p++ = ',';
+        }
+        // replace the last separator with the end of the row
+        p[-1] = '\n';
+    }
+
+    *samples_per_channel_written = row;
+    *bytes_written = (uint32_t)(p - buffer);
+    return RESULT_SUCCESS;
+}
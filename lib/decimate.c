@@ -0,0 +1,129 @@
+/*
+*   decimate.c
+*   author Measurement Computing Corp.
+*   brief This file contains functions for reducing scan data for display.
+*
+*   date 10/18/2026
+*/
+#include <stdint.h>
+#include <string.h>
+#include "daqhats.h"
+
+/******************************************************************************
+  Initialize the state for min/max decimation.
+ *****************************************************************************/
+int hat_decimate_init(struct HatMinMaxDecimator* state, uint8_t channel_count,
+    uint32_t bucket_size)
+{
+    if ((state == NULL) ||
+        (channel_count == 0) ||
+        (channel_count > HAT_DECIMATE_MAX_CHANNELS) ||
+        (bucket_size == 0))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    memset(state, 0, sizeof(struct HatMinMaxDecimator));
+    state->bucket_size = bucket_size;
+    state->channel_count = channel_count;
+    return RESULT_SUCCESS;
+}
+
+/******************************************************************************
+  Reduce interleaved scan data to the minimum and maximum of each bucket of
+  samples.  A partial bucket at the end of the data is kept in the state and
+  completed by the next call.
+ *****************************************************************************/
+int hat_decimate_minmax(struct HatMinMaxDecimator* state, const double* data,
+    uint32_t samples_per_channel, double* buffer,
+    uint32_t buffer_size_samples, uint32_t* samples_per_channel_written)
+{
+    uint32_t buckets;
+    uint32_t sample;
+    uint32_t written;
+    uint8_t channel;
+    uint8_t count;
+    double value;
+
+    if ((state == NULL) ||
+        (state->bucket_size == 0) ||
+        (state->channel_count == 0) ||
+        (state->channel_count > HAT_DECIMATE_MAX_CHANNELS) ||
+        ((data == NULL) && (samples_per_channel > 0)) ||
+        (samples_per_channel_written == NULL))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+    count = state->channel_count;
+
+    // every completed bucket writes two samples per channel
+    buckets = (uint32_t)(((uint64_t)state->count + samples_per_channel) /
+        state->bucket_size);
+    if ((buckets > 0) &&
+        ((buffer == NULL) ||
+         ((uint64_t)buckets * 2 * count > buffer_size_samples)))
+    {
+        *samples_per_channel_written = 0;
+        return RESULT_BAD_PARAMETER;
+    }
+
+    written = 0;
+    for (sample = 0; sample < samples_per_channel; sample++)
+    {
+        if (state->count == 0)
+        {
+            // the first sample of a bucket sets both limits
+            for (channel = 0; channel < count; channel++)
+            {
+                value = *data++;
+                state->min[channel] = value;
+                state->max[channel] = value;
+                state->min_index[channel] = 0;
+                state->max_index[channel] = 0;
+            }
+        }
+        else
+        {
+            for (channel = 0; channel < count; channel++)
+            {
+                value = *data++;
+                if (value < state->min[channel])
+                {
+                    state->min[channel] = value;
+                    state->min_index[channel] = state->count;
+                }
+                else if (value > state->max[channel])
+                {
+                    state->max[channel] = value;
+                    state->max_index[channel] = state->count;
+                }
+            }
+        }
+
+        state->count++;
+        if (state->count == state->bucket_size)
+        {
+            // write the limits in the order they occurred so the plotted
+            // envelope keeps the shape of the signal
+            for (channel = 0; channel < count; channel++)
+            {
+                if (state->max_index[channel] < state->min_index[channel])
+                {
+                    buffer[channel] = state->max[channel];
+                    buffer[count + channel] = state->min[channel];
+                }
+                else
+                {
+                    buffer[channel] = state->min[channel];
+                    buffer[count + channel] = state->max[channel];
+                }
+            }
+            buffer += 2 * count;
+            written += 2;
+            state->count = 0;
+        }
+    }
+
+    *samples_per_channel_written = written;
+    return RESULT_SUCCESS;
+}
@@ -11,15 +11,29 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <poll.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
 #include <syslog.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <linux/gpio.h>
 #include "bcm_host.h"
 #include "gpio.h"
 
 //#define DEBUG
 
+// Use the GPIO character device for interrupts when the kernel headers 
+// support the v2 line uAPI, falling back to sysfs at runtime if the device 
+// can't be used.
+#ifdef GPIO_V2_GET_LINE_IOCTL
+#define GPIO_CHARDEV
+#endif
+
 #define PERIPH_SIZE       (4*1024)
 
 #define GPIO_OFFSET       0x00200000
@@ -41,7 +55,7 @@ static void* gpio_map = NULL;
 
 static volatile unsigned* gpio;
 
-// Variables for GPIO interrupt threads
+// Variables for GPIO interrupts
 #define NUM_GPIO            32          // max number of GPIO pins we handle for
                                         // interrupts
 static int gpio_int_read_fds[NUM_GPIO] = 
@@ -51,13 +65,12 @@ static int gpio_int_read_fds[NUM_GPIO] =
     -1, -1, -1, -1, -1, -1, -1, -1,
     -1, -1, -1, -1, -1, -1, -1, -1
 };
-static int gpio_int_thread_signal[NUM_GPIO] =
-{
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0
-};
+static bool gpio_int_chardev[NUM_GPIO];     // read fd is a chardev line
+static bool gpio_int_polled[NUM_GPIO];      // read fd is a level polling timer
+static int gpio_int_mode[NUM_GPIO];         // edge mode of the callback
+static int gpio_int_level[NUM_GPIO];        // last level seen by polling
+static uint32_t gpio_int_generation[NUM_GPIO];  // changes when a handler stops
+static volatile uint64_t gpio_event_ns[NUM_GPIO];   // last edge timestamp
 static void* gpio_callback_data[NUM_GPIO] =
 {
     NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, 
@@ -65,9 +78,39 @@ static void* gpio_callback_data[NUM_GPIO] =
     NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, 
     NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL
 };
-static pthread_t gpio_int_threads[NUM_GPIO];
 static void (*gpio_callback_functions[NUM_GPIO])(void*);
 
+// Edges seen by the interrupt dispatcher, so gpio_wait_for_low() can wait on 
+// a pin that is held by an interrupt callback
+static uint32_t gpio_edge_count[NUM_GPIO];
+static pthread_mutex_t gpio_edge_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gpio_edge_cond;
+static pthread_once_t gpio_edge_once = PTHREAD_ONCE_INIT;
+
+// The GPIO line can only be requested by one process.  When another process 
+// holds it the pin level is polled at this interval instead.
+#define GPIO_POLL_PERIOD_NS 1000000
+
+// Variables for the interrupt dispatcher thread, which waits on all of the 
+// registered event sources with a single epoll instance
+#define DISPATCH_MAX_SOURCES    (NUM_GPIO + 16)
+
+struct gpioDispatchSource
+{
+    int fd;                             // -1 if the slot is free
+    void (*handler)(int fd, void* arg);
+    void* arg;
+    struct GpioDispatchStats stats;
+};
+
+static struct gpioDispatchSource dispatch_sources[DISPATCH_MAX_SOURCES];
+static int dispatch_source_count = 0;
+static int dispatch_epoll_fd = -1;
+static int dispatch_stop_fd = -1;
+static pthread_t dispatch_thread;
+static pthread_mutex_t dispatch_mutex;
+static pthread_once_t dispatch_once = PTHREAD_ONCE_INIT;
+
 static void gpio_init(void)
 {
     //uint8_t buffer[4];
@@ -171,45 +214,177 @@ int gpio_status(int pin)
     return GET_GPIO(pin);
 }
 
-static void *gpio_interrupt_thread(void* arg)
+/******************************************************************************
+  Set and clear several output pins with one write to each of the GPIO set and 
+  clear registers.  The clear register is written first, so the pins pass 
+  through at most one intermediate state rather than one per pin.
+ *****************************************************************************/
+void gpio_write_mask(uint32_t set_mask, uint32_t clear_mask)
 {
-    struct pollfd poll_data;
-    int ret;
-    uint8_t c;
-    int pin;
-    
-    pin = *(int*)arg;
-    free(arg);
-    if (pin >= NUM_GPIO)
+    if (!gpio_initialized)
     {
-        return NULL;
+        gpio_init();
     }
-    
-    while (gpio_int_thread_signal[pin] == 0)
+
+    if (gpio)
     {
-        poll_data.fd = gpio_int_read_fds[pin];
-        poll_data.events = POLLPRI | POLLERR;
-        poll_data.revents = 0;
-        
-        // timeout after 1ms
-        ret = poll(&poll_data, 1, 1);
-        
-        if (ret > 0)
+        if (clear_mask)
+        {
+            GPIO_CLR = clear_mask;
+        }
+        if (set_mask)
         {
-            // read to clear the interrupt
-            lseek(gpio_int_read_fds[pin], 0, SEEK_SET);
-            read(gpio_int_read_fds[pin], &c, 1);
-            
-            // call the callback
-            gpio_callback_functions[pin](gpio_callback_data[pin]);
+            GPIO_SET = set_mask;
         }
     }
-    
-    return NULL;
 }
 
-int gpio_interrupt_callback(int pin, int mode, void (*function)(void*),
-    void* data)
+/******************************************************************************
+  Read the levels of all pins in the first GPIO bank with one register read.
+ *****************************************************************************/
+uint32_t gpio_read_mask(void)
+{
+    if (!gpio_initialized)
+    {
+        gpio_init();
+    }
+
+    if (gpio)
+    {
+        return *(gpio+13);
+    }
+    return 0;
+}
+
+#define GPIO_EVENT_COUNT    16          // events read from a line at once
+
+#ifdef GPIO_CHARDEV
+#define GPIO_CHIP_COUNT     16          // number of gpiochip devices to search
+
+static int gpio_chip_fd = -1;
+
+/******************************************************************************
+  Open the GPIO character device for the SoC GPIO pins.  The header pins are on 
+  the pinctrl chip (gpiochip0 on most models, another number on the Pi 5.)
+ *****************************************************************************/
+static int gpio_chip_open(void)
+{
+    char name[32];
+    struct gpiochip_info info;
+    int fd;
+    int i;
+
+    if (gpio_chip_fd != -1)
+    {
+        return gpio_chip_fd;
+    }
+
+    for (i = 0; i < GPIO_CHIP_COUNT; i++)
+    {
+        sprintf(name, "/dev/gpiochip%d", i);
+        if ((fd = open(name, O_RDWR | O_CLOEXEC)) == -1)
+        {
+            continue;
+        }
+        if ((ioctl(fd, GPIO_GET_CHIPINFO_IOCTL, &info) == 0) &&
+            (strncmp(info.label, "pinctrl-", 8) == 0))
+        {
+            gpio_chip_fd = fd;
+            return fd;
+        }
+        close(fd);
+    }
+
+    // no pinctrl label, so assume the first chip
+    gpio_chip_fd = open("/dev/gpiochip0", O_RDWR | O_CLOEXEC);
+    return gpio_chip_fd;
+}
+
+/******************************************************************************
+  Request a GPIO line as an input with edge detection.  Returns the line fd, 
+  or -1 with errno set if the character device can't be used.
+
+  mode: 0 = falling, 1 = rising, 2 = both
+ *****************************************************************************/
+static int gpio_line_request(int pin, int mode)
+{
+    struct gpio_v2_line_request request;
+    int chip_fd;
+
+    if ((chip_fd = gpio_chip_open()) == -1)
+    {
+        return -1;
+    }
+
+    memset(&request, 0, sizeof(request));
+    request.offsets[0] = pin;
+    request.num_lines = 1;
+    strcpy(request.consumer, "daqhats");
+    request.config.flags = GPIO_V2_LINE_FLAG_INPUT;
+    switch (mode)
+    {
+    case 0:
+        request.config.flags |= GPIO_V2_LINE_FLAG_EDGE_FALLING;
+        break;
+    case 1:
+        request.config.flags |= GPIO_V2_LINE_FLAG_EDGE_RISING;
+        break;
+    default:
+        request.config.flags |= GPIO_V2_LINE_FLAG_EDGE_FALLING |
+            GPIO_V2_LINE_FLAG_EDGE_RISING;
+        break;
+    }
+
+    if (ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &request) == -1)
+    {
+        // errno is EBUSY if another process has requested the line
+#ifdef DEBUG
+        int error = errno;
+        syslog(LOG_ERR, "gpio line request failed %d", error);
+        errno = error;
+#endif
+        return -1;
+    }
+
+    return request.fd;
+}
+
+/******************************************************************************
+  Read the pending edge events from a line, save the timestamp of the last one 
+  and return the number of events read.
+ *****************************************************************************/
+static int gpio_line_read_events(int pin, int line_fd, uint64_t* timestamps)
+{
+    struct gpio_v2_line_event events[GPIO_EVENT_COUNT];
+    ssize_t ret;
+    int i;
+
+    ret = read(line_fd, events, sizeof(events));
+    if (ret < (ssize_t)sizeof(struct gpio_v2_line_event))
+    {
+        return 0;
+    }
+
+    ret /= sizeof(struct gpio_v2_line_event);
+    if (timestamps)
+    {
+        for (i = 0; i < ret; i++)
+        {
+            timestamps[i] = events[i].timestamp_ns;
+        }
+    }
+    gpio_event_ns[pin] = events[ret - 1].timestamp_ns;
+    return (int)ret;
+}
+#endif
+
+/******************************************************************************
+  Export a pin in sysfs, set the edge and open the value file.  Returns the 
+  value fd or -1.
+
+  mode: 0 = falling, 1 = rising, 2 = both, 3 = none
+ *****************************************************************************/
+static int gpio_sysfs_open(int pin, int mode)
 {
     int event_fd;
     int value_fd;
@@ -221,15 +396,7 @@ int gpio_interrupt_callback(int pin, int mode, void (*function)(void*),
     int count;
     int i;
     struct stat sb;
-    
-    if (pin >= NUM_GPIO)
-    {
-#ifdef DEBUG
-        syslog(LOG_ERR, "gpio error 1");
-#endif        
-        return -1;
-    }
-    
+
     // make sure gpio has been exported
     sprintf(basename, "/sys/class/gpio/gpio%d", pin);
     sprintf(event_filename, "%s/edge", basename);
@@ -245,7 +412,13 @@ int gpio_interrupt_callback(int pin, int mode, void (*function)(void*),
             return -1;
         }
         sprintf(buffer, "%d", pin);
-        write(fd, buffer, strlen(buffer));
+        if (write(fd, buffer, strlen(buffer)) < 0)
+        {
+            // the line is in use, e.g. requested through the character 
+            // device by another process, so the edge file won't appear
+            close(fd);
+            return -1;
+        }
         close(fd);
         
         // wait for the edge file to appear with group write access
@@ -265,7 +438,8 @@ int gpio_interrupt_callback(int pin, int mode, void (*function)(void*),
 #endif        
         return -1;
     }
-    read(event_fd, buffer, 32);
+    memset(buffer, 0, sizeof(buffer));
+    read(event_fd, buffer, sizeof(buffer) - 1);
     
     switch (mode)
     {
@@ -280,41 +454,21 @@ int gpio_interrupt_callback(int pin, int mode, void (*function)(void*),
         break;
     default:    // disable
         sprintf(mode_string, "none");
-        lseek(event_fd, 0, SEEK_SET);
-        write(event_fd, mode_string, strlen(mode_string));
-        close(event_fd);
-        
-        if (gpio_int_read_fds[pin] != -1)
-        {
-            // there is already an interrupt thread on this pin so signal the
-            // thread to end and wait for it
-            gpio_int_thread_signal[pin] = 1;
-            pthread_join(gpio_int_threads[pin], NULL);
-            close(gpio_int_read_fds[pin]);
-            gpio_int_read_fds[pin] = -1;
-        }
-        return 0;
+        break;
     }
 
-    // only get here if we are configuring an edge
-    if (strcmp(buffer, mode_string) != 0)
+    if (strncmp(buffer, mode_string, strlen(mode_string)) != 0)
     {
         lseek(event_fd, 0, SEEK_SET);
         write(event_fd, mode_string, strlen(mode_string));
     }
     close(event_fd);
 
-    // check for an existing thread
-    if (gpio_int_read_fds[pin] != -1)
+    if (mode > 2)
     {
-        // there is already an interrupt thread on this pin so signal the
-        // thread to end and wait for it
-        gpio_int_thread_signal[pin] = 1;
-        pthread_join(gpio_int_threads[pin], NULL);
-        close(gpio_int_read_fds[pin]);
-        gpio_int_read_fds[pin] = -1;
+        return -1;
     }
-    
+
     // clear any pending interrupts
     sprintf(value_filename, "%s/value", basename);
     value_fd = open(value_filename, O_RDONLY);
@@ -331,94 +485,800 @@ int gpio_interrupt_callback(int pin, int mode, void (*function)(void*),
     {
         read(value_fd, buffer, 1);
     }
+
+    return value_fd;
+}
+
+static uint64_t gpio_monotonic_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+/******************************************************************************
+  Read the level of a pin, using the line held by an interrupt callback if 
+  there is one.  Returns 0 or 1, or -1 if the level can't be read.
+ *****************************************************************************/
+static int gpio_read_level(int pin)
+{
+#ifdef GPIO_CHARDEV
+    struct gpio_v2_line_values values;
+
+    if ((gpio_int_read_fds[pin] != -1) && gpio_int_chardev[pin])
+    {
+        values.mask = 1;
+        values.bits = 0;
+        if (ioctl(gpio_int_read_fds[pin], GPIO_V2_LINE_GET_VALUES_IOCTL, 
+            &values) == -1)
+        {
+            return -1;
+        }
+        return (int)(values.bits & 1);
+    }
+#endif
+
+    // the GPIO registers can be read by any number of processes
+    if (!gpio_initialized)
+    {
+        gpio_init();
+    }
+    if (!gpio)
+    {
+        return -1;
+    }
+    return GET_GPIO(pin) ? 1 : 0;
+}
+
+/******************************************************************************
+  Create a timer that polls the level of a pin for the interrupt dispatcher, 
+  used when another process holds the GPIO line.  Returns the timer fd or -1.
+ *****************************************************************************/
+static int gpio_poll_open(int pin)
+{
+    struct itimerspec period;
+    int fd;
+
+    if ((gpio_int_level[pin] = gpio_read_level(pin)) == -1)
+    {
+        return -1;
+    }
+
+    if ((fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK)) == 
+        -1)
+    {
+        return -1;
+    }
+    period.it_interval.tv_sec = 0;
+    period.it_interval.tv_nsec = GPIO_POLL_PERIOD_NS;
+    period.it_value = period.it_interval;
+    if (timerfd_settime(fd, 0, &period, NULL) == -1)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/******************************************************************************
+  Read a polling timer and return 1 with the time of the edge if the pin level 
+  changed in the direction of the callback mode, otherwise 0.
+ *****************************************************************************/
+static int gpio_poll_read_edge(int pin, int timer_fd, uint64_t* timestamps)
+{
+    uint64_t expirations;
+    int level;
+
+    read(timer_fd, &expirations, sizeof(expirations));
+    level = gpio_read_level(pin);
+    if ((level == -1) || (level == gpio_int_level[pin]))
+    {
+        return 0;
+    }
+
+    gpio_int_level[pin] = level;
+    // mode 0 reports falling edges (new level 0), mode 1 rising edges
+    if ((gpio_int_mode[pin] != 2) && (gpio_int_mode[pin] != level))
+    {
+        return 0;
+    }
+    timestamps[0] = gpio_monotonic_ns();
+    gpio_event_ns[pin] = timestamps[0];
+    return 1;
+}
+
+/******************************************************************************
+  Create the condition variable used to wait for dispatched edges.  It uses 
+  CLOCK_MONOTONIC so timeouts are not affected by changes to the system time.
+ *****************************************************************************/
+static void gpio_edge_init(void)
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&gpio_edge_cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/******************************************************************************
+  Count an edge (or the removal of the callback) on a pin and wake any 
+  gpio_wait_for_low() callers waiting on it.
+ *****************************************************************************/
+static void gpio_edge_signal(int pin)
+{
+    pthread_once(&gpio_edge_once, gpio_edge_init);
+    pthread_mutex_lock(&gpio_edge_mutex);
+    gpio_edge_count[pin]++;
+    pthread_cond_broadcast(&gpio_edge_cond);
+    pthread_mutex_unlock(&gpio_edge_mutex);
+}
+
+/******************************************************************************
+  Create the dispatcher mutex.  It is recursive so a handler can remove 
+  sources.
+ *****************************************************************************/
+static void gpio_dispatch_init(void)
+{
+    pthread_mutexattr_t attr;
+    int i;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&dispatch_mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    for (i = 0; i < DISPATCH_MAX_SOURCES; i++)
+    {
+        dispatch_sources[i].fd = -1;
+    }
+}
+
+/******************************************************************************
+  The interrupt dispatcher thread.  Waits for any registered source to become 
+  readable and calls its handler with the dispatcher mutex held, so a source 
+  is never called after gpio_dispatch_remove() returns.
+ *****************************************************************************/
+static void* gpio_dispatch_thread(void* arg)
+{
+    struct epoll_event events[DISPATCH_MAX_SOURCES];
+    struct gpioDispatchSource* source;
+    int epoll_fd = (int)(intptr_t)arg;
+    int count;
+    int i;
+
+    while (1)
+    {
+        count = epoll_wait(epoll_fd, events, DISPATCH_MAX_SOURCES, -1);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+
+        pthread_mutex_lock(&dispatch_mutex);
+        for (i = 0; i < count; i++)
+        {
+            if (events[i].data.ptr == NULL)
+            {
+                // the shutdown eventfd
+                pthread_mutex_unlock(&dispatch_mutex);
+                return NULL;
+            }
+
+            // the source may have been removed by an earlier handler
+            source = (struct gpioDispatchSource*)events[i].data.ptr;
+            if (source->fd != -1)
+            {
+                source->handler(source->fd, source->arg);
+            }
+        }
+        pthread_mutex_unlock(&dispatch_mutex);
+    }
+
+    return NULL;
+}
+
+/******************************************************************************
+  Add an event source to the dispatcher, starting the dispatcher thread if 
+  needed.  The handler is called from the dispatcher thread whenever fd is 
+  readable (or has a priority event for sysfs GPIO value files.)
+ *****************************************************************************/
+int gpio_dispatch_add(int fd, bool priority, void (*handler)(int fd, void* arg),
+    void* arg)
+{
+    struct epoll_event event;
+    struct gpioDispatchSource* source;
+    int i;
+
+    if ((fd < 0) || (handler == NULL))
+    {
+        return -1;
+    }
+
+    pthread_once(&dispatch_once, gpio_dispatch_init);
+    pthread_mutex_lock(&dispatch_mutex);
+
+    if (dispatch_epoll_fd == -1)
+    {
+        // first source; create the epoll instance and dispatcher thread
+        dispatch_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        dispatch_stop_fd = eventfd(0, EFD_CLOEXEC);
+        event.events = EPOLLIN;
+        event.data.ptr = NULL;
+        if ((dispatch_epoll_fd == -1) ||
+            (dispatch_stop_fd == -1) ||
+            (epoll_ctl(dispatch_epoll_fd, EPOLL_CTL_ADD, dispatch_stop_fd, 
+                &event) == -1) ||
+            (pthread_create(&dispatch_thread, NULL, gpio_dispatch_thread, 
+                (void*)(intptr_t)dispatch_epoll_fd) != 0))
+        {
+            if (dispatch_epoll_fd != -1)
+            {
+                close(dispatch_epoll_fd);
+            }
+            if (dispatch_stop_fd != -1)
+            {
+                close(dispatch_stop_fd);
+            }
+            dispatch_epoll_fd = -1;
+            dispatch_stop_fd = -1;
+            pthread_mutex_unlock(&dispatch_mutex);
+            return -1;
+        }
+    }
+
+    source = NULL;
+    for (i = 0; i < DISPATCH_MAX_SOURCES; i++)
+    {
+        if (dispatch_sources[i].fd == -1)
+        {
+            source = &dispatch_sources[i];
+            break;
+        }
+    }
+    if (source == NULL)
+    {
+        pthread_mutex_unlock(&dispatch_mutex);
+        return -1;
+    }
+
+    memset(&source->stats, 0, sizeof(source->stats));
+    source->handler = handler;
+    source->arg = arg;
+    source->fd = fd;
+
+    event.events = priority ? (EPOLLPRI | EPOLLERR) : EPOLLIN;
+    event.data.ptr = source;
+    if (epoll_ctl(dispatch_epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1)
+    {
+        source->fd = -1;
+        pthread_mutex_unlock(&dispatch_mutex);
+        return -1;
+    }
+    dispatch_source_count++;
+
+    pthread_mutex_unlock(&dispatch_mutex);
+    return 0;
+}
+
+/******************************************************************************
+  Remove an event source from the dispatcher.  The dispatcher thread is 
+  stopped when the last source is removed, unless called from a handler.
+ *****************************************************************************/
+int gpio_dispatch_remove(int fd)
+{
+    uint64_t value = 1;
+    pthread_t thread;
+    int epoll_fd;
+    int stop_fd;
+    bool stop;
+    int i;
+
+    pthread_once(&dispatch_once, gpio_dispatch_init);
+    pthread_mutex_lock(&dispatch_mutex);
+
+    for (i = 0; i < DISPATCH_MAX_SOURCES; i++)
+    {
+        if ((dispatch_epoll_fd != -1) &&
+            (dispatch_sources[i].fd == fd))
+        {
+            break;
+        }
+    }
+    if ((fd < 0) || (i == DISPATCH_MAX_SOURCES))
+    {
+        pthread_mutex_unlock(&dispatch_mutex);
+        return -1;
+    }
+
+    epoll_ctl(dispatch_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    dispatch_sources[i].fd = -1;
+    dispatch_source_count--;
+
+    stop = (dispatch_source_count == 0) &&
+        !pthread_equal(pthread_self(), dispatch_thread);
+    if (stop)
+    {
+        // detach the dispatcher state so a new source added while we wait 
+        // for the thread starts a new dispatcher
+        thread = dispatch_thread;
+        epoll_fd = dispatch_epoll_fd;
+        stop_fd = dispatch_stop_fd;
+        dispatch_epoll_fd = -1;
+        dispatch_stop_fd = -1;
+        write(stop_fd, &value, sizeof(value));
+    }
+    pthread_mutex_unlock(&dispatch_mutex);
+
+    if (stop)
+    {
+        pthread_join(thread, NULL);
+        close(epoll_fd);
+        close(stop_fd);
+    }
+    return 0;
+}
+
+/******************************************************************************
+  Record that a dispatched event was handled, with the time it occurred. Must 
+  be called from a handler.
+ *****************************************************************************/
+static void gpio_dispatch_record(int fd, uint64_t event_ns)
+{
+    struct GpioDispatchStats* stats;
+    uint64_t latency;
+    int i;
+
+    for (i = 0; i < DISPATCH_MAX_SOURCES; i++)
+    {
+        if (dispatch_sources[i].fd == fd)
+        {
+            stats = &dispatch_sources[i].stats;
+            latency = gpio_monotonic_ns() - event_ns;
+            stats->count++;
+            stats->latency_sum_ns += latency;
+            if (latency > stats->latency_max_ns)
+            {
+                stats->latency_max_ns = latency;
+            }
+            return;
+        }
+    }
+}
+
+/******************************************************************************
+  Read the handler statistics for a dispatcher source.
+ *****************************************************************************/
+int gpio_dispatch_stats(int fd, struct GpioDispatchStats* stats)
+{
+    int i;
+
+    pthread_once(&dispatch_once, gpio_dispatch_init);
+    pthread_mutex_lock(&dispatch_mutex);
+    for (i = 0; i < DISPATCH_MAX_SOURCES; i++)
+    {
+        if ((dispatch_epoll_fd != -1) &&
+            (fd >= 0) &&
+            (dispatch_sources[i].fd == fd))
+        {
+            *stats = dispatch_sources[i].stats;
+            pthread_mutex_unlock(&dispatch_mutex);
+            return 0;
+        }
+    }
+    pthread_mutex_unlock(&dispatch_mutex);
+    return -1;
+}
+
+/******************************************************************************
+  Dispatcher handler for GPIO interrupt pins.
+ *****************************************************************************/
+static void gpio_interrupt_handler(int fd, void* arg)
+{
+    int pin = (int)(intptr_t)arg;
+    uint64_t timestamps[GPIO_EVENT_COUNT];
+    uint32_t generation;
+    int count;
+    int i;
+    uint8_t c;
+
+    if (gpio_int_polled[pin])
+    {
+        count = gpio_poll_read_edge(pin, fd, timestamps);
+    }
+#ifdef GPIO_CHARDEV
+    else if (gpio_int_chardev[pin])
+    {
+        count = gpio_line_read_events(pin, fd, timestamps);
+    }
+#endif
+    else
+    {
+        // read to clear the interrupt; sysfs has no event timestamp
+        lseek(fd, 0, SEEK_SET);
+        read(fd, &c, 1);
+        timestamps[0] = gpio_monotonic_ns();
+        gpio_event_ns[pin] = timestamps[0];
+        count = 1;
+    }
+
+    if (count > 0)
+    {
+        gpio_edge_signal(pin);
+    }
+
+    // call the callback for each edge; the callback can read the time of the
+    // edge it is handling with gpio_event_timestamp().  Stop if the callback
+    // removed or replaced the handler, which closes fd.
+    generation = gpio_int_generation[pin];
+    for (i = 0; i < count; i++)
+    {
+        gpio_event_ns[pin] = timestamps[i];
+        gpio_callback_functions[pin](gpio_callback_data[pin]);
+        if (gpio_int_generation[pin] != generation)
+        {
+            break;
+        }
+        gpio_dispatch_record(fd, timestamps[i]);
+    }
+}
+
+/******************************************************************************
+  Remove the interrupt handler on a pin and close its file.
+ *****************************************************************************/
+static void gpio_interrupt_stop(int pin)
+{
+    int read_fd;
+
+    if (gpio_int_read_fds[pin] != -1)
+    {
+        // remove it from the dispatcher before taking gpio_edge_mutex; the 
+        // dispatcher takes that mutex while it holds its own
+        gpio_dispatch_remove(gpio_int_read_fds[pin]);
+        gpio_int_generation[pin]++;
+
+        // gpio_wait_dispatched() reads the line with gpio_edge_mutex held
+        pthread_once(&gpio_edge_once, gpio_edge_init);
+        pthread_mutex_lock(&gpio_edge_mutex);
+        read_fd = gpio_int_read_fds[pin];
+        gpio_int_read_fds[pin] = -1;
+        close(read_fd);
+        pthread_mutex_unlock(&gpio_edge_mutex);
+
+        // waiters on the callback must request the line themselves now
+        gpio_edge_signal(pin);
+    }
+}
+
+int gpio_interrupt_callback(int pin, int mode, void (*function)(void*),
+    void* data)
+{
+    int read_fd;
+    bool chardev;
+    bool busy;
+    bool polled;
+    
+    if ((pin < 0) || (pin >= NUM_GPIO))
+    {
+#ifdef DEBUG
+        syslog(LOG_ERR, "gpio error 1");
+#endif        
+        return -1;
+    }
+    
+    // stop any existing handler on this pin; this also releases the line
+    gpio_interrupt_stop(pin);
+
+    if ((mode < 0) || (mode > 2))
+    {
+        // disable
+#ifdef GPIO_CHARDEV
+        if (gpio_chip_fd == -1)
+#endif
+        {
+            gpio_sysfs_open(pin, 3);
+        }
+        return 0;
+    }
+
+    chardev = false;
+    busy = false;
+    polled = false;
+    read_fd = -1;
+#ifdef GPIO_CHARDEV
+    if ((read_fd = gpio_line_request(pin, mode)) != -1)
+    {
+        chardev = true;
+    }
+    else if (errno == EBUSY)
+    {
+        // another process has the line, so sysfs can't export it either
+        busy = true;
+    }
+#endif
+    if ((read_fd == -1) && !busy)
+    {
+        read_fd = gpio_sysfs_open(pin, mode);
+    }
+    if (read_fd == -1)
+    {
+        // share the pin with the other process by polling its level
+        if ((read_fd = gpio_poll_open(pin)) == -1)
+        {
+            return -1;
+        }
+        polled = true;
+    }
     
     // set the callback function
+    pthread_once(&gpio_edge_once, gpio_edge_init);
     gpio_callback_functions[pin] = function;
     gpio_callback_data[pin] = data;
-    gpio_int_read_fds[pin] = value_fd;
-    gpio_int_thread_signal[pin] = 0;
-    int* ppin = (int*)malloc(sizeof(int));
-    *ppin = pin;
+    gpio_int_chardev[pin] = chardev;
+    gpio_int_polled[pin] = polled;
+    gpio_int_mode[pin] = mode;
     
-    // start the interrupt thread
-    pthread_create(&gpio_int_threads[pin], NULL, gpio_interrupt_thread, ppin);
+    // add the pin to the dispatcher
+    if (gpio_dispatch_add(read_fd, !chardev, gpio_interrupt_handler, 
+        (void*)(intptr_t)pin) != 0)
+    {
+        close(read_fd);
+        return -1;
+    }
+    pthread_mutex_lock(&gpio_edge_mutex);
+    gpio_int_read_fds[pin] = read_fd;
+    pthread_mutex_unlock(&gpio_edge_mutex);
     
     return 0;
 }
 
-int gpio_wait_for_low(int pin, int timeout)
+int gpio_interrupt_stats(int pin, struct GpioDispatchStats* stats)
 {
-    int event_fd;
-    int value_fd;
-    struct pollfd poll_data;
-    char basename[64];
-    char event_filename[64];
-    char value_filename[64];
-    char buffer[32];
+    if ((pin < 0) || (pin >= NUM_GPIO) ||
+        (stats == NULL))
+    {
+        return -1;
+    }
+    return gpio_dispatch_stats(gpio_int_read_fds[pin], stats);
+}
+
+/******************************************************************************
+  Wait for a pin to be low by polling its level, with a timeout in 
+  milliseconds (-1 to wait forever.)  Used when the pin can't be watched for 
+  edges because another process holds the GPIO line.
+ *****************************************************************************/
+static int gpio_poll_for_low(int pin, int timeout)
+{
+    struct timespec period;
+    uint64_t start_ns;
+    uint64_t now_ns;
+    int level;
+    bool was_high;
+
+    period.tv_sec = 0;
+    period.tv_nsec = GPIO_POLL_PERIOD_NS;
+    start_ns = gpio_monotonic_ns();
+    was_high = false;
+    while ((level = gpio_read_level(pin)) == 1)
+    {
+        was_high = true;
+        now_ns = gpio_monotonic_ns();
+        if ((timeout >= 0) &&
+            ((now_ns - start_ns) >= ((uint64_t)timeout * 1000000ull)))
+        {
+            return 0;
+        }
+        nanosleep(&period, NULL);
+    }
+    if ((level == 0) && was_high)
+    {
+        gpio_event_ns[pin] = gpio_monotonic_ns();
+    }
+    return (level == 0) ? 1 : -1;
+}
+
+/******************************************************************************
+  Wait for a pin that is held by an interrupt callback to be low, using the 
+  edges seen by the interrupt dispatcher.  Returns 1 if low, 0 on timeout, -1 
+  on error, or 2 if the callback was removed; timeout is updated with the time
+  remaining so the caller can continue waiting on its own line.
+ *****************************************************************************/
+static int gpio_wait_dispatched(int pin, int* timeout)
+{
+    struct timespec deadline;
+    uint64_t deadline_ns;
+    uint64_t now_ns;
+    uint32_t count;
+    int level;
+    int error;
     int ret;
-    struct stat sb;
-    
-    // make sure gpio has been exported
-    sprintf(basename, "/sys/class/gpio/gpio%d", pin);
-    sprintf(event_filename, "%s/edge", basename);
-    if (stat(basename, &sb) != 0)
+    bool edge;
+
+    pthread_once(&gpio_edge_once, gpio_edge_init);
+    deadline_ns = 0;
+    if (*timeout >= 0)
     {
-        int fd = open("/sys/class/gpio/export", O_RDWR);
-        if (fd == -1)
+        deadline_ns = gpio_monotonic_ns() + (uint64_t)*timeout * 1000000ull;
+        deadline.tv_sec = deadline_ns / 1000000000ull;
+        deadline.tv_nsec = deadline_ns % 1000000000ull;
+    }
+
+    edge = false;
+    pthread_mutex_lock(&gpio_edge_mutex);
+    while (1)
+    {
+        if (gpio_int_read_fds[pin] == -1)
         {
-            return -1;
+            // the callback was removed
+            ret = 2;
+            break;
+        }
+        if (edge && (gpio_int_mode[pin] == 0))
+        {
+            // a falling edge was seen, even if the pin is already high again
+            ret = 1;
+            break;
         }
-        sprintf(buffer, "%d", pin);
-        write(fd, buffer, strlen(buffer));
-        close(fd);
 
-        // wait for the edge file to appear with group write access
-        do
+        // the edge count is read under the mutex before the level, so an 
+        // edge after reading the level wakes the wait below
+        count = gpio_edge_count[pin];
+        if ((level = gpio_read_level(pin)) == -1)
         {
-            usleep(10);
-        } while (!( (stat(event_filename, &sb) == 0) &&     // file exists
-                    ((sb.st_mode & S_IWGRP) == S_IWGRP) )); // group writable
+            // the line may have been closed while reading it
+            ret = -1;
+            if (gpio_int_read_fds[pin] == -1)
+            {
+                continue;
+            }
+            break;
+        }
+        if (level == 0)
+        {
+            ret = 1;
+            break;
+        }
+
+        error = 0;
+        while ((error == 0) && (count == gpio_edge_count[pin]))
+        {
+            if (*timeout < 0)
+            {
+                error = pthread_cond_wait(&gpio_edge_cond, &gpio_edge_mutex);
+            }
+            else
+            {
+                error = pthread_cond_timedwait(&gpio_edge_cond, 
+                    &gpio_edge_mutex, &deadline);
+            }
+        }
+        if (error != 0)
+        {
+            // timeout
+            ret = 0;
+            break;
+        }
+        edge = true;
     }
+    pthread_mutex_unlock(&gpio_edge_mutex);
 
-    // return if it is already low
-    sprintf(value_filename, "%s/value", basename);
-    value_fd = open(value_filename, O_RDONLY);
-    if (value_fd == -1)
+    if ((ret == 2) && (*timeout >= 0))
+    {
+        now_ns = gpio_monotonic_ns();
+        *timeout = (now_ns >= deadline_ns) ? 0 : 
+            (int)((deadline_ns - now_ns) / 1000000ull);
+    }
+    return ret;
+}
+
+int gpio_wait_for_low(int pin, int timeout)
+{
+    int value_fd;
+    struct pollfd poll_data;
+    struct timespec now;
+    char buffer[32];
+    int ret;
+
+    if ((pin < 0) || (pin >= NUM_GPIO))
     {
         return -1;
     }
-    read(value_fd, buffer, 1);
-    if (buffer[0] == '0')
+
+    if (gpio_int_read_fds[pin] != -1)
     {
-        return 1;
+        // the pin is held by an interrupt callback, so wait for the 
+        // dispatcher to see an edge instead of requesting the line again
+        if (gpio_int_mode[pin] == 1)
+        {
+            // only rising edges are reported
+            return gpio_poll_for_low(pin, timeout);
+        }
+        if ((ret = gpio_wait_dispatched(pin, &timeout)) != 2)
+        {
+            return ret;
+        }
     }
-    
-    // make sure edge is set
-    event_fd = open(event_filename, O_RDWR);
-    if (event_fd == -1)
+
+#ifdef GPIO_CHARDEV
+    value_fd = gpio_line_request(pin, 0);
+    if ((value_fd == -1) && (errno == EBUSY))
     {
-        return -1;
+        // another process has the line, so sysfs can't export it either
+        return gpio_poll_for_low(pin, timeout);
     }
-    read(event_fd, buffer, 32);
-    if (strcmp(buffer, "falling") != 0)
+    if (value_fd != -1)
     {
-        lseek(event_fd, 0, SEEK_SET);
-        sprintf(buffer, "falling");
-        write(event_fd, buffer, strlen(buffer));
+        struct gpio_v2_line_values values;
+
+        // the edge detection is already running, so an edge after reading 
+        // the value will not be missed
+        values.mask = 1;
+        values.bits = 0;
+        if (ioctl(value_fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) == -1)
+        {
+            close(value_fd);
+            return -1;
+        }
+        if ((values.bits & 1) == 0)
+        {
+            // return if it is already low
+            close(value_fd);
+            return 1;
+        }
+
+        poll_data.fd = value_fd;
+        poll_data.events = POLLIN;
+        poll_data.revents = 0;
+        do
+        {
+            ret = poll(&poll_data, 1, timeout);
+        } while ((ret < 0) && (errno == EINTR));
+        if (ret > 0)
+        {
+            gpio_line_read_events(pin, value_fd, NULL);
+        }
+        close(value_fd);
     }
-    close(event_fd);
-    
-    poll_data.fd = value_fd;
-    poll_data.events = POLLPRI | POLLERR;
-    poll_data.revents = 0;
-    
-    read(value_fd, buffer, 1);
-    
-    ret = poll(&poll_data, 1, timeout);
-    lseek(value_fd, 0, SEEK_SET);
-    read(value_fd, buffer, 1);
-    
-    close(value_fd);
+    else
+#endif
+    {
+        if ((value_fd = gpio_sysfs_open(pin, 0)) == -1)
+        {
+            // the pin may be in use by another process, so poll the level
+            return gpio_poll_for_low(pin, timeout);
+        }
+
+        // return if it is already low
+        lseek(value_fd, 0, SEEK_SET);
+        read(value_fd, buffer, 1);
+        if (buffer[0] == '0')
+        {
+            close(value_fd);
+            return 1;
+        }
+
+        poll_data.fd = value_fd;
+        poll_data.events = POLLPRI | POLLERR;
+        poll_data.revents = 0;
+        
+        ret = poll(&poll_data, 1, timeout);
+        lseek(value_fd, 0, SEEK_SET);
+        read(value_fd, buffer, 1);
+        if (ret > 0)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            gpio_event_ns[pin] = (uint64_t)now.tv_sec * 1000000000ull + 
+                now.tv_nsec;
+        }
+        
+        close(value_fd);
+    }
+
     if (ret == 0)
     {
         // timeout
@@ -434,3 +1294,12 @@ int gpio_wait_for_low(int pin, int timeout)
         return 1;
     }
 }
+
+uint64_t gpio_event_timestamp(int pin)
+{
+    if ((pin < 0) || (pin >= NUM_GPIO))
+    {
+        return 0;
+    }
+    return gpio_event_ns[pin];
+}
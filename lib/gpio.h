@@ -8,13 +8,34 @@
 #ifndef _GPIO_H
 #define _GPIO_H
 
+#include <stdint.h>
+#include <stdbool.h>
+
+// Handler statistics for an interrupt dispatcher source
+struct GpioDispatchStats
+{
+    uint64_t count;             // number of events handled
+    uint64_t latency_sum_ns;    // total time from event to handler completion
+    uint64_t latency_max_ns;    // longest time from event to handler completion
+};
+
 // Simple GPIO functions for setting output values on address pins
 
 void gpio_dir(int pin, int dir);
 void gpio_write(int pin, int val);
 int gpio_status(int pin);
+void gpio_write_mask(uint32_t set_mask, uint32_t clear_mask);
+uint32_t gpio_read_mask(void);
 int gpio_wait_for_low(int pin, int timeout);
 int gpio_interrupt_callback(int pin, int mode, void (*function)(void*),
     void* data);
+uint64_t gpio_event_timestamp(int pin);
+int gpio_interrupt_stats(int pin, struct GpioDispatchStats* stats);
+
+// Interrupt dispatcher; one thread waits on all registered event sources
+int gpio_dispatch_add(int fd, bool priority, void (*handler)(int fd, void* arg),
+    void* arg);
+int gpio_dispatch_remove(int fd);
+int gpio_dispatch_stats(int fd, struct GpioDispatchStats* stats);
 
 #endif
\ No newline at end of file
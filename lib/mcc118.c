@@ -17,6 +17,7 @@
 #include <errno.h>
 #include <syslog.h>
 #include <sys/ioctl.h>
+#include <sys/eventfd.h>
 #include <linux/spi/spidev.h>
 #include "daqhats.h"
 #include "util.h"
@@ -110,7 +111,14 @@ struct MCC118DeviceInfo mcc118_device_info =
 
 #define TX_BUFFER_SIZE          (MAX_TX_DATA_SIZE + MSG_TX_HEADER_SIZE)
 
-#define MAX_SAMPLES_READ        512
+#define MAX_SAMPLES_READ        512     // default block size
+
+// The largest block of samples that fits in a single spidev transfer
+#define MAX_SAMPLES_READ_LIMIT  ((MAX_SPI_TRANSFER - MSG_RX_HEADER_SIZE) / 2)
+
+// Scan transfer defaults
+#define DEFAULT_SCAN_LATENCY    0.1     // read data every 100ms or faster
+#define DEFAULT_POLL_INTERVAL   200     // microseconds
 
 // MCC 118 command response codes
 #define FW_RES_SUCCESS          0x00
@@ -130,6 +138,19 @@ struct MCC118DeviceInfo mcc118_device_info =
 
 #define MAX_SCAN_BUFFER_SIZE_SAMPLES    (16ul*1024ul*1024ul)    // 16 MS
 
+#define SCAN_TIMESTAMP_COUNT    32      // number of block timestamps used for
+                                        // estimating sample times
+#define RETRIGGER_SEGMENTS      16      // segments buffered by a retrigger scan
+#define RETRIGGER_MAX_BUFFER    1000000 // samples per channel
+#define SCAN_GAP_COUNT          16      // number of unread gaps that are kept
+                                        // before merging new gaps
+
+#define SAMPLER_MAX_RATE        10000.0 // software-timed samples per second
+#define SAMPLER_DEFAULT_SECONDS 10      // default sampler buffer duration
+#define SAMPLER_JITTER_BIN_NS   10000   // sampler jitter histogram resolution
+#define SAMPLER_JITTER_BINS     1000    // last bin collects larger values
+#define SAMPLER_MAX_SLEEP_NS    100000000   // check for stop every 100 ms
+
 #define COUNT_NORMALIZE(x, c)  ((x / c) * c)
 
 #define MIN(a, b)   ((a < b) ? a : b)
@@ -149,23 +170,54 @@ struct mcc118FactoryData
     double offsets[NUM_CHANNELS];
 };
 
+// A device sample count and the host clock times when it was read
+struct mcc118ScanTimestamp
+{
+    uint64_t sample_count;      // samples per channel acquired by the device
+    double monotonic_time;      // CLOCK_MONOTONIC time in seconds
+    double real_time;           // CLOCK_REALTIME time in seconds
+};
+
 // Local data for analog input scans
 struct mcc118ScanThreadInfo
 {
     pthread_t handle;
+    uint8_t address;
     double* scan_buffer;
     uint32_t buffer_size;
+    uint32_t buffer_capacity;   // allocated size of scan_buffer in samples
     uint32_t write_index;
     uint32_t read_index;
-    uint32_t samples_transferred;
+    uint64_t samples_transferred;
     uint32_t buffer_depth;
 
+    double nominal_rate;        // requested scan rate per channel
+    pthread_mutex_t info_mutex; // protects the timestamps, gaps and the
+                                // thread handshake
+    pthread_cond_t thread_cond; // signals a launch or the end of a scan
+    struct mcc118ScanTimestamp timestamps[SCAN_TIMESTAMP_COUNT];
+    uint16_t timestamp_index;   // next timestamp slot to write
+    uint16_t timestamp_count;   // number of valid timestamps
+    struct MCC118ScanGap gaps[SCAN_GAP_COUNT];
+    uint16_t gap_count;         // number of unread gaps
+    uint8_t start_command[10];      // scan start command for re-arming
+    uint32_t segment_size;      // samples in each retriggered segment
+    uint32_t segments_read;     // segments read by the user
+    uint8_t restart_command[10];    // scan start command for auto-recovery
+    int ready_fd;               // eventfd signaled when data is ready, or -1
+    uint32_t ready_threshold;   // samples in the buffer that signal ready_fd
+
     uint16_t read_threshold;
+    uint16_t max_read_size;     // largest block read per transfer
+    uint32_t min_sleep_us;      // shortest time between status reads
+    uint32_t max_sleep_us;      // longest time between status reads
     uint16_t options;
     bool hw_overrun;
     bool buffer_overrun;
     bool thread_running;
     bool stop_thread;
+    bool launch_thread;         // the parked thread should run a scan
+    bool exit_thread;           // the parked thread should exit
     bool triggered;
     bool scan_running;
     uint8_t channel_count;
@@ -175,6 +227,36 @@ struct mcc118ScanThreadInfo
     double offsets[NUM_CHANNELS];
 };
 
+// Local data for software-timed sampling
+struct mcc118SamplerInfo
+{
+    pthread_t handle;
+    pthread_mutex_t mutex;      // protects the buffer and statistics
+    uint8_t address;
+    bool stop_thread;
+    uint8_t channel_mask;
+    uint8_t channel_count;
+    uint32_t options;
+    uint64_t period_ns;
+
+    double* timestamps;         // CLOCK_MONOTONIC time of each sample
+    double* values;             // channel values for each sample
+    uint32_t buffer_size;       // in samples per channel
+    uint32_t write_index;
+    uint32_t read_index;
+    uint32_t buffer_depth;
+
+    uint64_t sample_count;
+    uint64_t missed_deadlines;
+    uint64_t buffer_overruns;
+    int last_error;
+    double first_time;
+    double last_time;
+    double jitter_sum;
+    double jitter_max;
+    uint32_t jitter_histogram[SAMPLER_JITTER_BINS];
+};
+
 // Local data for each open MCC 118 board.
 struct mcc118Device
 {
@@ -184,8 +266,14 @@ struct mcc118Device
     uint16_t boot_version;      // bootloader version
     int spi_fd;                 // SPI file descriptor
     uint8_t trigger_mode;       // Trigger mode
+    struct MCC118ScanConfig scan_config;    // Scan transfer settings
     struct mcc118FactoryData factory_data;   // Factory data
     struct mcc118ScanThreadInfo* scan_info; // Scan info
+    struct mcc118SamplerInfo* sampler_info; // Software-timed sampler info
+    double* spare_buffer;       // scan buffer kept for reuse by the next scan
+    struct mcc118ScanThreadInfo* spare_info;    // scan info and its parked
+                                                // thread kept for reuse
+    uint32_t spare_buffer_size; // size of spare_buffer in samples
 };
 
 /// \endcond
@@ -195,6 +283,7 @@ struct mcc118Device
 
 static struct mcc118Device* _devices[MAX_NUMBER_HATS];
 static bool _mcc118_lib_initialized = false;
+static pthread_once_t _mcc118_lib_once = PTHREAD_ONCE_INIT;
 
 #ifdef DEBUG
 static bool log_open = false;
@@ -350,7 +439,8 @@ static int _create_frame(uint8_t* buffer, uint8_t command, uint16_t count,
 }
 
 /******************************************************************************
-  Perform command / response SPI transfers to an MCC 118.
+  Perform command / response SPI transfers to an MCC 118.  The caller must hold 
+  the SPI lock and have selected the board with _spi_select().
 
   address: board address
   command: firmware API command code
@@ -363,7 +453,7 @@ static int _create_frame(uint8_t* buffer, uint8_t command, uint16_t count,
 
   Return: RESULT_SUCCESS if successful
  *****************************************************************************/
-static int _spi_transfer(uint8_t address, uint8_t command, void* tx_data, 
+static int _spi_command(uint8_t address, uint8_t command, void* tx_data, 
     uint16_t tx_data_count, void* rx_data, uint16_t rx_data_count, 
     uint32_t reply_timeout_us, uint32_t retry_us)
 {
@@ -372,9 +462,7 @@ static int _spi_transfer(uint8_t address, uint8_t command, void* tx_data,
     uint32_t diff;
     bool got_reply;
     bool resend;
-    int lock_fd;
     int ret;
-    uint8_t temp;
     bool timeout;
 
     uint16_t tx_count;
@@ -411,41 +499,6 @@ static int _spi_transfer(uint8_t address, uint8_t command, void* tx_data,
     // create a tx frame
     tx_count = _create_frame(tx_buffer, command, tx_data_count, tx_data);
 
-    // Obtain a spi lock
-    if ((lock_fd = _obtain_lock()) < 0)
-    {
-        // could not get a lock within 5 seconds, report as a timeout
-        free(tx_buffer);
-        free(rx_buffer);
-        free(temp_buffer);
-        return RESULT_LOCK_TIMEOUT;
-    }
-
-    _set_address(address);
-
-    // check spi mode and change if necessary
-    ret = ioctl(dev->spi_fd, SPI_IOC_RD_MODE, &temp);
-    if (ret == -1)
-    {
-        _release_lock(lock_fd);
-        free(tx_buffer);
-        free(rx_buffer);
-        free(temp_buffer);
-        return RESULT_UNDEFINED;
-    }
-    if (temp != spi_mode)
-    {
-        ret = ioctl(dev->spi_fd, SPI_IOC_WR_MODE, &spi_mode);
-        if (ret == -1)
-        {
-            _release_lock(lock_fd);
-            free(tx_buffer);
-            free(rx_buffer);
-            free(temp_buffer);
-            return RESULT_UNDEFINED;
-        }
-    }
-
     // Init the spi ioctl structure, using temp_buffer for the intermediate
     // reply.
     struct spi_ioc_transfer tr = {
@@ -464,7 +517,6 @@ static int _spi_transfer(uint8_t address, uint8_t command, void* tx_data,
     {
         if ((ret = ioctl(dev->spi_fd, SPI_IOC_MESSAGE(1), &tr)) < 1)
         {
-            _release_lock(lock_fd);
             free(tx_buffer);
             free(rx_buffer);
             free(temp_buffer);
@@ -558,8 +610,6 @@ static int _spi_transfer(uint8_t address, uint8_t command, void* tx_data,
 
     if (!got_reply)
     {
-        // clear the SPI lock
-        _release_lock(lock_fd);
         free(tx_buffer);
         free(rx_buffer);
         free(temp_buffer);
@@ -602,9 +652,6 @@ static int _spi_transfer(uint8_t address, uint8_t command, void* tx_data,
         ret = RESULT_BAD_PARAMETER;
     }
 
-    // clear the SPI lock
-    _release_lock(lock_fd);
-
     free(tx_buffer);
     free(rx_buffer);
     free(temp_buffer);
@@ -612,6 +659,77 @@ static int _spi_transfer(uint8_t address, uint8_t command, void* tx_data,
     return ret;
 }
 
+/******************************************************************************
+  Obtain the SPI lock, select the board and set the SPI mode for a series of 
+  _spi_command() calls.
+
+  address: board address
+  lock_fd: receives the lock handle to pass to _release_lock()
+
+  Return: RESULT_SUCCESS if successful
+ *****************************************************************************/
+static int _spi_select(uint8_t address, int* lock_fd)
+{
+    uint8_t temp;
+    struct mcc118Device* dev = _devices[address];
+
+    // Obtain a spi lock
+    if ((*lock_fd = _obtain_lock()) < 0)
+    {
+        // could not get a lock within 5 seconds, report as a timeout
+        return RESULT_LOCK_TIMEOUT;
+    }
+
+    _set_address(address);
+
+    // check spi mode and change if necessary
+    if (ioctl(dev->spi_fd, SPI_IOC_RD_MODE, &temp) == -1)
+    {
+        _release_lock(*lock_fd);
+        return RESULT_UNDEFINED;
+    }
+    if (temp != spi_mode)
+    {
+        if (ioctl(dev->spi_fd, SPI_IOC_WR_MODE, &spi_mode) == -1)
+        {
+            _release_lock(*lock_fd);
+            return RESULT_UNDEFINED;
+        }
+    }
+
+    return RESULT_SUCCESS;
+}
+
+/******************************************************************************
+  Perform a single command / response SPI transfer to an MCC 118 under its own 
+  SPI lock.  The arguments are the same as _spi_command().
+ *****************************************************************************/
+static int _spi_transfer(uint8_t address, uint8_t command, void* tx_data, 
+    uint16_t tx_data_count, void* rx_data, uint16_t rx_data_count, 
+    uint32_t reply_timeout_us, uint32_t retry_us)
+{
+    int lock_fd;
+    int ret;
+
+    if (!_check_addr(address))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    if ((ret = _spi_select(address, &lock_fd)) != RESULT_SUCCESS)
+    {
+        return ret;
+    }
+
+    ret = _spi_command(address, command, tx_data, tx_data_count, rx_data, 
+        rx_data_count, reply_timeout_us, retry_us);
+
+    // clear the SPI lock
+    _release_lock(lock_fd);
+
+    return ret;
+}
+
 /******************************************************************************
   Sets an mcc118FactoryData to default values.
  *****************************************************************************/
@@ -791,21 +909,231 @@ static int _parse_factory_data(cJSON* root, struct mcc118FactoryData* data)
 }
 
 /******************************************************************************
-  Perform any library initialization.
+  Initialize the library variables.  Called only once.
+ *****************************************************************************/
+static void _mcc118_lib_init_once(void)
+{
+    int i;
+
+    for (i = 0; i < MAX_NUMBER_HATS; i++)
+    {
+        _devices[i] = NULL;
+    }
+
+    _mcc118_lib_initialized = true;
+}
+
+/******************************************************************************
+  Perform any library initialization.  Boards may be opened from several
+  threads at once, e.g. by hat_open_all().
  *****************************************************************************/
 static void _mcc118_lib_init(void)
 {
+    pthread_once(&_mcc118_lib_once, _mcc118_lib_init_once);
+}
+
+/******************************************************************************
+  Convert a struct timespec to seconds.
+ *****************************************************************************/
+static double _timespec_to_sec(struct timespec* ts)
+{
+    return (double)ts->tv_sec + (double)ts->tv_nsec / 1e9;
+}
+
+/******************************************************************************
+  Save the number of samples per channel the device had acquired along with the
+  host clock times when the count was read.
+ *****************************************************************************/
+static void _scan_save_timestamp(struct mcc118ScanThreadInfo* info,
+    uint64_t sample_count, struct timespec* monotonic_time,
+    struct timespec* real_time)
+{
+    struct mcc118ScanTimestamp* entry;
+
+    pthread_mutex_lock(&info->info_mutex);
+    entry = &info->timestamps[info->timestamp_index];
+    entry->sample_count = sample_count;
+    entry->monotonic_time = _timespec_to_sec(monotonic_time);
+    entry->real_time = _timespec_to_sec(real_time);
+
+    info->timestamp_index++;
+    if (info->timestamp_index >= SCAN_TIMESTAMP_COUNT)
+    {
+        info->timestamp_index = 0;
+    }
+    if (info->timestamp_count < SCAN_TIMESTAMP_COUNT)
+    {
+        info->timestamp_count++;
+    }
+    pthread_mutex_unlock(&info->info_mutex);
+}
+
+/******************************************************************************
+  Fit a line through the saved timestamps using least squares.  The fit is
+  returned relative to the most recent timestamp so the sample time is:
+
+    monotonic_time = ref_time + (sample_count - ref_count) * period
+
+  real_offset is the difference between CLOCK_REALTIME and CLOCK_MONOTONIC at
+  the most recent timestamp.  If there are fewer than 2 timestamps the nominal
+  rate is used for the period.
+
+  Return: the number of timestamps used in the fit
+ *****************************************************************************/
+static int _scan_fit_timestamps(struct mcc118ScanThreadInfo* info,
+    uint64_t* ref_count, double* ref_time, double* period, double* real_offset)
+{
+    struct mcc118ScanTimestamp latest;
+    struct mcc118ScanTimestamp* entry;
+    double mean_x;
+    double mean_t;
+    double sxx;
+    double sxt;
+    double dx;
+    double dt;
+    int count;
     int i;
 
-    if (!_mcc118_lib_initialized)
+    pthread_mutex_lock(&info->info_mutex);
+    count = info->timestamp_count;
+    if (count == 0)
+    {
+        pthread_mutex_unlock(&info->info_mutex);
+        return 0;
+    }
+
+    // copy the latest timestamp; the scan thread may overwrite its slot once
+    // the mutex is released
+    latest = info->timestamps[(info->timestamp_index + SCAN_TIMESTAMP_COUNT -
+        1) % SCAN_TIMESTAMP_COUNT];
+    *ref_count = latest.sample_count;
+    *real_offset = latest.real_time - latest.monotonic_time;
+
+    // use values relative to the latest timestamp to preserve precision
+    mean_x = 0.0;
+    mean_t = 0.0;
+    for (i = 0; i < count; i++)
+    {
+        entry = &info->timestamps[i];
+        mean_x += (double)entry->sample_count - (double)latest.sample_count;
+        mean_t += entry->monotonic_time - latest.monotonic_time;
+    }
+    mean_x /= count;
+    mean_t /= count;
+
+    sxx = 0.0;
+    sxt = 0.0;
+    for (i = 0; i < count; i++)
+    {
+        entry = &info->timestamps[i];
+        dx = (double)entry->sample_count - (double)latest.sample_count -
+            mean_x;
+        dt = entry->monotonic_time - latest.monotonic_time - mean_t;
+        sxx += dx * dx;
+        sxt += dx * dt;
+    }
+    pthread_mutex_unlock(&info->info_mutex);
+
+    if ((count > 1) && (sxx > 0.0) && (sxt > 0.0))
+    {
+        *period = sxt / sxx;
+        *ref_time = latest.monotonic_time + mean_t - (mean_x * *period);
+    }
+    else if (info->nominal_rate > 0.0)
+    {
+        *period = 1.0 / info->nominal_rate;
+        *ref_time = latest.monotonic_time;
+        count = 1;
+    }
+    else
+    {
+        // external clock with no rate specified, can't estimate yet
+        count = 0;
+    }
+
+    return count;
+}
+
+/******************************************************************************
+  Record a gap in the scan data.  Consecutive gaps at the same sample index are
+  merged, as are new gaps when the gap list is full.  The timestamps are
+  cleared because the device sample count no longer matches the data in the
+  scan buffer.
+ *****************************************************************************/
+static void _scan_add_gap(struct mcc118ScanThreadInfo* info,
+    uint64_t sample_index, uint64_t samples_lost)
+{
+    struct MCC118ScanGap* last;
+
+    pthread_mutex_lock(&info->info_mutex);
+    last = (info->gap_count > 0) ? &info->gaps[info->gap_count - 1] : NULL;
+    if (last &&
+        ((last->sample_index == sample_index) ||
+         (info->gap_count >= SCAN_GAP_COUNT)))
+    {
+        last->samples_lost += samples_lost;
+    }
+    else
+    {
+        info->gaps[info->gap_count].sample_index = sample_index;
+        info->gaps[info->gap_count].samples_lost = samples_lost;
+        info->gap_count++;
+    }
+
+    info->timestamp_index = 0;
+    info->timestamp_count = 0;
+    pthread_mutex_unlock(&info->info_mutex);
+}
+
+/******************************************************************************
+  Restart the device scan after a hardware overrun and record the estimated
+  number of lost samples as a gap.
+ *****************************************************************************/
+static int _scan_restart(uint8_t address)
+{
+    struct mcc118ScanThreadInfo* info = _devices[address]->scan_info;
+    struct timespec restart_time;
+    uint64_t sample_index;
+    uint64_t samples_lost;
+    uint64_t ref_count;
+    double ref_time;
+    double period;
+    double real_offset;
+    double expected;
+    int ret;
+
+    // make sure the device scan is stopped, then start it again without 
+    // waiting for a trigger
+    _spi_transfer(address, CMD_AINSCANSTOP, NULL, 0, NULL, 0, 20*MSEC, 10);
+
+    clock_gettime(CLOCK_MONOTONIC, &restart_time);
+    ret = _spi_transfer(address, CMD_AINSCANSTART, info->restart_command, 10,
+        NULL, 0, 20*MSEC, 0);
+    if (ret != RESULT_SUCCESS)
+    {
+        return ret;
+    }
+
+    // estimate how many samples the device would have acquired by now and 
+    // count the ones we did not receive as lost
+    sample_index = info->samples_transferred / info->channel_count;
+    samples_lost = 0;
+    if (_scan_fit_timestamps(info, &ref_count, &ref_time, &period, 
+        &real_offset) > 0)
     {
-        for (i = 0; i < MAX_NUMBER_HATS; i++)
+        expected = (double)ref_count + 
+            (_timespec_to_sec(&restart_time) - ref_time) / period;
+        if (expected > (double)sample_index)
         {
-            _devices[i] = NULL;
+            samples_lost = (uint64_t)(expected - (double)sample_index + 0.5);
         }
-
-        _mcc118_lib_initialized = true;
     }
+
+    _scan_add_gap(info, sample_index, samples_lost);
+
+    // the restarted scan begins with the first channel
+    info->channel_index = 0;
+    return RESULT_SUCCESS;
 }
 
 /******************************************************************************
@@ -878,7 +1206,7 @@ static int _a_in_read_scan_data(uint8_t address, uint16_t sample_count,
 /******************************************************************************
  Reads the scan status and data until the scan ends.
  *****************************************************************************/
-static void* _scan_thread(void* arg)
+static void _scan_run(struct mcc118ScanThreadInfo* info)
 {
     bool done;
     uint16_t available_samples;
@@ -887,25 +1215,21 @@ static void* _scan_thread(void* arg)
     int error;
     uint32_t sleep_us;
     uint32_t status_count;
-    uint8_t address = *(uint8_t*)arg;
-    struct mcc118ScanThreadInfo* info = _devices[address]->scan_info;
+    uint8_t address = info->address;
     bool calibrated;
     bool scaled;
     //uint16_t largest_read;
     uint8_t rx_buffer[5];
     bool scan_running;
+    struct timespec status_monotonic;
+    struct timespec status_real;
+    bool recover;
+    bool retrigger;
+    double discard_buffer[MAX_SAMPLES_READ_LIMIT];
 #ifdef DEBUG
     char str[80];
 #endif
 
-    free(arg);
-
-    if (!_check_addr(address) ||
-        (info == NULL))
-    {
-        return NULL;
-    }
-
     info->thread_running = true;
     info->hw_overrun = false;
     status_count = 0;
@@ -928,16 +1252,21 @@ static void* _scan_thread(void* arg)
         calibrated = true;
     }
 
-#define MIN_SLEEP_US	200
+    recover = (info->options & OPTS_AUTORECOVER) == OPTS_AUTORECOVER;
+    retrigger = (info->options & OPTS_RETRIGGER) == OPTS_RETRIGGER;
 
     done = false;
-    sleep_us = MIN_SLEEP_US;
+    sleep_us = info->min_sleep_us;
     while (!info->stop_thread && !done)
     {
         // read the scan status
         if (_spi_transfer(address, CMD_AINSCANSTATUS, NULL, 0, rx_buffer, 5, 
             1*MSEC, 20) == RESULT_SUCCESS)
         {
+            // save the time of the status read for sample time estimation
+            clock_gettime(CLOCK_MONOTONIC, &status_monotonic);
+            clock_gettime(CLOCK_REALTIME, &status_real);
+
             available_samples = ((uint16_t)rx_buffer[2] << 8) + rx_buffer[1];
             max_read_now = ((uint16_t)rx_buffer[4] << 8) + rx_buffer[3];
             scan_running = (rx_buffer[0] & 0x01) == 0x01;
@@ -946,7 +1275,24 @@ static void* _scan_thread(void* arg)
 
             status_count++;
 
-            if (info->hw_overrun)
+            if (info->hw_overrun && recover)
+            {
+#ifdef DEBUG
+                _syslog("hw overrun, restarting");
+#endif
+                if (_scan_restart(address) == RESULT_SUCCESS)
+                {
+                    info->hw_overrun = false;
+                    sleep_us = info->min_sleep_us;
+                    status_count = 0;
+                }
+                else
+                {
+                    done = true;
+                    info->scan_running = false;
+                }
+            }
+            else if (info->hw_overrun)
             {
 #ifdef DEBUG
                 _syslog("hw overrun");
@@ -966,9 +1312,9 @@ static void* _scan_thread(void* arg)
                     {
                         read_count = max_read_now;
                     }
-                    if (read_count > MAX_SAMPLES_READ)
+                    if (read_count > info->max_read_size)
                     {
-                        read_count = MAX_SAMPLES_READ;
+                        read_count = info->max_read_size;
                     }
                 }
                 else
@@ -976,7 +1322,46 @@ static void* _scan_thread(void* arg)
                     read_count = 0;
                 }
 
-                if (read_count > 0)
+                if (recover)
+                {
+                    // only read whole frames so gaps keep the channels aligned
+                    read_count = COUNT_NORMALIZE(read_count,
+                        info->channel_count);
+
+                    if (!scan_running && (read_count == 0) &&
+                        (available_samples > 0) &&
+                        (available_samples < info->channel_count) &&
+                        (available_samples <= max_read_now))
+                    {
+                        // the device stopped with a partial frame; discard
+                        // it so the scan can end
+                        if (_a_in_read_scan_data(address, available_samples,
+                            scaled, calibrated, discard_buffer) ==
+                            RESULT_SUCCESS)
+                        {
+                            available_samples = 0;
+                        }
+                    }
+                }
+
+                if ((read_count > 0) && recover &&
+                    ((info->buffer_depth + read_count) > info->buffer_size))
+                {
+                    // the scan buffer is full; read the data from the device 
+                    // so it does not overrun and record it as lost
+                    if ((error = _a_in_read_scan_data(address, read_count,
+                        scaled, calibrated, discard_buffer)) == RESULT_SUCCESS)
+                    {
+#ifdef DEBUG
+                        _syslog("buffer full, discarding data");
+#endif
+                        _scan_add_gap(info, 
+                            info->samples_transferred / info->channel_count,
+                            read_count / info->channel_count);
+                    }
+                    status_count = 0;
+                }
+                else if (read_count > 0)
                 {
                     // handle wrap at end of buffer
                     if ((info->buffer_size - info->write_index) < read_count)
@@ -984,11 +1369,31 @@ static void* _scan_thread(void* arg)
                         read_count = (info->buffer_size - info->write_index);
                     }
 
-                    if ((error = _a_in_read_scan_data(address, read_count, 
+                    if ((info->buffer_depth + read_count) > info->buffer_size)
+                    {
+                        // stop with an overrun rather than overwrite data 
+                        // that has not been read or released
+#ifdef DEBUG
+                        _syslog("buffer overrun");
+#endif
+                        info->buffer_overrun = true;
+                        info->scan_running = false;
+                        done = true;
+                    }
+                    else if ((error = _a_in_read_scan_data(address, read_count, 
                         scaled, calibrated, 
                         &info->scan_buffer[info->write_index])) == 
                         RESULT_SUCCESS)
                     {
+                        if (scan_running)
+                        {
+                            // the device had acquired available_samples more
+                            // than we have read when the status was read
+                            _scan_save_timestamp(info, 
+                                (info->samples_transferred + 
+                                available_samples) / info->channel_count,
+                                &status_monotonic, &status_real);
+                        }
 #ifdef DEBUG
                         sprintf(str, "scan_thread_read %d %d %d", 
                             info->write_index, read_count, info->buffer_depth);
@@ -1001,15 +1406,10 @@ static void* _scan_thread(void* arg)
                         }
 
                         info->buffer_depth += read_count;
-
-                        if (info->buffer_depth > info->buffer_size)
+                        if ((info->ready_fd >= 0) &&
+                            (info->buffer_depth >= info->ready_threshold))
                         {
-#ifdef DEBUG
-                            _syslog("buffer overrun");
-#endif
-                            info->buffer_overrun = true;
-                            info->scan_running = false;
-                            done = true;
+                            eventfd_write(info->ready_fd, 1);
                         }
                         info->samples_transferred += read_count;
                     }
@@ -1025,13 +1425,17 @@ static void* _scan_thread(void* arg)
                     if (status_count > 4)
                     {
                         sleep_us *= 2;
+                        if (sleep_us > info->max_sleep_us)
+                        {
+                            sleep_us = info->max_sleep_us;
+                        }
                     }
                     else if (status_count < 1)
                     {
                         sleep_us /= 2;
-                        if (sleep_us < MIN_SLEEP_US)
+                        if (sleep_us < info->min_sleep_us)
                         {
-                            sleep_us = MIN_SLEEP_US;
+                            sleep_us = info->min_sleep_us;
                         }
                     }
 
@@ -1040,8 +1444,31 @@ static void* _scan_thread(void* arg)
 
                 if (!scan_running && (available_samples == read_count))
                 {
-                    done = true;
-                    info->scan_running = false;
+                    if (retrigger && !info->stop_thread &&
+                        (_spi_transfer(address, CMD_AINSCANSTART, 
+                            info->start_command, sizeof(info->start_command), 
+                            NULL, 0, 20*MSEC, 0) == RESULT_SUCCESS))
+                    {
+                        // the device is waiting for the next trigger; the
+                        // next segment is not continuous in time with this one
+                        pthread_mutex_lock(&info->info_mutex);
+                        info->timestamp_index = 0;
+                        info->timestamp_count = 0;
+                        pthread_mutex_unlock(&info->info_mutex);
+                        sleep_us = info->min_sleep_us;
+                        status_count = 0;
+                    }
+                    else
+                    {
+                        done = true;
+                        info->scan_running = false;
+                    }
+                }
+                else if (retrigger && !scan_running)
+                {
+                    // the device finished a segment; unload it without 
+                    // waiting so it can be re-armed sooner
+                    continue;
                 }
             }
         }
@@ -1057,13 +1484,406 @@ static void* _scan_thread(void* arg)
     }
 
     info->thread_running = false;
-    return NULL;
+    if (info->ready_fd >= 0)
+    {
+        // wake any waiter so it sees the scan has ended
+        eventfd_write(info->ready_fd, 1);
+    }
 }
 
-
-//*****************************************************************************
-// Global Functions
-
+/******************************************************************************
+ Runs a scan each time one is launched and stays parked between scans so 
+ re-armed and restarted scans do not create a new thread.
+ *****************************************************************************/
+static void* _scan_thread(void* arg)
+{
+    struct mcc118ScanThreadInfo* info = (struct mcc118ScanThreadInfo*)arg;
+
+    pthread_mutex_lock(&info->info_mutex);
+    while (!info->exit_thread)
+    {
+        if (info->launch_thread)
+        {
+            info->launch_thread = false;
+            pthread_mutex_unlock(&info->info_mutex);
+
+            _scan_run(info);
+
+            pthread_mutex_lock(&info->info_mutex);
+            // tell any waiter that the scan has ended
+            pthread_cond_broadcast(&info->thread_cond);
+        }
+        else
+        {
+            pthread_cond_wait(&info->thread_cond, &info->info_mutex);
+        }
+    }
+    pthread_mutex_unlock(&info->info_mutex);
+
+    return NULL;
+}
+
+/******************************************************************************
+  Stop the scan run by the parked thread and wait until the thread is idle.
+ *****************************************************************************/
+static void _scan_thread_idle(struct mcc118ScanThreadInfo* info)
+{
+    if (info->handle == 0)
+    {
+        return;
+    }
+
+    // the thread will send the a_in_stop_scan command if the scan is running
+    info->stop_thread = true;
+
+    pthread_mutex_lock(&info->info_mutex);
+    while (info->launch_thread || info->thread_running)
+    {
+        pthread_cond_wait(&info->thread_cond, &info->info_mutex);
+    }
+    pthread_mutex_unlock(&info->info_mutex);
+}
+
+/******************************************************************************
+  Stop the scan thread and free the scan info.
+ *****************************************************************************/
+static void _scan_info_free(struct mcc118ScanThreadInfo* info)
+{
+    if (info == NULL)
+    {
+        return;
+    }
+
+    _scan_thread_idle(info);
+    if (info->handle != 0)
+    {
+        pthread_mutex_lock(&info->info_mutex);
+        info->exit_thread = true;
+        pthread_cond_broadcast(&info->thread_cond);
+        pthread_mutex_unlock(&info->info_mutex);
+
+        pthread_join(info->handle, NULL);
+        info->handle = 0;
+    }
+
+    if (info->ready_fd >= 0)
+    {
+        close(info->ready_fd);
+    }
+    pthread_cond_destroy(&info->thread_cond);
+    pthread_mutex_destroy(&info->info_mutex);
+    free(info);
+}
+
+
+/******************************************************************************
+  Get a scan buffer of at least the specified number of samples, reusing the 
+  buffer kept from a previous scan when it is large enough. New buffers are 
+  prefaulted so the scan thread does not take page faults while writing.
+ *****************************************************************************/
+static double* _scan_buffer_get(struct mcc118Device* dev, uint32_t size,
+    uint32_t* capacity)
+{
+    double* buffer;
+
+    if ((dev->spare_buffer != NULL) &&
+        (dev->spare_buffer_size >= size))
+    {
+        buffer = dev->spare_buffer;
+        *capacity = dev->spare_buffer_size;
+        dev->spare_buffer = NULL;
+        dev->spare_buffer_size = 0;
+        return buffer;
+    }
+
+    // the spare is too small, so release it before allocating
+    free(dev->spare_buffer);
+    dev->spare_buffer = NULL;
+    dev->spare_buffer_size = 0;
+
+#ifdef DEBUG
+    char str[80];
+    sprintf(str, "malloc %d", size * sizeof(double));
+    _syslog(str);
+#endif
+    buffer = (double*)malloc(size * sizeof(double));
+    if (buffer != NULL)
+    {
+        memset(buffer, 0, size * sizeof(double));
+        *capacity = size;
+    }
+    return buffer;
+}
+
+/******************************************************************************
+  Return a scan buffer to the device for reuse by the next scan.
+ *****************************************************************************/
+static void _scan_buffer_put(struct mcc118Device* dev, double* buffer,
+    uint32_t capacity)
+{
+    if (buffer == NULL)
+    {
+        return;
+    }
+
+    // keep the larger of the two buffers
+    if (dev->spare_buffer_size > capacity)
+    {
+        free(buffer);
+    }
+    else
+    {
+        free(dev->spare_buffer);
+        dev->spare_buffer = buffer;
+        dev->spare_buffer_size = capacity;
+    }
+}
+
+/******************************************************************************
+  Reset the scan state, send the saved scan start command and wake the parked 
+  scan thread, creating it the first time.
+ *****************************************************************************/
+static int _scan_launch(uint8_t address)
+{
+    int result;
+    struct mcc118ScanThreadInfo* info = _devices[address]->scan_info;
+    pthread_attr_t attr;
+
+    info->write_index = 0;
+    info->read_index = 0;
+    info->buffer_depth = 0;
+    info->samples_transferred = 0;
+    info->segments_read = 0;
+    info->channel_index = 0;
+    info->hw_overrun = false;
+    info->buffer_overrun = false;
+    info->triggered = false;
+    info->stop_thread = false;
+    info->scan_running = false;
+    pthread_mutex_lock(&info->info_mutex);
+    info->timestamp_index = 0;
+    info->timestamp_count = 0;
+    info->gap_count = 0;
+    pthread_mutex_unlock(&info->info_mutex);
+
+    result = _spi_transfer(address, CMD_AINSCANSTART, info->start_command, 
+        sizeof(info->start_command), NULL, 0, 20*MSEC, 0);
+    if (result != RESULT_SUCCESS)
+    {
+        return result;
+    }
+
+    // mark the scan running before waking the thread so the thread can clear 
+    // it if the scan finishes right away
+    pthread_mutex_lock(&info->info_mutex);
+    info->scan_running = true;
+    info->thread_running = true;
+    info->launch_thread = true;
+    pthread_cond_broadcast(&info->thread_cond);
+    pthread_mutex_unlock(&info->info_mutex);
+
+    if (info->handle != 0)
+    {
+        return RESULT_SUCCESS;
+    }
+
+    // create the scan data thread
+    if ((result = pthread_attr_init(&attr)) == 0)
+    {
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+        result = pthread_create(&info->handle, &attr, &_scan_thread, info);
+        pthread_attr_destroy(&attr);
+    }
+    if (result != 0)
+    {
+        mcc118_a_in_scan_stop(address);
+        info->scan_running = false;
+        info->thread_running = false;
+        info->launch_thread = false;
+        info->handle = 0;
+        return RESULT_RESOURCE_UNAVAIL;
+    }
+
+    return RESULT_SUCCESS;
+}
+
+/******************************************************************************
+  Return the scan info to the device for reuse by the next scan.  The scan 
+  thread stays parked and the buffer goes back to the buffer pool.
+ *****************************************************************************/
+static void _scan_info_put(struct mcc118Device* dev)
+{
+    struct mcc118ScanThreadInfo* info = dev->scan_info;
+
+    _scan_thread_idle(info);
+
+    if (info->ready_fd >= 0)
+    {
+        close(info->ready_fd);
+        info->ready_fd = -1;
+    }
+    _scan_buffer_put(dev, info->scan_buffer, info->buffer_capacity);
+    info->scan_buffer = NULL;
+
+    _scan_info_free(dev->spare_info);
+    dev->spare_info = info;
+    dev->scan_info = NULL;
+}
+
+/******************************************************************************
+  Add nanoseconds to a timespec.
+ *****************************************************************************/
+static void _timespec_add_ns(struct timespec* ts, uint64_t ns)
+{
+    ns += ts->tv_nsec;
+    ts->tv_sec += ns / 1000000000ull;
+    ts->tv_nsec = ns % 1000000000ull;
+}
+
+/******************************************************************************
+  Return the jitter value below which the given fraction of the sampler 
+  deadlines were met.  Must be called with the sampler mutex held.
+ *****************************************************************************/
+static double _sampler_jitter_percentile(struct mcc118SamplerInfo* info,
+    double fraction)
+{
+    uint64_t target;
+    uint64_t count;
+    uint32_t bin;
+
+    if (info->sample_count == 0)
+    {
+        return 0.0;
+    }
+
+    target = (uint64_t)(fraction * info->sample_count + 0.5);
+    if (target == 0)
+    {
+        target = 1;
+    }
+    count = 0;
+    for (bin = 0; bin < SAMPLER_JITTER_BINS - 1; bin++)
+    {
+        count += info->jitter_histogram[bin];
+        if (count >= target)
+        {
+            return (double)(bin + 1) * SAMPLER_JITTER_BIN_NS / 1e9;
+        }
+    }
+    return info->jitter_max;
+}
+
+/******************************************************************************
+  Software-timed sampler thread.  Reads the channels at absolute deadlines 
+  and stores timestamped samples in the sampler buffer.
+ *****************************************************************************/
+static void* _sampler_thread(void* arg)
+{
+    struct mcc118SamplerInfo* info = (struct mcc118SamplerInfo*)arg;
+    struct timespec deadline;
+    struct timespec wake;
+    struct timespec now;
+    double values[NUM_CHANNELS];
+    double now_time;
+    int64_t late_ns;
+    uint64_t missed;
+    uint32_t bin;
+    int result;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    while (!info->stop_thread)
+    {
+        // sleep until the deadline; the time is absolute so the sampling 
+        // interval does not accumulate the time spent reading.  Long periods 
+        // are slept in steps so a stop request is not delayed.
+        do
+        {
+            clock_gettime(CLOCK_MONOTONIC, &wake);
+            _timespec_add_ns(&wake, SAMPLER_MAX_SLEEP_NS);
+            if ((wake.tv_sec > deadline.tv_sec) ||
+                ((wake.tv_sec == deadline.tv_sec) && 
+                (wake.tv_nsec > deadline.tv_nsec)))
+            {
+                wake = deadline;
+            }
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            late_ns = (now.tv_sec - deadline.tv_sec) * 1000000000ll +
+                (now.tv_nsec - deadline.tv_nsec);
+        } while ((late_ns < 0) && !info->stop_thread);
+
+        if (info->stop_thread)
+        {
+            break;
+        }
+        now_time = _timespec_to_sec(&now);
+
+        result = mcc118_a_in_read_multi(info->address, info->channel_mask, 
+            info->options, values);
+
+        pthread_mutex_lock(&info->mutex);
+        if (result == RESULT_SUCCESS)
+        {
+            if (info->sample_count == 0)
+            {
+                info->first_time = now_time;
+            }
+            info->last_time = now_time;
+            info->sample_count++;
+
+            if (info->buffer_depth == info->buffer_size)
+            {
+                // the buffer is full; drop the oldest sample
+                info->read_index = (info->read_index + 1) % info->buffer_size;
+                info->buffer_depth--;
+                info->buffer_overruns++;
+            }
+            info->timestamps[info->write_index] = now_time;
+            memcpy(&info->values[info->write_index * info->channel_count],
+                values, info->channel_count * sizeof(double));
+            info->write_index = (info->write_index + 1) % info->buffer_size;
+            info->buffer_depth++;
+
+            // update the jitter statistics
+            bin = (uint32_t)(late_ns / SAMPLER_JITTER_BIN_NS);
+            if (bin >= SAMPLER_JITTER_BINS)
+            {
+                bin = SAMPLER_JITTER_BINS - 1;
+            }
+            info->jitter_histogram[bin]++;
+            info->jitter_sum += late_ns / 1e9;
+            if ((late_ns / 1e9) > info->jitter_max)
+            {
+                info->jitter_max = late_ns / 1e9;
+            }
+        }
+        else
+        {
+            info->last_error = result;
+        }
+
+        // schedule the next deadline, skipping any that have already passed
+        _timespec_add_ns(&deadline, info->period_ns);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        missed = 0;
+        while ((now.tv_sec > deadline.tv_sec) ||
+            ((now.tv_sec == deadline.tv_sec) && 
+            (now.tv_nsec > deadline.tv_nsec)))
+        {
+            _timespec_add_ns(&deadline, info->period_ns);
+            missed++;
+        }
+        info->missed_deadlines += missed;
+        pthread_mutex_unlock(&info->mutex);
+    }
+
+    return NULL;
+}
+
+//*****************************************************************************
+// Global Functions
+
 /******************************************************************************
   Open a connection to the MCC 118 device at the specified address.
  *****************************************************************************/
@@ -1118,7 +1938,13 @@ int mcc118_open(uint8_t address)
 
         // initialize the struct elements
         dev->scan_info = NULL;
+        dev->sampler_info = NULL;
+        dev->spare_buffer = NULL;
+        dev->spare_buffer_size = 0;
+        dev->spare_info = NULL;
         dev->handle_count = 1;
+        mcc118_a_in_scan_config_preset(SCAN_PROFILE_DEFAULT, 
+            &dev->scan_config);
 
         // open the SPI device handle
         dev->spi_fd = open(spi_device, O_RDWR);
@@ -1132,14 +1958,24 @@ int mcc118_open(uint8_t address)
 
         if (custom_size > 0)
         {
-            // convert the JSON custom data to parameters
-            cJSON* root = cJSON_Parse(custom_data);
-            if (!_parse_factory_data(root, &dev->factory_data))
+            // use the parameters saved from an earlier open if the custom
+            // data has not changed, otherwise convert the JSON custom data
+            if (!_factory_cache_load("mcc118", custom_data, custom_size,
+                &dev->factory_data, sizeof(dev->factory_data)))
             {
-                // invalid custom data, use default values
-                _set_defaults(&dev->factory_data);
+                cJSON* root = cJSON_Parse(custom_data);
+                if (_parse_factory_data(root, &dev->factory_data))
+                {
+                    _factory_cache_save("mcc118", custom_data, custom_size,
+                        &dev->factory_data, sizeof(dev->factory_data));
+                }
+                else
+                {
+                    // invalid custom data, use default values
+                    _set_defaults(&dev->factory_data);
+                }
+                cJSON_Delete(root);
             }
-            cJSON_Delete(root);
 
             free(custom_data);
         }
@@ -1222,11 +2058,14 @@ int mcc118_close(uint8_t address)
     }
 
     mcc118_a_in_scan_cleanup(address);
+    mcc118_a_in_sampler_stop(address);
 
     _devices[address]->handle_count--;
     if (_devices[address]->handle_count == 0)
     {
         close(_devices[address]->spi_fd);
+        _scan_info_free(_devices[address]->spare_info);
+        free(_devices[address]->spare_buffer);
         free(_devices[address]);
         _devices[address] = NULL;
     }
@@ -1377,6 +2216,33 @@ int mcc118_calibration_coefficient_write(uint8_t address, uint8_t channel,
 }
 
 
+/******************************************************************************
+  Convert an ADC code to a calibrated and / or scaled value.
+ *****************************************************************************/
+static double _a_in_scale(struct mcc118Device* dev, uint8_t channel, 
+    uint16_t code, uint32_t options)
+{
+    double val;
+
+    // calibrate?
+    if (options & OPTS_NOCALIBRATEDATA)
+    {
+        val = (double)code;
+    }
+    else
+    {
+        val = ((double)code * dev->factory_data.slopes[channel]) +
+            dev->factory_data.offsets[channel];
+    }
+
+    // calculate voltage?
+    if ((options & OPTS_NOSCALEDATA) == 0)
+    {
+        val = (val * LSB_SIZE) + VOLTAGE_MIN;
+    }
+    return val;
+}
+
 /******************************************************************************
   Perform a single reading of an analog input channel and return the value.
  *****************************************************************************/
@@ -1385,7 +2251,6 @@ int mcc118_a_in_read(uint8_t address, uint8_t channel, uint32_t options,
 {
     int ret;
     uint16_t code;
-    double val;
 
     if (!_check_addr(address) ||
         (channel >= NUM_CHANNELS) ||
@@ -1402,23 +2267,60 @@ int mcc118_a_in_read(uint8_t address, uint8_t channel, uint32_t options,
         return ret;
     }
 
-    // calibrate?
-    if (options & OPTS_NOCALIBRATEDATA)
+    *value = _a_in_scale(_devices[address], channel, code, options);
+    return RESULT_SUCCESS;
+}
+
+/******************************************************************************
+  Read several analog input channels under a single SPI lock and return the 
+  values in channel order.
+ *****************************************************************************/
+int mcc118_a_in_read_multi(uint8_t address, uint8_t channel_mask, 
+    uint32_t options, double* values)
+{
+    int ret;
+    int lock_fd;
+    uint8_t channel;
+    uint8_t count;
+    uint16_t codes[NUM_CHANNELS];
+    uint8_t channels[NUM_CHANNELS];
+
+    if (!_check_addr(address) ||
+        (channel_mask == 0) ||
+        (values == NULL))
     {
-        val = (double)code;
+        return RESULT_BAD_PARAMETER;
     }
-    else
+
+    if ((ret = _spi_select(address, &lock_fd)) != RESULT_SUCCESS)
+    {
+        return ret;
+    }
+
+    // read all of the codes before releasing the lock
+    count = 0;
+    for (channel = 0; channel < NUM_CHANNELS; channel++)
     {
-        val = ((double)code * _devices[address]->factory_data.slopes[channel]) +
-            _devices[address]->factory_data.offsets[channel];
+        if (channel_mask & (1 << channel))
+        {
+            ret = _spi_command(address, CMD_AIN, &channel, 1, &codes[count], 
+                2, 20*MSEC, 10);
+            if (ret != RESULT_SUCCESS)
+            {
+                _release_lock(lock_fd);
+                return ret;
+            }
+            channels[count++] = channel;
+        }
     }
 
-    // calculate voltage?
-    if ((options & OPTS_NOSCALEDATA) == 0)
+    _release_lock(lock_fd);
+
+    for (channel = 0; channel < count; channel++)
     {
-        val = (val * LSB_SIZE) + VOLTAGE_MIN;
+        values[channel] = _a_in_scale(_devices[address], channels[channel], 
+            codes[channel], options);
     }
-    *value = val;
     return RESULT_SUCCESS;
 }
 
@@ -1444,33 +2346,109 @@ int mcc118_trigger_mode(uint8_t address, uint8_t mode)
 }
 
 /******************************************************************************
-  Read the actual scan rate for a set of scan parameters.
+  Fill a scan configuration structure with a preset profile.
  *****************************************************************************/
-int mcc118_a_in_scan_actual_rate(uint8_t channel_count, 
-    double sample_rate_per_channel, double* actual_sample_rate_per_channel)
+int mcc118_a_in_scan_config_preset(uint8_t profile, 
+    struct MCC118ScanConfig* config)
 {
-    double adc_rate;
-    uint32_t period;
-
-    if ((channel_count == 0) || (channel_count > 8) ||
-        (actual_sample_rate_per_channel == NULL))
+    if (config == NULL)
     {
         return RESULT_BAD_PARAMETER;
     }
 
-    // Make sure the rate is within the board specs
-    adc_rate = channel_count * sample_rate_per_channel;
-    if (adc_rate > MAX_ADC_RATE)
-    {
-        *actual_sample_rate_per_channel = 0.0;
+    switch (profile)
+    {
+    case SCAN_PROFILE_DEFAULT:
+        config->target_latency = DEFAULT_SCAN_LATENCY;
+        config->max_block_size = MAX_SAMPLES_READ;
+        config->min_poll_interval_us = DEFAULT_POLL_INTERVAL;
+        break;
+    case SCAN_PROFILE_LOW_LATENCY:
+        config->target_latency = 0.002;
+        config->max_block_size = 64;
+        config->min_poll_interval_us = 100;
+        break;
+    case SCAN_PROFILE_THROUGHPUT:
+        config->target_latency = 0.5;
+        config->max_block_size = MAX_SAMPLES_READ_LIMIT;
+        config->min_poll_interval_us = 1000;
+        break;
+    default:
         return RESULT_BAD_PARAMETER;
     }
 
-    // calculate period value
-    if (sample_rate_per_channel <= ((double)CLOCK_TIMEBASE / 0xFFFFFFFF))
-    {
-        period = 0xFFFFFFFF;
-    }
+    return RESULT_SUCCESS;
+}
+
+/******************************************************************************
+  Set the scan transfer configuration.
+ *****************************************************************************/
+int mcc118_a_in_scan_config_write(uint8_t address, 
+    struct MCC118ScanConfig* config)
+{
+    if (!_check_addr(address) ||
+        (config == NULL) ||
+        (config->target_latency <= 0.0) ||
+        (config->max_block_size < 2) ||
+        (config->max_block_size > MAX_SAMPLES_READ_LIMIT))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    // don't allow changing while scan is running
+    if (_devices[address]->scan_info != NULL)
+    {
+        return RESULT_BUSY;
+    }
+
+    _devices[address]->scan_config = *config;
+    return RESULT_SUCCESS;
+}
+
+/******************************************************************************
+  Read the scan transfer configuration.
+ *****************************************************************************/
+int mcc118_a_in_scan_config_read(uint8_t address, 
+    struct MCC118ScanConfig* config)
+{
+    if (!_check_addr(address) ||
+        (config == NULL))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    *config = _devices[address]->scan_config;
+    return RESULT_SUCCESS;
+}
+
+/******************************************************************************
+  Read the actual scan rate for a set of scan parameters.
+ *****************************************************************************/
+int mcc118_a_in_scan_actual_rate(uint8_t channel_count, 
+    double sample_rate_per_channel, double* actual_sample_rate_per_channel)
+{
+    double adc_rate;
+    uint32_t period;
+
+    if ((channel_count == 0) || (channel_count > 8) ||
+        (actual_sample_rate_per_channel == NULL))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    // Make sure the rate is within the board specs
+    adc_rate = channel_count * sample_rate_per_channel;
+    if (adc_rate > MAX_ADC_RATE)
+    {
+        *actual_sample_rate_per_channel = 0.0;
+        return RESULT_BAD_PARAMETER;
+    }
+
+    // calculate period value
+    if (sample_rate_per_channel <= ((double)CLOCK_TIMEBASE / 0xFFFFFFFF))
+    {
+        period = 0xFFFFFFFF;
+    }
     else
     {
         period = (uint32_t)(CLOCK_TIMEBASE / sample_rate_per_channel + 0.5) - 1;
@@ -1496,7 +2474,6 @@ int mcc118_a_in_scan_start(uint8_t address, uint8_t channel_mask,
     double adc_rate;
     struct mcc118Device* dev;
     struct mcc118ScanThreadInfo* info;
-    uint8_t buffer[10];
     uint32_t period;
     uint32_t scan_count;
     uint8_t scan_options;
@@ -1504,24 +2481,42 @@ int mcc118_a_in_scan_start(uint8_t address, uint8_t channel_mask,
 
     if (!_check_addr(address) ||
         (channel_mask == 0) ||
-        ((samples_per_channel == 0) && ((options & OPTS_CONTINUOUS) == 0)))
+        ((samples_per_channel == 0) && ((options & OPTS_CONTINUOUS) == 0)) ||
+        ((options & OPTS_AUTORECOVER) && ((options & OPTS_CONTINUOUS) == 0)) ||
+        ((options & OPTS_RETRIGGER) && 
+            (((options & OPTS_EXTTRIGGER) == 0) || 
+            (options & OPTS_CONTINUOUS))))
     {
         return RESULT_BAD_PARAMETER;
     }
 
     dev = _devices[address];
 
-    if (dev->scan_info != NULL)
+    if ((dev->scan_info != NULL) ||
+        (dev->sampler_info != NULL))
     {
-        // scan already running?
+        // scan or software-timed sampler already running?
         return RESULT_BUSY;
     }
 
-    dev->scan_info = (struct mcc118ScanThreadInfo*)calloc(
-        sizeof(struct mcc118ScanThreadInfo), 1);
-    if (dev->scan_info == NULL)
+    if (dev->spare_info != NULL)
     {
-        return RESULT_RESOURCE_UNAVAIL;
+        // reuse the scan info and parked thread from the previous scan
+        dev->scan_info = dev->spare_info;
+        dev->spare_info = NULL;
+    }
+    else
+    {
+        dev->scan_info = (struct mcc118ScanThreadInfo*)calloc(
+            sizeof(struct mcc118ScanThreadInfo), 1);
+        if (dev->scan_info == NULL)
+        {
+            return RESULT_RESOURCE_UNAVAIL;
+        }
+        dev->scan_info->address = address;
+        dev->scan_info->ready_fd = -1;
+        pthread_mutex_init(&dev->scan_info->info_mutex, NULL);
+        pthread_cond_init(&dev->scan_info->thread_cond, NULL);
     }
 
     info = dev->scan_info;
@@ -1552,8 +2547,7 @@ int mcc118_a_in_scan_start(uint8_t address, uint8_t channel_mask,
         adc_rate = num_channels * sample_rate_per_channel;
         if (adc_rate > MAX_ADC_RATE)
         {
-            free(info);
-            dev->scan_info = NULL;
+            _scan_info_put(dev);
             return RESULT_BAD_PARAMETER;
         }
     }
@@ -1597,6 +2591,24 @@ int mcc118_a_in_scan_start(uint8_t address, uint8_t channel_mask,
             info->buffer_size = samples_per_channel;
         }
     }
+    else if (options & OPTS_RETRIGGER)
+    {
+        // Retriggered finite scan - buffer several segments, but no less 
+        // than two
+        if (samples_per_channel <= (RETRIGGER_MAX_BUFFER / RETRIGGER_SEGMENTS))
+        {
+            info->buffer_size = samples_per_channel * RETRIGGER_SEGMENTS;
+        }
+        else if (samples_per_channel <= (RETRIGGER_MAX_BUFFER / 2))
+        {
+            info->buffer_size = COUNT_NORMALIZE(RETRIGGER_MAX_BUFFER, 
+                samples_per_channel);
+        }
+        else
+        {
+            info->buffer_size = samples_per_channel * 2;
+        }
+    }
     else
     {
         // Finite scan - buffer size is the number of channels * 
@@ -1605,50 +2617,48 @@ int mcc118_a_in_scan_start(uint8_t address, uint8_t channel_mask,
     }
 
     info->buffer_size *= num_channels;
+    info->segment_size = samples_per_channel * num_channels;
 
     // allocate the buffer
-#ifdef DEBUG
-    char str[80];
-    sprintf(str, "malloc %d", info->buffer_size * sizeof(double));
-    _syslog(str);
-#endif
-    info->scan_buffer = (double*)malloc(info->buffer_size * sizeof(double));
+    info->scan_buffer = _scan_buffer_get(dev, info->buffer_size, 
+        &info->buffer_capacity);
     if (info->scan_buffer == NULL)
     {
         // can't allocate memory
-        free(info);
-        dev->scan_info = NULL;
+        _scan_info_put(dev);
         return RESULT_RESOURCE_UNAVAIL;
     }
 
-    // Set the device read threshold based on the scan rate - read data
-    // every 100ms or faster.
+    // Set the device read threshold based on the scan rate and target 
+    // latency, but no more than half a block so the device has room to keep 
+    // acquiring while we read.
+    info->max_read_size = dev->scan_config.max_block_size;
     if ((adc_rate == 0.0) ||    // rate not specified
-        (adc_rate > 2560.0))
+        (adc_rate * dev->scan_config.target_latency > 
+            info->max_read_size / 2))
     {
-        info->read_threshold = COUNT_NORMALIZE(256, info->channel_count);
+        info->read_threshold = COUNT_NORMALIZE(info->max_read_size / 2, 
+            info->channel_count);
     }
     else
     {
-        info->read_threshold = (uint16_t)(adc_rate / 10);
+        info->read_threshold = (uint16_t)(adc_rate * 
+            dev->scan_config.target_latency);
         info->read_threshold = COUNT_NORMALIZE(info->read_threshold, 
             info->channel_count);
-        if (info->read_threshold == 0)
-        {
-            info->read_threshold = info->channel_count;
-        }
     }
-
-    pthread_attr_t attr;
-    if ((result = pthread_attr_init(&attr)) != 0)
+    if (info->read_threshold == 0)
     {
-        free(info->scan_buffer);
-        free(info);
-        dev->scan_info = NULL;
-        return RESULT_RESOURCE_UNAVAIL;
+        info->read_threshold = info->channel_count;
     }
 
-    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+    // poll at least twice per latency period
+    info->min_sleep_us = dev->scan_config.min_poll_interval_us;
+    info->max_sleep_us = (uint32_t)(dev->scan_config.target_latency * 1e6 / 2);
+    if (info->max_sleep_us < info->min_sleep_us)
+    {
+        info->max_sleep_us = info->min_sleep_us;
+    }
 
     // Start the scan
     scan_options = 0;
@@ -1676,6 +2686,16 @@ int mcc118_a_in_scan_start(uint8_t address, uint8_t channel_mask,
         }
     }
 
+    // save the rate for sample time estimation
+    if (options & OPTS_EXTCLOCK)
+    {
+        info->nominal_rate = sample_rate_per_channel;
+    }
+    else
+    {
+        info->nominal_rate = CLOCK_TIMEBASE / ((double)period + 1);
+    }
+
     if (options & OPTS_CONTINUOUS)
     {
         // set to 0 for continuous
@@ -1687,49 +2707,57 @@ int mcc118_a_in_scan_start(uint8_t address, uint8_t channel_mask,
     }
 
 
-    buffer[0] = (uint8_t)scan_count;
-    buffer[1] = (uint8_t)(scan_count >> 8);
-    buffer[2] = (uint8_t)(scan_count >> 16);
-    buffer[3] = (uint8_t)(scan_count >> 24);
-    buffer[4] = (uint8_t)period;
-    buffer[5] = (uint8_t)(period >> 8);
-    buffer[6] = (uint8_t)(period >> 16);
-    buffer[7] = (uint8_t)(period >> 24);
-    buffer[8] = channel_mask;
-    buffer[9] = scan_options;
+    info->start_command[0] = (uint8_t)scan_count;
+    info->start_command[1] = (uint8_t)(scan_count >> 8);
+    info->start_command[2] = (uint8_t)(scan_count >> 16);
+    info->start_command[3] = (uint8_t)(scan_count >> 24);
+    info->start_command[4] = (uint8_t)period;
+    info->start_command[5] = (uint8_t)(period >> 8);
+    info->start_command[6] = (uint8_t)(period >> 16);
+    info->start_command[7] = (uint8_t)(period >> 24);
+    info->start_command[8] = channel_mask;
+    info->start_command[9] = scan_options;
 
-    result = _spi_transfer(address, CMD_AINSCANSTART, buffer, 10, NULL, 0, 
-        20*MSEC, 0);
+    // save the command for restarting after an overrun; the restarted scan 
+    // does not wait for the trigger
+    memcpy(info->restart_command, info->start_command, 
+        sizeof(info->restart_command));
+    info->restart_command[9] &= ~(0x01 | (0x03 << 1));
 
-    if (result != RESULT_SUCCESS)
+    if ((result = _scan_launch(address)) != RESULT_SUCCESS)
     {
-        pthread_attr_destroy(&attr);
-        free(info->scan_buffer);
-        free(info);
-        dev->scan_info = NULL;
+        _scan_info_put(dev);
         return result;
     }
 
-    // create the scan data thread
-    uint8_t* temp_address = (uint8_t*)malloc(sizeof(uint8_t));
-    *temp_address = address;
-    if ((result = pthread_create(&info->handle, &attr, &_scan_thread, 
-        temp_address)) != 0)
+    return RESULT_SUCCESS;
+}
+
+/******************************************************************************
+  Start the current scan again with the same parameters once it has finished, 
+  reusing the scan buffer and thread.
+ *****************************************************************************/
+int mcc118_a_in_scan_rearm(uint8_t address)
+{
+    struct mcc118ScanThreadInfo* info;
+
+    if (!_check_addr(address))
     {
-        free(temp_address);
-        mcc118_a_in_scan_stop(address);
-        pthread_attr_destroy(&attr);
-        free(info->scan_buffer);
-        free(info);
-        dev->scan_info = NULL;
-        return RESULT_RESOURCE_UNAVAIL;
+        return RESULT_BAD_PARAMETER;
     }
 
-    pthread_attr_destroy(&attr);
+    info = _devices[address]->scan_info;
+    if (info == NULL)
+    {
+        return RESULT_RESOURCE_UNAVAIL;
+    }
 
-    dev->scan_info->scan_running = true;
+    if (info->thread_running || info->scan_running)
+    {
+        return RESULT_BUSY;
+    }
 
-    return RESULT_SUCCESS;
+    return _scan_launch(address);
 }
 
 /******************************************************************************
@@ -1767,6 +2795,102 @@ int mcc118_a_in_scan_channel_count(uint8_t address)
     return _devices[address]->scan_info->channel_count;
 }
 
+/******************************************************************************
+  Estimate the host clock times when a scan sample was acquired.
+ *****************************************************************************/
+int mcc118_a_in_scan_sample_time(uint8_t address, uint64_t sample_index,
+    double* monotonic_time, double* real_time)
+{
+    struct mcc118ScanThreadInfo* info;
+    uint64_t ref_count;
+    double ref_time;
+    double period;
+    double real_offset;
+    double time;
+
+    if (!_check_addr(address))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    if ((info = _devices[address]->scan_info) == NULL)
+    {
+        return RESULT_RESOURCE_UNAVAIL;
+    }
+
+    if (_scan_fit_timestamps(info, &ref_count, &ref_time, &period,
+        &real_offset) == 0)
+    {
+        // no data has been acquired yet
+        return RESULT_RESOURCE_UNAVAIL;
+    }
+
+    // sample_index was acquired when the device count reached 
+    // sample_index + 1
+    time = ref_time + ((double)(sample_index + 1) - (double)ref_count) * 
+        period;
+
+    if (monotonic_time)
+    {
+        *monotonic_time = time;
+    }
+    if (real_time)
+    {
+        *real_time = time + real_offset;
+    }
+    return RESULT_SUCCESS;
+}
+
+/******************************************************************************
+  Return the scan rate measured against the host clock.
+ *****************************************************************************/
+int mcc118_a_in_scan_clock_drift(uint8_t address, 
+    double* measured_rate_per_channel, double* drift_ppm)
+{
+    struct mcc118ScanThreadInfo* info;
+    uint64_t ref_count;
+    double ref_time;
+    double period;
+    double real_offset;
+    double rate;
+
+    if (!_check_addr(address))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    if ((info = _devices[address]->scan_info) == NULL)
+    {
+        return RESULT_RESOURCE_UNAVAIL;
+    }
+
+    if (_scan_fit_timestamps(info, &ref_count, &ref_time, &period,
+        &real_offset) < 2)
+    {
+        // need at least 2 timestamps to measure the rate
+        return RESULT_RESOURCE_UNAVAIL;
+    }
+
+    rate = 1.0 / period;
+    if (measured_rate_per_channel)
+    {
+        *measured_rate_per_channel = rate;
+    }
+    if (drift_ppm)
+    {
+        if (info->nominal_rate > 0.0)
+        {
+            *drift_ppm = (rate - info->nominal_rate) / info->nominal_rate * 
+                1e6;
+        }
+        else
+        {
+            *drift_ppm = 0.0;
+        }
+    }
+    return RESULT_SUCCESS;
+}
+
 /******************************************************************************
   Read the scan status and amount of data in the scan buffer.
  *****************************************************************************/
@@ -1816,20 +2940,60 @@ int mcc118_a_in_scan_status(uint8_t address, uint16_t* status,
     {
         stat |= STATUS_RUNNING;
     }
+    if (info->gap_count > 0)
+    {
+        stat |= STATUS_GAP;
+    }
 
     *status = stat;
     return RESULT_SUCCESS;
 }
 
+/******************************************************************************
+  Copy samples from the scan buffer into a user buffer, converting them to the 
+  requested sample format.
+ *****************************************************************************/
+static void _scan_buffer_copy(void* buffer, uint8_t format, uint32_t offset,
+    const double* source, uint32_t count)
+{
+    uint32_t i;
+    float* float_buffer;
+    uint16_t* raw_buffer;
+
+    switch (format)
+    {
+    case SAMPLE_FORMAT_FLOAT:
+        float_buffer = (float*)buffer + offset;
+        for (i = 0; i < count; i++)
+        {
+            float_buffer[i] = (float)source[i];
+        }
+        break;
+    case SAMPLE_FORMAT_RAW:
+        // the scan buffer holds uncalibrated codes for this format
+        raw_buffer = (uint16_t*)buffer + offset;
+        for (i = 0; i < count; i++)
+        {
+            raw_buffer[i] = (uint16_t)(source[i] + 0.5);
+        }
+        break;
+    case SAMPLE_FORMAT_DOUBLE:
+    default:
+        memcpy((double*)buffer + offset, source, count*sizeof(double));
+        break;
+    }
+}
+
 /******************************************************************************
   Read the specified amount of data from the scan buffer.  If
   samples_per_channel == -1, return all available samples.  If timeout is
   negative, wait indefinitely.  If it is 0,  return immediately with the
   available data.
  *****************************************************************************/
-int mcc118_a_in_scan_read(uint8_t address, uint16_t* status, 
-    int32_t samples_per_channel, double timeout, double* buffer,
-    uint32_t buffer_size_samples, uint32_t* samples_read_per_channel)
+static int _scan_read(uint8_t address, uint16_t* status, 
+    int32_t samples_per_channel, double timeout, void* buffer,
+    uint32_t buffer_size_samples, uint8_t format, 
+    uint32_t* samples_read_per_channel)
 {
     uint32_t samples_to_read;
     uint32_t samples_read;
@@ -1882,6 +3046,14 @@ int mcc118_a_in_scan_read(uint8_t address, uint16_t* status,
         return RESULT_RESOURCE_UNAVAIL;
     }
 
+    if ((format == SAMPLE_FORMAT_RAW) &&
+        ((info->options & (OPTS_NOSCALEDATA | OPTS_NOCALIBRATEDATA)) !=
+            (OPTS_NOSCALEDATA | OPTS_NOCALIBRATEDATA)))
+    {
+        // raw codes are only available when the scan does not convert them
+        return RESULT_BAD_PARAMETER;
+    }
+
     // Determine how many samples to read
     if (samples_per_channel == -1)
     {
@@ -1921,22 +3093,20 @@ int mcc118_a_in_scan_read(uint8_t address, uint16_t* status,
                 if (max_read < current_read)
                 {
                     // when wrapping, perform two copies
-                    memcpy(&buffer[samples_read], 
-                        &info->scan_buffer[info->read_index],  
-                        max_read*sizeof(double));
+                    _scan_buffer_copy(buffer, format, samples_read,
+                        &info->scan_buffer[info->read_index], max_read);
 
                     samples_read += max_read;
-                    memcpy(&buffer[samples_read], &info->scan_buffer[0],
-                        (current_read - max_read)*sizeof(double));
+                    _scan_buffer_copy(buffer, format, samples_read,
+                        &info->scan_buffer[0], current_read - max_read);
 
                     samples_read += (current_read - max_read);
                     info->read_index = (current_read - max_read);
                 }
                 else
                 {
-                    memcpy(&buffer[samples_read], 
-                        &info->scan_buffer[info->read_index],
-                        current_read*sizeof(double));
+                    _scan_buffer_copy(buffer, format, samples_read,
+                        &info->scan_buffer[info->read_index], current_read);
                     samples_read += current_read;
                     info->read_index += current_read;
                     if (info->read_index >= info->buffer_size)
@@ -2005,6 +3175,10 @@ int mcc118_a_in_scan_read(uint8_t address, uint16_t* status,
     {
         stat |= STATUS_RUNNING;
     }
+    if (info->gap_count > 0)
+    {
+        stat |= STATUS_GAP;
+    }
 
     *status = stat;
 
@@ -2018,6 +3192,265 @@ int mcc118_a_in_scan_read(uint8_t address, uint16_t* status,
     }
 }
 
+/******************************************************************************
+  Read the specified amount of data from the scan buffer as doubles.
+ *****************************************************************************/
+int mcc118_a_in_scan_read(uint8_t address, uint16_t* status, 
+    int32_t samples_per_channel, double timeout, double* buffer,
+    uint32_t buffer_size_samples, uint32_t* samples_read_per_channel)
+{
+    return _scan_read(address, status, samples_per_channel, timeout, buffer,
+        buffer_size_samples, SAMPLE_FORMAT_DOUBLE, samples_read_per_channel);
+}
+
+/******************************************************************************
+  Read the specified amount of data from the scan buffer in the specified 
+  sample format.
+ *****************************************************************************/
+int mcc118_a_in_scan_read_format(uint8_t address, uint16_t* status, 
+    int32_t samples_per_channel, double timeout, void* buffer,
+    uint32_t buffer_size_samples, uint8_t format, 
+    uint32_t* samples_read_per_channel)
+{
+    if (format > SAMPLE_FORMAT_RAW)
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    return _scan_read(address, status, samples_per_channel, timeout, buffer,
+        buffer_size_samples, format, samples_read_per_channel);
+}
+
+/******************************************************************************
+  Return a pointer to the unread data in the scan buffer, up to the end of the 
+  buffer.  The data stays in the buffer until released.
+ *****************************************************************************/
+int mcc118_a_in_scan_buffer_peek(uint8_t address, double** data,
+    uint32_t* samples_per_channel)
+{
+    struct mcc118ScanThreadInfo* info;
+    uint32_t count;
+
+    if (!_check_addr(address) ||
+        (data == NULL) ||
+        (samples_per_channel == NULL))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    if ((info = _devices[address]->scan_info) == NULL)
+    {
+        *data = NULL;
+        *samples_per_channel = 0;
+        return RESULT_RESOURCE_UNAVAIL;
+    }
+
+    // the buffer size is a multiple of the channel count, so scans never 
+    // split across the end of the buffer
+    count = MIN(info->buffer_depth, info->buffer_size - info->read_index);
+    *data = &info->scan_buffer[info->read_index];
+    *samples_per_channel = count / info->channel_count;
+    return RESULT_SUCCESS;
+}
+
+/******************************************************************************
+  Return a file descriptor that becomes readable when the scan buffer holds at 
+  least the specified number of samples per channel or the scan ends.
+ *****************************************************************************/
+int mcc118_a_in_scan_ready_fd(uint8_t address, uint32_t samples_per_channel,
+    int* fd)
+{
+    struct mcc118ScanThreadInfo* info;
+    uint32_t threshold;
+
+    if (!_check_addr(address) ||
+        (fd == NULL))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    if ((info = _devices[address]->scan_info) == NULL)
+    {
+        return RESULT_RESOURCE_UNAVAIL;
+    }
+
+    if (samples_per_channel == 0)
+    {
+        samples_per_channel = 1;
+    }
+    threshold = MIN(samples_per_channel * info->channel_count, 
+        info->buffer_size);
+
+    if (info->ready_fd < 0)
+    {
+        // this descriptor belongs to the caller's event loop, so it is not 
+        // added to the gpio dispatcher, which would consume its events
+        info->ready_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (info->ready_fd < 0)
+        {
+            return RESULT_RESOURCE_UNAVAIL;
+        }
+    }
+    info->ready_threshold = threshold;
+
+    if ((info->buffer_depth >= threshold) ||
+        (!info->scan_running && !info->thread_running))
+    {
+        // already ready
+        eventfd_write(info->ready_fd, 1);
+    }
+
+    *fd = info->ready_fd;
+    return RESULT_SUCCESS;
+}
+
+/******************************************************************************
+  Remove data returned by mcc118_a_in_scan_buffer_peek() from the scan buffer.
+ *****************************************************************************/
+int mcc118_a_in_scan_buffer_release(uint8_t address, 
+    uint32_t samples_per_channel)
+{
+    struct mcc118ScanThreadInfo* info;
+    uint32_t count;
+
+    if (!_check_addr(address))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    if ((info = _devices[address]->scan_info) == NULL)
+    {
+        return RESULT_RESOURCE_UNAVAIL;
+    }
+
+    count = samples_per_channel * info->channel_count;
+    if (count > MIN(info->buffer_depth, info->buffer_size - info->read_index))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    info->read_index += count;
+    if (info->read_index >= info->buffer_size)
+    {
+        info->read_index = 0;
+    }
+    info->buffer_depth -= count;
+    return RESULT_SUCCESS;
+}
+
+/******************************************************************************
+  Read and remove the recorded gaps from an auto-recovering scan.
+ *****************************************************************************/
+int mcc118_a_in_scan_read_gaps(uint8_t address, struct MCC118ScanGap* gaps,
+    uint16_t max_gaps, uint16_t* gaps_read)
+{
+    struct mcc118ScanThreadInfo* info;
+    uint16_t count;
+
+    if (!_check_addr(address) ||
+        ((max_gaps > 0) && (gaps == NULL)) ||
+        (gaps_read == NULL))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    if ((info = _devices[address]->scan_info) == NULL)
+    {
+        *gaps_read = 0;
+        return RESULT_RESOURCE_UNAVAIL;
+    }
+
+    pthread_mutex_lock(&info->info_mutex);
+    count = MIN(max_gaps, info->gap_count);
+    if (count > 0)
+    {
+        memcpy(gaps, info->gaps, count * sizeof(struct MCC118ScanGap));
+        memmove(info->gaps, &info->gaps[count], 
+            (info->gap_count - count) * sizeof(struct MCC118ScanGap));
+        info->gap_count -= count;
+    }
+    pthread_mutex_unlock(&info->info_mutex);
+
+    *gaps_read = count;
+    return RESULT_SUCCESS;
+}
+
+/******************************************************************************
+  Wait for a complete segment of a retriggered scan and read it.
+ *****************************************************************************/
+int mcc118_a_in_scan_read_segment(uint8_t address, uint16_t* status, 
+    double timeout, double* buffer, uint32_t buffer_size_samples, 
+    uint32_t* segment_number)
+{
+    struct mcc118ScanThreadInfo* info;
+    struct timespec start_time;
+    struct timespec current_time;
+    uint32_t samples_read_per_channel;
+    int result;
+
+    if (!_check_addr(address) ||
+        (status == NULL) ||
+        (buffer == NULL))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    if (((info = _devices[address]->scan_info) == NULL) ||
+        ((info->options & OPTS_RETRIGGER) == 0))
+    {
+        *status = 0;
+        return RESULT_RESOURCE_UNAVAIL;
+    }
+
+    if (buffer_size_samples < info->segment_size)
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    // wait until the whole segment is in the scan buffer so a timeout does 
+    // not consume part of it
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    while ((info->buffer_depth < info->segment_size) &&
+        info->thread_running &&
+        !info->hw_overrun &&
+        !info->buffer_overrun)
+    {
+        if (timeout >= 0.0)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &current_time);
+            if (_difftime_us(&start_time, &current_time) >= 
+                (uint32_t)(timeout * 1e6))
+            {
+                // update the status only
+                mcc118_a_in_scan_read(address, status, 0, 0.0, NULL, 0, 
+                    NULL);
+                return RESULT_TIMEOUT;
+            }
+        }
+        usleep(100);
+    }
+
+    if (info->buffer_depth < info->segment_size)
+    {
+        // the scan ended without another complete segment
+        mcc118_a_in_scan_read(address, status, 0, 0.0, NULL, 0, NULL);
+        return RESULT_RESOURCE_UNAVAIL;
+    }
+
+    result = mcc118_a_in_scan_read(address, status, 
+        info->segment_size / info->channel_count, 0.0, buffer, 
+        buffer_size_samples, &samples_read_per_channel);
+    if (result == RESULT_SUCCESS)
+    {
+        if (segment_number)
+        {
+            *segment_number = info->segments_read;
+        }
+        info->segments_read++;
+    }
+    return result;
+}
+
 /******************************************************************************
   Stop a running scan by sending the scan stop command to the device.  The
   thread will  detect that the scan has stopped and terminate gracefully.
@@ -2036,8 +3469,9 @@ int mcc118_a_in_scan_stop(uint8_t address)
 }
 
 /******************************************************************************
-  Free the resources used by a scan.  If the scan thread is still running it
-  will terminate the thread first.
+  Release the resources used by a scan.  If the scan thread is still running 
+  it will stop the scan first.  The scan info, buffer and thread are kept for
+  the next scan.
  *****************************************************************************/
 int mcc118_a_in_scan_cleanup(uint8_t address)
 {
@@ -2048,19 +3482,204 @@ int mcc118_a_in_scan_cleanup(uint8_t address)
 
     if (_devices[address]->scan_info != NULL)
     {
-        if (_devices[address]->scan_info->handle != 0)
+        // stop the thread if it is running and keep the scan resources for 
+        // the next scan
+        _scan_info_put(_devices[address]);
+    }
+
+    return RESULT_SUCCESS;
+}
+
+/******************************************************************************
+  Start software-timed sampling of a set of channels.
+ *****************************************************************************/
+int mcc118_a_in_sampler_start(uint8_t address, uint8_t channel_mask, 
+    double sample_rate, uint32_t buffer_size, uint32_t options)
+{
+    struct mcc118Device* dev;
+    struct mcc118SamplerInfo* info;
+    uint8_t channel;
+
+    if (!_check_addr(address) ||
+        (channel_mask == 0) ||
+        (sample_rate <= 0.0) ||
+        (sample_rate > SAMPLER_MAX_RATE))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    dev = _devices[address];
+    if ((dev->scan_info != NULL) ||
+        (dev->sampler_info != NULL))
+    {
+        return RESULT_BUSY;
+    }
+
+    info = (struct mcc118SamplerInfo*)calloc(
+        sizeof(struct mcc118SamplerInfo), 1);
+    if (info == NULL)
+    {
+        return RESULT_RESOURCE_UNAVAIL;
+    }
+
+    info->address = address;
+    info->channel_mask = channel_mask;
+    info->options = options;
+    info->period_ns = (uint64_t)(1e9 / sample_rate + 0.5);
+    for (channel = 0; channel < NUM_CHANNELS; channel++)
+    {
+        if (channel_mask & (1 << channel))
         {
-            // If the thread is running then tell it to stop and wait for it. 
-            // It will send the a_in_stop_scan command.
-            _devices[address]->scan_info->stop_thread = true;
+            info->channel_count++;
+        }
+    }
+
+    if (buffer_size == 0)
+    {
+        buffer_size = (uint32_t)(sample_rate * SAMPLER_DEFAULT_SECONDS);
+        if (buffer_size < 1000)
+        {
+            buffer_size = 1000;
+        }
+    }
+    info->buffer_size = buffer_size;
+    info->timestamps = (double*)malloc(buffer_size * sizeof(double));
+    info->values = (double*)malloc(buffer_size * info->channel_count * 
+        sizeof(double));
+    if ((info->timestamps == NULL) ||
+        (info->values == NULL))
+    {
+        free(info->timestamps);
+        free(info->values);
+        free(info);
+        return RESULT_RESOURCE_UNAVAIL;
+    }
+
+    pthread_mutex_init(&info->mutex, NULL);
+
+    if (pthread_create(&info->handle, NULL, &_sampler_thread, info) != 0)
+    {
+        pthread_mutex_destroy(&info->mutex);
+        free(info->timestamps);
+        free(info->values);
+        free(info);
+        return RESULT_RESOURCE_UNAVAIL;
+    }
+
+    dev->sampler_info = info;
+    return RESULT_SUCCESS;
+}
 
-            pthread_join(_devices[address]->scan_info->handle, NULL);
-            _devices[address]->scan_info->handle = 0;
+/******************************************************************************
+  Read timestamped samples from the software-timed sampler buffer.
+ *****************************************************************************/
+int mcc118_a_in_sampler_read(uint8_t address, double* timestamps, 
+    double* values, uint32_t max_samples, uint32_t* samples_read)
+{
+    struct mcc118SamplerInfo* info;
+    uint32_t count;
+    uint32_t index;
+
+    if (!_check_addr(address) ||
+        (values == NULL) ||
+        (samples_read == NULL))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    if ((info = _devices[address]->sampler_info) == NULL)
+    {
+        *samples_read = 0;
+        return RESULT_RESOURCE_UNAVAIL;
+    }
+
+    pthread_mutex_lock(&info->mutex);
+    count = MIN(max_samples, info->buffer_depth);
+    for (index = 0; index < count; index++)
+    {
+        if (timestamps)
+        {
+            timestamps[index] = info->timestamps[info->read_index];
         }
+        memcpy(&values[index * info->channel_count],
+            &info->values[info->read_index * info->channel_count],
+            info->channel_count * sizeof(double));
+        info->read_index = (info->read_index + 1) % info->buffer_size;
+    }
+    info->buffer_depth -= count;
+    pthread_mutex_unlock(&info->mutex);
+
+    *samples_read = count;
+    return RESULT_SUCCESS;
+}
+
+/******************************************************************************
+  Read the software-timed sampler statistics.
+ *****************************************************************************/
+int mcc118_a_in_sampler_stats(uint8_t address, 
+    struct MCC118SamplerStats* stats)
+{
+    struct mcc118SamplerInfo* info;
+
+    if (!_check_addr(address) ||
+        (stats == NULL))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    if ((info = _devices[address]->sampler_info) == NULL)
+    {
+        return RESULT_RESOURCE_UNAVAIL;
+    }
 
-        free(_devices[address]->scan_info->scan_buffer);
-        free(_devices[address]->scan_info);
-        _devices[address]->scan_info = NULL;
+    pthread_mutex_lock(&info->mutex);
+    stats->sample_count = info->sample_count;
+    stats->missed_deadlines = info->missed_deadlines;
+    stats->buffer_overruns = info->buffer_overruns;
+    stats->samples_available = info->buffer_depth;
+    stats->last_error = info->last_error;
+    if ((info->sample_count > 1) &&
+        (info->last_time > info->first_time))
+    {
+        stats->actual_rate = (info->sample_count - 1) / 
+            (info->last_time - info->first_time);
+    }
+    else
+    {
+        stats->actual_rate = 0.0;
+    }
+    stats->jitter_mean = (info->sample_count > 0) ? 
+        info->jitter_sum / info->sample_count : 0.0;
+    stats->jitter_p50 = _sampler_jitter_percentile(info, 0.50);
+    stats->jitter_p99 = _sampler_jitter_percentile(info, 0.99);
+    stats->jitter_max = info->jitter_max;
+    pthread_mutex_unlock(&info->mutex);
+
+    return RESULT_SUCCESS;
+}
+
+/******************************************************************************
+  Stop the software-timed sampler and free its resources.
+ *****************************************************************************/
+int mcc118_a_in_sampler_stop(uint8_t address)
+{
+    struct mcc118SamplerInfo* info;
+
+    if (!_check_addr(address))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    if ((info = _devices[address]->sampler_info) != NULL)
+    {
+        info->stop_thread = true;
+        pthread_join(info->handle, NULL);
+
+        pthread_mutex_destroy(&info->mutex);
+        free(info->timestamps);
+        free(info->values);
+        free(info);
+        _devices[address]->sampler_info = NULL;
     }
 
     return RESULT_SUCCESS;
@@ -14,6 +14,9 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include "daqhats.h"
 #include "util.h"
 #include "cJSON.h"
@@ -56,6 +59,15 @@ struct MCC152DeviceInfo mcc152_device_info =
 // The maximum size of the serial number string, plus NULL.
 #define SERIAL_SIZE         (8+1)   
 
+#define OUT_SCAN_MAX_RATE       10000.0 // analog output updates per second
+#define OUT_SCAN_JITTER_BIN_NS  10000   // jitter histogram resolution
+#define OUT_SCAN_JITTER_BINS    1000    // last bin collects larger values
+#define OUT_SCAN_MAX_SLEEP_NS   100000000   // check for stop every 100 ms
+
+#define DIO_EVENT_DEFAULT_SIZE  4096    // default DIO event ring size
+#define DIO_EVENT_MAX_SIZE      (1u << 24)
+#define DIO_EVENT_MAX_SWEEPS    8       // sweeps per edge while IRQ is active
+
 #define MIN(a, b)           ((a < b) ? a : b)
 #define MAX(a, b)           ((a > b) ? a : b)
 
@@ -67,6 +79,32 @@ struct mcc152FactoryData
     char serial[SERIAL_SIZE];
 };
 
+// Local data for a timed analog output scan
+struct mcc152OutScanInfo
+{
+    pthread_t handle;
+    pthread_mutex_t mutex;      // protects the statistics
+    uint8_t address;
+    uint8_t spi_device;
+    bool stop_thread;
+    bool running;
+    bool continuous;
+    uint64_t period_ns;
+
+    uint8_t* frames;            // pre-built DAC frames for every update
+    uint8_t frame_count;        // frames per update
+    uint32_t update_total;      // updates in the buffer
+
+    uint64_t update_count;
+    uint64_t underruns;
+    int last_error;
+    double first_time;
+    double last_time;
+    double jitter_sum;
+    double jitter_max;
+    uint32_t jitter_histogram[OUT_SCAN_JITTER_BINS];
+};
+
 // Local data for each open MCC 152 board.
 struct mcc152Device
 {
@@ -74,6 +112,7 @@ struct mcc152Device
     struct mcc152FactoryData factory_data;   // Factory data
     uint8_t spi_device;         // which SPI device for the DAC (rev 1 boards
                                 // used SPI 1, newer boards use SPI 0)
+    struct mcc152OutScanInfo* out_scan_info;    // Analog output scan info
 };
 /// \endcond
 
@@ -82,6 +121,24 @@ struct mcc152Device
 
 static struct mcc152Device* _devices[MAX_NUMBER_HATS];
 static bool _mcc152_lib_initialized = false;
+static pthread_once_t _mcc152_lib_once = PTHREAD_ONCE_INIT;
+
+// DIO event ring.  The interrupt hook is the only producer and 
+// mcc152_dio_event_read() the only consumer, so the indices are advanced with
+// atomic loads and stores and no lock is needed.  The indices count up 
+// continuously and are masked to index the ring.
+static struct MCC152DIOEvent* _dio_events = NULL;
+static uint32_t _dio_event_mask;
+static uint32_t _dio_event_head;            // written by the producer
+static uint32_t _dio_event_tail;            // written by the consumer
+static uint64_t _dio_event_overruns;
+static int _dio_event_fd = -1;              // wakes a waiting reader
+// protects starting and stopping the engine.  mcc152_dio_event_stop() waits 
+// for _dio_event_readers to reach 0 before it frees the ring.
+static pthread_mutex_t _dio_event_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _dio_event_cond = PTHREAD_COND_INITIALIZER;
+static uint32_t _dio_event_readers;
+static bool _dio_event_stopping;
 
 //*****************************************************************************
 // Local Functions
@@ -172,20 +229,308 @@ static int _parse_factory_data(cJSON* root, struct mcc152FactoryData* data)
 }
 
 /******************************************************************************
-  Perform any library initialization.
+  Initialize the library variables.  Called only once.
  *****************************************************************************/
-static void _mcc152_lib_init(void)
+static void _mcc152_lib_init_once(void)
 {
     int i;
     
-    if (!_mcc152_lib_initialized)
+    for (i = 0; i < MAX_NUMBER_HATS; i++)
     {
-        for (i = 0; i < MAX_NUMBER_HATS; i++)
+        _devices[i] = NULL;
+    }
+    
+    _mcc152_lib_initialized = true;
+}
+
+/******************************************************************************
+  Perform any library initialization.  Boards may be opened from several
+  threads at once, e.g. by hat_open_all().
+ *****************************************************************************/
+static void _mcc152_lib_init(void)
+{
+    pthread_once(&_mcc152_lib_once, _mcc152_lib_init_once);
+}
+
+/******************************************************************************
+  Convert an analog output value to a DAC code.  Return false if the value is
+  outside the output range (0 - 5V, or 0 - 4095 with OPTS_NOSCALEDATA).
+ *****************************************************************************/
+static bool _a_out_code(double value, uint32_t options, uint16_t* code)
+{
+    if ((options & OPTS_NOSCALEDATA) == 0)
+    {
+        // voltage
+        if (!((value >= MIN_VOLTAGE) && (value <= MAX_RANGE)))
         {
-            _devices[i] = NULL;
+            return false;
         }
-        
-        _mcc152_lib_initialized = true;
+        value = value / LSB_SIZE;
+    }
+    else if (!((value >= 0.0) && (value <= MAX_CODE)))
+    {
+        return false;
+    }
+
+    // full scale voltage is one LSB above the largest code
+    *code = (uint16_t)MIN(value + 0.5, MAX_CODE);
+    return true;
+}
+
+/******************************************************************************
+  Add nanoseconds to a timespec.
+ *****************************************************************************/
+static void _timespec_add_ns(struct timespec* ts, uint64_t ns)
+{
+    ns += ts->tv_nsec;
+    ts->tv_sec += ns / 1000000000ull;
+    ts->tv_nsec = ns % 1000000000ull;
+}
+
+/******************************************************************************
+  Return the jitter value below which the given fraction of the output updates
+  were made.  Must be called with the scan mutex held.
+ *****************************************************************************/
+static double _out_scan_jitter_percentile(struct mcc152OutScanInfo* info,
+    double fraction)
+{
+    uint64_t target;
+    uint64_t count;
+    uint32_t bin;
+
+    if (info->update_count == 0)
+    {
+        return 0.0;
+    }
+
+    target = (uint64_t)(fraction * info->update_count + 0.5);
+    if (target == 0)
+    {
+        target = 1;
+    }
+    count = 0;
+    for (bin = 0; bin < OUT_SCAN_JITTER_BINS - 1; bin++)
+    {
+        count += info->jitter_histogram[bin];
+        if (count >= target)
+        {
+            return (double)(bin + 1) * OUT_SCAN_JITTER_BIN_NS / 1e9;
+        }
+    }
+    return info->jitter_max;
+}
+
+/******************************************************************************
+  Analog output scan thread.  Sends the pre-built DAC frames at absolute 
+  deadlines.  If the thread falls behind, the updates whose time has passed 
+  are skipped so the waveform stays aligned with the clock, and each one is 
+  counted as an underrun.
+ *****************************************************************************/
+static void* _out_scan_thread(void* arg)
+{
+    struct mcc152OutScanInfo* info = (struct mcc152OutScanInfo*)arg;
+    struct timespec deadline;
+    struct timespec wake;
+    struct timespec now;
+    double now_time;
+    int64_t late_ns;
+    uint64_t missed;
+    uint32_t index;
+    uint32_t bin;
+    int result;
+    bool done;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    index = 0;
+    done = false;
+
+    while (!info->stop_thread && !done)
+    {
+        // sleep until the deadline; the time is absolute so the update 
+        // interval does not accumulate the time spent writing.  Long periods 
+        // are slept in steps so a stop request is not delayed.
+        do
+        {
+            clock_gettime(CLOCK_MONOTONIC, &wake);
+            _timespec_add_ns(&wake, OUT_SCAN_MAX_SLEEP_NS);
+            if ((wake.tv_sec > deadline.tv_sec) ||
+                ((wake.tv_sec == deadline.tv_sec) && 
+                (wake.tv_nsec > deadline.tv_nsec)))
+            {
+                wake = deadline;
+            }
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            late_ns = (now.tv_sec - deadline.tv_sec) * 1000000000ll +
+                (now.tv_nsec - deadline.tv_nsec);
+        } while ((late_ns < 0) && !info->stop_thread);
+
+        if (info->stop_thread)
+        {
+            break;
+        }
+        now_time = (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+
+        result = _mcc152_dac_write_frames(info->spi_device, info->address,
+            &info->frames[index * info->frame_count * DAC_FRAME_SIZE],
+            info->frame_count);
+
+        pthread_mutex_lock(&info->mutex);
+        if (result == RESULT_SUCCESS)
+        {
+            if (info->update_count == 0)
+            {
+                info->first_time = now_time;
+            }
+            info->last_time = now_time;
+            info->update_count++;
+
+            // update the jitter statistics
+            bin = (uint32_t)(late_ns / OUT_SCAN_JITTER_BIN_NS);
+            if (bin >= OUT_SCAN_JITTER_BINS)
+            {
+                bin = OUT_SCAN_JITTER_BINS - 1;
+            }
+            info->jitter_histogram[bin]++;
+            info->jitter_sum += late_ns / 1e9;
+            if ((late_ns / 1e9) > info->jitter_max)
+            {
+                info->jitter_max = late_ns / 1e9;
+            }
+        }
+        else
+        {
+            info->last_error = result;
+        }
+
+        // schedule the next deadline, skipping any that have already passed
+        _timespec_add_ns(&deadline, info->period_ns);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        missed = 0;
+        while ((now.tv_sec > deadline.tv_sec) ||
+            ((now.tv_sec == deadline.tv_sec) && 
+            (now.tv_nsec > deadline.tv_nsec)))
+        {
+            _timespec_add_ns(&deadline, info->period_ns);
+            missed++;
+        }
+        info->underruns += missed;
+        pthread_mutex_unlock(&info->mutex);
+
+        // advance through the buffer by the number of update times that 
+        // passed
+        if (info->continuous)
+        {
+            index = (uint32_t)((index + 1 + missed) % info->update_total);
+        }
+        else if ((index + 1 + missed) >= info->update_total)
+        {
+            done = true;
+        }
+        else
+        {
+            index += 1 + missed;
+        }
+    }
+
+    pthread_mutex_lock(&info->mutex);
+    info->running = false;
+    pthread_mutex_unlock(&info->mutex);
+    return NULL;
+}
+
+/******************************************************************************
+  Add an event to the DIO event ring.  Called only by the interrupt hook.
+ *****************************************************************************/
+static bool _dio_event_push(uint64_t timestamp_ns, uint8_t address, 
+    uint8_t channel, uint8_t value)
+{
+    struct MCC152DIOEvent* event;
+    uint32_t head;
+    uint32_t tail;
+
+    head = __atomic_load_n(&_dio_event_head, __ATOMIC_RELAXED);
+    tail = __atomic_load_n(&_dio_event_tail, __ATOMIC_ACQUIRE);
+    if ((head - tail) > _dio_event_mask)
+    {
+        // the ring is full; drop the new event
+        __atomic_add_fetch(&_dio_event_overruns, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    event = &_dio_events[head & _dio_event_mask];
+    event->timestamp_ns = timestamp_ns;
+    event->address = address;
+    event->channel = channel;
+    event->value = value;
+    __atomic_store_n(&_dio_event_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/******************************************************************************
+  Interrupt hook for the DIO event engine.  Reads the interrupt status and 
+  inputs of every open MCC 152 with combined bus transfers and records an 
+  event for each channel with a pending interrupt.  The interrupt line is edge 
+  triggered, so the boards are swept again while it remains active to catch 
+  changes that happened during the sweep.
+ *****************************************************************************/
+static void _dio_event_hook(uint64_t timestamp_ns)
+{
+    uint8_t addresses[MAX_NUMBER_HATS];
+    uint8_t status[MAX_NUMBER_HATS];
+    uint8_t inputs[MAX_NUMBER_HATS];
+    struct timespec now;
+    uint8_t count;
+    uint8_t address;
+    uint8_t channel;
+    uint8_t i;
+    int sweep;
+    bool added;
+
+    count = 0;
+    for (address = 0; address < MAX_NUMBER_HATS; address++)
+    {
+        if (_devices[address] != NULL)
+        {
+            addresses[count++] = address;
+        }
+    }
+
+    added = false;
+    for (sweep = 0; sweep < DIO_EVENT_MAX_SWEEPS; sweep++)
+    {
+        if (_mcc152_dio_int_sweep(addresses, count, status, inputs) !=
+            RESULT_SUCCESS)
+        {
+            break;
+        }
+
+        for (i = 0; i < count; i++)
+        {
+            for (channel = 0; channel < NUM_DIO_CHANNELS; channel++)
+            {
+                if (status[i] & (1 << channel))
+                {
+                    _dio_event_push(timestamp_ns, addresses[i], channel,
+                        (inputs[i] >> channel) & 0x01);
+                    added = true;
+                }
+            }
+        }
+
+        if (hat_interrupt_state() == 0)
+        {
+            break;
+        }
+
+        // later sweeps find changes after the edge, so use the current time
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        timestamp_ns = (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+    }
+
+    if (added)
+    {
+        eventfd_write(_dio_event_fd, 1);
     }
 }
 
@@ -257,14 +602,24 @@ int mcc152_open(uint8_t address)
                 dev->spi_device = 1;
             }
 
-            // convert the JSON custom data to parameters
-            cJSON* root = cJSON_Parse(custom_data);
-            if (!_parse_factory_data(root, &dev->factory_data))
+            // use the parameters saved from an earlier open if the custom
+            // data has not changed, otherwise convert the JSON custom data
+            if (!_factory_cache_load("mcc152", custom_data, custom_size,
+                &dev->factory_data, sizeof(dev->factory_data)))
             {
-                // invalid custom data, use default values
-                _set_defaults(&dev->factory_data);
+                cJSON* root = cJSON_Parse(custom_data);
+                if (_parse_factory_data(root, &dev->factory_data))
+                {
+                    _factory_cache_save("mcc152", custom_data, custom_size,
+                        &dev->factory_data, sizeof(dev->factory_data));
+                }
+                else
+                {
+                    // invalid custom data, use default values
+                    _set_defaults(&dev->factory_data);
+                }
+                cJSON_Delete(root);
             }
-            cJSON_Delete(root);
             
             free(custom_data);
         }
@@ -330,6 +685,8 @@ int mcc152_close(uint8_t address)
     _devices[address]->handle_count--;
     if (_devices[address]->handle_count == 0)
     {
+        mcc152_a_out_scan_stop(address);
+        _mcc152_dio_fini(address);
         free(_devices[address]);
         _devices[address] = NULL;
     }
@@ -375,6 +732,11 @@ int mcc152_a_out_write(uint8_t address, uint8_t channel, uint32_t options,
         return RESULT_BAD_PARAMETER;
     }
 
+    if (_devices[address]->out_scan_info != NULL)
+    {
+        return RESULT_BUSY;
+    }
+
     if ((options & OPTS_NOSCALEDATA) == 0)
     {
         // user passed voltage
@@ -420,6 +782,11 @@ int mcc152_a_out_write_all(uint8_t address, uint32_t options, double* values)
         return RESULT_BAD_PARAMETER;
     }
 
+    if (_devices[address]->out_scan_info != NULL)
+    {
+        return RESULT_BUSY;
+    }
+
     for (i = 0; i < NUM_AO_CHANNELS; i++)
     {
         if ((options & OPTS_NOSCALEDATA) == 0)
@@ -455,84 +822,268 @@ int mcc152_a_out_write_all(uint8_t address, uint32_t options, double* values)
 }
 
 /******************************************************************************
-  Reset DIO to default configuration.
+  Write all analog output channels on several boards with a synchronized 
+  update.
  *****************************************************************************/
-int mcc152_dio_reset(uint8_t address)
+int mcc152_a_out_write_sync(uint8_t count, uint8_t* addresses, 
+    uint32_t options, double* values)
 {
-    int ret;
+    uint8_t devices[MAX_NUMBER_HATS];
+    uint16_t codes[MAX_NUMBER_HATS * NUM_AO_CHANNELS];
+    uint8_t i;
+    uint8_t j;
 
-    if (!_check_addr(address))                // check address failed
+    if ((count == 0) ||
+        (count > MAX_NUMBER_HATS) ||
+        (addresses == NULL) ||
+        (values == NULL))
     {
         return RESULT_BAD_PARAMETER;
-    }    
+    }
 
-    // write the register values
-    
-    // interrupt mask
-    ret = _mcc152_dio_reg_write(address, DIO_REG_INT_MASK, DIO_CHANNEL_ALL,
-        0xFF, false);
-    if (ret != RESULT_SUCCESS)
+    for (i = 0; i < count; i++)
     {
-        return ret;
+        if (!_check_addr(addresses[i]))
+        {
+            return RESULT_BAD_PARAMETER;
+        }
+        for (j = 0; j < i; j++)
+        {
+            if (addresses[j] == addresses[i])
+            {
+                // each board may only appear once
+                return RESULT_BAD_PARAMETER;
+            }
+        }
+        if (_devices[addresses[i]]->out_scan_info != NULL)
+        {
+            return RESULT_BUSY;
+        }
+
+        devices[i] = _devices[addresses[i]]->spi_device;
+        for (j = 0; j < NUM_AO_CHANNELS; j++)
+        {
+            if (!_a_out_code(values[i*NUM_AO_CHANNELS + j], options,
+                &codes[i*NUM_AO_CHANNELS + j]))
+            {
+                return RESULT_BAD_PARAMETER;
+            }
+        }
     }
-    
-    // switch to inputs
-    ret = _mcc152_dio_reg_write(address, DIO_REG_CONFIG, DIO_CHANNEL_ALL, 0xFF,
-        false);
-    if (ret != RESULT_SUCCESS)
+
+    return _mcc152_dac_write_staged(count, devices, addresses, codes);
+}
+
+/******************************************************************************
+  Start a timed analog output scan.
+ *****************************************************************************/
+int mcc152_a_out_scan_start(uint8_t address, uint8_t channel_mask, 
+    double rate, double* buffer, uint32_t count, uint32_t options)
+{
+    struct mcc152Device* dev;
+    struct mcc152OutScanInfo* info;
+    uint8_t channel_count;
+    uint16_t codes[NUM_AO_CHANNELS];
+    uint32_t index;
+    uint8_t channel;
+    uint8_t* frame;
+
+    if (!_check_addr(address) ||
+        (channel_mask == 0) ||
+        (channel_mask >= (1 << NUM_AO_CHANNELS)) ||
+        (rate <= 0.0) ||
+        (rate > OUT_SCAN_MAX_RATE) ||
+        (buffer == NULL) ||
+        (count == 0))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    dev = _devices[address];
+    if (dev->out_scan_info != NULL)
     {
-        return ret;
+        return RESULT_BUSY;
     }
-    
-    // pull-up setting
-    ret = _mcc152_dio_reg_write(address, DIO_REG_PULL_SELECT, DIO_CHANNEL_ALL,
-        0xFF, false);
-    if (ret != RESULT_SUCCESS)
+
+    info = (struct mcc152OutScanInfo*)calloc(
+        sizeof(struct mcc152OutScanInfo), 1);
+    if (info == NULL)
     {
-        return ret;
+        return RESULT_RESOURCE_UNAVAIL;
     }
-    
-    // pull-up enable
-    ret = _mcc152_dio_reg_write(address, DIO_REG_PULL_ENABLE, DIO_CHANNEL_ALL,
-        0xFF, false);
-    if (ret != RESULT_SUCCESS)
+
+    info->address = address;
+    info->spi_device = dev->spi_device;
+    info->continuous = ((options & OPTS_CONTINUOUS) != 0);
+    info->period_ns = (uint64_t)(1e9 / rate + 0.5);
+    info->update_total = count;
+    info->frame_count = (channel_mask == 0x03) ? 2 : 1;
+    channel_count = info->frame_count;
+
+    // build every SPI frame up front so the thread only has to send them
+    info->frames = (uint8_t*)malloc((size_t)count * info->frame_count * 
+        DAC_FRAME_SIZE);
+    if (info->frames == NULL)
     {
-        return ret;
+        free(info);
+        return RESULT_RESOURCE_UNAVAIL;
     }
-    
-    // input invert
-    ret = _mcc152_dio_reg_write(address, DIO_REG_POLARITY, DIO_CHANNEL_ALL, 0,
-        false);
-    if (ret != RESULT_SUCCESS)
+
+    for (index = 0; index < count; index++)
     {
-        return ret;
+        codes[0] = 0;
+        codes[1] = 0;
+        for (channel = 0; channel < NUM_AO_CHANNELS; channel++)
+        {
+            if (channel_mask & (1 << channel))
+            {
+                // values are interleaved in order of increasing channel
+                if (!_a_out_code(buffer[index * channel_count +
+                    ((channel_count == 2) ? channel : 0)], options,
+                    &codes[channel]))
+                {
+                    free(info->frames);
+                    free(info);
+                    return RESULT_BAD_PARAMETER;
+                }
+            }
+        }
+        frame = &info->frames[index * info->frame_count * DAC_FRAME_SIZE];
+        _mcc152_dac_frames_build(channel_mask, codes[0], codes[1], frame);
     }
 
-    // input latch
-    ret = _mcc152_dio_reg_write(address, DIO_REG_INPUT_LATCH, DIO_CHANNEL_ALL,
-        0, false);
-    if (ret != RESULT_SUCCESS)
+    pthread_mutex_init(&info->mutex, NULL);
+
+    // the thread and mcc152_a_out_scan_status() cannot see info yet, so the
+    // mutex is not needed here
+    info->running = true;
+    if (pthread_create(&info->handle, NULL, &_out_scan_thread, info) != 0)
     {
-        return ret;
+        pthread_mutex_destroy(&info->mutex);
+        free(info->frames);
+        free(info);
+        return RESULT_RESOURCE_UNAVAIL;
     }
-    
-    // output type
-    ret = _mcc152_dio_reg_write(address, DIO_REG_OUTPUT_CONFIG, DIO_CHANNEL_ALL,
-        0, false);
-    if (ret != RESULT_SUCCESS)
+
+    dev->out_scan_info = info;
+    return RESULT_SUCCESS;
+}
+
+/******************************************************************************
+  Read the analog output scan status and timing statistics.
+ *****************************************************************************/
+int mcc152_a_out_scan_status(uint8_t address, 
+    struct MCC152OutScanStatus* status)
+{
+    struct mcc152OutScanInfo* info;
+
+    if (!_check_addr(address) ||
+        (status == NULL))
     {
-        return ret;
+        return RESULT_BAD_PARAMETER;
     }
 
-    // output latch
-    ret = _mcc152_dio_reg_write(address, DIO_REG_OUTPUT_PORT, DIO_CHANNEL_ALL,
-        0, false);
-    if (ret != RESULT_SUCCESS)
+    if ((info = _devices[address]->out_scan_info) == NULL)
     {
-        return ret;
+        return RESULT_RESOURCE_UNAVAIL;
     }
-    
-    return RESULT_SUCCESS;    
+
+    pthread_mutex_lock(&info->mutex);
+    status->running = info->running ? 1 : 0;
+    status->update_count = info->update_count;
+    status->underruns = info->underruns;
+    status->last_error = info->last_error;
+    if ((info->update_count > 1) &&
+        (info->last_time > info->first_time))
+    {
+        status->actual_rate = (info->update_count - 1) / 
+            (info->last_time - info->first_time);
+    }
+    else
+    {
+        status->actual_rate = 0.0;
+    }
+    status->jitter_mean = (info->update_count > 0) ? 
+        info->jitter_sum / info->update_count : 0.0;
+    status->jitter_p50 = _out_scan_jitter_percentile(info, 0.50);
+    status->jitter_p99 = _out_scan_jitter_percentile(info, 0.99);
+    status->jitter_max = info->jitter_max;
+    pthread_mutex_unlock(&info->mutex);
+
+    return RESULT_SUCCESS;
+}
+
+/******************************************************************************
+  Stop the analog output scan and free its resources.
+ *****************************************************************************/
+int mcc152_a_out_scan_stop(uint8_t address)
+{
+    struct mcc152OutScanInfo* info;
+
+    if (!_check_addr(address))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    if ((info = _devices[address]->out_scan_info) != NULL)
+    {
+        info->stop_thread = true;
+        pthread_join(info->handle, NULL);
+
+        pthread_mutex_destroy(&info->mutex);
+        free(info->frames);
+        free(info);
+        _devices[address]->out_scan_info = NULL;
+    }
+
+    return RESULT_SUCCESS;
+}
+
+/******************************************************************************
+  Reset DIO to default configuration.
+ *****************************************************************************/
+int mcc152_dio_reset(uint8_t address)
+{
+    static const uint8_t reset_regs[] =
+    {
+        DIO_REG_INT_MASK,
+        DIO_REG_CONFIG,
+        DIO_REG_PULL_SELECT,
+        DIO_REG_PULL_ENABLE,
+        DIO_REG_POLARITY,
+        DIO_REG_INPUT_LATCH,
+        DIO_REG_OUTPUT_CONFIG,
+        DIO_REG_OUTPUT_PORT
+    };
+    static const uint8_t reset_values[] =
+    {
+        0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00
+    };
+
+    if (!_check_addr(address))                // check address failed
+    {
+        return RESULT_BAD_PARAMETER;
+    }    
+
+    // write the register values in one bus transfer: interrupt mask, switch 
+    // to inputs, pull-up setting, pull-up enable, input invert, input latch,
+    // output type, output latch
+    return _mcc152_dio_reg_write_multi(address, reset_regs, reset_values,
+        sizeof(reset_regs));
+}
+
+/******************************************************************************
+  Discard the cached DIO register values.
+ *****************************************************************************/
+int mcc152_dio_cache_invalidate(uint8_t address)
+{
+    if (!_check_addr(address))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    _mcc152_dio_cache_invalidate(address);
+    return RESULT_SUCCESS;
 }
 
 /******************************************************************************
@@ -652,17 +1203,14 @@ int mcc152_dio_config_write_bit(uint8_t address, uint8_t channel, uint8_t item,
     uint8_t value)
 {
     uint8_t reg;
-    bool cache;
     uint8_t chan;
     
-    cache = false;
     chan = channel;
     
     switch (item)
     {
     case DIO_DIRECTION:
         reg = DIO_REG_CONFIG;
-        cache = true;
         break;
     case DIO_PULL_CONFIG:
         reg = DIO_REG_PULL_SELECT;
@@ -692,7 +1240,7 @@ int mcc152_dio_config_write_bit(uint8_t address, uint8_t channel, uint8_t item,
         return RESULT_BAD_PARAMETER;
     }
 
-    return _mcc152_dio_reg_write(address, reg, chan, value, cache);
+    return _mcc152_dio_reg_write(address, reg, chan, value, true);
 }
 
 /******************************************************************************
@@ -848,3 +1396,229 @@ int mcc152_dio_config_read_port(uint8_t address, uint8_t item, uint8_t* value)
     }
     return RESULT_SUCCESS;
 }
+
+/******************************************************************************
+  Start the DIO event engine.
+ *****************************************************************************/
+int mcc152_dio_event_start(uint32_t buffer_size)
+{
+    uint32_t size;
+    int result;
+
+    _mcc152_lib_init();
+
+    if (buffer_size > DIO_EVENT_MAX_SIZE)
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+    if (buffer_size == 0)
+    {
+        buffer_size = DIO_EVENT_DEFAULT_SIZE;
+    }
+
+    // round up to a power of 2 so the indices can be masked
+    size = 1;
+    while (size < buffer_size)
+    {
+        size <<= 1;
+    }
+
+    pthread_mutex_lock(&_dio_event_mutex);
+    if (_dio_events != NULL)
+    {
+        pthread_mutex_unlock(&_dio_event_mutex);
+        return RESULT_BUSY;
+    }
+
+    _dio_events = (struct MCC152DIOEvent*)calloc(size, 
+        sizeof(struct MCC152DIOEvent));
+    _dio_event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if ((_dio_events == NULL) ||
+        (_dio_event_fd < 0))
+    {
+        free(_dio_events);
+        _dio_events = NULL;
+        if (_dio_event_fd >= 0)
+        {
+            close(_dio_event_fd);
+            _dio_event_fd = -1;
+        }
+        pthread_mutex_unlock(&_dio_event_mutex);
+        return RESULT_RESOURCE_UNAVAIL;
+    }
+    _dio_event_mask = size - 1;
+    _dio_event_head = 0;
+    _dio_event_tail = 0;
+    _dio_event_overruns = 0;
+
+    if ((result = _hat_interrupt_hook(_dio_event_hook)) != RESULT_SUCCESS)
+    {
+        free(_dio_events);
+        _dio_events = NULL;
+        close(_dio_event_fd);
+        _dio_event_fd = -1;
+    }
+    pthread_mutex_unlock(&_dio_event_mutex);
+
+    return result;
+}
+
+/******************************************************************************
+  Read events from the DIO event ring.
+ *****************************************************************************/
+int mcc152_dio_event_read(struct MCC152DIOEvent* events, uint32_t max_events,
+    double timeout, uint32_t* events_read)
+{
+    struct pollfd poll_data;
+    struct timespec start;
+    struct timespec now;
+    eventfd_t value;
+    uint32_t head;
+    uint32_t tail;
+    uint32_t count;
+    uint32_t i;
+    int wait_ms;
+    int result;
+    double elapsed;
+
+    if ((events == NULL) ||
+        (events_read == NULL))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+    *events_read = 0;
+
+    // hold a reference so mcc152_dio_event_stop() can't free the ring or 
+    // close the eventfd during the read
+    pthread_mutex_lock(&_dio_event_mutex);
+    if ((_dio_events == NULL) || _dio_event_stopping)
+    {
+        pthread_mutex_unlock(&_dio_event_mutex);
+        return RESULT_RESOURCE_UNAVAIL;
+    }
+    _dio_event_readers++;
+    pthread_mutex_unlock(&_dio_event_mutex);
+
+    result = RESULT_SUCCESS;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (true)
+    {
+        if (__atomic_load_n(&_dio_event_stopping, __ATOMIC_ACQUIRE))
+        {
+            result = RESULT_RESOURCE_UNAVAIL;
+            count = 0;
+            break;
+        }
+
+        tail = __atomic_load_n(&_dio_event_tail, __ATOMIC_RELAXED);
+        head = __atomic_load_n(&_dio_event_head, __ATOMIC_ACQUIRE);
+        count = MIN(head - tail, max_events);
+        if ((count > 0) || 
+            (max_events == 0) ||
+            (timeout == 0.0))
+        {
+            break;
+        }
+
+        // wait for the hook to add events
+        if (timeout < 0.0)
+        {
+            wait_ms = -1;
+        }
+        else
+        {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            elapsed = (now.tv_sec - start.tv_sec) + 
+                (now.tv_nsec - start.tv_nsec) / 1e9;
+            if (elapsed >= timeout)
+            {
+                result = RESULT_TIMEOUT;
+                count = 0;
+                break;
+            }
+            wait_ms = (int)((timeout - elapsed) * 1000.0) + 1;
+        }
+        poll_data.fd = _dio_event_fd;
+        poll_data.events = POLLIN;
+        poll_data.revents = 0;
+        if ((poll(&poll_data, 1, wait_ms) > 0) &&
+            !__atomic_load_n(&_dio_event_stopping, __ATOMIC_ACQUIRE))
+        {
+            // leave the wake up from mcc152_dio_event_stop() for the check
+            // at the top of the loop
+            eventfd_read(_dio_event_fd, &value);
+        }
+    }
+
+    if (count > 0)
+    {
+        for (i = 0; i < count; i++)
+        {
+            events[i] = _dio_events[(tail + i) & _dio_event_mask];
+        }
+        __atomic_store_n(&_dio_event_tail, tail + count, __ATOMIC_RELEASE);
+    }
+    *events_read = count;
+
+    pthread_mutex_lock(&_dio_event_mutex);
+    _dio_event_readers--;
+    pthread_cond_broadcast(&_dio_event_cond);
+    pthread_mutex_unlock(&_dio_event_mutex);
+
+    return result;
+}
+
+/******************************************************************************
+  Read the DIO event engine status.
+ *****************************************************************************/
+int mcc152_dio_event_status(uint32_t* events_available, uint64_t* overruns)
+{
+    pthread_mutex_lock(&_dio_event_mutex);
+    if (_dio_events == NULL)
+    {
+        pthread_mutex_unlock(&_dio_event_mutex);
+        return RESULT_RESOURCE_UNAVAIL;
+    }
+
+    if (events_available)
+    {
+        *events_available = __atomic_load_n(&_dio_event_head, 
+            __ATOMIC_ACQUIRE) - __atomic_load_n(&_dio_event_tail, 
+            __ATOMIC_RELAXED);
+    }
+    if (overruns)
+    {
+        *overruns = __atomic_load_n(&_dio_event_overruns, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&_dio_event_mutex);
+    return RESULT_SUCCESS;
+}
+
+/******************************************************************************
+  Stop the DIO event engine and discard any unread events.
+ *****************************************************************************/
+int mcc152_dio_event_stop(void)
+{
+    pthread_mutex_lock(&_dio_event_mutex);
+    if (_dio_events != NULL)
+    {
+        // wake a waiting reader and wait for it to return
+        __atomic_store_n(&_dio_event_stopping, true, __ATOMIC_RELEASE);
+        eventfd_write(_dio_event_fd, 1);
+        while (_dio_event_readers > 0)
+        {
+            pthread_cond_wait(&_dio_event_cond, &_dio_event_mutex);
+        }
+        __atomic_store_n(&_dio_event_stopping, false, __ATOMIC_RELEASE);
+
+        // removing the hook waits for a running hook to finish
+        _hat_interrupt_hook(NULL);
+        free(_dio_events);
+        _dio_events = NULL;
+        close(_dio_event_fd);
+        _dio_event_fd = -1;
+    }
+    pthread_mutex_unlock(&_dio_event_mutex);
+
+    return RESULT_SUCCESS;
+}
@@ -6,8 +6,11 @@
 *   07/18/2018
 */
 #include <fcntl.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
 #include <linux/spi/spidev.h>
 #include "daqhats.h"
@@ -42,78 +45,226 @@ static const uint16_t spi_delay = 0;                // delay in us before
 
 // a file descriptor for each SPI device to support mixing old and new boards
 static int spi_fd[2] = {-1, -1};
+// protects opening spi_fd when boards are opened from several threads
+static pthread_mutex_t spi_open_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// the last codes sent to each DAC's input and output registers, kept so a 
+// failed staged write can be undone; protected by the SPI lock
+struct mcc152DacState
+{
+    uint16_t input[MAX_CHANNEL+1];
+    uint16_t output[MAX_CHANNEL+1];
+    bool input_valid[MAX_CHANNEL+1];
+    bool output_valid[MAX_CHANNEL+1];
+};
+static struct mcc152DacState dac_state[MAX_NUMBER_HATS];
 
 /******************************************************************************
-  Perform a SPI transfer to the DAC.
+  Update the register state for a board after frames were sent.  If the 
+  transfer failed the registers are unknown.
  *****************************************************************************/
-static int _mcc152_spi_transfer(uint8_t device, uint8_t address, void* tx_data,
-    uint8_t data_count)
+static void _mcc152_dac_state_update(uint8_t address, const uint8_t* frames,
+    uint8_t frame_count, bool sent)
 {
-    int lock_fd;
-    uint8_t temp;
-    int ret;
+    struct mcc152DacState* state = &dac_state[address];
+    const uint8_t* frame;
+    uint8_t command;
+    uint8_t dac;
+    uint16_t code;
+    uint8_t i;
+    uint8_t ch;
 
-    if ((device > 1) ||                     // invalid SPI device
-        (address >= MAX_NUMBER_HATS))       // check address failed
+    if (!sent)
     {
-        return RESULT_BAD_PARAMETER;
-    }    
+        memset(state, 0, sizeof(struct mcc152DacState));
+        return;
+    }
 
-    if (spi_fd[device] == -1)
+    for (i = 0; i < frame_count; i++)
     {
-        return RESULT_RESOURCE_UNAVAIL;
+        frame = &frames[i * DAC_FRAME_SIZE];
+        command = frame[0] & 0xF8;
+        dac = frame[0] & 0x07;
+        code = (((uint16_t)frame[1] << 8) | frame[2]) >> 4;
+
+        if ((command == DACCMD_WRITE) ||
+            (command == DACCMD_WRITE_LOAD) ||
+            (command == DACCMD_WRITE_LOAD_ALL))
+        {
+            if (dac > MAX_CHANNEL)
+            {
+                continue;
+            }
+            state->input[dac] = code;
+            state->input_valid[dac] = true;
+        }
+
+        switch (command)
+        {
+        case DACCMD_WRITE_LOAD:
+            state->output[dac] = code;
+            state->output_valid[dac] = true;
+            break;
+        case DACCMD_WRITE_LOAD_ALL:
+        case DACCMD_LDAC:
+            for (ch = 0; ch <= MAX_CHANNEL; ch++)
+            {
+                if ((command == DACCMD_WRITE_LOAD_ALL) || 
+                    (dac == DAC_BOTH) || (dac == ch))
+                {
+                    state->output[ch] = state->input[ch];
+                    state->output_valid[ch] = state->input_valid[ch];
+                }
+            }
+            break;
+        default:
+            break;
+        }
     }
+}
 
-    // Obtain a lock
-    if ((lock_fd = _obtain_lock()) < 0)
+/******************************************************************************
+  Select a board and send one or more DAC frames.  The caller must hold the 
+  SPI lock.  The chip select is released between frames so the DAC latches 
+  each command.
+ *****************************************************************************/
+static int _mcc152_spi_send(uint8_t device, uint8_t address, 
+    const uint8_t* frames, uint8_t frame_count)
+{
+    struct spi_ioc_transfer tr[DAC_MAX_FRAMES];
+    uint8_t temp;
+    uint8_t i;
+
+    // Init the spi ioctl structures
+    memset(tr, 0, sizeof(tr));
+    for (i = 0; i < frame_count; i++)
     {
-        // could not get a lock within 5 seconds, report as a timeout
-        return RESULT_LOCK_TIMEOUT;
+        tr[i].tx_buf = (uintptr_t)&frames[i * DAC_FRAME_SIZE];
+        tr[i].rx_buf = (uintptr_t)NULL;
+        tr[i].len = DAC_FRAME_SIZE;
+        tr[i].delay_usecs = spi_delay;
+        tr[i].speed_hz = spi_rate;
+        tr[i].bits_per_word = spi_bits;
+        tr[i].cs_change = (i < (frame_count - 1)) ? 1 : 0;
     }
 
     _set_address(address);
     
     // check spi mode and change if necessary
-    ret = ioctl(spi_fd[device], SPI_IOC_RD_MODE, &temp);
-    if (ret == -1)
+    if (ioctl(spi_fd[device], SPI_IOC_RD_MODE, &temp) == -1)
     {
-        _release_lock(lock_fd);
         return RESULT_COMMS_FAILURE;
     }
     if (temp != spi_mode)
     {
-        ret = ioctl(spi_fd[device], SPI_IOC_WR_MODE, &spi_mode);
-        if (ret == -1)
+        if (ioctl(spi_fd[device], SPI_IOC_WR_MODE, &spi_mode) == -1)
         {
-            _release_lock(lock_fd);
             return RESULT_COMMS_FAILURE;
         }
     }
 
-    // Init the spi ioctl structure
-    struct spi_ioc_transfer tr = {
-        .tx_buf = (uintptr_t)tx_data,
-        .rx_buf = (uintptr_t)NULL,
-        .len = data_count,
-        .delay_usecs = spi_delay,
-        .speed_hz = spi_rate,
-        .bits_per_word = spi_bits,
-    };
+    if (ioctl(spi_fd[device], SPI_IOC_MESSAGE(frame_count), tr) < 1)
+    {
+        _mcc152_dac_state_update(address, frames, frame_count, false);
+        return RESULT_COMMS_FAILURE;
+    }
+    _mcc152_dac_state_update(address, frames, frame_count, true);
+    return RESULT_SUCCESS;
+}
+
+/******************************************************************************
+  Perform a SPI transfer of one or more DAC frames under a single lock.
+ *****************************************************************************/
+static int _mcc152_spi_transfer(uint8_t device, uint8_t address, 
+    const uint8_t* frames, uint8_t frame_count)
+{
+    int lock_fd;
+    int ret;
+
+    if ((device > 1) ||                     // invalid SPI device
+        (address >= MAX_NUMBER_HATS) ||     // check address failed
+        (frames == NULL) ||
+        (frame_count == 0) ||
+        (frame_count > DAC_MAX_FRAMES))
+    {
+        return RESULT_BAD_PARAMETER;
+    }    
 
-    if ((ret = ioctl(spi_fd[device], SPI_IOC_MESSAGE(1), &tr)) < 1)
+    if (spi_fd[device] == -1)
     {
-        ret = RESULT_COMMS_FAILURE;
+        return RESULT_RESOURCE_UNAVAIL;
     }
-    else
+
+    // Obtain a lock
+    if ((lock_fd = _obtain_lock()) < 0)
     {
-        ret = RESULT_SUCCESS;
+        // could not get a lock within 5 seconds, report as a timeout
+        return RESULT_LOCK_TIMEOUT;
     }
 
+    ret = _mcc152_spi_send(device, address, frames, frame_count);
+
     // clear the SPI lock
     _release_lock(lock_fd);
 
     return ret;
 }
+
+/******************************************************************************
+  Fill in a DAC command frame.
+ *****************************************************************************/
+static void _mcc152_dac_frame(uint8_t* frame, uint8_t command, uint16_t code)
+{
+    uint16_t value;
+
+    value = code << 4;
+    frame[0] = command;
+    frame[1] = (uint8_t)(value >> 8);
+    frame[2] = (uint8_t)value;
+}
+
+/******************************************************************************
+  Build the frames that update the channels in channel_mask.  A single channel
+  is written and loaded with one frame; both channels are written then loaded
+  together with two frames.  frames must hold DAC_MAX_FRAMES frames.
+
+  Return: the number of frames, or 0 for invalid arguments
+ *****************************************************************************/
+uint8_t _mcc152_dac_frames_build(uint8_t channel_mask, uint16_t code0,
+    uint16_t code1, uint8_t* frames)
+{
+    if ((frames == NULL) ||
+        (code0 > MAX_CODE) || (code1 > MAX_CODE))
+    {
+        return 0;
+    }
+
+    switch (channel_mask)
+    {
+    case 0x01:
+        _mcc152_dac_frame(frames, DACCMD_WRITE_LOAD | DAC_A, code0);
+        return 1;
+    case 0x02:
+        _mcc152_dac_frame(frames, DACCMD_WRITE_LOAD | DAC_B, code1);
+        return 1;
+    case 0x03:
+        _mcc152_dac_frame(frames, DACCMD_WRITE | DAC_A, code0);
+        _mcc152_dac_frame(&frames[DAC_FRAME_SIZE], 
+            DACCMD_WRITE_LOAD_ALL | DAC_B, code1);
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+/******************************************************************************
+  Send frames built with _mcc152_dac_frames_build().
+ *****************************************************************************/
+int _mcc152_dac_write_frames(uint8_t device, uint8_t address,
+    const uint8_t* frames, uint8_t frame_count)
+{
+    return _mcc152_spi_transfer(device, address, frames, frame_count);
+}
     
 /******************************************************************************
   Write a single analog output channel.
@@ -121,8 +272,8 @@ static int _mcc152_spi_transfer(uint8_t device, uint8_t address, void* tx_data,
 int _mcc152_dac_write(uint8_t device, uint8_t address, uint8_t channel,
     uint16_t code)
 {
-    uint8_t data[3];
-    uint16_t value;
+    uint8_t frames[DAC_MAX_FRAMES * DAC_FRAME_SIZE];
+    uint8_t count;
     
     if ((device > 1) ||                         // invalid SPI device
         (address >= MAX_NUMBER_HATS) ||         // check address failed
@@ -132,19 +283,8 @@ int _mcc152_dac_write(uint8_t device, uint8_t address, uint8_t channel,
         return RESULT_BAD_PARAMETER;
     }    
     
-    if (channel == 0)
-    {
-        data[0] = DACCMD_WRITE_LOAD | DAC_A;
-    }
-    else
-    {
-        data[0] = DACCMD_WRITE_LOAD | DAC_B;
-    }
-    value = code << 4;
-    data[1] = (uint8_t)(value >> 8);
-    data[2] = (uint8_t)value;
-    
-    return _mcc152_spi_transfer(device, address, data, 3);
+    count = _mcc152_dac_frames_build(1 << channel, code, code, frames);
+    return _mcc152_spi_transfer(device, address, frames, count);
 }
 
 /******************************************************************************
@@ -153,9 +293,8 @@ int _mcc152_dac_write(uint8_t device, uint8_t address, uint8_t channel,
 int _mcc152_dac_write_both(uint8_t device, uint8_t address, uint16_t code0,
     uint16_t code1)
 {
-    uint8_t data[3];
-    uint16_t value;
-    int result;
+    uint8_t frames[DAC_MAX_FRAMES * DAC_FRAME_SIZE];
+    uint8_t count;
     
     if ((device > 1) ||                             // invalid SPI device
         (address >= MAX_NUMBER_HATS) ||             // check address failed
@@ -164,21 +303,104 @@ int _mcc152_dac_write_both(uint8_t device, uint8_t address, uint16_t code0,
         return RESULT_BAD_PARAMETER;
     }    
     
-    data[0] = DACCMD_WRITE | DAC_A;
-    value = code0 << 4;
-    data[1] = (uint8_t)(value >> 8);
-    data[2] = (uint8_t)value;
-    result = _mcc152_spi_transfer(device, address, data, 3);
-    if (result != RESULT_SUCCESS)
+    // both frames go out under one lock
+    count = _mcc152_dac_frames_build(0x03, code0, code1, frames);
+    return _mcc152_spi_transfer(device, address, frames, count);
+}
+
+/******************************************************************************
+  Write both analog output channels on several boards and update them 
+  together.  The new codes are written to the DAC input registers of every 
+  board first, then the software LDAC commands are sent back to back, all 
+  under a single SPI lock, so the outputs change with minimal skew.
+
+  codes holds two codes per board.  If a transfer fails the input registers 
+  of every board are rewritten with its current output codes so values that
+  were staged but never loaded do not appear on the next load.  Boards whose
+  output codes are unknown, such as one that has just failed a transfer, keep
+  whatever was staged.
+ *****************************************************************************/
+int _mcc152_dac_write_staged(uint8_t count, const uint8_t* devices,
+    const uint8_t* addresses, const uint16_t* codes)
+{
+    uint8_t frames[DAC_MAX_FRAMES * DAC_FRAME_SIZE];
+    uint8_t load[DAC_FRAME_SIZE];
+    struct mcc152DacState* state;
+    int lock_fd;
+    int ret;
+    uint8_t i;
+
+    if ((count == 0) ||
+        (devices == NULL) ||
+        (addresses == NULL) ||
+        (codes == NULL))
     {
-        return result;
+        return RESULT_BAD_PARAMETER;
     }
-    
-    data[0] = DACCMD_WRITE_LOAD_ALL | DAC_B;
-    value = code1 << 4;
-    data[1] = (uint8_t)(value >> 8);
-    data[2] = (uint8_t)value;
-    return _mcc152_spi_transfer(device, address, data, 3);    
+
+    for (i = 0; i < count; i++)
+    {
+        if ((devices[i] > 1) ||                     // invalid SPI device
+            (addresses[i] >= MAX_NUMBER_HATS) ||    // check address failed
+            (codes[2*i] > MAX_CODE) ||              // bad DAC code
+            (codes[2*i+1] > MAX_CODE))
+        {
+            return RESULT_BAD_PARAMETER;
+        }
+        if (spi_fd[devices[i]] == -1)
+        {
+            return RESULT_RESOURCE_UNAVAIL;
+        }
+    }
+
+    // Obtain a lock
+    if ((lock_fd = _obtain_lock()) < 0)
+    {
+        // could not get a lock within 5 seconds, report as a timeout
+        return RESULT_LOCK_TIMEOUT;
+    }
+
+    // write the input registers without updating the outputs
+    ret = RESULT_SUCCESS;
+    for (i = 0; (i < count) && (ret == RESULT_SUCCESS); i++)
+    {
+        _mcc152_dac_frame(frames, DACCMD_WRITE | DAC_A, codes[2*i]);
+        _mcc152_dac_frame(&frames[DAC_FRAME_SIZE], DACCMD_WRITE | DAC_B, 
+            codes[2*i+1]);
+        ret = _mcc152_spi_send(devices[i], addresses[i], frames, 2);
+    }
+
+    // load the new values on every board
+    _mcc152_dac_frame(load, DACCMD_LDAC | DAC_BOTH, 0);
+    for (i = 0; (i < count) && (ret == RESULT_SUCCESS); i++)
+    {
+        ret = _mcc152_spi_send(devices[i], addresses[i], load, 1);
+    }
+
+    if (ret != RESULT_SUCCESS)
+    {
+        // discard the staged values that were not loaded
+        for (i = 0; i < count; i++)
+        {
+            state = &dac_state[addresses[i]];
+            if (state->output_valid[0] && state->output_valid[1] &&
+                ((state->input[0] != state->output[0]) ||
+                 (state->input[1] != state->output[1]) ||
+                 !state->input_valid[0] || !state->input_valid[1]))
+            {
+                _mcc152_dac_frame(frames, DACCMD_WRITE | DAC_A, 
+                    state->output[0]);
+                _mcc152_dac_frame(&frames[DAC_FRAME_SIZE], 
+                    DACCMD_WRITE | DAC_B, state->output[1]);
+                _mcc152_spi_send(devices[i], addresses[i], frames, 2);
+            }
+        }
+    }
+
+    // clear the SPI lock
+    _release_lock(lock_fd);
+
+    return ret;
 }
 
 /******************************************************************************
@@ -186,7 +408,7 @@ int _mcc152_dac_write_both(uint8_t device, uint8_t address, uint16_t code0,
  *****************************************************************************/
 int _mcc152_dac_init(uint8_t device, uint8_t address)
 {
-    uint8_t data[3];
+    uint8_t data[DAC_FRAME_SIZE];
     
     if ((address >= MAX_NUMBER_HATS) ||     // check address failed
         (device > 1))                       // invalid SPI device
@@ -194,6 +416,7 @@ int _mcc152_dac_init(uint8_t device, uint8_t address)
         return RESULT_BAD_PARAMETER;
     }    
 
+    pthread_mutex_lock(&spi_open_mutex);
     if (spi_fd[device] == -1)
     {
         // SPI device has not been opened yet.
@@ -208,16 +431,19 @@ int _mcc152_dac_init(uint8_t device, uint8_t address)
         
         if (spi_fd[device] < 0)
         {
+            spi_fd[device] = -1;
+            pthread_mutex_unlock(&spi_open_mutex);
             return RESULT_RESOURCE_UNAVAIL;
         }
     }
+    pthread_mutex_unlock(&spi_open_mutex);
     
     // the DAC defaults to external reference so switch it to the internal
     // reference
     data[0] = DACCMD_REF_MODE;
     data[1] = 0;
     data[2] = 1;
-    int result = _mcc152_spi_transfer(device, address, data, 3);
+    int result = _mcc152_spi_transfer(device, address, data, 1);
     
     return result;
 }
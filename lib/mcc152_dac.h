@@ -10,12 +10,24 @@
 
 #include <stdint.h>
 
+#define DAC_FRAME_SIZE      3       // bytes in a DAC command frame
+#define DAC_MAX_FRAMES      2       // frames sent under one lock
+
 // Write to a single analog output channel.
 int _mcc152_dac_write(uint8_t device, uint8_t address, uint8_t channel, 
     uint16_t code);
 // Write to both channels at once.
 int _mcc152_dac_write_both(uint8_t device, uint8_t address, uint16_t code0, 
     uint16_t code1);
+// Build the command frames that update the channels in a mask.
+uint8_t _mcc152_dac_frames_build(uint8_t channel_mask, uint16_t code0,
+    uint16_t code1, uint8_t* frames);
+// Send pre-built command frames.
+int _mcc152_dac_write_frames(uint8_t device, uint8_t address,
+    const uint8_t* frames, uint8_t frame_count);
+// Write both channels on several boards and update them together.
+int _mcc152_dac_write_staged(uint8_t count, const uint8_t* devices,
+    const uint8_t* addresses, const uint16_t* codes);
 // Initialize the SPI interface and DAC.
 int _mcc152_dac_init(uint8_t device, uint8_t address);
 
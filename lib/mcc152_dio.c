@@ -5,8 +5,10 @@
 *
 *   07/18/2018
 */
+#include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
 #include <linux/i2c.h>
 #include <linux/i2c-dev.h>
@@ -18,75 +20,105 @@
 
 #define NUM_DIO_CHANNELS    8
 
+// The registers held in the shadow register file.  The input port and 
+// interrupt status registers change without being written so they are always
+// read from the device.
+static const uint8_t shadow_regs[] =
+{
+    DIO_REG_OUTPUT_PORT,
+    DIO_REG_POLARITY,
+    DIO_REG_CONFIG,
+    DIO_REG_INPUT_LATCH,
+    DIO_REG_PULL_ENABLE,
+    DIO_REG_PULL_SELECT,
+    DIO_REG_INT_MASK,
+    DIO_REG_OUTPUT_CONFIG
+};
+#define NUM_SHADOW_REGS     (sizeof(shadow_regs) / sizeof(shadow_regs[0]))
+
 /// \cond
 // Local data for all MCC 152 boards.
 struct dio_device
 {
-    uint8_t last_register;
-    uint8_t output_port;
-    uint8_t direction;
+    bool bus_open;
+    bool shadow_valid;
+    uint8_t shadow[NUM_SHADOW_REGS];
 } dio_devices[MAX_NUMBER_HATS];
 /// \endcond
 
+// All of the boards share one I2C bus handle, which stays open while any MCC 
+// 152 is open.  Messages carry the slave address so I2C_SLAVE is not needed.
+static int i2c_fd = -1;
+static int i2c_ref_count = 0;
+static pthread_mutex_t i2c_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 /******************************************************************************
-  Write data to an I2C device.
+  Open the shared I2C bus handle, or add a reference to it if it is already 
+  open.
  *****************************************************************************/
-static inline int _write_byte_data(int file, uint8_t reg, uint8_t value)
+static int _mcc152_i2c_open(void)
 {
-	union i2c_smbus_data data;
-	struct i2c_smbus_ioctl_data args;
+    int ret;
 
-	data.byte = value;
+    pthread_mutex_lock(&i2c_mutex);
+    ret = RESULT_SUCCESS;
+    if (i2c_fd < 0)
+    {
+        i2c_fd = open(I2C_DEVICE_1, O_RDWR | O_CLOEXEC);
+    }
+    if (i2c_fd < 0)
+    {
+        ret = RESULT_RESOURCE_UNAVAIL;
+    }
+    else
+    {
+        i2c_ref_count++;
+    }
+    pthread_mutex_unlock(&i2c_mutex);
 
-	args.read_write = 0;
-	args.command = reg;
-	args.size = 2;
-	args.data = &data;
-	return ioctl(file, I2C_SMBUS, &args);
+    return ret;
 }
 
 /******************************************************************************
-  Read data from an I2C device.
+  Release a reference to the shared I2C bus handle, closing it when the last
+  board is closed.
  *****************************************************************************/
-static inline int _read_byte_data(int file, uint8_t reg)
+static void _mcc152_i2c_close(void)
 {
-	union i2c_smbus_data data;
-	struct i2c_smbus_ioctl_data args;
-
-	args.read_write = 1;
-	args.command = reg;
-	args.size = 2;
-	args.data = &data;
-	if (ioctl(file, I2C_SMBUS, &args))
-    {
-        return -1;
-    }
-    else
+    pthread_mutex_lock(&i2c_mutex);
+    if (i2c_ref_count > 0)
     {
-        return data.byte & 0xFF;
+        i2c_ref_count--;
+        if ((i2c_ref_count == 0) && (i2c_fd >= 0))
+        {
+            close(i2c_fd);
+            i2c_fd = -1;
+        }
     }
+    pthread_mutex_unlock(&i2c_mutex);
 }
 
 /******************************************************************************
-  Read a single byte from an I2C device.
+  Perform a combined I2C transfer.  The kernel holds the bus for all of the
+  messages, using a repeated start between them, so other processes can't 
+  access the I/O expander in the middle of the transfer.
  *****************************************************************************/
-static inline int _read_byte(int file)
+static int _mcc152_i2c_transfer(struct i2c_msg* msgs, int count)
 {
-	union i2c_smbus_data data;
-	struct i2c_smbus_ioctl_data args;
+    struct i2c_rdwr_ioctl_data data;
 
-	args.read_write = 1;
-	args.command = 0;
-	args.size = 1;
-	args.data = &data;
-	if (ioctl(file, I2C_SMBUS, &args))
+    if (i2c_fd < 0)
     {
-        return -1;
+        return RESULT_RESOURCE_UNAVAIL;
     }
-    else
+
+    data.msgs = msgs;
+    data.nmsgs = count;
+    if (ioctl(i2c_fd, I2C_RDWR, &data) != count)
     {
-        return data.byte & 0xFF;
+        return RESULT_COMMS_FAILURE;
     }
+    return RESULT_SUCCESS;
 }
 
 /******************************************************************************
@@ -94,49 +126,23 @@ static inline int _read_byte(int file)
  *****************************************************************************/
 static int _mcc152_i2c_write(uint8_t address, uint8_t reg, uint8_t value)
 {
-    int i2c_fd;
-    uint8_t addr;
-    int ret;
+    struct i2c_msg msg;
+    uint8_t buffer[2];
 
     if ((address >= MAX_NUMBER_HATS))   // check address failed
     {
         return RESULT_BAD_PARAMETER;
     }    
-    addr = I2C_BASE_ADDR + address;
 
-    // Open the I2C device handle - this will block until all other handles are
-    // closed so we don't need a lock mechanism.
-    i2c_fd = open(I2C_DEVICE_1, O_RDWR);
-    if (i2c_fd < 0)
-    {
-        return RESULT_RESOURCE_UNAVAIL;
-    }
+    buffer[0] = reg;
+    buffer[1] = value;
 
-    // set slave address
-    ret = ioctl(i2c_fd, I2C_SLAVE, addr);
-    if (ret == -1)
-    {
-        close(i2c_fd);
-        return RESULT_COMMS_FAILURE;
-    }
-    
-    // write the value
-	ret = _write_byte_data(i2c_fd, reg, value);    
-    if (ret == -1)
-    {
-        ret = RESULT_COMMS_FAILURE;
-    }
-    else
-    {
-        ret = RESULT_SUCCESS;
-    }
+    msg.addr = I2C_BASE_ADDR + address;
+    msg.flags = 0;
+    msg.len = 2;
+    msg.buf = buffer;
 
-    // close the device and save this register as last_register for possible time
-    // savings if reading/writing this same register again
-    close(i2c_fd);
-    dio_devices[address].last_register = reg;
-    
-    return ret;
+    return _mcc152_i2c_transfer(&msg, 1);
 }
 
 /******************************************************************************
@@ -144,60 +150,132 @@ static int _mcc152_i2c_write(uint8_t address, uint8_t reg, uint8_t value)
  *****************************************************************************/
 static int _mcc152_i2c_read(uint8_t address, uint8_t reg, uint8_t* value)
 {
-    int i2c_fd;
-    uint8_t addr;
-    int ret;
+    struct i2c_msg msgs[2];
 
     if ((address >= MAX_NUMBER_HATS) ||         // check address failed
         (value == NULL))                        // bad pointer
     {
         return RESULT_BAD_PARAMETER;
     }    
-    addr = I2C_BASE_ADDR + address;
 
-    // Open the I2C device handle - this will block until all other handles are
-    // closed so we don't need a lock mechanism.
-    i2c_fd = open(I2C_DEVICE_1, O_RDWR);
-    if (i2c_fd < 0)
+    // write the register pointer then read the value after a repeated start,
+    // in a single call
+    msgs[0].addr = I2C_BASE_ADDR + address;
+    msgs[0].flags = 0;
+    msgs[0].len = 1;
+    msgs[0].buf = &reg;
+
+    msgs[1].addr = I2C_BASE_ADDR + address;
+    msgs[1].flags = I2C_M_RD;
+    msgs[1].len = 1;
+    msgs[1].buf = value;
+
+    return _mcc152_i2c_transfer(msgs, 2);
+}
+
+/******************************************************************************
+  Return the shadow register file index for a register, or -1 if the register
+  is not shadowed.
+ *****************************************************************************/
+static int _mcc152_dio_shadow_index(uint8_t reg)
+{
+    int i;
+
+    for (i = 0; i < (int)NUM_SHADOW_REGS; i++)
     {
-        return RESULT_RESOURCE_UNAVAIL;
+        if (shadow_regs[i] == reg)
+        {
+            return i;
+        }
     }
+    return -1;
+}
+
+/******************************************************************************
+  Read all of the shadowed registers from the device in a single bus transfer.
+ *****************************************************************************/
+static int _mcc152_dio_shadow_load(uint8_t address)
+{
+    struct i2c_msg msgs[2*NUM_SHADOW_REGS];
+    uint8_t regs[NUM_SHADOW_REGS];
+    uint8_t values[NUM_SHADOW_REGS];
+    int i;
+    int ret;
 
-    // set the slave address
-    ret = ioctl(i2c_fd, I2C_SLAVE, addr);
-    if (ret == -1)
+    for (i = 0; i < (int)NUM_SHADOW_REGS; i++)
     {
-        close(i2c_fd);
-        return RESULT_COMMS_FAILURE;
+        regs[i] = shadow_regs[i];
+
+        msgs[2*i].addr = I2C_BASE_ADDR + address;
+        msgs[2*i].flags = 0;
+        msgs[2*i].len = 1;
+        msgs[2*i].buf = &regs[i];
+
+        msgs[2*i+1].addr = I2C_BASE_ADDR + address;
+        msgs[2*i+1].flags = I2C_M_RD;
+        msgs[2*i+1].len = 1;
+        msgs[2*i+1].buf = &values[i];
     }
-    
-    // If the register has not changed since the last transfer then just perform
-    // a read byte; otherwise, perform read byte data which writes the register
-    // to the I/O expander.
-    if (reg == dio_devices[address].last_register)
+
+    ret = _mcc152_i2c_transfer(msgs, 2*NUM_SHADOW_REGS);
+    if (ret != RESULT_SUCCESS)
     {
-        ret = _read_byte(i2c_fd);
+        dio_devices[address].shadow_valid = false;
+        return ret;
     }
-    else
+
+    memcpy(dio_devices[address].shadow, values, NUM_SHADOW_REGS);
+    dio_devices[address].shadow_valid = true;
+    return RESULT_SUCCESS;
+}
+
+/******************************************************************************
+  Update the shadow register file after a successful transfer.
+ *****************************************************************************/
+static void _mcc152_dio_cache_update(uint8_t address, uint8_t reg,
+    uint8_t value)
+{
+    int index;
+
+    if ((index = _mcc152_dio_shadow_index(reg)) >= 0)
     {
-        // read from the device
-        ret = _read_byte_data(i2c_fd, reg);
+        dio_devices[address].shadow[index] = value;
     }
+}
 
-    close(i2c_fd);
-    
-    if (ret == -1)
+/******************************************************************************
+  Read a register, using the shadow register file when the register is 
+  shadowed and use_cache is true.  An invalidated shadow register file is 
+  reloaded first.
+ *****************************************************************************/
+static int _mcc152_dio_cached_read(uint8_t address, uint8_t reg,
+    uint8_t* value, bool use_cache)
+{
+    int index;
+    int ret;
+
+    index = _mcc152_dio_shadow_index(reg);
+    if ((index < 0) || !use_cache)
     {
-        ret = RESULT_COMMS_FAILURE;
+        ret = _mcc152_i2c_read(address, reg, value);
+        if ((ret == RESULT_SUCCESS) && (index >= 0))
+        {
+            dio_devices[address].shadow[index] = *value;
+        }
+        return ret;
     }
-    else
+
+    if (!dio_devices[address].shadow_valid)
     {
-        *value = (uint8_t)ret;
-        ret = RESULT_SUCCESS;
-        dio_devices[address].last_register = reg;
+        ret = _mcc152_dio_shadow_load(address);
+        if (ret != RESULT_SUCCESS)
+        {
+            return ret;
+        }
     }
-    
-    return ret;
+
+    *value = dio_devices[address].shadow[index];
+    return RESULT_SUCCESS;
 }
 
 /******************************************************************************
@@ -209,6 +287,7 @@ int _mcc152_dio_reg_write(uint8_t address, uint8_t reg, uint8_t channel,
     int ret;
     uint8_t reg_value;
     
+    ret = RESULT_SUCCESS;
     if ((address >= MAX_NUMBER_HATS) ||          // check address failed
         // bad channel
         ((channel > NUM_DIO_CHANNELS) && (channel != DIO_CHANNEL_ALL))) 
@@ -223,25 +302,10 @@ int _mcc152_dio_reg_write(uint8_t address, uint8_t reg, uint8_t channel,
     else
     {
         value &= 0x01;      // force to single bit
-        if (use_cache)
+        ret = _mcc152_dio_cached_read(address, reg, &reg_value, use_cache);
+        if (ret != RESULT_SUCCESS)
         {
-            switch (reg)
-            {
-            case DIO_REG_OUTPUT_PORT:
-                reg_value = dio_devices[address].output_port;
-                break;
-            case DIO_REG_CONFIG:
-                reg_value = dio_devices[address].direction;
-                break;
-            default:
-                // no cache available
-                _mcc152_i2c_read(address, reg, &reg_value);
-                break;
-            }
-        }
-        else
-        {
-            _mcc152_i2c_read(address, reg, &reg_value);
+            return ret;
         }
         reg_value = (reg_value & ~(1 << channel)) | (value << channel);
     }
@@ -252,19 +316,7 @@ int _mcc152_dio_reg_write(uint8_t address, uint8_t reg, uint8_t channel,
         return ret;
     }   
 
-    // update cache
-    switch (reg)
-    {
-    case DIO_REG_OUTPUT_PORT:
-        dio_devices[address].output_port = reg_value;
-        break;
-    case DIO_REG_CONFIG:
-        dio_devices[address].direction = reg_value;
-        break;
-    default:
-        // no cache available
-        break;
-    }
+    _mcc152_dio_cache_update(address, reg, reg_value);
     
     return RESULT_SUCCESS;
 }
@@ -286,26 +338,12 @@ int _mcc152_dio_reg_read(uint8_t address, uint8_t reg, uint8_t channel,
         return RESULT_BAD_PARAMETER;
     }    
 
-    ret = _mcc152_i2c_read(address, reg, &reg_value);
+    ret = _mcc152_dio_cached_read(address, reg, &reg_value, true);
     if (ret != RESULT_SUCCESS)
     {
         return ret;
     }   
 
-    // update cache
-    switch (reg)
-    {
-    case DIO_REG_OUTPUT_PORT:
-        dio_devices[address].output_port = reg_value;
-        break;
-    case DIO_REG_CONFIG:
-        dio_devices[address].direction = reg_value;
-        break;
-    default:
-        // no cache available
-        break;
-    }
-    
     if (channel == DIO_CHANNEL_ALL)
     {
         *value = reg_value;
@@ -319,7 +357,164 @@ int _mcc152_dio_reg_read(uint8_t address, uint8_t reg, uint8_t channel,
 }
 
 /******************************************************************************
-  Initialize the DIO interface by reading the cached registers.
+  Write several I/O expander registers in a single bus transfer.
+ *****************************************************************************/
+int _mcc152_dio_reg_write_multi(uint8_t address, const uint8_t* regs,
+    const uint8_t* values, uint8_t count)
+{
+    struct i2c_msg msgs[DIO_MAX_MULTI_WRITE];
+    uint8_t buffers[DIO_MAX_MULTI_WRITE][2];
+    uint8_t i;
+    int ret;
+
+    if ((address >= MAX_NUMBER_HATS) ||         // check address failed
+        (regs == NULL) ||
+        (values == NULL) ||
+        (count == 0) ||
+        (count > DIO_MAX_MULTI_WRITE))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        buffers[i][0] = regs[i];
+        buffers[i][1] = values[i];
+
+        msgs[i].addr = I2C_BASE_ADDR + address;
+        msgs[i].flags = 0;
+        msgs[i].len = 2;
+        msgs[i].buf = buffers[i];
+    }
+
+    ret = _mcc152_i2c_transfer(msgs, count);
+    if (ret != RESULT_SUCCESS)
+    {
+        return ret;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        _mcc152_dio_cache_update(address, regs[i], values[i]);
+    }
+
+    return RESULT_SUCCESS;
+}
+
+/******************************************************************************
+  Read the interrupt status and input port registers of several boards.  The
+  status of every board is read in one bus transfer, then the inputs of the 
+  boards with pending interrupts in a second.  If a combined transfer fails 
+  (such as when one board does not respond) each board is read separately and 
+  boards that fail report no interrupts.
+
+  Reading the input port clears the interrupt, so a failed input transfer may
+  already have cleared some of the boards.  Their status was read first and 
+  is kept, so the retry only has to read their inputs again and the 
+  interrupts are not lost.
+ *****************************************************************************/
+int _mcc152_dio_int_sweep(const uint8_t* addresses, uint8_t count,
+    uint8_t* status, uint8_t* inputs)
+{
+    struct i2c_msg msgs[2*MAX_NUMBER_HATS];
+    uint8_t regs[2] = {DIO_REG_INT_STATUS, DIO_REG_INPUT_PORT};
+    uint8_t pending[MAX_NUMBER_HATS];
+    uint8_t pending_count;
+    uint8_t i;
+    int ret;
+
+    if ((addresses == NULL) ||
+        (status == NULL) ||
+        (inputs == NULL) ||
+        (count > MAX_NUMBER_HATS))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+    if (count == 0)
+    {
+        return RESULT_SUCCESS;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        msgs[2*i].addr = I2C_BASE_ADDR + addresses[i];
+        msgs[2*i].flags = 0;
+        msgs[2*i].len = 1;
+        msgs[2*i].buf = &regs[0];
+
+        msgs[2*i+1].addr = I2C_BASE_ADDR + addresses[i];
+        msgs[2*i+1].flags = I2C_M_RD;
+        msgs[2*i+1].len = 1;
+        msgs[2*i+1].buf = &status[i];
+
+        inputs[i] = 0;
+    }
+
+    // this runs on the interrupt dispatcher thread, so hold the mutex to keep
+    // mcc152_close() on another thread from closing the bus handle
+    pthread_mutex_lock(&i2c_mutex);
+
+    // reading the status does not clear it, so this can simply be retried
+    ret = _mcc152_i2c_transfer(msgs, 2*count);
+    if ((ret != RESULT_SUCCESS) && (count > 1))
+    {
+        for (i = 0; i < count; i++)
+        {
+            if (_mcc152_i2c_transfer(&msgs[2*i], 2) != RESULT_SUCCESS)
+            {
+                status[i] = 0;
+            }
+            else
+            {
+                ret = RESULT_SUCCESS;
+            }
+        }
+    }
+    if (ret != RESULT_SUCCESS)
+    {
+        pthread_mutex_unlock(&i2c_mutex);
+        return ret;
+    }
+
+    // read the inputs of the interrupted boards, which clears the interrupts
+    pending_count = 0;
+    for (i = 0; i < count; i++)
+    {
+        if (status[i] != 0)
+        {
+            msgs[2*pending_count].addr = I2C_BASE_ADDR + addresses[i];
+            msgs[2*pending_count].flags = 0;
+            msgs[2*pending_count].len = 1;
+            msgs[2*pending_count].buf = &regs[1];
+
+            msgs[2*pending_count+1].addr = I2C_BASE_ADDR + addresses[i];
+            msgs[2*pending_count+1].flags = I2C_M_RD;
+            msgs[2*pending_count+1].len = 1;
+            msgs[2*pending_count+1].buf = &inputs[i];
+
+            pending[pending_count++] = i;
+        }
+    }
+
+    if ((pending_count > 0) &&
+        (_mcc152_i2c_transfer(msgs, 2*pending_count) != RESULT_SUCCESS))
+    {
+        for (i = 0; i < pending_count; i++)
+        {
+            if (_mcc152_i2c_transfer(&msgs[2*i], 2) != RESULT_SUCCESS)
+            {
+                status[pending[i]] = 0;
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&i2c_mutex);
+    return RESULT_SUCCESS;
+}
+
+/******************************************************************************
+  Initialize the DIO interface by opening the bus and reading the shadowed 
+  registers.
  *****************************************************************************/
 int _mcc152_dio_init(int address)
 {
@@ -330,25 +525,44 @@ int _mcc152_dio_init(int address)
         return RESULT_BAD_PARAMETER;
     }
 
-    // Only one handle may be open to an I2C device at a time, so open it only
-    // while performing a bus transfer.
-
-    // read the registers that have local cache
-    dio_devices->last_register = 0xFF;
-    
-    ret = _mcc152_i2c_read(address, DIO_REG_OUTPUT_PORT, 
-        &dio_devices[address].output_port);
+    ret = _mcc152_i2c_open();
     if (ret != RESULT_SUCCESS)
     {
         return ret;
     }
-    ret = _mcc152_i2c_read(address, DIO_REG_CONFIG, 
-        &dio_devices[address].direction);
+
+    // populate the shadow register file
+    ret = _mcc152_dio_shadow_load(address);
     if (ret != RESULT_SUCCESS)
     {
+        _mcc152_i2c_close();
         return ret;
     }
+    dio_devices[address].bus_open = true;
     
     return RESULT_SUCCESS;
 }
 
+/******************************************************************************
+  Release the DIO interface when a board is closed.
+ *****************************************************************************/
+void _mcc152_dio_fini(int address)
+{
+    if ((address < MAX_NUMBER_HATS) &&
+        dio_devices[address].bus_open)
+    {
+        dio_devices[address].bus_open = false;
+        _mcc152_i2c_close();
+    }
+}
+
+/******************************************************************************
+  Mark the shadow register file as stale so it is reloaded on the next access.
+ *****************************************************************************/
+void _mcc152_dio_cache_invalidate(int address)
+{
+    if (address < MAX_NUMBER_HATS)
+    {
+        dio_devices[address].shadow_valid = false;
+    }
+}
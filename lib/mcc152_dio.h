@@ -26,13 +26,26 @@
 #define DIO_REG_INT_STATUS          0x46
 #define DIO_REG_OUTPUT_CONFIG       0x4F
 
+#define DIO_MAX_MULTI_WRITE         16      // registers per combined write
+
 // Initialize the DIO interface.
 int _mcc152_dio_init(int address);
+// Release the DIO interface.
+void _mcc152_dio_fini(int address);
+// Force the shadow registers to be reloaded from the device.
+void _mcc152_dio_cache_invalidate(int address);
 // Read a DIO register.
 int _mcc152_dio_reg_read(uint8_t address, uint8_t reg, uint8_t channel,
     uint8_t* value);
 // Write a DIO register.
 int _mcc152_dio_reg_write(uint8_t address, uint8_t reg, uint8_t channel,
     uint8_t value, bool use_cache);
+// Read the interrupt status and inputs of several boards with combined
+// transfers.
+int _mcc152_dio_int_sweep(const uint8_t* addresses, uint8_t count,
+    uint8_t* status, uint8_t* inputs);
+// Write several DIO registers in one bus transfer.
+int _mcc152_dio_reg_write_multi(uint8_t address, const uint8_t* regs,
+    const uint8_t* values, uint8_t count);
 
 #endif
\ No newline at end of file
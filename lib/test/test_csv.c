@@ -0,0 +1,203 @@
+/*
+*   test_csv.c
+*   author Measurement Computing Corp.
+*   brief Checks hat_csv_format() against printf on random values.
+*
+*   date 10/18/2026
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "daqhats.h"
+
+#define VALUE_COUNT     200000
+#define MAX_DECIMALS    9
+#define ROW_CHANNELS    8
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+/******************************************************************************
+  Return a pseudo-random 64-bit value (xorshift64*), so failures repeat.
+ *****************************************************************************/
+static uint64_t _random(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1Dull;
+}
+
+/******************************************************************************
+  Return a random value, mixing typical scan data with the cases that are hard
+  to round: halves, short binary fractions and very large or small values.
+ *****************************************************************************/
+static double _random_value(void)
+{
+    double value;
+    double sign = (_random() & 1) ? -1.0 : 1.0;
+
+    switch (_random() % 6)
+    {
+    case 0:
+        // a voltage in the MCC 118 range
+        value = (double)(_random() >> 11) / (double)(1ull << 53) * 10.0;
+        break;
+    case 1:
+        // an exact binary fraction, which is often a tie when rounded
+        value = (double)(_random() % 100000) / (double)(1 << (_random() % 12));
+        break;
+    case 2:
+        // a tie at a random number of decimal places
+        value = ((double)(_random() % 1000000) + 0.5) / 
+            pow(10.0, (double)(_random() % 10));
+        break;
+    case 3:
+        // any magnitude from 1e-12 to 1e20
+        value = pow(10.0, (double)(_random() % 3200) / 100.0 - 12.0);
+        break;
+    case 4:
+        // a random bit pattern that is a finite double
+        do
+        {
+            uint64_t bits = _random();
+            memcpy(&value, &bits, sizeof(value));
+        } while (isnan(value) || isinf(value));
+        return value;
+    default:
+        // a whole number
+        value = (double)(_random() % 100000);
+        break;
+    }
+    return sign * value;
+}
+
+/******************************************************************************
+  Format a value with printf the way hat_csv_format() documents it.
+ *****************************************************************************/
+static int _expected(char* text, size_t size, double value, uint8_t decimals)
+{
+    if (fabs(value) >= 1e15)
+    {
+        return snprintf(text, size, "%.*e", decimals, value);
+    }
+    return snprintf(text, size, "%.*f", decimals, value);
+}
+
+/******************************************************************************
+  Compare single values against printf.
+ *****************************************************************************/
+static int _test_values(void)
+{
+    char buffer[64];
+    char expected[64];
+    uint32_t rows;
+    uint32_t bytes;
+    uint32_t i;
+    uint8_t decimals;
+    double value;
+    int length;
+    int failures = 0;
+
+    for (i = 0; i < VALUE_COUNT; i++)
+    {
+        value = _random_value();
+        decimals = (uint8_t)(_random() % (MAX_DECIMALS + 1));
+
+        if ((hat_csv_format(&value, 1, 1, decimals, buffer, sizeof(buffer),
+            &rows, &bytes) != RESULT_SUCCESS) ||
+            (rows != 1))
+        {
+            printf("FAIL %.17g decimals %d: error\n", value, decimals);
+            failures++;
+            continue;
+        }
+
+        length = _expected(expected, sizeof(expected), value, decimals);
+        expected[length++] = '\n';
+        if ((bytes != (uint32_t)length) ||
+            (memcmp(buffer, expected, length) != 0))
+        {
+            printf("FAIL %.17g decimals %d: \"%.*s\" expected \"%.*s\"\n",
+                value, decimals, (int)bytes - 1, buffer, length - 1, 
+                expected);
+            if (++failures >= 20)
+            {
+                break;
+            }
+        }
+    }
+    return failures;
+}
+
+/******************************************************************************
+  Check that rows are separated correctly and only whole rows are written.
+ *****************************************************************************/
+static int _test_rows(void)
+{
+    double data[ROW_CHANNELS * 4];
+    char buffer[ROW_CHANNELS * 32 * 4];
+    char expected[sizeof(buffer)];
+    uint32_t rows;
+    uint32_t bytes;
+    uint32_t total_rows;
+    uint32_t total_bytes;
+    int length;
+    int i;
+
+    for (i = 0; i < (int)(sizeof(data) / sizeof(double)); i++)
+    {
+        data[i] = _random_value();
+    }
+
+    length = 0;
+    for (i = 0; i < (int)(sizeof(data) / sizeof(double)); i++)
+    {
+        length += _expected(&expected[length], sizeof(expected) - length,
+            data[i], 3);
+        expected[length++] = ((i % ROW_CHANNELS) == (ROW_CHANNELS - 1)) ? 
+            '\n' : ',';
+    }
+
+    // a buffer that only holds one worst case row gets one row per call
+    total_rows = 0;
+    total_bytes = 0;
+    while (total_rows < 4)
+    {
+        if ((hat_csv_format(&data[total_rows * ROW_CHANNELS], 4 - total_rows,
+            ROW_CHANNELS, 3, &buffer[total_bytes], ROW_CHANNELS * 32, &rows,
+            &bytes) != RESULT_SUCCESS) ||
+            (rows != 1))
+        {
+            printf("FAIL rows: %u rows written to a one row buffer\n", rows);
+            return 1;
+        }
+        total_rows += rows;
+        total_bytes += bytes;
+    }
+
+    if ((total_bytes != (uint32_t)length) ||
+        (memcmp(buffer, expected, length) != 0))
+    {
+        printf("FAIL rows: \"%.*s\" expected \"%.*s\"\n", (int)total_bytes,
+            buffer, length, expected);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    int failures;
+
+    failures = _test_values();
+    failures += _test_rows();
+
+    if (failures != 0)
+    {
+        printf("test_csv: %d failures\n", failures);
+        return 1;
+    }
+    printf("test_csv: passed\n");
+    return 0;
+}
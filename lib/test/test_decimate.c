@@ -0,0 +1,200 @@
+/*
+*   test_decimate.c
+*   author Measurement Computing Corp.
+*   brief Checks hat_decimate_minmax() bucket handling and output order.
+*
+*   date 10/18/2026
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "daqhats.h"
+
+#define CHANNELS        3
+#define SAMPLES         5000
+#define MAX_BUCKET      40
+
+static uint64_t rng_state = 0x2545F4914F6CDD1Dull;
+
+/******************************************************************************
+  Return a pseudo-random 64-bit value (xorshift64*), so failures repeat.
+ *****************************************************************************/
+static uint64_t _random(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1Dull;
+}
+
+/******************************************************************************
+  Decimate all of the data at once the simple way: the first minimum and the 
+  first maximum of each bucket, in the order they occurred.
+ *****************************************************************************/
+static uint32_t _reference(const double* data, uint32_t samples, 
+    uint8_t channels, uint32_t bucket_size, double* buffer)
+{
+    uint32_t bucket;
+    uint32_t i;
+    uint32_t min_index;
+    uint32_t max_index;
+    uint8_t channel;
+    double value;
+
+    for (bucket = 0; bucket < samples / bucket_size; bucket++)
+    {
+        for (channel = 0; channel < channels; channel++)
+        {
+            min_index = 0;
+            max_index = 0;
+            for (i = 1; i < bucket_size; i++)
+            {
+                value = data[(bucket * bucket_size + i) * channels + channel];
+                if (value < 
+                    data[(bucket * bucket_size + min_index) * channels + 
+                    channel])
+                {
+                    min_index = i;
+                }
+                if (value > 
+                    data[(bucket * bucket_size + max_index) * channels + 
+                    channel])
+                {
+                    max_index = i;
+                }
+            }
+            if (max_index < min_index)
+            {
+                i = max_index;
+                max_index = min_index;
+                min_index = i;
+            }
+            buffer[(2 * bucket) * channels + channel] = 
+                data[(bucket * bucket_size + min_index) * channels + channel];
+            buffer[(2 * bucket + 1) * channels + channel] = 
+                data[(bucket * bucket_size + max_index) * channels + channel];
+        }
+    }
+    return 2 * (samples / bucket_size);
+}
+
+/******************************************************************************
+  Check a small case by hand: a bucket split across calls, and a maximum that 
+  comes before the minimum on one channel but not the other.
+ *****************************************************************************/
+static int _test_order(void)
+{
+    struct HatMinMaxDecimator state;
+    // two channels, buckets of 4 samples; channel 0 is 1, 3, 0, 2 so its 
+    // maximum comes first, channel 1 is 5, 2, 9, 2 so its minimum comes first
+    const double first[] = {1.0, 5.0, 3.0, 2.0, 0.0, 9.0};
+    const double second[] = {2.0, 2.0, 7.0, 1.0, 6.0, 6.0, 6.0, 6.0};
+    const double expected[] = {3.0, 2.0, 0.0, 9.0};
+    double buffer[8];
+    uint32_t written;
+
+    hat_decimate_init(&state, 2, 4);
+
+    // three samples per channel do not complete a bucket
+    if ((hat_decimate_minmax(&state, first, 3, buffer, 0, &written) != 
+        RESULT_SUCCESS) ||
+        (written != 0) ||
+        (state.count != 3))
+    {
+        printf("FAIL order: partial bucket wrote %u\n", written);
+        return 1;
+    }
+
+    // the fourth sample completes it; the rest start the next bucket
+    if ((hat_decimate_minmax(&state, second, 4, buffer, 8, &written) != 
+        RESULT_SUCCESS) ||
+        (written != 2) ||
+        (state.count != 3) ||
+        (memcmp(buffer, expected, sizeof(expected)) != 0))
+    {
+        printf("FAIL order: wrote %u: %g %g %g %g\n", written, buffer[0], 
+            buffer[1], buffer[2], buffer[3]);
+        return 1;
+    }
+    return 0;
+}
+
+/******************************************************************************
+  Feed random data in random block sizes and compare the output with 
+  decimating all of it at once.
+ *****************************************************************************/
+static int _test_blocks(void)
+{
+    static double data[SAMPLES * CHANNELS];
+    static double expected[SAMPLES * CHANNELS * 2];
+    static double buffer[SAMPLES * CHANNELS * 2];
+    struct HatMinMaxDecimator state;
+    uint32_t bucket_size;
+    uint32_t expected_count;
+    uint32_t offset;
+    uint32_t block;
+    uint32_t written;
+    uint32_t total;
+    uint32_t i;
+    int failures = 0;
+
+    for (bucket_size = 1; bucket_size <= MAX_BUCKET; bucket_size++)
+    {
+        // small integer values so many buckets have repeated limits
+        for (i = 0; i < SAMPLES * CHANNELS; i++)
+        {
+            data[i] = (double)(int)(_random() % 16) - 8.0;
+        }
+        expected_count = _reference(data, SAMPLES, CHANNELS, bucket_size, 
+            expected);
+
+        hat_decimate_init(&state, CHANNELS, bucket_size);
+        offset = 0;
+        total = 0;
+        while (offset < SAMPLES)
+        {
+            block = (uint32_t)(_random() % (2 * bucket_size + 2));
+            if (block > SAMPLES - offset)
+            {
+                block = SAMPLES - offset;
+            }
+            if (hat_decimate_minmax(&state, &data[offset * CHANNELS], block,
+                &buffer[total * CHANNELS], 
+                (SAMPLES * 2 - total) * CHANNELS, &written) != 
+                RESULT_SUCCESS)
+            {
+                printf("FAIL blocks: bucket %u error\n", bucket_size);
+                return failures + 1;
+            }
+            offset += block;
+            total += written;
+        }
+
+        if ((total != expected_count) ||
+            (memcmp(buffer, expected, 
+                total * CHANNELS * sizeof(double)) != 0) ||
+            (state.count != SAMPLES % bucket_size))
+        {
+            printf("FAIL blocks: bucket %u wrote %u, expected %u\n", 
+                bucket_size, total, expected_count);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+int main(void)
+{
+    int failures;
+
+    failures = _test_order();
+    failures += _test_blocks();
+
+    if (failures != 0)
+    {
+        printf("test_decimate: %d failures\n", failures);
+        return 1;
+    }
+    printf("test_decimate: passed\n");
+    return 0;
+}
@@ -0,0 +1,197 @@
+/*
+*   test_scan_timestamps.c
+*   author Measurement Computing Corp.
+*   brief Checks the MCC 118 scan sample time fit and the gap records.
+*
+*   The scan functions under test are static, so this file includes mcc118.c
+*   and is linked with the other library objects.  No hardware is used.
+*
+*   date 10/18/2026
+*/
+#include <math.h>
+#include "../mcc118.c"
+
+#define TEST_ADDRESS    0
+
+static int failures = 0;
+
+/******************************************************************************
+  Report a failed check.
+ *****************************************************************************/
+static void _check(bool condition, const char* message)
+{
+    if (!condition)
+    {
+        printf("FAIL %s\n", message);
+        failures++;
+    }
+}
+
+/******************************************************************************
+  Save a timestamp for a sample count read at a monotonic time in seconds.
+ *****************************************************************************/
+static void _save(struct mcc118ScanThreadInfo* info, uint64_t sample_count,
+    double time)
+{
+    struct timespec monotonic;
+    struct timespec real;
+
+    monotonic.tv_sec = (time_t)time;
+    monotonic.tv_nsec = (long)((time - (double)monotonic.tv_sec) * 1e9);
+    // the real time clock is 1000 seconds ahead of the monotonic clock
+    real.tv_sec = monotonic.tv_sec + 1000;
+    real.tv_nsec = monotonic.tv_nsec;
+    _scan_save_timestamp(info, sample_count, &monotonic, &real);
+}
+
+/******************************************************************************
+  Fit timestamps that follow a known rate with alternating read latency, more
+  than fill the timestamp ring, and check the fitted sample times.
+ *****************************************************************************/
+static void _test_fit(struct mcc118ScanThreadInfo* info)
+{
+    const double rate = 1000.0;
+    const double start = 500.0;
+    uint64_t ref_count;
+    double ref_time;
+    double period;
+    double real_offset;
+    double time;
+    uint64_t count;
+    int used;
+    int i;
+
+    info->nominal_rate = 990.0;
+    info->timestamp_index = 0;
+    info->timestamp_count = 0;
+
+    // no timestamps yet
+    _check(_scan_fit_timestamps(info, &ref_count, &ref_time, &period,
+        &real_offset) == 0, "fit with no timestamps");
+
+    // one timestamp uses the nominal rate
+    _save(info, 100, start + 0.1);
+    used = _scan_fit_timestamps(info, &ref_count, &ref_time, &period,
+        &real_offset);
+    _check((used == 1) && (ref_count == 100) && 
+        (fabs(ref_time - (start + 0.1)) < 1e-6) &&
+        (fabs(period - 1.0 / 990.0) < 1e-12), "fit with one timestamp");
+
+    // the status is read 50 us +/- 20 us after the samples were acquired
+    for (i = 2; i <= 100; i++)
+    {
+        count = (uint64_t)i * 100;
+        time = start + (double)count / rate + 50e-6 + ((i & 1) ? 20e-6 : 
+            -20e-6);
+        _save(info, count, time);
+    }
+
+    used = _scan_fit_timestamps(info, &ref_count, &ref_time, &period,
+        &real_offset);
+    _check(used == SCAN_TIMESTAMP_COUNT, "fit uses the full timestamp ring");
+    _check(ref_count == 10000, "fit reference is the latest timestamp");
+    _check(fabs(period * rate - 1.0) < 1e-5, "fit period");
+    _check(fabs(real_offset - 1000.0) < 1e-6, "fit real time offset");
+
+    // the fitted time of any sample is within the read latency jitter
+    for (count = 7000; count <= 12000; count += 250)
+    {
+        time = ref_time + ((double)count - (double)ref_count) * period;
+        if (fabs(time - (start + (double)count / rate + 50e-6)) > 25e-6)
+        {
+            printf("FAIL sample %llu time error %g\n", 
+                (unsigned long long)count, 
+                time - (start + (double)count / rate + 50e-6));
+            failures++;
+        }
+    }
+
+    // an external clock with no rate can't be estimated from one timestamp
+    info->nominal_rate = 0.0;
+    info->timestamp_index = 0;
+    info->timestamp_count = 0;
+    _save(info, 100, start);
+    _check(_scan_fit_timestamps(info, &ref_count, &ref_time, &period,
+        &real_offset) == 0, "fit with one timestamp and no rate");
+}
+
+/******************************************************************************
+  Record gaps, including ones that are merged, and read them back through the
+  public API.
+ *****************************************************************************/
+static void _test_gaps(struct mcc118ScanThreadInfo* info)
+{
+    struct MCC118ScanGap gaps[SCAN_GAP_COUNT + 4];
+    uint16_t gaps_read;
+    uint16_t i;
+
+    info->gap_count = 0;
+    info->nominal_rate = 1000.0;
+    _save(info, 100, 1.0);
+    _save(info, 200, 1.1);
+
+    _scan_add_gap(info, 1000, 50);
+    _check(info->timestamp_count == 0, "a gap clears the timestamps");
+
+    // a second gap at the same sample index is merged with the first
+    _scan_add_gap(info, 1000, 25);
+    _scan_add_gap(info, 2000, 10);
+    _check(info->gap_count == 2, "gaps at the same index are merged");
+
+    // read one gap, leaving the other
+    _check((mcc118_a_in_scan_read_gaps(TEST_ADDRESS, gaps, 1, &gaps_read) ==
+        RESULT_SUCCESS) && (gaps_read == 1) && 
+        (gaps[0].sample_index == 1000) && (gaps[0].samples_lost == 75),
+        "read the first gap");
+    _check((mcc118_a_in_scan_read_gaps(TEST_ADDRESS, gaps, 4, &gaps_read) ==
+        RESULT_SUCCESS) && (gaps_read == 1) && 
+        (gaps[0].sample_index == 2000) && (gaps[0].samples_lost == 10),
+        "read the second gap");
+    _check((mcc118_a_in_scan_read_gaps(TEST_ADDRESS, gaps, 4, &gaps_read) ==
+        RESULT_SUCCESS) && (gaps_read == 0), "no gaps left");
+
+    // once the list is full new gaps are added to the last one
+    for (i = 0; i < SCAN_GAP_COUNT + 4; i++)
+    {
+        _scan_add_gap(info, 100 * (i + 1), i + 1);
+    }
+    _check((mcc118_a_in_scan_read_gaps(TEST_ADDRESS, gaps, 
+        SCAN_GAP_COUNT + 4, &gaps_read) == RESULT_SUCCESS) &&
+        (gaps_read == SCAN_GAP_COUNT), "a full gap list");
+    _check((gaps[0].sample_index == 100) && (gaps[0].samples_lost == 1),
+        "the first gap of a full list");
+    // the last entry holds gap 16 plus the 4 merged gaps 17 - 20
+    _check((gaps[SCAN_GAP_COUNT - 1].sample_index == 100 * SCAN_GAP_COUNT) &&
+        (gaps[SCAN_GAP_COUNT - 1].samples_lost == 16 + 17 + 18 + 19 + 20),
+        "the merged gaps of a full list");
+}
+
+int main(void)
+{
+    struct mcc118Device device;
+    struct mcc118ScanThreadInfo info;
+
+    // a device without hardware, so the public gap API can be used
+    memset(&device, 0, sizeof(device));
+    memset(&info, 0, sizeof(info));
+    pthread_mutex_init(&info.info_mutex, NULL);
+    info.ready_fd = -1;
+    device.handle_count = 1;
+    device.scan_info = &info;
+    _devices[TEST_ADDRESS] = &device;
+    _mcc118_lib_initialized = true;
+
+    _test_fit(&info);
+    _test_gaps(&info);
+
+    _devices[TEST_ADDRESS] = NULL;
+    pthread_mutex_destroy(&info.info_mutex);
+
+    if (failures != 0)
+    {
+        printf("test_scan_timestamps: %d failures\n", failures);
+        return 1;
+    }
+    printf("test_scan_timestamps: passed\n");
+    return 0;
+}
@@ -15,6 +15,8 @@
 #include <sys/file.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
 #include <semaphore.h>
 #include "daqhats.h"
 #include "util.h"
@@ -58,6 +60,9 @@
 #define ADDR0_GPIO              12
 #define ADDR1_GPIO              13
 #define ADDR2_GPIO              26
+#define ADDR_GPIO_MASK          ((1u << ADDR0_GPIO) | (1u << ADDR1_GPIO) | \
+                                 (1u << ADDR2_GPIO))
+#define ADDRESS_UNKNOWN         0xFF
 
 #define IRQ_GPIO                21
 
@@ -103,6 +108,21 @@ static const char* const HAT_SETTINGS_DIR = "/etc/mcc/hats";
 static const char* const SYS_HAT_DIR = "/proc/device-tree/hat";
 static const char* const VENDOR_NAME = "Measurement Computing Corp.";
 
+// Longest path to a HAT information file, including the root directory
+#define HAT_PATH_SIZE           512
+// Largest EEPROM image that is read
+#define MAX_EEPROM_FILE_SIZE    (64*1024)
+
+// Parsed factory data cache, in a directory below the user's cache directory
+#define FACTORY_CACHE_DIR       "daqhats"
+#define FACTORY_CACHE_MAGIC     0x4643434D  // "MCCF" in ASCII
+#define FACTORY_CACHE_FORMAT    1
+#define FACTORY_CACHE_MAX_DATA  1024
+
+// 64-bit FNV-1a hash parameters
+#define FNV_OFFSET_BASIS        0xcbf29ce484222325ULL
+#define FNV_PRIME               0x100000001b3ULL
+
 static const char* HAT_ERROR_MESSAGES[] =
 {
     "Success.",
@@ -120,10 +140,65 @@ static const char* HAT_ERROR_MESSAGES[] =
 // Variables
 static bool _address_initialized = false;
 static int lockfile;
+// flock() only excludes other processes, so threads in this process also take
+// this mutex while they hold the lock
+static pthread_mutex_t lock_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t current_address = ADDRESS_UNKNOWN;  // valid while locked
+
+// The interrupt line is shared by the user callback and the library hook, 
+// which is called first with the time of the edge
+static void (*irq_user_function)(void*) = NULL;
+static void* irq_user_data = NULL;
+static void (*irq_hook_function)(uint64_t) = NULL;
+static int irq_event_fd = -1;       // signaled on each interrupt, or -1
+// protects the irq_ variables, which the handler reads on the dispatcher 
+// thread
+static pthread_mutex_t irq_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Factory data cache file header, followed by the parsed data
+struct _FactoryCacheHeader
+{
+    uint32_t magic;
+    uint16_t format;
+    uint16_t data_size;     // size of the parsed data
+    uint64_t key;           // hash of the EEPROM custom data
+    uint32_t custom_size;   // size of the EEPROM custom data
+    uint32_t checksum;      // hash of the parsed data
+};
+
+// A board being opened by hat_open_all()
+struct _HatOpenInfo
+{
+    uint8_t address;
+    uint16_t id;
+    int result;
+    pthread_t thread;
+    bool started;
+};
+
+// Parsed board information for one address
+struct _HatCacheEntry
+{
+    bool found;             // information found for _hat_info()
+    bool listed;            // reported by hat_list()
+    struct HatInfo info;
+    char* custom_data;      // JSON factory data, or NULL
+    uint16_t custom_size;
+};
+
+// The board information is read once and cached until the files in
+// HAT_SETTINGS_DIR change, which is detected with inotify.
+static struct _HatCacheEntry hat_cache[MAX_NUMBER_HATS];
+static bool hat_cache_valid = false;
+static int hat_notify_fd = -1;
+static pthread_mutex_t hat_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char hat_root_dir[256] = "";     // prefix for the HAT directories
 
 // *****************************************************************************
 // Local Functions
 
+static void _hat_cache_fini(void);
+
 /******************************************************************************
   Initializes the GPIO pins used for board addressing.
  *****************************************************************************/
@@ -183,6 +258,7 @@ void __attribute__ ((destructor)) fini(void)
 {
     // cleanup
     _lock_fini();
+    _hat_cache_fini();
 }
 
 
@@ -191,12 +267,27 @@ void __attribute__ ((destructor)) fini(void)
  *****************************************************************************/
 void _set_address(uint8_t address)
 {
-    if (address < MAX_NUMBER_HATS)
+    uint32_t set_mask;
+
+    if ((address >= MAX_NUMBER_HATS) ||
+        (address == current_address))
+    {
+        return;
+    }
+
+    set_mask = ((address & 0x01) ? (1u << ADDR0_GPIO) : 0) |
+               ((address & 0x02) ? (1u << ADDR1_GPIO) : 0) |
+               ((address & 0x04) ? (1u << ADDR2_GPIO) : 0);
+
+    // The cache is cleared whenever the lock is obtained because another 
+    // process may have selected a different board in the meantime.  The pins 
+    // themselves are the shared state, so check them before writing.
+    if ((current_address != ADDRESS_UNKNOWN) ||
+        ((gpio_read_mask() & ADDR_GPIO_MASK) != set_mask))
     {
-        gpio_write(ADDR0_GPIO, address & 0x01);
-        gpio_write(ADDR1_GPIO, address & 0x02);
-        gpio_write(ADDR2_GPIO, address & 0x04);
+        gpio_write_mask(set_mask, ADDR_GPIO_MASK & ~set_mask);
     }
+    current_address = address;
 }
 
 /******************************************************************************
@@ -244,7 +335,8 @@ uint32_t _difftime_ms(struct timespec* start, struct timespec* end)
 // file handle is automatically released.
 
 /******************************************************************************
-  Use lock files to control access to the SPI bus by multiple processes.
+  Use lock files to control access to the SPI bus by multiple processes, and a
+  mutex to control access by multiple threads in this process.
 
   Return: int, file descriptor (RESULT_TIMEOUT for time out obtaining lock)
  *****************************************************************************/
@@ -253,8 +345,18 @@ int _obtain_lock(void)
     bool locked;
     struct timespec start_time;
     struct timespec current_time;
+    struct timespec deadline;
     int test;
 
+    // Wait for the other threads in this process first.  The mutex wait uses
+    // CLOCK_REALTIME, so the 5 second time out is calculated on that clock.
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += (LOCK_RETRY_TIME) / (SEC);
+    if (pthread_mutex_timedlock(&lock_mutex, &deadline) != 0)
+    {
+        return RESULT_TIMEOUT;
+    }
+
     // Block until lock obtained, but allow context switching with usleep().
     // Time out after 5 seconds
     locked = false;
@@ -279,9 +381,14 @@ int _obtain_lock(void)
     if (!locked)
     {
         // could not get a lock within 5 seconds, report as a timeout
+        pthread_mutex_unlock(&lock_mutex);
         return RESULT_TIMEOUT;
     }
 
+    // another process may have changed the address pins while we did not 
+    // hold the lock
+    current_address = ADDRESS_UNKNOWN;
+
     return lockfile;
 }
 
@@ -292,173 +399,400 @@ int _obtain_lock(void)
 void _release_lock(int lock_fd)
 {
     flock(lock_fd, LOCK_UN);
+    pthread_mutex_unlock(&lock_mutex);
 }
 
 
 /******************************************************************************
-  List HAT boards attached to the Pi.
+  Read a small text file, such as a device tree property, into a
+  NUL-terminated string.
  *****************************************************************************/
-int hat_list(uint16_t filter_id, struct HatInfo* pList)
+static bool _read_text_file(const char* filename, char* buffer, size_t size)
 {
-    //struct HatInfo* entry;
-    uint8_t address;
-    char filename[256];
+    int fd;
+    ssize_t count;
+
+    if ((fd = open(filename, O_RDONLY | O_CLOEXEC)) == -1)
+    {
+        return false;
+    }
+    count = read(fd, buffer, size - 1);
+    close(fd);
+    if (count <= 0)
+    {
+        return false;
+    }
+    buffer[count] = '\0';
+    return true;
+}
+
+/******************************************************************************
+  Read a whole file into a new buffer.  Returns the buffer, which must be freed
+  by the caller, or NULL.
+ *****************************************************************************/
+static uint8_t* _read_binary_file(const char* filename, uint32_t* pSize)
+{
+    int fd;
+    struct stat filestat;
+    uint8_t* data;
+
+    if ((fd = open(filename, O_RDONLY | O_CLOEXEC)) == -1)
+    {
+        return NULL;
+    }
+    if ((fstat(fd, &filestat) != 0) ||
+        (filestat.st_size <= 0) ||
+        (filestat.st_size > MAX_EEPROM_FILE_SIZE) ||
+        ((data = (uint8_t*)malloc(filestat.st_size)) == NULL))
+    {
+        close(fd);
+        return NULL;
+    }
+    if (read(fd, data, filestat.st_size) != filestat.st_size)
+    {
+        free(data);
+        close(fd);
+        return NULL;
+    }
+    close(fd);
+    *pSize = (uint32_t)filestat.st_size;
+    return data;
+}
+
+/******************************************************************************
+  Read the board information for address 0 from the device tree, which the OS
+  creates from the HAT EEPROM at boot.
+ *****************************************************************************/
+static bool _hat_cache_read_sys(struct _HatCacheEntry* pEntry)
+{
+    char filename[HAT_PATH_SIZE];
     char temp[256];
-    char* ptr;
-    int eeprom_fd;
-    uint8_t count;
-    struct _Header header;
-    struct _Atom atom;
-    struct _VendorInfo vinf;
-    uint16_t id;
-    uint16_t pver;
+    uint32_t size;
 
-    count = 0;
+    snprintf(filename, sizeof(filename), "%s%s/vendor", hat_root_dir,
+        SYS_HAT_DIR);
+    if (!_read_text_file(filename, temp, sizeof(temp)) ||
+        (strcmp(temp, VENDOR_NAME) != 0))
+    {
+        return false;
+    }
 
-    // EEPROM 0 will always use the built-in OS support to prevent caching info
-    // for a single board that is swapped out (such as during manufacturing
-    // test.)
-
-    sprintf(filename, "%s/vendor", SYS_HAT_DIR);
-    // open vendor file and compare against VENDOR_NAME
-    eeprom_fd = -1;
-    if (((eeprom_fd = open(filename, O_RDONLY)) != -1) &&
-        (read(eeprom_fd, &temp, 256) > 0) &&
-        (strcmp(temp, VENDOR_NAME) == 0))
-    {
-        // match, so read the pid
-        close(eeprom_fd);
-        eeprom_fd = -1;
-        sprintf(filename, "%s/product_id", SYS_HAT_DIR);
-        if (((eeprom_fd = open(filename, O_RDONLY)) != -1) &&
-            (read(eeprom_fd, &temp, 256) > 0))
+    pEntry->found = true;
+    pEntry->info.address = 0;
+
+    snprintf(filename, sizeof(filename), "%s%s/product_id", hat_root_dir,
+        SYS_HAT_DIR);
+    if (_read_text_file(filename, temp, sizeof(temp)))
+    {
+        pEntry->info.id = (uint16_t)strtoul(temp, NULL, 16);
+        pEntry->listed = true;
+    }
+
+    snprintf(filename, sizeof(filename), "%s%s/product_ver", hat_root_dir,
+        SYS_HAT_DIR);
+    if (_read_text_file(filename, temp, sizeof(temp)))
+    {
+        pEntry->info.version = (uint16_t)strtoul(temp, NULL, 16);
+    }
+
+    snprintf(filename, sizeof(filename), "%s%s/product", hat_root_dir,
+        SYS_HAT_DIR);
+    _read_text_file(filename, pEntry->info.product_name,
+        sizeof(pEntry->info.product_name));
+
+    snprintf(filename, sizeof(filename), "%s%s/custom_0", hat_root_dir,
+        SYS_HAT_DIR);
+    pEntry->custom_data = (char*)_read_binary_file(filename, &size);
+    if (pEntry->custom_data != NULL)
+    {
+        if (size > UINT16_MAX)
         {
-            // convert string to int
-            id = (uint16_t)strtoul(temp, &ptr, 16);
-            if ((filter_id == 0) ||
-                (filter_id == id))
-            {
-                // pid matches, save the info
-                close(eeprom_fd);
-                eeprom_fd = -1;
-                count = 1;
-                if (pList != NULL)
-                {
-                    pList[0].address = 0;
-                    pList[0].id = id;
-
-                    // read the version
-                    sprintf(filename, "%s/product_ver", SYS_HAT_DIR);
-                    if (((eeprom_fd = open(filename, O_RDONLY)) != -1) &&
-                        (read(eeprom_fd, &temp, 256) > 0))
-                    {
-                        pver = (uint16_t)strtoul(temp, &ptr, 16);
-                        pList[0].version = pver;
-
-                        // read the product string
-                        close(eeprom_fd);
-                        eeprom_fd = -1;
-                        sprintf(filename, "%s/product", SYS_HAT_DIR);
-                        if (((eeprom_fd = open(filename, O_RDONLY)) != -1) &&
-                            (read(eeprom_fd, &temp, 256) > 0))
-                        {
-                            strcpy(pList[0].product_name, temp);
-                        }
-                    }
-                }
-            }
+            // too large to report, treat as no custom data
+            free(pEntry->custom_data);
+            pEntry->custom_data = NULL;
+        }
+        else
+        {
+            pEntry->custom_size = (uint16_t)size;
         }
     }
-    if (eeprom_fd != -1)
-        close(eeprom_fd);
+    return true;
+}
 
-    // Boards 1-7 will be supported with the read_eeproms utility that copies 
-    // the EEPROM contents to /etc/mcc/hats
-    for (address = 1; address < MAX_NUMBER_HATS; address++)
+/******************************************************************************
+  Read the board information from an EEPROM image saved in HAT_SETTINGS_DIR by
+  daqhats_read_eeproms.  The file is read with a single read and parsed in
+  memory.
+ *****************************************************************************/
+static bool _hat_cache_read_file(uint8_t address,
+    struct _HatCacheEntry* pEntry)
+{
+    char filename[HAT_PATH_SIZE];
+    uint8_t* data;
+    uint32_t size;
+    uint32_t offset;
+    uint16_t atom_num;
+    uint16_t length;
+    struct _Header header;
+    struct _Atom atom;
+    struct _VendorInfo vinf;
+    bool found_vendor;
+
+    snprintf(filename, sizeof(filename), "%s%s/eeprom_%d.bin", hat_root_dir,
+        HAT_SETTINGS_DIR, address);
+    if ((data = _read_binary_file(filename, &size)) == NULL)
     {
-        // look for HAT eeprom.bin files in /etc/mcc/hats
-        sprintf(filename, "%s/eeprom_%d.bin", HAT_SETTINGS_DIR, address);
+        return false;
+    }
 
-        // open file
-        if ((eeprom_fd = open(filename, O_RDONLY)) == -1)
-            continue;
+    if (size < HEADER_SIZE)
+    {
+        free(data);
+        return false;
+    }
+    memcpy(&header, data, HEADER_SIZE);
+    if ((header.signature != SIGNATURE) ||
+        (header.ver != FORMAT_VERSION) ||
+        (header.numatoms < 1))
+    {
+        free(data);
+        return false;
+    }
 
-        // read hat header
-        if (read(eeprom_fd, &header, HEADER_SIZE) != HEADER_SIZE)
+    found_vendor = false;
+    offset = HEADER_SIZE;
+    for (atom_num = 0; atom_num < header.numatoms; atom_num++)
+    {
+        if ((size - offset) < (ATOM_SIZE - CRC_SIZE))
         {
-            close(eeprom_fd);
-            continue;
+            break;
         }
-
-        // check the header
-        if ((header.signature != SIGNATURE) ||
-            (header.ver != FORMAT_VERSION) ||
-            (header.numatoms < 1))
+        memcpy(&atom, &data[offset], ATOM_SIZE - CRC_SIZE);
+        offset += ATOM_SIZE - CRC_SIZE;
+        if ((atom.dlen < CRC_SIZE) || (atom.dlen > (size - offset)))
         {
-            close(eeprom_fd);
-            continue;
+            break;
         }
 
-        // header is valid, read the vendor atom
-        if (read(eeprom_fd, &atom, ATOM_SIZE-CRC_SIZE) != ATOM_SIZE-CRC_SIZE)
+        if ((atom.type == ATOM_VENDOR_TYPE) && !found_vendor)
         {
-            close(eeprom_fd);
-            continue;
-        }
+            if (atom.dlen < (VENDOR_SIZE + CRC_SIZE))
+            {
+                break;
+            }
+            memcpy(&vinf, &data[offset], VENDOR_SIZE);
+            if ((uint32_t)(VENDOR_SIZE + vinf.vslen + vinf.pslen + CRC_SIZE) >
+                atom.dlen)
+            {
+                break;
+            }
+
+            // compare the vendor string to the desired string
+            if ((vinf.vslen != strlen(VENDOR_NAME)) ||
+                (memcmp(&data[offset + VENDOR_SIZE], VENDOR_NAME, vinf.vslen) !=
+                0))
+            {
+                break;
+            }
 
-        // vendor atom must be the first atom
-        if (atom.type != ATOM_VENDOR_TYPE)
+            pEntry->info.address = address;
+            pEntry->info.id = vinf.pid;
+            pEntry->info.version = vinf.pver;
+            length = vinf.pslen;
+            if (length >= sizeof(pEntry->info.product_name))
+            {
+                length = sizeof(pEntry->info.product_name) - 1;
+            }
+            memcpy(pEntry->info.product_name,
+                &data[offset + VENDOR_SIZE + vinf.vslen], length);
+            pEntry->info.product_name[length] = '\0';
+            found_vendor = true;
+        }
+        else if ((atom.type == ATOM_CUSTOM_TYPE) &&
+            (pEntry->custom_data == NULL) &&
+            ((atom.dlen - CRC_SIZE) <= UINT16_MAX))
         {
-            close(eeprom_fd);
-            continue;
+            // the JSON custom data
+            pEntry->custom_size = (uint16_t)(atom.dlen - CRC_SIZE);
+            pEntry->custom_data = (char*)malloc(pEntry->custom_size);
+            if (pEntry->custom_data != NULL)
+            {
+                memcpy(pEntry->custom_data, &data[offset],
+                    pEntry->custom_size);
+            }
+            else
+            {
+                pEntry->custom_size = 0;
+            }
         }
+        offset += atom.dlen;
+    }
 
-        // read the vendor info
-        if (read(eeprom_fd, &vinf, VENDOR_SIZE) != VENDOR_SIZE)
+    free(data);
+
+    if (!found_vendor)
+    {
+        free(pEntry->custom_data);
+        memset(pEntry, 0, sizeof(struct _HatCacheEntry));
+        return false;
+    }
+    pEntry->found = true;
+    pEntry->listed = true;
+    return true;
+}
+
+/******************************************************************************
+  Free the cached board information.
+ *****************************************************************************/
+static void _hat_cache_clear(void)
+{
+    uint8_t address;
+
+    for (address = 0; address < MAX_NUMBER_HATS; address++)
+    {
+        free(hat_cache[address].custom_data);
+        memset(&hat_cache[address], 0, sizeof(struct _HatCacheEntry));
+    }
+    hat_cache_valid = false;
+}
+
+/******************************************************************************
+  Make sure the cached board information is current, reading it if this is the
+  first use or the files in HAT_SETTINGS_DIR have changed.  The device tree
+  only changes at boot, so it does not need to be watched.  If the settings
+  directory can't be watched, for example because it does not exist yet, the
+  information is read on every call.  Must be called with hat_cache_mutex
+  locked.
+ *****************************************************************************/
+static void _hat_cache_update(void)
+{
+    char events[4096]
+        __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    char dirname[HAT_PATH_SIZE];
+    uint8_t address;
+
+    if (hat_cache_valid)
+    {
+        // any event in the directory means the files must be read again
+        while (read(hat_notify_fd, events, sizeof(events)) > 0)
         {
-            close(eeprom_fd);
-            continue;
+            hat_cache_valid = false;
         }
-
-        // allocate and read the vendor and product strings
-        vinf.vstr = (char*)malloc(vinf.vslen+1);
-        vinf.pstr = (char*)malloc(vinf.pslen+1);
-        if (read(eeprom_fd, vinf.vstr, vinf.vslen) != vinf.vslen)
+        if (hat_cache_valid)
         {
-            free(vinf.vstr);
-            free(vinf.pstr);
-            close(eeprom_fd);
-            continue;
+            return;
         }
-        vinf.vstr[vinf.vslen] = '\0';
-        if (read(eeprom_fd, vinf.pstr, vinf.pslen) != vinf.pslen)
+    }
+
+    _hat_cache_clear();
+
+    // watch the directory before reading it so no change is missed
+    if (hat_notify_fd == -1)
+    {
+        hat_notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    }
+    if (hat_notify_fd != -1)
+    {
+        snprintf(dirname, sizeof(dirname), "%s%s", hat_root_dir,
+            HAT_SETTINGS_DIR);
+        hat_cache_valid = (inotify_add_watch(hat_notify_fd, dirname,
+            IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+            IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF) != -1);
+    }
+
+    // EEPROM 0 uses the built-in OS support when it is available, so a single
+    // board that is swapped out does not use a stale EEPROM image.  Boards 1-7
+    // use the images that the read_eeproms utility copies to
+    // HAT_SETTINGS_DIR.
+    if (!_hat_cache_read_sys(&hat_cache[0]))
+    {
+        // only used by _hat_info(), hat_list() only lists the device tree
+        // board at address 0
+        if (_hat_cache_read_file(0, &hat_cache[0]))
         {
-            free(vinf.vstr);
-            free(vinf.pstr);
-            close(eeprom_fd);
-            continue;
+            hat_cache[0].listed = false;
         }
-        vinf.pstr[vinf.pslen] = '\0';
+    }
+    for (address = 1; address < MAX_NUMBER_HATS; address++)
+    {
+        _hat_cache_read_file(address, &hat_cache[address]);
+    }
+}
 
-        // compare the vendor string to the desired string
-        if ((strcmp(vinf.vstr, VENDOR_NAME) == 0) &&
-            (filter_id == 0 ? true : (vinf.pid == filter_id)))
+/******************************************************************************
+  Free the cache and stop watching for changes.
+ *****************************************************************************/
+static void _hat_cache_fini(void)
+{
+    pthread_mutex_lock(&hat_cache_mutex);
+    _hat_cache_clear();
+    if (hat_notify_fd != -1)
+    {
+        close(hat_notify_fd);
+        hat_notify_fd = -1;
+    }
+    pthread_mutex_unlock(&hat_cache_mutex);
+}
+
+/******************************************************************************
+  Set the root directory used to find the HAT information.
+ *****************************************************************************/
+int hat_set_root_directory(const char* path)
+{
+    if (path == NULL)
+    {
+        path = "";
+    }
+    if (strlen(path) >= sizeof(hat_root_dir))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    pthread_mutex_lock(&hat_cache_mutex);
+    strcpy(hat_root_dir, path);
+    // remove a trailing separator, the directory names start with one
+    if ((strlen(hat_root_dir) > 0) &&
+        (hat_root_dir[strlen(hat_root_dir) - 1] == '/'))
+    {
+        hat_root_dir[strlen(hat_root_dir) - 1] = '\0';
+    }
+    _hat_cache_clear();
+    if (hat_notify_fd != -1)
+    {
+        // drop the watch on the previous directory
+        close(hat_notify_fd);
+        hat_notify_fd = -1;
+    }
+    pthread_mutex_unlock(&hat_cache_mutex);
+
+    return RESULT_SUCCESS;
+}
+
+/******************************************************************************
+  List HAT boards attached to the Pi.
+ *****************************************************************************/
+int hat_list(uint16_t filter_id, struct HatInfo* pList)
+{
+    uint8_t address;
+    uint8_t count;
+
+    count = 0;
+
+    pthread_mutex_lock(&hat_cache_mutex);
+    _hat_cache_update();
+    for (address = 0; address < MAX_NUMBER_HATS; address++)
+    {
+        if (hat_cache[address].listed &&
+            ((filter_id == 0) || (hat_cache[address].info.id == filter_id)))
         {
-            // vendor is MCC, save the entry if it matches the PID filter
             if (pList != NULL)
             {
-                pList[count].address = address;
-                pList[count].id = vinf.pid;
-                pList[count].version = vinf.pver;
-                strncpy(pList[count].product_name, vinf.pstr, 256);
+                pList[count] = hat_cache[address].info;
             }
             count++;
         }
-
-        free(vinf.vstr);
-        free(vinf.pstr);
-        close(eeprom_fd);
     }
+    pthread_mutex_unlock(&hat_cache_mutex);
 
     return count;
 }
@@ -469,224 +803,267 @@ int hat_list(uint16_t filter_id, struct HatInfo* pList)
 int _hat_info(uint8_t address, struct HatInfo* entry, char* pData, 
     uint16_t* pSize)
 {
-    bool found_custom;
-    bool found_vendor;
-    bool error;
-    char filename[256];
-    char temp[256];
-    uint8_t atom_num;
-    uint16_t custom_size;
-    int eeprom_fd;
-    struct _Header header;
-    struct _Atom atom;
-    struct _VendorInfo vinf;
-    struct stat filestat;
+    struct _HatCacheEntry* cached;
 
     if (address >= MAX_NUMBER_HATS)
     {
         return RESULT_BAD_PARAMETER;
     }
 
-    found_vendor = false;
+    pthread_mutex_lock(&hat_cache_mutex);
+    _hat_cache_update();
+    cached = &hat_cache[address];
+    if (!cached->found)
+    {
+        // no board info found
+        pthread_mutex_unlock(&hat_cache_mutex);
+        return RESULT_BAD_PARAMETER;
+    }
 
-    if (address == 0)
+    if (entry != NULL)
     {
-        // use the info in /proc/device-tree/hat if possible
-        sprintf(filename, "%s/vendor", SYS_HAT_DIR);
-        // open vendor file and compare against VENDOR_NAME
-        eeprom_fd = -1;
-        if (((eeprom_fd = open(filename, O_RDONLY)) != -1) &&
-            (read(eeprom_fd, temp, 256) > 0) &&
-            (strcmp(temp, VENDOR_NAME) == 0))
-        {
-            // name matches
-            found_vendor = true;
-            close(eeprom_fd);
-            eeprom_fd = -1;
+        *entry = cached->info;
+    }
+    if ((pData != NULL) && (cached->custom_size > 0))
+    {
+        memcpy(pData, cached->custom_data, cached->custom_size);
+    }
+    if (pSize != NULL)
+    {
+        *pSize = cached->custom_size;
+    }
+    pthread_mutex_unlock(&hat_cache_mutex);
 
-            if (entry)
-            {
-                entry->address = 0;
-
-                // read the device info
-                sprintf(filename, "%s/product_id", SYS_HAT_DIR);
-                if (((eeprom_fd = open(filename, O_RDONLY)) != -1) &&
-                    (read(eeprom_fd, temp, 256) > 0))
-                {
-                    // convert string to int
-                    entry->id = (uint16_t)strtoul(temp, NULL, 16);
-                    close(eeprom_fd);
-                    eeprom_fd = -1;
-                }
-
-                sprintf(filename, "%s/product_ver", SYS_HAT_DIR);
-                if (((eeprom_fd = open(filename, O_RDONLY)) != -1) &&
-                    (read(eeprom_fd, temp, 256) > 0))
-                {
-                    entry->version = (uint16_t)strtoul(temp, NULL, 16);
-                    close(eeprom_fd);
-                    eeprom_fd = -1;
-                }
-
-                sprintf(filename, "%s/product", SYS_HAT_DIR);
-                if (((eeprom_fd = open(filename, O_RDONLY)) != -1) &&
-                    (read(eeprom_fd, temp, 256) > 0))
-                {
-                    strcpy(entry->product_name, temp);
-                    close(eeprom_fd);
-                    eeprom_fd = -1;
-                }
-            }
+    return RESULT_SUCCESS;
+}
 
-            // get the custom size
-            custom_size = 0;
-            sprintf(filename, "%s/custom_0", SYS_HAT_DIR);
-            if (stat(filename, &filestat) == 0)
-            {
-                custom_size = filestat.st_size;
-
-                // read the file?
-                if (pData)
-                {
-                    if (((eeprom_fd = open(filename, O_RDONLY)) != -1) &&
-                        (read(eeprom_fd, pData, custom_size) > 0))
-                    {
-                        close(eeprom_fd);
-                        eeprom_fd = -1;
-                    }
-                }
-            }
+/******************************************************************************
+  Calculate the FNV-1a hash of a block of data.
+ *****************************************************************************/
+static uint64_t _hash_data(const void* data, uint32_t size)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    uint64_t hash = FNV_OFFSET_BASIS;
 
-            if (pSize)
-            {
-                *pSize = custom_size;
-            }
-        }
-        if (eeprom_fd != -1)
-            close(eeprom_fd);
+    while (size--)
+    {
+        hash ^= *p++;
+        hash *= FNV_PRIME;
     }
+    return hash;
+}
 
-    if (!found_vendor)
+/******************************************************************************
+  Create the name of the factory data cache file for a board type and EEPROM
+  custom data hash.  The cache is kept in the user's cache directory so only
+  that user can change it.  Returns false if there is no cache directory.
+ *****************************************************************************/
+static bool _factory_cache_path(const char* name, uint64_t key, char* path,
+    size_t size, bool create)
+{
+    const char* base;
+    int length;
+
+    if ((base = getenv("XDG_CACHE_HOME")) != NULL)
     {
-        // try the files in /etc/mcc/hats
-        found_custom = false;
-        sprintf(filename, "%s/eeprom_%d.bin", HAT_SETTINGS_DIR, address);
-        eeprom_fd = -1;
-        if (((eeprom_fd = open(filename, O_RDONLY)) != -1) &&
-            (read(eeprom_fd, &header, HEADER_SIZE) == HEADER_SIZE) &&
-            (header.signature == SIGNATURE) &&
-            (header.ver == FORMAT_VERSION) &&
-            (header.numatoms > 1))
+        length = snprintf(path, size, "%s", base);
+    }
+    else if ((base = getenv("HOME")) != NULL)
+    {
+        length = snprintf(path, size, "%s/.cache", base);
+    }
+    else
+    {
+        return false;
+    }
+    if ((length <= 0) || ((size_t)length >= size))
+    {
+        return false;
+    }
+
+    if (create)
+    {
+        mkdir(path, S_IRWXU);
+    }
+    length += snprintf(&path[length], size - length, "/%s", FACTORY_CACHE_DIR);
+    if ((size_t)length >= size)
+    {
+        return false;
+    }
+    if (create)
+    {
+        mkdir(path, S_IRWXU);
+    }
+
+    length += snprintf(&path[length], size - length, "/%s_%016llx.bin", name,
+        (unsigned long long)key);
+    return ((size_t)length < size);
+}
+
+/******************************************************************************
+  Read parsed factory data saved by a previous open of a board with the same
+  EEPROM custom data, so the JSON does not need to be parsed.  The file must
+  match the board type, custom data and size of the parsed data, and pass its
+  checksum.
+ *****************************************************************************/
+bool _factory_cache_load(const char* name, const char* custom_data,
+    uint16_t custom_size, void* data, uint16_t data_size)
+{
+    char path[HAT_PATH_SIZE];
+    struct _FactoryCacheHeader header;
+    uint8_t buffer[FACTORY_CACHE_MAX_DATA];
+    uint64_t key;
+    int fd;
+    bool valid;
+
+    if ((custom_data == NULL) ||
+        (data_size > FACTORY_CACHE_MAX_DATA))
+    {
+        return false;
+    }
+
+    key = _hash_data(custom_data, custom_size);
+    if (!_factory_cache_path(name, key, path, sizeof(path), false) ||
+        ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1))
+    {
+        return false;
+    }
+
+    valid = ((read(fd, &header, sizeof(header)) == sizeof(header)) &&
+        (header.magic == FACTORY_CACHE_MAGIC) &&
+        (header.format == FACTORY_CACHE_FORMAT) &&
+        (header.data_size == data_size) &&
+        (header.custom_size == custom_size) &&
+        (header.key == key) &&
+        (read(fd, buffer, data_size) == data_size) &&
+        (header.checksum == (uint32_t)_hash_data(buffer, data_size)));
+    close(fd);
+
+    if (valid)
+    {
+        memcpy(data, buffer, data_size);
+    }
+    return valid;
+}
+
+/******************************************************************************
+  Save parsed factory data for _factory_cache_load().  The file is written
+  under a temporary name and renamed so other processes never read a partial
+  file.  Errors are ignored; the data is parsed again next time.
+ *****************************************************************************/
+void _factory_cache_save(const char* name, const char* custom_data,
+    uint16_t custom_size, const void* data, uint16_t data_size)
+{
+    char path[HAT_PATH_SIZE];
+    char temp_path[HAT_PATH_SIZE + 16];
+    struct _FactoryCacheHeader header;
+    int fd;
+    bool written;
+
+    if ((custom_data == NULL) ||
+        (data_size > FACTORY_CACHE_MAX_DATA))
+    {
+        return;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = FACTORY_CACHE_MAGIC;
+    header.format = FACTORY_CACHE_FORMAT;
+    header.data_size = data_size;
+    header.custom_size = custom_size;
+    header.key = _hash_data(custom_data, custom_size);
+    header.checksum = (uint32_t)_hash_data(data, data_size);
+
+    if (!_factory_cache_path(name, header.key, path, sizeof(path), true))
+    {
+        return;
+    }
+    snprintf(temp_path, sizeof(temp_path), "%s.%d", path, (int)getpid());
+    if ((fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+        S_IRUSR | S_IWUSR)) == -1)
+    {
+        return;
+    }
+
+    written = ((write(fd, &header, sizeof(header)) == sizeof(header)) &&
+        (write(fd, data, data_size) == data_size));
+    close(fd);
+
+    if (!written || (rename(temp_path, path) != 0))
+    {
+        unlink(temp_path);
+    }
+}
+
+/******************************************************************************
+  Open one board for hat_open_all().  Runs as a thread.
+ *****************************************************************************/
+static void* _hat_open_thread(void* arg)
+{
+    struct _HatOpenInfo* board = (struct _HatOpenInfo*)arg;
+
+    switch (board->id)
+    {
+    case HAT_ID_MCC_118:
+        board->result = mcc118_open(board->address);
+        break;
+    case HAT_ID_MCC_152:
+        board->result = mcc152_open(board->address);
+        break;
+    default:
+        board->result = RESULT_INVALID_DEVICE;
+        break;
+    }
+    return NULL;
+}
+
+/******************************************************************************
+  Open every detected board at the same time.
+ *****************************************************************************/
+int hat_open_all(uint16_t filter_id, struct HatInfo* pList, int* pResults)
+{
+    struct HatInfo list[MAX_NUMBER_HATS];
+    struct _HatOpenInfo boards[MAX_NUMBER_HATS];
+    int count;
+    int index;
+
+    count = hat_list(filter_id, list);
+
+    // Each board's information is read and parsed in its own thread.  The SPI
+    // lock excludes the other threads as well as other processes, so the 
+    // transfers are still made one at a time and the threads only overlap the
+    // host side of opening each board with the other boards' transfers.
+    for (index = 0; index < count; index++)
+    {
+        boards[index].address = list[index].address;
+        boards[index].id = list[index].id;
+        boards[index].result = RESULT_UNDEFINED;
+        boards[index].started = (pthread_create(&boards[index].thread, NULL,
+            _hat_open_thread, &boards[index]) == 0);
+        if (!boards[index].started)
         {
-            // header is valid, read atoms
-            atom_num = 0;
-            error = false;
-            while (!(found_custom && found_vendor) &&
-                (atom_num < header.numatoms) &&
-                !error)
-            {
-                if (read(eeprom_fd, &atom, ATOM_SIZE-CRC_SIZE) == 
-                    ATOM_SIZE-CRC_SIZE)
-                {
-                    // process the atom by type
-                    if (atom.type == ATOM_VENDOR_TYPE)
-                    {
-                        // get the vendor info
-                        if (read(eeprom_fd, &vinf, VENDOR_SIZE) == VENDOR_SIZE)
-                        {
-                            vinf.vstr = (char*)malloc(vinf.vslen+1);
-                            vinf.pstr = (char*)malloc(vinf.pslen+1);
-                            if (read(eeprom_fd, vinf.vstr, vinf.vslen) != 
-                                vinf.vslen)
-                            {
-                                free(vinf.vstr);
-                                free(vinf.pstr);
-                                error = true;
-                                continue;
-                            }
-                            vinf.vstr[vinf.vslen] = '\0';
-                            if (read(eeprom_fd, vinf.pstr, vinf.pslen) != 
-                                vinf.pslen)
-                            {
-                                free(vinf.vstr);
-                                free(vinf.pstr);
-                                error = true;
-                                continue;
-                            }
-                            vinf.pstr[vinf.pslen] = '\0';
-                            lseek(eeprom_fd, CRC_SIZE, SEEK_CUR);
-
-                            if (strcmp(vinf.vstr, VENDOR_NAME) == 0)
-                            {
-                                // valid vendor, save the info
-                                if (entry != NULL)
-                                {
-                                    entry->address = address;
-                                    entry->id = vinf.pid;
-                                    entry->version = vinf.pver;
-                                    strncpy(entry->product_name, vinf.pstr, 
-                                        256);
-                                }
-                                found_vendor = true;
-                            }
-                            else
-                            {
-                                // invalid vendor
-                                error = true;
-                            }
-                            free(vinf.vstr);
-                            free(vinf.pstr);
-                        }
-                        else
-                        {
-                            error = true;
-                        }
-                        atom_num++;
-                    }
-                    else if (atom.type == ATOM_CUSTOM_TYPE)
-                    {
-                        // found the custom info
-                        found_custom = true;
-                    }
-                    else
-                    {
-                        // skip
-                        lseek(eeprom_fd, atom.dlen, SEEK_CUR);
-                        atom_num++;
-                    }
-                }
-                else
-                {
-                    error = true;
-                }
-            }
+            // open it on this thread instead
+            _hat_open_thread(&boards[index]);
         }
-        else
+    }
+
+    for (index = 0; index < count; index++)
+    {
+        if (boards[index].started)
         {
-            // no board info found
-            return RESULT_BAD_PARAMETER;
+            pthread_join(boards[index].thread, NULL);
         }
-
-        custom_size = 0;
-        if (found_custom)
+        if (pList != NULL)
         {
-            // read the JSON custom data
-            custom_size = atom.dlen - CRC_SIZE;
-            if (pData)
-            {
-                if (read(eeprom_fd, pData, custom_size) != custom_size)
-                {
-                    custom_size = 0;
-                }
-            }
+            pList[index] = list[index];
         }
-        if (pSize)
+        if (pResults != NULL)
         {
-            *pSize = custom_size;
+            pResults[index] = boards[index].result;
         }
     }
 
-    return RESULT_SUCCESS;
+    return count;
 }
 
 /******************************************************************************
@@ -749,11 +1126,75 @@ int hat_wait_for_interrupt(int timeout)
 }
 
 /******************************************************************************
-  Create an interrupt handler that calls the user-provided callback function.
+  Return the kernel timestamp of the most recent interrupt edge.
  *****************************************************************************/
-int hat_interrupt_callback_enable(void (*function)(void*), void* data)
+int hat_interrupt_timestamp(uint64_t* timestamp_ns)
+{
+    uint64_t value;
+
+    if (timestamp_ns == NULL)
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    if ((value = gpio_event_timestamp(IRQ_GPIO)) == 0)
+    {
+        return RESULT_RESOURCE_UNAVAIL;
+    }
+
+    *timestamp_ns = value;
+    return RESULT_SUCCESS;
+}
+
+/******************************************************************************
+  Interrupt handler for the shared interrupt line.  Runs the library hook, 
+  then the user callback.
+ *****************************************************************************/
+static void _hat_interrupt_handler(void* data)
+{
+    void (*hook_function)(uint64_t);
+    void (*user_function)(void*);
+    void* user_data;
+
+    (void)data;
+
+    // the eventfd is written with the mutex held so hat_interrupt_fd_close()
+    // can't close it during the write; the functions are called without it
+    // so they may change the interrupt settings
+    pthread_mutex_lock(&irq_mutex);
+    hook_function = irq_hook_function;
+    user_function = irq_user_function;
+    user_data = irq_user_data;
+    if (irq_event_fd >= 0)
+    {
+        eventfd_write(irq_event_fd, 1);
+    }
+    pthread_mutex_unlock(&irq_mutex);
+
+    if (hook_function)
+    {
+        hook_function(gpio_event_timestamp(IRQ_GPIO));
+    }
+    if (user_function)
+    {
+        user_function(user_data);
+    }
+}
+
+/******************************************************************************
+  Install or remove the interrupt handler depending on whether a user callback,
+  library hook or interrupt file descriptor is set.
+ *****************************************************************************/
+static int _hat_interrupt_update(void)
 {
-    switch (gpio_interrupt_callback(IRQ_GPIO, 0, function, data))
+    int mode;
+
+    pthread_mutex_lock(&irq_mutex);
+    mode = (irq_user_function || irq_hook_function || (irq_event_fd >= 0)) ? 
+        0 : 3;
+    pthread_mutex_unlock(&irq_mutex);
+    switch (gpio_interrupt_callback(IRQ_GPIO, mode, _hat_interrupt_handler, 
+        NULL))
     {
     case -1:    // error
         return RESULT_UNDEFINED;
@@ -764,16 +1205,138 @@ int hat_interrupt_callback_enable(void (*function)(void*), void* data)
 }
 
 /******************************************************************************
-  Disable an interrupt callback.
+  Set or clear (function = NULL) the library interrupt hook, which is called 
+  on the interrupt dispatcher thread before the user callback.
  *****************************************************************************/
-int hat_interrupt_callback_disable(void)
+int _hat_interrupt_hook(void (*function)(uint64_t timestamp_ns))
 {
-    switch (gpio_interrupt_callback(IRQ_GPIO, 3, NULL, NULL))
+    pthread_mutex_lock(&irq_mutex);
+    irq_hook_function = function;
+    pthread_mutex_unlock(&irq_mutex);
+    return _hat_interrupt_update();
+}
+
+/******************************************************************************
+  Return a file descriptor that becomes readable when an interrupt occurs, 
+  creating it on first use.
+ *****************************************************************************/
+int hat_interrupt_fd_open(int* fd)
+{
+    int event_fd;
+    int result;
+
+    if (fd == NULL)
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    pthread_mutex_lock(&irq_mutex);
+    if (irq_event_fd >= 0)
+    {
+        *fd = irq_event_fd;
+        pthread_mutex_unlock(&irq_mutex);
+        return RESULT_SUCCESS;
+    }
+
+    event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (event_fd < 0)
+    {
+        pthread_mutex_unlock(&irq_mutex);
+        return RESULT_RESOURCE_UNAVAIL;
+    }
+    irq_event_fd = event_fd;
+    pthread_mutex_unlock(&irq_mutex);
+
+    if ((result = _hat_interrupt_update()) != RESULT_SUCCESS)
+    {
+        pthread_mutex_lock(&irq_mutex);
+        irq_event_fd = -1;
+        pthread_mutex_unlock(&irq_mutex);
+        _hat_interrupt_update();
+        close(event_fd);
+        return result;
+    }
+
+    *fd = event_fd;
+    return RESULT_SUCCESS;
+}
+
+/******************************************************************************
+  Close the interrupt file descriptor.
+ *****************************************************************************/
+int hat_interrupt_fd_close(void)
+{
+    int result;
+    int fd;
+
+    pthread_mutex_lock(&irq_mutex);
+    fd = irq_event_fd;
+    irq_event_fd = -1;
+    pthread_mutex_unlock(&irq_mutex);
+
+    if (fd < 0)
     {
-    case -1:    // error
-        return RESULT_UNDEFINED;
-    case 0:
-    default:
         return RESULT_SUCCESS;
     }
+
+    // update the handler first; this waits for a running handler to finish, 
+    // so the fd is not in use when it is closed
+    result = _hat_interrupt_update();
+    close(fd);
+    return result;
+}
+
+/******************************************************************************
+  Create an interrupt handler that calls the user-provided callback function.
+ *****************************************************************************/
+int hat_interrupt_callback_enable(void (*function)(void*), void* data)
+{
+    pthread_mutex_lock(&irq_mutex);
+    irq_user_function = function;
+    irq_user_data = data;
+    pthread_mutex_unlock(&irq_mutex);
+    return _hat_interrupt_update();
+}
+
+/******************************************************************************
+  Read the interrupt callback statistics.
+ *****************************************************************************/
+int hat_interrupt_callback_stats(struct HatCallbackStats* stats)
+{
+    struct GpioDispatchStats gpio_stats;
+
+    if (stats == NULL)
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    if (gpio_interrupt_stats(IRQ_GPIO, &gpio_stats) != 0)
+    {
+        return RESULT_RESOURCE_UNAVAIL;
+    }
+
+    stats->count = gpio_stats.count;
+    if (gpio_stats.count > 0)
+    {
+        stats->mean_latency = gpio_stats.latency_sum_ns / 1e9 / 
+            gpio_stats.count;
+    }
+    else
+    {
+        stats->mean_latency = 0.0;
+    }
+    stats->max_latency = gpio_stats.latency_max_ns / 1e9;
+    return RESULT_SUCCESS;
+}
+
+/******************************************************************************
+  Disable an interrupt callback.
+ *****************************************************************************/
+int hat_interrupt_callback_disable(void)
+{
+    pthread_mutex_lock(&irq_mutex);
+    irq_user_function = NULL;
+    irq_user_data = NULL;
+    pthread_mutex_unlock(&irq_mutex);
+    return _hat_interrupt_update();
 }
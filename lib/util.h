@@ -9,6 +9,7 @@
 #define _UTIL_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <time.h>
 
 enum SpiBus
@@ -50,6 +51,11 @@ void _address_init(void);
 void _set_address(uint8_t address);
 int _hat_info(uint8_t address, struct HatInfo* pEntry, char* pData, 
     uint16_t* pSize);
+int _hat_interrupt_hook(void (*function)(uint64_t timestamp_ns));
+bool _factory_cache_load(const char* name, const char* custom_data,
+    uint16_t custom_size, void* data, uint16_t data_size);
+void _factory_cache_save(const char* name, const char* custom_data,
+    uint16_t custom_size, const void* data, uint16_t data_size);
 
 #ifdef __cplusplus
 }
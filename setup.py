@@ -1,13 +1,21 @@
 #!/usr/bin/env python
 
 import sys
-from setuptools import setup
+from setuptools import setup, Extension
 
 if sys.version_info < (3,4):
     install_requires=['enum34']
 else:
     install_requires=[]
 
+# Native module for the most frequently called methods.  It links to the
+# installed libdaqhats; if it can't be built the ctypes calls are used instead.
+native = Extension('daqhats._daqhats',
+                   sources=['daqhats/_daqhats.c'],
+                   include_dirs=['include'],
+                   libraries=['daqhats'],
+                   optional=True)
+
 setup(
     name='daqhats',
     version='1.1.0',
@@ -17,5 +25,6 @@ setup(
     license='MIT',
     url='https://github.com/mccdaq/daqhats',
     packages=['daqhats'],
+    ext_modules=[native],
     install_requires=install_requires
 )
@@ -6,6 +6,7 @@
 #include <fcntl.h>
 #include <termios.h>
 #include <unistd.h>
+#include <pthread.h>
 #include "daqhats/daqhats.h"
 #include "mcc118_update.h"
 
@@ -28,6 +29,39 @@
 
 #define TOTAL_LENGTH    (0xB000*BYTES_PER_ADDR)
 
+// Hex record count, address and type size
+#define RECORD_HEADER_SIZE  4
+// Most data bytes allowed for -r.  mcc118_bl_write() takes an 8-bit length
+// for the record with its header and checksum, so this is the largest power
+// of 2 that fits; it is also the block size this tool already uses for
+// mcc118_bootmem_write().  The bootloader must accept records this large.
+#define MAX_RECORD_DATA     128
+
+// A hex record sent to the bootloader
+struct HexRecord
+{
+    uint8_t length;
+    uint8_t data[RECORD_HEADER_SIZE + MAX_RECORD_DATA + 1];
+};
+
+enum BoardStatus
+{
+    BOARD_ERROR,
+    BOARD_UPDATED,
+    BOARD_CURRENT
+};
+
+// The state of the update for one board
+struct BoardUpdate
+{
+    uint8_t address;
+    pthread_t thread;
+    bool started;
+    enum BoardStatus status;
+    // the step that failed when status is BOARD_ERROR
+    const char* step;
+};
+
 uint8_t virtual_flash[TOTAL_LENGTH];
 
 uint32_t ext_lin_address;
@@ -36,11 +70,27 @@ uint32_t ext_seg_address;
 uint16_t hex_user_version;
 uint16_t hex_boot_version;
 
+// The records to send and the CRC of the firmware, shared by the update
+// threads
+struct HexRecord* firmware_records = NULL;
+uint32_t firmware_record_count = 0;
+uint32_t firmware_record_max = 0;
+uint16_t firmware_crc;
+// data bytes per combined record, or 0 to send the records in the hex file
+// unchanged
+uint32_t max_record_data = 0;
+
 void print_usage(void)
 {
     // don't advertise bootloader update option
-    printf("Usage: firmware_update <address> <hex file>\n");
-    printf("  address: the board address (0-7)\n");
+    printf("Usage: firmware_update [-r <size>] <address> <hex file>\n");
+    printf("  -r <size>: combine consecutive hex records into records of up "
+        "to <size>\n");
+    printf("      data bytes (1-%d) to reduce the number of writes.  Only use "
+        "this with\n", MAX_RECORD_DATA);
+    printf("      a bootloader that accepts records of that size.\n");
+    printf("  address: the board address (0-7), or all to update every "
+        "MCC 118\n");
     printf("  hex file: the name of the hex file containing the firmware\n");
 }
 
@@ -361,21 +411,214 @@ char kbhit(void)
     return c;
 }
 
-// Update the main firmware
-int update_firmware(int address, char* filename)
+// Add an empty hex record to the list of records sent to the bootloader and
+// return its index, or -1 if out of memory
+int add_firmware_record(void)
+{
+    struct HexRecord* new_records;
+
+    if (firmware_record_count == firmware_record_max)
+    {
+        firmware_record_max = firmware_record_max ? 
+            (2 * firmware_record_max) : 256;
+        new_records = (struct HexRecord*)realloc(firmware_records,
+            firmware_record_max * sizeof(struct HexRecord));
+        if (new_records == NULL)
+        {
+            return -1;
+        }
+        firmware_records = new_records;
+    }
+    memset(&firmware_records[firmware_record_count], 0,
+        sizeof(struct HexRecord));
+    return firmware_record_count++;
+}
+
+// Read the hex file into the virtual flash and create the records that are
+// sent to the bootloader.  When max_record_data is set, consecutive data
+// records are combined into records of up to that many bytes so the device is
+// written with fewer, larger transfers.
+bool load_firmware_records(FILE* file)
 {
     char string[256];
     uint8_t buffer[128];
-    FILE* file;
-    int fd;
     int count;
+    int index;
+    int pending;
     uint8_t rec_type;
-    uint16_t crc_calc;
+    uint8_t rec_count;
+    uint16_t hex_address;
+    uint32_t pending_address;
     uint32_t flash_address;
+    uint8_t checksum;
+    struct HexRecord* record;
+
+    firmware_record_count = 0;
+    pending = -1;
+    pending_address = 0;
+
+    rewind(file);
+    while (fgets(string, 256, file) != NULL)
+    {
+        if ((count = process_hex_line(string, buffer, 128, &rec_type,
+            &flash_address)) == 0)
+        {
+            continue;
+        }
+
+        if (rec_type == 0)
+        {
+            // data, don't send records in the bootloader region
+            if ((flash_address < USER_START) ||
+                (flash_address >= (USER_START+USER_LENGTH)))
+            {
+                continue;
+            }
+
+            rec_count = buffer[0];
+            hex_address = ((uint16_t)buffer[1] << 8) + buffer[2];
+            if (pending >= 0)
+            {
+                record = &firmware_records[pending];
+                if ((hex_address == (pending_address + record->data[0])) &&
+                    ((record->data[0] + rec_count) <= max_record_data))
+                {
+                    // append to the previous record
+                    memcpy(&record->data[RECORD_HEADER_SIZE + record->data[0]],
+                        &buffer[RECORD_HEADER_SIZE], rec_count);
+                    record->data[0] += rec_count;
+                    continue;
+                }
+            }
+
+            // start a new record
+            if ((pending = add_firmware_record()) < 0)
+            {
+                return false;
+            }
+            pending_address = hex_address;
+            memcpy(firmware_records[pending].data, buffer,
+                RECORD_HEADER_SIZE + rec_count);
+        }
+        else
+        {
+            // other records are sent unchanged and end the current data
+            // record
+            if ((index = add_firmware_record()) < 0)
+            {
+                return false;
+            }
+            memcpy(firmware_records[index].data, buffer, count - 1);
+            pending = -1;
+        }
+    }
+
+    // set the lengths and checksums
+    for (index = 0; index < (int)firmware_record_count; index++)
+    {
+        record = &firmware_records[index];
+        record->length = RECORD_HEADER_SIZE + record->data[0];
+        checksum = 0;
+        for (count = 0; count < record->length; count++)
+        {
+            checksum += record->data[count];
+        }
+        record->data[record->length++] = (uint8_t)(-checksum);
+    }
+
+    return true;
+}
+
+// Update the main firmware on one board.  The board must be open.  The
+// firmware is not written if the CRC read from the device shows that it
+// already matches the hex file.  Runs as a thread so several boards can be
+// updated at the same time.
+void* update_board(void* arg)
+{
+    struct BoardUpdate* board = (struct BoardUpdate*)arg;
+    uint8_t address = board->address;
+    uint32_t index;
     uint16_t crc;
+
+    board->status = BOARD_ERROR;
+
+    board->step = "entering the bootloader";
+    if (mcc118_enter_bootloader(address) != RESULT_SUCCESS)
+    {
+        return NULL;
+    }
+
+    // compare the device firmware to the hex file
+    board->step = "reading the CRC";
+    if (mcc118_bl_read_crc(address, USER_START, USER_LENGTH, &crc) !=
+        RESULT_SUCCESS)
+    {
+        return NULL;
+    }
+    if (crc == firmware_crc)
+    {
+        board->step = "starting the firmware";
+        if (mcc118_bl_jump(address) != RESULT_SUCCESS)
+        {
+            return NULL;
+        }
+        board->status = BOARD_CURRENT;
+        return NULL;
+    }
+
+    // erase the flash memory
+    board->step = "erasing";
+    if (mcc118_bl_erase(address) != RESULT_SUCCESS)
+    {
+        return NULL;
+    }
+
+    // write the records from the hex file
+    board->step = "writing";
+    for (index = 0; index < firmware_record_count; index++)
+    {
+        if (mcc118_bl_write(address, firmware_records[index].data,
+            firmware_records[index].length) != RESULT_SUCCESS)
+        {
+            return NULL;
+        }
+    }
+
+    // read the CRC and compare
+    board->step = "verifying";
+    if (mcc118_bl_read_crc(address, USER_START, USER_LENGTH, &crc) !=
+        RESULT_SUCCESS)
+    {
+        return NULL;
+    }
+    if (crc != firmware_crc)
+    {
+        board->step = "verifying, CRC mismatch";
+        return NULL;
+    }
+
+    // jump to new firmware
+    board->step = "starting the firmware";
+    if (mcc118_bl_jump(address) != RESULT_SUCCESS)
+    {
+        return NULL;
+    }
+
+    board->status = BOARD_UPDATED;
+    return NULL;
+}
+
+// Update the main firmware on one or more boards
+int update_firmware(struct BoardUpdate* boards, int board_count,
+    char* filename)
+{
+    FILE* file;
     uint16_t fw_version;
     uint16_t boot_version;
-    char c;
+    int index;
+    int opened;
+    int errors;
+    char c = 0;
 
     init_virtual_flash();
     
@@ -394,130 +637,112 @@ int update_firmware(int address, char* filename)
         return 1;
     }
     
+    // read the records to send and calculate the CRC of the new firmware
+    if (!load_firmware_records(file))
+    {
+        printf("Error - not enough memory for hex file %s.\n", filename);
+        fclose(file);
+        return 1;
+    }
+    fclose(file);
+    firmware_crc = calculate_crc(USER_LENGTH, &virtual_flash[USER_START]);
+
     printf("Checking versions...\n");
     
     printf("Hex file firmware version %X.%02X\n",
         (uint8_t)(hex_user_version >> 8), (uint8_t)hex_user_version);
         
-    if (mcc118_open(address) != RESULT_SUCCESS)
+    for (opened = 0; opened < board_count; opened++)
     {
-        printf("Error opening the device at address %d.\n", address);
-        fclose(file);
-        return 1;
-    }
+        if (mcc118_open(boards[opened].address) != RESULT_SUCCESS)
+        {
+            printf("Error opening the device at address %d.\n",
+                boards[opened].address);
+            break;
+        }
     
-    if (mcc118_firmware_version(address, &fw_version, &boot_version) !=
-        RESULT_SUCCESS)
-    {
-        printf("Error getting the firmware version.\n");
-        return 1;
-    }
+        if (mcc118_firmware_version(boards[opened].address, &fw_version,
+            &boot_version) != RESULT_SUCCESS)
+        {
+            printf("Error getting the firmware version.\n");
+            opened++;
+            break;
+        }
   
-    printf("Device firmware version   %X.%02X\n", 
-        (uint8_t)(fw_version >> 8), (uint8_t)fw_version);
+        printf("Device %d firmware version %X.%02X\n", boards[opened].address,
+            (uint8_t)(fw_version >> 8), (uint8_t)fw_version);
+    }
 
-    printf("Do you want to continue? Press Y to continue, any other key to "
-        "exit. > ");
-    
-    c = kbhit();
-    printf("\n");
-    
-    if (!((c == 'y') || (c == 'Y')))
+    if (opened == board_count)
     {
-        printf("Exiting\n");
-        fclose(file);
-        mcc118_close(address);
-        return 1;
-    }
+        printf("Do you want to continue? Press Y to continue, any other key "
+            "to exit. > ");
     
-    if (mcc118_enter_bootloader(address) != RESULT_SUCCESS)
-    {
-        printf("Error entering the bootloader.\n");
-        mcc118_close(address);
-        fclose(file);
-        return 1;
+        c = kbhit();
+        printf("\n");
     }
-        
-    // erase the flash memory
-    printf("Erasing...");
-    if (mcc118_bl_erase(address) != RESULT_SUCCESS)
-    {
-        printf("Error\n");
-        mcc118_close(address);
-        fclose(file);
-        return 1;
-    }
-    printf("done\n");
     
-    // write the data from the hex file
-    printf("Writing...");
-    while (fgets(string, 256, file) != NULL)
+    if ((opened < board_count) || !((c == 'y') || (c == 'Y')))
     {
-        if ((count = process_hex_line(string, buffer, 128, &rec_type,
-            &flash_address)) == 0)
+        if (opened == board_count)
         {
-            continue;
+            printf("Exiting\n");
         }
-        
-        switch (rec_type)
+        for (index = 0; index < opened; index++)
         {
-        case 0:
-            // data, don't send records in the bootloader region
-            if ((flash_address < USER_START) ||
-                (flash_address >= (USER_START+USER_LENGTH)))
-            {
-                // skip line
-                continue;
-            }
-            break;
-        default:
-            break;
-        }
-        
-        // send the record to the device
-        if (mcc118_bl_write(address, buffer, count) != RESULT_SUCCESS)
-        {
-            printf("error\n");
-            fclose(file);
-            mcc118_close(address);
-            return 1;
+            mcc118_close(boards[index].address);
         }
+        return 1;
     }
-    fclose(file);
-    printf("done\n");
     
-    // read the CRC and compare
-    printf("Verifying...");
-    if (mcc118_bl_read_crc(address, USER_START, USER_LENGTH, &crc) !=
-        RESULT_SUCCESS)
+    // Update the boards in parallel.  Every transfer holds the SPI lock, which
+    // also excludes the other threads, so frames always reach the selected
+    // board.  The threads overlap the waits made without the bus, such as the
+    // delay after each board is reset into the bootloader.
+    printf("Updating...");
+    fflush(stdout);
+    for (index = 0; index < board_count; index++)
     {
-        printf("error\n");
-        mcc118_close(address);
-        return 1;
+        boards[index].status = BOARD_ERROR;
+        boards[index].step = "starting the update";
+        boards[index].started = (pthread_create(&boards[index].thread, NULL,
+            update_board, &boards[index]) == 0);
     }
-    
-    crc_calc = calculate_crc(USER_LENGTH, &virtual_flash[USER_START]);
-    if (crc != crc_calc)
+    for (index = 0; index < board_count; index++)
     {
-        printf("CRC mismatch %04X vs %04X\n", crc_calc, crc);
-        mcc118_close(address);
-        return 1;
+        if (boards[index].started)
+        {
+            pthread_join(boards[index].thread, NULL);
+        }
     }
     printf("done\n");
-    
-    // jump to new firmware
-    printf("Starting firmware...");
-    if (mcc118_bl_jump(address) != RESULT_SUCCESS)
+
+    errors = 0;
+    for (index = 0; index < board_count; index++)
     {
-        printf("error\n");
-        mcc118_close(address);
-        return 1;
+        switch (boards[index].status)
+        {
+        case BOARD_UPDATED:
+            printf("Device %d updated\n", boards[index].address);
+            break;
+        case BOARD_CURRENT:
+            printf("Device %d already has this firmware, skipped\n",
+                boards[index].address);
+            break;
+        default:
+            printf("Device %d error %s\n", boards[index].address,
+                boards[index].step);
+            errors++;
+            break;
+        }
+        mcc118_close(boards[index].address);
     }
 
-    printf("done\n");
-    
-    mcc118_close(address);
-    return 0;
+    free(firmware_records);
+    firmware_records = NULL;
+    firmware_record_max = 0;
+
+    return (errors > 0) ? 1 : 0;
 }
 
 int update_bootloader(int address, char* filename)
@@ -683,39 +908,71 @@ int main(int argc, char* argv[])
     int result;
     uint16_t fw_version;
     uint16_t boot_version;
+    struct BoardUpdate boards[MAX_NUMBER_HATS];
+    struct HatInfo list[MAX_NUMBER_HATS];
+    int board_count;
+    int index;
+    int arg_index;
+    
+    // validate arguments, look for the -b and -r options
+    write_bootloader = false;
+    arg_index = 1;
+    while ((arg_index < argc) && (argv[arg_index][0] == '-'))
+    {
+        if (strcmp(argv[arg_index], "-b") == 0)
+        {
+            write_bootloader = true;
+            arg_index++;
+        }
+        else if ((strcmp(argv[arg_index], "-r") == 0) &&
+            ((arg_index + 1) < argc) &&
+            (sscanf(argv[arg_index + 1], "%u", &max_record_data) == 1) &&
+            (max_record_data > 0) &&
+            (max_record_data <= MAX_RECORD_DATA))
+        {
+            arg_index += 2;
+        }
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
     
-    // validate arguments
-    if ((argc < 3) || (argc > 4))
+    if ((argc - arg_index) != 2)
     {
         print_usage();
         return 1;
     }
+    address_index = arg_index;
+    hexfile_index = arg_index + 1;
     
-    if (argc == 4)
+    memset(boards, 0, sizeof(boards));
+    if (!write_bootloader && (strcmp(argv[address_index], "all") == 0))
     {
-        // look for -b option
-        if (strcmp(argv[1], "-b") != 0)
+        // update every MCC 118 in the stack
+        board_count = hat_list(HAT_ID_MCC_118, list);
+        if (board_count == 0)
         {
-            print_usage();
+            printf("No MCC 118 boards found.\n");
             return 1;
         }
-        write_bootloader = true;
-        address_index = 2;
-        hexfile_index = 3;
-    }
-    else
-    {
-        write_bootloader = false;
-        address_index = 1;
-        hexfile_index = 2;
+        for (index = 0; index < board_count; index++)
+        {
+            boards[index].address = list[index].address;
+        }
     }
-    
-    if ((sscanf(argv[address_index], "%u", &address) != 1) ||
+    else if ((sscanf(argv[address_index], "%u", &address) != 1) ||
         (address >= MAX_NUMBER_HATS))
     {
         print_usage();
         return 1;
     }
+    else
+    {
+        boards[0].address = address;
+        board_count = 1;
+    }
 
     if (sscanf(argv[hexfile_index], "%s", filename) != 1)
     {
@@ -725,11 +982,11 @@ int main(int argc, char* argv[])
     
     if (write_bootloader)
     {
-        result = update_bootloader(address, filename);
+        result = update_bootloader(boards[0].address, filename);
     }
     else
     {
-        result = update_firmware(address, filename);
+        result = update_firmware(boards, board_count, filename);
     }
     
     if (result == 1)
@@ -737,31 +994,39 @@ int main(int argc, char* argv[])
         return 1;
     }
 
-    printf("Checking device...");
+    printf("Checking device...\n");
     // wait for device to enter main firmware
     usleep(800000);
     
-    if (mcc118_open(address) != RESULT_SUCCESS)
-    {
-        printf("error\n");
-        return 1;
-    }
-    if (mcc118_firmware_version(address, &fw_version, &boot_version) !=
-        RESULT_SUCCESS)
+    for (index = 0; index < board_count; index++)
     {
-        printf("error\n");
-        return 1;
-    }
+        address = boards[index].address;
+        if (mcc118_open(address) != RESULT_SUCCESS)
+        {
+            printf("Device %d error\n", address);
+            result = 1;
+            continue;
+        }
+        if (mcc118_firmware_version(address, &fw_version, &boot_version) !=
+            RESULT_SUCCESS)
+        {
+            printf("Device %d error\n", address);
+            mcc118_close(address);
+            result = 1;
+            continue;
+        }
     
-    if (write_bootloader)
-    {
-        printf("bootloader version %X.%02X\n", 
-            (uint8_t)(boot_version >> 8), (uint8_t)boot_version);
-    }
-    else
-    {
-        printf("firmware version %X.%02X\n", 
-            (uint8_t)(fw_version >> 8), (uint8_t)fw_version);
+        if (write_bootloader)
+        {
+            printf("Device %d bootloader version %X.%02X\n", address,
+                (uint8_t)(boot_version >> 8), (uint8_t)boot_version);
+        }
+        else
+        {
+            printf("Device %d firmware version %X.%02X\n", address,
+                (uint8_t)(fw_version >> 8), (uint8_t)fw_version);
+        }
+        mcc118_close(address);
     }
-    return 0;
+    return result;
 }